@@ -8,9 +8,11 @@
 
 #include "nblex/nblex.h"
 #include "../src/nblex_internal.h"
+#include "../src/parsers/nql_parser.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
 #include <getopt.h>
 
 static void print_version(void) {
@@ -28,9 +30,14 @@ static void print_usage(const char* program) {
   printf("  -n, --network IFACE     Monitor network interface\n");
   printf("  -f, --filter EXPR       Filter expression\n");
   printf("  -q, --query QUERY       nQL query expression\n");
+  printf("  -t, --event-time FIELD  Window by the time in FIELD, not arrival time\n");
   printf("  -o, --output FORMAT     Output format (json|file|http|metrics)\n");
   printf("  -O, --output-file PATH  Output file path (for file output)\n");
   printf("  -U, --output-url URL    Output URL (for http output)\n");
+  printf("  -k, --checkpoint FILE   Save query state to FILE and resume from it\n");
+  printf("  -j, --threads N         Aggregate on N threads\n");
+  printf("  -b, --batch-size N      Run the query on N events at a time (default %d)\n",
+         NBLEX_BATCH_SIZE);
   printf("  -c, --config FILE       Configuration file\n");
   printf("  -v, --version           Show version\n");
   printf("  -h, --help              Show this help\n");
@@ -94,26 +101,64 @@ static void event_handler_multi(nblex_event* event, void* user_data) {
   }
 }
 
+/* Helper: Print an event as a JSON line */
+static void print_event_json(nblex_event* event) {
+  char* json_str = nblex_event_to_json(event);
+  if (json_str) {
+    printf("%s\n", json_str);
+    fflush(stdout);
+    free(json_str);
+  }
+}
+
+/* Results emitted by the query itself (aggregations, correlations) have
+ * no input, so they come to the event handler rather than the batch
+ * handler; print them rather than running them back through it. */
 static void event_handler_query(nblex_event* event, void* user_data) {
-  const char* query_str = (const char*)user_data;
-  
-  if (!event || !query_str) {
-    return;
+  (void)user_data;
+
+  if (event && event->data && json_object_get(event->data, "nql_result_type")) {
+    print_event_json(event);
   }
-  
-  /* Execute query on event */
-  nblex_world* world = event->input ? event->input->world : NULL;
-  if (world && nql_execute(query_str, event, world)) {
-    /* Query matched - output event */
-    char* json_str = nblex_event_to_json(event);
-    if (json_str) {
-      printf("%s\n", json_str);
-      fflush(stdout);
-      free(json_str);
+}
+
+/* Input events are run through the query a batch at a time: the world
+ * hands them over when the batch fills and after each loop iteration's
+ * input, so that nothing waits on later input. */
+static void batch_handler_query(nblex_event** events, size_t count, void* user_data) {
+  nql_prepared_t* prepared = (nql_prepared_t*)user_data;
+  uint32_t matched[NBLEX_BATCH_SIZE];
+
+  for (size_t base = 0; base < count; base += NBLEX_BATCH_SIZE) {
+    size_t chunk = count - base < NBLEX_BATCH_SIZE ? count - base : NBLEX_BATCH_SIZE;
+    size_t matched_count = nql_execute_prepared_batch(prepared, events + base, chunk, matched);
+    for (size_t i = 0; i < matched_count; i++) {
+      print_event_json(events[base + matched[i]]);
     }
   }
 }
 
+/* Print a query's plan, and counters under explain analyze, to stderr */
+static void print_query_explain(nql_prepared_t* prepared) {
+  char* explain = nql_explain(prepared);
+  if (explain) {
+    fprintf(stderr, "%s", explain);
+    nblex_free(explain);
+  }
+}
+
+/* SIGUSR1: report explain analyze counters so far */
+static void explain_signal_cb(uv_signal_t* handle, int signum) {
+  (void)signum;
+  print_query_explain((nql_prepared_t*)handle->data);
+}
+
+/* SIGINT/SIGTERM under explain analyze: stop, so counters are reported */
+static void stop_signal_cb(uv_signal_t* handle, int signum) {
+  (void)signum;
+  nblex_world_stop((nblex_world*)handle->data);
+}
+
 int main(int argc, char** argv) {
   const char* log_path = NULL;
   const char* log_format = NULL;
@@ -124,6 +169,10 @@ int main(int argc, char** argv) {
   const char* output_file = NULL;
   const char* output_url = NULL;
   const char* config_file = NULL;
+  const char* event_time_field = NULL;
+  const char* checkpoint_path = NULL;
+  int worker_threads = 0;
+  int batch_size = -1;
 
   static struct option long_options[] = {
     {"logs",       required_argument, 0, 'l'},
@@ -131,9 +180,13 @@ int main(int argc, char** argv) {
     {"network",   required_argument, 0, 'n'},
     {"filter",    required_argument, 0, 'f'},
     {"query",     required_argument, 0, 'q'},
+    {"event-time", required_argument, 0, 't'},
     {"output",    required_argument, 0, 'o'},
     {"output-file", required_argument, 0, 'O'},
     {"output-url", required_argument, 0, 'U'},
+    {"checkpoint", required_argument, 0, 'k'},
+    {"threads",   required_argument, 0, 'j'},
+    {"batch-size", required_argument, 0, 'b'},
     {"config",    required_argument, 0, 'c'},
     {"version",   no_argument,       0, 'v'},
     {"help",      no_argument,       0, 'h'},
@@ -143,7 +196,10 @@ int main(int argc, char** argv) {
   int opt;
   int option_index = 0;
 
-  while ((opt = getopt_long(argc, argv, "l:F:n:f:q:o:O:U:c:vh",
+  /* Before any JSON is created: count it by subsystem for the metrics */
+  nblex_json_allocator_init();
+
+  while ((opt = getopt_long(argc, argv, "l:F:n:f:q:t:o:O:U:k:j:b:c:vh",
                             long_options, &option_index)) != -1) {
     switch (opt) {
       case 'l':
@@ -161,6 +217,9 @@ int main(int argc, char** argv) {
       case 'q':
         query = optarg;
         break;
+      case 't':
+        event_time_field = optarg;
+        break;
       case 'o':
         output_format = optarg;
         break;
@@ -170,6 +229,15 @@ int main(int argc, char** argv) {
       case 'U':
         output_url = optarg;
         break;
+      case 'k':
+        checkpoint_path = optarg;
+        break;
+      case 'j':
+        worker_threads = atoi(optarg);
+        break;
+      case 'b':
+        batch_size = atoi(optarg);
+        break;
       case 'c':
         config_file = optarg;
         break;
@@ -206,6 +274,7 @@ int main(int argc, char** argv) {
 
   /* Load configuration file if specified */
   nblex_config_t* config = NULL;
+  nql_prepared_t* prepared_query = NULL;
   if (config_file) {
     config = nblex_config_load_yaml(config_file);
     if (!config) {
@@ -221,6 +290,25 @@ int main(int argc, char** argv) {
     }
   }
 
+  /* Event time must be set before the query is prepared */
+  if (event_time_field && nblex_world_set_event_time(world, event_time_field, 1000) != 0) {
+    fprintf(stderr, "Warning: Failed to enable event time on field '%s'\n", event_time_field);
+  }
+
+  if (checkpoint_path && nblex_world_set_checkpoint(world, checkpoint_path, 10000) != 0) {
+    fprintf(stderr, "Warning: Failed to enable checkpoints to '%s'\n", checkpoint_path);
+  }
+
+  if (worker_threads > 0) {
+    nblex_world_set_worker_threads(world, (size_t)worker_threads);
+  }
+
+  /* A configuration file sets its own batch size */
+  if (batch_size >= 0 || !config_file) {
+    nblex_world_set_batch_size(world, batch_size >= 0 ? (size_t)batch_size :
+                                                        NBLEX_BATCH_SIZE);
+  }
+
   /* Configure inputs based on command-line arguments (if not using config file) */
   nblex_input* log_input = NULL;
   nblex_input* pcap_input = NULL;
@@ -365,8 +453,27 @@ int main(int argc, char** argv) {
     printf("Writing metrics to: %s\n", output_file);
   } else if (strcmp(output_format, "json") == 0) {
     if (query) {
-      /* Use query handler */
-      nblex_set_event_handler(world, event_handler_query, (void*)query);
+      /* Parse the query once; the handler executes the prepared form */
+      char* query_error = NULL;
+      prepared_query = nql_prepare_ex(query, world, &query_error);
+      if (!prepared_query) {
+        fprintf(stderr, "Error: Invalid query: %s\n",
+                query_error ? query_error : "parse failed");
+        nblex_free(query_error);
+        nblex_world_free(world);
+        if (config) nblex_config_free(config);
+        return 1;
+      }
+      if (nql_prepared_query(prepared_query)->explain == NQL_EXPLAIN_PLAN) {
+        /* Describe the query and exit without running it */
+        print_query_explain(prepared_query);
+        nql_prepared_free(prepared_query);
+        nblex_world_free(world);
+        if (config) nblex_config_free(config);
+        return 0;
+      }
+      nblex_set_event_handler(world, event_handler_query, NULL);
+      nblex_set_batch_handler(world, batch_handler_query, prepared_query);
       printf("Query: %s\n", query);
     } else {
       nblex_set_event_handler(world, event_handler_json, NULL);
@@ -384,6 +491,7 @@ int main(int argc, char** argv) {
 
   if (nblex_world_start(world) != 0) {
     fprintf(stderr, "Error: Failed to start nblex world\n");
+    nql_prepared_free(prepared_query);
     nblex_world_free(world);
     if (config) nblex_config_free(config);
     if (file_output) nblex_file_output_free(file_output);
@@ -394,6 +502,22 @@ int main(int argc, char** argv) {
 
   printf("Running... (Press Ctrl+C to stop)\n\n");
 
+  /* Under explain analyze, report counters on SIGUSR1 and at shutdown */
+  bool analyze = prepared_query &&
+                 nql_prepared_query(prepared_query)->explain == NQL_EXPLAIN_ANALYZE;
+  uv_signal_t explain_signal;
+  uv_signal_t stop_signals[2];
+  if (analyze) {
+    uv_signal_init(world->loop, &explain_signal);
+    explain_signal.data = prepared_query;
+    uv_signal_start(&explain_signal, explain_signal_cb, SIGUSR1);
+    for (int i = 0; i < 2; i++) {
+      uv_signal_init(world->loop, &stop_signals[i]);
+      stop_signals[i].data = world;
+      uv_signal_start(&stop_signals[i], stop_signal_cb, i == 0 ? SIGINT : SIGTERM);
+    }
+  }
+
   /* Run event loop (blocking) */
   int result = nblex_world_run(world);
 
@@ -401,11 +525,22 @@ int main(int argc, char** argv) {
     fprintf(stderr, "Error: Event loop exited with error\n");
   }
 
+  /* Run what the last iteration queued while the query is still here */
+  nblex_world_flush_batch(world);
+
+  if (analyze) {
+    print_query_explain(prepared_query);
+    uv_close((uv_handle_t*)&explain_signal, NULL);
+    uv_close((uv_handle_t*)&stop_signals[0], NULL);
+    uv_close((uv_handle_t*)&stop_signals[1], NULL);
+  }
+
   /* Cleanup */
   if (file_output) nblex_file_output_free(file_output);
   if (http_output) nblex_http_output_free(http_output);
   if (metrics_output) nblex_metrics_output_free(metrics_output);
   if (config) nblex_config_free(config);
+  nql_prepared_free(prepared_query);
   nblex_world_free(world);
 
   return 0;
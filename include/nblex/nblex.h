@@ -104,9 +104,34 @@ typedef enum {
   NBLEX_CORR_CONNECTION     /* Connection-based correlation */
 } nblex_correlation_type;
 
+/* Handling of events that arrive after the watermark has closed their window */
+typedef enum {
+  NBLEX_LATE_DROP,          /* Discard the event (counted) */
+  NBLEX_LATE_SIDE_OUTPUT,   /* Emit it as a "late_event" result instead */
+  NBLEX_LATE_UPDATE         /* Update the closed window and emit a revised result */
+} nblex_late_policy;
+
+/* What a query does with the aggregation buckets it evicts over its memory budget */
+typedef enum {
+  NBLEX_EVICT_EMIT,         /* Emit the bucket's result early, marked "evicted" */
+  NBLEX_EVICT_FOLD          /* Merge it into the group whose fields read "__other__" */
+} nblex_evict_policy;
+
+/* Events dropped to stay within a world's limits */
+typedef enum {
+  NBLEX_DROP_BUFFER_FULL,      /* Not buffered for correlation: buffer limit reached */
+  NBLEX_DROP_BUFFER_SHRUNK,    /* Released from correlation buffers early: memory limit */
+  NBLEX_DROP_NETWORK_SAMPLED,  /* Network event not admitted while sampling */
+  NBLEX_DROP_INPUT_SHED,       /* Event of a lower priority input not admitted */
+  NBLEX_DROP_MAX
+} nblex_drop_reason;
+
 /* Event callback */
 typedef void (*nblex_event_handler)(nblex_event* event, void* user_data);
 
+/* Batch callback: the handler borrows the events, retaining any it keeps */
+typedef void (*nblex_batch_handler)(nblex_event** events, size_t count, void* user_data);
+
 /*
  * Core API - World management
  */
@@ -157,6 +182,197 @@ NBLEX_API int nblex_world_stop(nblex_world* world);
  */
 NBLEX_API int nblex_world_run(nblex_world* world);
 
+/**
+ * nblex_world_set_event_time - Window and correlate by event time
+ *
+ * Source events are stamped with the time they describe rather than the
+ * time they arrive: log events from a field, network events from the
+ * packet capture header. Each input's watermark trails the newest event
+ * time it has seen by @max_delay_ms, and windows close when the lowest
+ * input watermark passes them. Log events without a usable time do not
+ * move watermarks. nblex_world_stop() closes the remaining windows.
+ * Must be called before queries are prepared.
+ *
+ * @world: World instance
+ * @timestamp_field: Log event field holding the event time, NULL for "timestamp"
+ * @max_delay_ms: Out-of-order delay tolerated before an event is late
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_event_time(nblex_world* world,
+                                         const char* timestamp_field,
+                                         uint32_t max_delay_ms);
+
+/**
+ * nblex_world_set_late_policy - Choose what happens to late events
+ *
+ * @world: World instance
+ * @policy: Late event policy (default NBLEX_LATE_DROP)
+ * @allowed_lateness_ms: For NBLEX_LATE_UPDATE, how long after the
+ *                       watermark passes a window it can still be revised
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_late_policy(nblex_world* world,
+                                          nblex_late_policy policy,
+                                          uint32_t allowed_lateness_ms);
+
+/**
+ * nblex_world_get_watermark - Get the event-time watermark
+ *
+ * @world: World instance
+ * Returns: Nanoseconds since the epoch below which windows are complete,
+ *          0 before the first event or when event time is not enabled
+ */
+NBLEX_API uint64_t nblex_world_get_watermark(nblex_world* world);
+
+/**
+ * nblex_world_set_memory_limit - Bound the memory of query execution state
+ *
+ * Aggregation buckets, correlation buffers and the like of every query
+ * bound to the world count against the limit. Over it, queries evict
+ * their least recently updated aggregation buckets.
+ *
+ * Events count too: the structs of the world's events not yet
+ * released, whether being handled, queued for a batch handler, buffered
+ * or held by the application, plus all live JSON. A limit installs
+ * nblex's JSON allocator (see nblex_json_allocator_init()) unless
+ * another one is; JSON is counted per process, so worlds in one process
+ * share its JSON count, and JSON made by another allocator is not
+ * counted. Should the estimated size of the buffered correlation events
+ * be larger, it counts instead. Free event structs the world keeps for
+ * reuse, input and parser buffers and output queues are not counted.
+ *
+ * When an input creates an event with events over what query state
+ * leaves of the limit, the world releases the oldest buffered events.
+ * If events still reach the limit during the following second, it
+ * also admits only one network event in 8, and after another such
+ * second drops the events of inputs below the highest input priority
+ * (nblex_event_new() returns NULL for them). Each second events stay
+ * under the limit it takes one step back. Every event dropped is
+ * counted; see nblex_world_get_drops().
+ *
+ * @world: World instance
+ * @limit_bytes: Limit in bytes, 0 for none (the default)
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_memory_limit(nblex_world* world, size_t limit_bytes);
+
+/**
+ * nblex_world_get_memory_usage - Get the memory held by query execution state
+ *
+ * @world: World instance
+ * Returns: Bytes of query state and events, as counted against the
+ *          memory limit
+ */
+NBLEX_API size_t nblex_world_get_memory_usage(nblex_world* world);
+
+/**
+ * nblex_world_set_query_memory_limit - Bound the memory of each query
+ *
+ * Gives every query bound to the world, those already prepared and those
+ * prepared later, its own budget for execution state, which counts
+ * against the world's memory limit too. Over either, a query evicts its
+ * least recently updated aggregation buckets by the policy. Sliding
+ * window panes are always folded, and without "by" there is no
+ * "__other__" group, so buckets are emitted.
+ *
+ * @world: World instance
+ * @limit_bytes: Budget of each query in bytes, 0 for none (the default)
+ * @policy: Eviction policy (default NBLEX_EVICT_EMIT); it applies over
+ *          the world's limit even without a budget
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_query_memory_limit(nblex_world* world,
+                                                 size_t limit_bytes,
+                                                 nblex_evict_policy policy);
+
+/**
+ * nblex_world_set_buffer_limit - Bound the events buffered for correlation
+ *
+ * Events that would take the correlation engine's buffers over the
+ * limit are not buffered, and so not correlated with later events.
+ *
+ * @world: World instance
+ * @limit_bytes: Limit in bytes (estimated), 0 for none (the default)
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_buffer_limit(nblex_world* world, size_t limit_bytes);
+
+/**
+ * nblex_world_get_buffer_usage - Get the size of events buffered for correlation
+ *
+ * Events too old to correlate are released as the world's loop runs.
+ *
+ * @world: World instance
+ * Returns: Estimated bytes buffered
+ */
+NBLEX_API size_t nblex_world_get_buffer_usage(nblex_world* world);
+
+/**
+ * nblex_world_get_drops - Count events dropped to stay within limits
+ *
+ * @world: World instance
+ * @reason: Why the events were dropped
+ * Returns: Events dropped for the reason since the world was created
+ */
+NBLEX_API uint64_t nblex_world_get_drops(nblex_world* world, nblex_drop_reason reason);
+
+/**
+ * nblex_world_set_worker_threads - Aggregate batches on several threads
+ *
+ * When queries run over a batch of events at a time (from a batch
+ * handler, with nql_execute_prepared_batch() or nql_execute_all_batch()),
+ * tumbling and sliding window aggregation updates buckets on this many
+ * threads, the calling thread included. Each bucket is updated by one
+ * thread in event order, so results are the same as with one thread.
+ * Everything else runs on the calling thread: events executed one at a
+ * time, session windows, aggregates without a window, late events, stages
+ * other than aggregation, and batches with fewer than 64 bucket updates.
+ *
+ * @world: World instance
+ * @threads: Number of threads, 0 or 1 (the default) for the calling thread only
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_worker_threads(nblex_world* world, size_t threads);
+
+/**
+ * nblex_world_set_checkpoint - Snapshot query state periodically
+ *
+ * Open aggregation windows, buffered correlation events, the event-time
+ * watermark and file input read positions are written to @path every
+ * @interval_ms and when the world stops. Each checkpoint replaces the
+ * previous one atomically, so one survives a crash at any point. When
+ * the world starts it restores the checkpoint into queries with the
+ * same query strings, and file inputs resume where it left off instead
+ * of at the end of the file. Must be called before the world starts.
+ *
+ * @world: World instance
+ * @path: Checkpoint file, NULL to disable checkpoints
+ * @interval_ms: Time between checkpoints, 0 for only when stopping
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_checkpoint(nblex_world* world, const char* path,
+                                         uint32_t interval_ms);
+
+/**
+ * nblex_world_checkpoint - Write a checkpoint now
+ *
+ * @world: World instance with checkpoints enabled
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_checkpoint(nblex_world* world);
+
+/**
+ * nblex_world_restore - Restore the checkpoint before starting
+ *
+ * Done by nblex_world_start() unless called first, e.g. to restore
+ * state without starting inputs. Queries must already be prepared.
+ *
+ * @world: World instance with checkpoints enabled
+ * Returns: 0 on success or if there is no checkpoint yet, non-zero if
+ *          it cannot be read
+ */
+NBLEX_API int nblex_world_restore(nblex_world* world);
+
 /*
  * Input API
  */
@@ -197,6 +413,18 @@ NBLEX_API int nblex_input_set_format(nblex_input* input, nblex_log_format format
  */
 NBLEX_API int nblex_input_set_filter(nblex_input* input, const char* filter);
 
+/**
+ * nblex_input_set_priority - Set how long an input is kept under memory pressure
+ *
+ * Over its memory limit, a world sheds the events of inputs below the
+ * highest priority of its inputs first.
+ *
+ * @input: Input instance
+ * @priority: Priority, higher is kept longer; 0 by default
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_input_set_priority(nblex_input* input, int priority);
+
 /**
  * nblex_input_free - Free an input instance
  *
@@ -221,13 +449,82 @@ NBLEX_API nblex_correlation* nblex_correlation_new(nblex_world* world);
  *
  * @corr: Correlation instance
  * @type: Strategy type
- * @window_ms: Time window in milliseconds (for time-based)
+ * @window_ms: Time window in milliseconds (for time-based); for
+ *             ID-based, also how long an unused ID stays indexed; for
+ *             connection-based, how far a log may precede its flow
  * Returns: 0 on success, non-zero on error
  */
 NBLEX_API int nblex_correlation_add_strategy(nblex_correlation* corr,
                                               nblex_correlation_type type,
                                               uint32_t window_ms);
 
+/**
+ * nblex_correlation_add_id_field - Add a field carrying the correlation ID
+ *
+ * For ID-based correlation. Fields are tried in the order added and the
+ * first a log or network event carries (a string or integer) is its ID.
+ * Without any, log events use request_id or trace_id and network events
+ * http.headers.x-request-id or trace_id.
+ *
+ * @corr: Correlation instance
+ * @type: NBLEX_EVENT_LOG or NBLEX_EVENT_NETWORK
+ * @field: Field name, flat or a dot path into nested objects
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_correlation_add_id_field(nblex_correlation* corr,
+                                             nblex_event_type type,
+                                             const char* field);
+
+/**
+ * nblex_correlation_set_coalesce - Emit one correlation per event
+ *
+ * Instead of one correlation event per matching pair, an event that
+ * matches emits one correlation listing its max_matches closest
+ * matches, with the match count, the min and max time difference and
+ * the network bytes of all of them. Applies to time-based and ID-based
+ * correlation; matches left out are counted as dropped pairs.
+ *
+ * @corr: Correlation instance
+ * @enabled: Whether to coalesce
+ * @max_matches: Matches listed per correlation, 0 for 10
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_correlation_set_coalesce(nblex_correlation* corr,
+                                             bool enabled,
+                                             size_t max_matches);
+
+/**
+ * nblex_correlation_set_peer_fields - Set the log fields naming the peer
+ *
+ * For connection-based correlation. A log event is joined to the TCP or
+ * UDP flow its peer endpoint last had traffic on. Without this, the
+ * fields are remote_addr and remote_port.
+ *
+ * @corr: Correlation instance
+ * @ip_field: Field holding the peer IPv4 or IPv6 address
+ * @port_field: Field holding the peer port, an integer or numeric string
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_correlation_set_peer_fields(nblex_correlation* corr,
+                                                const char* ip_field,
+                                                const char* port_field);
+
+/**
+ * nblex_correlation_set_flow_limits - Bound the connection flow table
+ *
+ * For connection-based correlation. Flows without traffic for the idle
+ * timeout expire; with max_flows live, a new flow evicts the longest
+ * idle one.
+ *
+ * @corr: Correlation instance
+ * @idle_timeout_ms: Idle timeout in milliseconds, 0 for 60000
+ * @max_flows: Flow table size cap, 0 for 65536
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_correlation_set_flow_limits(nblex_correlation* corr,
+                                                uint32_t idle_timeout_ms,
+                                                size_t max_flows);
+
 /**
  * nblex_correlation_free - Free a correlation instance
  *
@@ -251,6 +548,35 @@ NBLEX_API int nblex_set_event_handler(nblex_world* world,
                                        nblex_event_handler handler,
                                        void* user_data);
 
+/**
+ * nblex_set_batch_handler - Receive input events a batch at a time
+ *
+ * While a batch handler is set, events read by inputs go to it, in
+ * arrays of up to the world's batch size, instead of to the event
+ * handler. Events with no input (query results, correlations) still go
+ * to the event handler. Queued events are handed over when the batch
+ * is full, after each loop iteration, in event time mode before the
+ * watermark passes any of them, and when the world stops.
+ *
+ * @world: World instance
+ * @handler: Callback function, NULL to go back to the event handler
+ * @user_data: User data passed to callback
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_set_batch_handler(nblex_world* world,
+                                       nblex_batch_handler handler,
+                                       void* user_data);
+
+/**
+ * nblex_world_set_batch_size - Set how many input events make a batch
+ *
+ * @world: World instance
+ * @batch_size: Events per batch, 0 or 1 (the default) to hand each
+ *              event to the batch handler as it arrives
+ * Returns: 0 on success, non-zero on error
+ */
+NBLEX_API int nblex_world_set_batch_size(nblex_world* world, size_t batch_size);
+
 /**
  * nblex_event_get_type - Get event type
  *
@@ -267,10 +593,47 @@ NBLEX_API nblex_event_type nblex_event_get_type(nblex_event* event);
  */
 NBLEX_API char* nblex_event_to_json(nblex_event* event);
 
+/**
+ * nblex_event_retain - Keep an event beyond the handler call
+ *
+ * An event handler only borrows its event. To keep it, retain it and
+ * release it when done; the event data must then be treated as
+ * read-only. Call both on the thread running the world's loop.
+ *
+ * @event: Event instance
+ * Returns: The event
+ */
+NBLEX_API nblex_event* nblex_event_retain(nblex_event* event);
+
+/**
+ * nblex_event_release - Release a retained event
+ *
+ * The event is freed with its last reference.
+ *
+ * @event: Event instance (NULL is ignored)
+ */
+NBLEX_API void nblex_event_release(nblex_event* event);
+
 /*
  * Utility functions
  */
 
+/**
+ * nblex_json_allocator_init - Allocate JSON through nblex
+ *
+ * Installs an allocator for jansson that recycles small blocks and
+ * counts JSON memory by the nblex subsystem allocating it, for the
+ * metrics output and world memory limits (setting one calls this).
+ * jansson has one allocator per process; JSON created before the call
+ * is freed as before, uncounted. Its blocks come from malloc(): strings
+ * from json_dumps() may be freed with free(), though only the free
+ * function of json_get_alloc_funcs() uncounts them. Without it (or a
+ * memory limit) nblex leaves jansson's allocator alone.
+ *
+ * Returns: 0 on success, non-zero if another allocator is installed
+ */
+NBLEX_API int nblex_json_allocator_init(void);
+
 /**
  * nblex_version_string - Get version string
  *
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Build nblex in Release mode with benchmarks enabled and run them.
+# Results are printed and saved to bench_output.txt in the source tree.
+#
+# Usage: ./scripts/benchmark.sh [iterations]
+
+set -e
+
+SRC_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-"$SRC_DIR/build-bench"}
+OUTPUT="$SRC_DIR/bench_output.txt"
+
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release \
+  -DNBLEX_BUILD_BENCHMARKS=ON >/dev/null
+cmake --build "$BUILD_DIR" -j >/dev/null
+
+: > "$OUTPUT"
+for bench in "$BUILD_DIR"/tests/bench/bench_*; do
+  [ -x "$bench" ] || continue
+  echo "== $(basename "$bench")" | tee -a "$OUTPUT"
+  "$bench" "$@" | tee -a "$OUTPUT"
+done
@@ -0,0 +1,651 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * checkpoint.c - Crash-safe snapshots of query state and input positions
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * File format (all integers little-endian):
+ *
+ *   magic "NBLXCKPT", u32 version, u64 body length
+ *   body:
+ *     u64 world clock when written
+ *     u8 event time enabled, u64 watermark
+ *     u32 inputs; per input, by position in the world:
+ *       u32 type, string path, u8 has position, u64 inode, u64 offset,
+ *       u64 newest event time
+ *     queries, as written by nql_world_checkpoint()
+ *   u64 hash of the body
+ *
+ * A checkpoint is written to "<path>.tmp", synced and renamed over the
+ * previous one, so a crash at any point leaves one complete checkpoint.
+ */
+#define CHECKPOINT_MAGIC "NBLXCKPT"
+#define CHECKPOINT_MAGIC_LENGTH 8
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER_SIZE (CHECKPOINT_MAGIC_LENGTH + 4 + 8)
+#define CHECKPOINT_HASH_SEED 0x6e626c6578636b70ULL
+
+/* Read position of an input, from a restored checkpoint */
+typedef struct {
+  nblex_input_type type;
+  char* path;             /* File inputs; NULL otherwise */
+  bool has_position;
+  uint64_t inode;
+  uint64_t offset;
+} nblex_checkpoint_input_t;
+
+/*
+ * Checkpoint structure
+ */
+struct nblex_checkpoint_s {
+  nblex_world* world;
+  char* path;
+  char* tmp_path;
+  uint32_t interval_ms;   /* 0: only on stop and on request */
+
+  uv_timer_t timer;
+  bool timer_initialized;
+  bool restored;          /* Restore attempted; not repeated on start */
+
+  /* Positions read from the restored checkpoint, by input index */
+  nblex_checkpoint_input_t* inputs;
+  size_t inputs_count;
+
+  /* Statistics */
+  uint64_t written;
+  uint64_t failed;
+};
+
+/* Encoding */
+
+/* Helper: Make room for `length` more bytes */
+static bool writer_reserve(nblex_ckpt_writer_t* writer, size_t length) {
+  if (writer->failed) {
+    return false;
+  }
+  if (writer->size + length <= writer->capacity) {
+    return true;
+  }
+  size_t capacity = writer->capacity ? writer->capacity : 4096;
+  while (capacity < writer->size + length) {
+    capacity *= 2;
+  }
+  uint8_t* data = nblex_realloc(writer->data, capacity);
+  if (!data) {
+    writer->failed = true;
+    return false;
+  }
+  writer->data = data;
+  writer->capacity = capacity;
+  return true;
+}
+
+/* Helper: Store a value little-endian */
+static void store_le(uint8_t* out, uint64_t value, size_t width) {
+  for (size_t i = 0; i < width; i++) {
+    out[i] = (uint8_t)(value >> (8 * i));
+  }
+}
+
+/* Helper: Load a little-endian value */
+static uint64_t load_le(const uint8_t* in, size_t width) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < width; i++) {
+    value |= (uint64_t)in[i] << (8 * i);
+  }
+  return value;
+}
+
+static void put_le(nblex_ckpt_writer_t* writer, uint64_t value, size_t width) {
+  if (writer_reserve(writer, width)) {
+    store_le(writer->data + writer->size, value, width);
+    writer->size += width;
+  }
+}
+
+void nblex_ckpt_put_u8(nblex_ckpt_writer_t* writer, uint8_t value) {
+  put_le(writer, value, 1);
+}
+
+void nblex_ckpt_put_u32(nblex_ckpt_writer_t* writer, uint32_t value) {
+  put_le(writer, value, 4);
+}
+
+void nblex_ckpt_put_u64(nblex_ckpt_writer_t* writer, uint64_t value) {
+  put_le(writer, value, 8);
+}
+
+void nblex_ckpt_put_double(nblex_ckpt_writer_t* writer, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_le(writer, bits, 8);
+}
+
+void nblex_ckpt_put_bytes(nblex_ckpt_writer_t* writer, const void* data, size_t length) {
+  if (length > 0 && writer_reserve(writer, length)) {
+    memcpy(writer->data + writer->size, data, length);
+    writer->size += length;
+  }
+}
+
+void nblex_ckpt_put_string(nblex_ckpt_writer_t* writer, const char* s, size_t length) {
+  if (length > UINT32_MAX) {
+    writer->failed = true;
+    return;
+  }
+  if (!s) {
+    length = 0;
+  }
+  nblex_ckpt_put_u32(writer, (uint32_t)length);
+  nblex_ckpt_put_bytes(writer, s, length);
+}
+
+void nblex_ckpt_patch_u32(nblex_ckpt_writer_t* writer, size_t offset, uint32_t value) {
+  if (!writer->failed && offset + 4 <= writer->size) {
+    store_le(writer->data + offset, value, 4);
+  }
+}
+
+/* Helper: Take `length` bytes, or fail */
+static const uint8_t* reader_take(nblex_ckpt_reader_t* reader, size_t length) {
+  if (reader->failed || length > reader->size - reader->pos) {
+    reader->failed = true;
+    return NULL;
+  }
+  const uint8_t* p = reader->data + reader->pos;
+  reader->pos += length;
+  return p;
+}
+
+static uint64_t get_le(nblex_ckpt_reader_t* reader, size_t width) {
+  const uint8_t* p = reader_take(reader, width);
+  return p ? load_le(p, width) : 0;
+}
+
+uint8_t nblex_ckpt_get_u8(nblex_ckpt_reader_t* reader) {
+  return (uint8_t)get_le(reader, 1);
+}
+
+uint32_t nblex_ckpt_get_u32(nblex_ckpt_reader_t* reader) {
+  return (uint32_t)get_le(reader, 4);
+}
+
+uint64_t nblex_ckpt_get_u64(nblex_ckpt_reader_t* reader) {
+  return get_le(reader, 8);
+}
+
+double nblex_ckpt_get_double(nblex_ckpt_reader_t* reader) {
+  uint64_t bits = get_le(reader, 8);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+const void* nblex_ckpt_get_bytes(nblex_ckpt_reader_t* reader, size_t length) {
+  return reader_take(reader, length);
+}
+
+const char* nblex_ckpt_get_string(nblex_ckpt_reader_t* reader, size_t* length_out) {
+  uint32_t length = nblex_ckpt_get_u32(reader);
+  const uint8_t* p = reader_take(reader, length);
+  *length_out = p ? length : 0;
+  return (const char*)p;
+}
+
+size_t nblex_ckpt_remaining(const nblex_ckpt_reader_t* reader) {
+  return reader->failed ? 0 : reader->size - reader->pos;
+}
+
+/* Checkpoint files */
+
+/* Helper: Free positions read from a checkpoint */
+static void free_checkpoint_inputs(nblex_checkpoint_t* checkpoint) {
+  for (size_t i = 0; i < checkpoint->inputs_count; i++) {
+    nblex_free(checkpoint->inputs[i].path);
+  }
+  nblex_free(checkpoint->inputs);
+  checkpoint->inputs = NULL;
+  checkpoint->inputs_count = 0;
+}
+
+/* Helper: Write an input's read position: where it has read to if
+ * running, else what was restored for it
+ */
+static void write_input(nblex_checkpoint_t* checkpoint, size_t index,
+                        nblex_input* input, nblex_ckpt_writer_t* writer) {
+  const char* path = NULL;
+  bool has_position = false;
+  uint64_t inode = 0;
+  uint64_t offset = 0;
+
+  if (input && input->type == NBLEX_INPUT_FILE && input->data && input->vtable &&
+      strcmp(input->vtable->name, "file") == 0) {
+    nblex_file_input_data* data = (nblex_file_input_data*)input->data;
+    path = data->path;
+    struct stat st;
+    long pos;
+    if (data->file && (pos = ftell(data->file)) >= 0 && fstat(fileno(data->file), &st) == 0) {
+      has_position = true;
+      inode = (uint64_t)st.st_ino;
+      offset = (uint64_t)pos;
+    } else if (index < checkpoint->inputs_count && checkpoint->inputs[index].has_position &&
+               checkpoint->inputs[index].path && strcmp(checkpoint->inputs[index].path, path) == 0) {
+      has_position = true;
+      inode = checkpoint->inputs[index].inode;
+      offset = checkpoint->inputs[index].offset;
+    }
+  }
+
+  nblex_ckpt_put_u32(writer, input ? (uint32_t)input->type : 0);
+  nblex_ckpt_put_string(writer, path ? path : "", path ? strlen(path) : 0);
+  nblex_ckpt_put_u8(writer, has_position ? 1 : 0);
+  nblex_ckpt_put_u64(writer, inode);
+  nblex_ckpt_put_u64(writer, offset);
+  nblex_ckpt_put_u64(writer, input ? input->event_time_max_ns : 0);
+}
+
+/* Helper: Write all of a buffer to a file descriptor */
+static int write_all(int fd, const uint8_t* data, size_t length) {
+  while (length > 0) {
+    ssize_t n = write(fd, data, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += n;
+    length -= (size_t)n;
+  }
+  return 0;
+}
+
+/* Helper: Sync the directory holding a path, so a rename in it is durable */
+static void sync_parent_dir(const char* path) {
+  char* copy = nblex_strdup(path);
+  if (!copy) {
+    return;
+  }
+  int fd = open(dirname(copy), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+  nblex_free(copy);
+}
+
+/* Helper: Replace the checkpoint file with a buffer, atomically */
+static int write_checkpoint_file(nblex_checkpoint_t* checkpoint, const nblex_ckpt_writer_t* writer) {
+  int fd = open(checkpoint->tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Error: Failed to write checkpoint '%s': %s\n",
+            checkpoint->tmp_path, strerror(errno));
+    return -1;
+  }
+  if (write_all(fd, writer->data, writer->size) != 0 || fsync(fd) != 0) {
+    fprintf(stderr, "Error: Failed to write checkpoint '%s': %s\n",
+            checkpoint->tmp_path, strerror(errno));
+    close(fd);
+    unlink(checkpoint->tmp_path);
+    return -1;
+  }
+  close(fd);
+
+  if (rename(checkpoint->tmp_path, checkpoint->path) != 0) {
+    fprintf(stderr, "Error: Failed to replace checkpoint '%s': %s\n",
+            checkpoint->path, strerror(errno));
+    unlink(checkpoint->tmp_path);
+    return -1;
+  }
+  sync_parent_dir(checkpoint->path);
+  return 0;
+}
+
+/* Helper: Snapshot the world into a checkpoint file, recording the
+ * given event time watermark */
+static int write_checkpoint(nblex_checkpoint_t* checkpoint, uint64_t watermark_ns) {
+  nblex_world* world = checkpoint->world;
+  nblex_ckpt_writer_t writer = {0};
+
+  nblex_ckpt_put_bytes(&writer, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH);
+  nblex_ckpt_put_u32(&writer, CHECKPOINT_VERSION);
+  nblex_ckpt_put_u64(&writer, 0);   /* Body length, patched below */
+
+  nblex_ckpt_put_u64(&writer, nblex_world_clock(world));
+  nblex_ckpt_put_u8(&writer, world->event_time.enabled ? 1 : 0);
+  nblex_ckpt_put_u64(&writer, watermark_ns);
+  nblex_ckpt_put_u32(&writer, (uint32_t)world->inputs_count);
+  for (size_t i = 0; i < world->inputs_count; i++) {
+    write_input(checkpoint, i, world->inputs[i], &writer);
+  }
+  nql_world_checkpoint(world, &writer);
+
+  int rc = -1;
+  if (!writer.failed) {
+    uint64_t body_length = writer.size - CHECKPOINT_HEADER_SIZE;
+    store_le(writer.data + CHECKPOINT_MAGIC_LENGTH + 4, body_length, 8);
+    nblex_ckpt_put_u64(&writer, nblex_hash64(writer.data + CHECKPOINT_HEADER_SIZE,
+                                             body_length, CHECKPOINT_HASH_SEED));
+    rc = writer.failed ? -1 : write_checkpoint_file(checkpoint, &writer);
+  }
+  nblex_free(writer.data);
+
+  if (rc == 0) {
+    checkpoint->written++;
+  } else {
+    checkpoint->failed++;
+  }
+  return rc;
+}
+
+/* Helper: Read a checkpoint file whole; returns 0, 1 if there is none, or -1 */
+static int read_checkpoint_file(const char* path, uint8_t** data_out, size_t* size_out) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return errno == ENOENT ? 1 : -1;
+  }
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0 || st.st_size < 0) {
+    fclose(file);
+    return -1;
+  }
+  size_t size = (size_t)st.st_size;
+  uint8_t* data = nblex_malloc(size ? size : 1);
+  if (!data || fread(data, 1, size, file) != size) {
+    nblex_free(data);
+    fclose(file);
+    return -1;
+  }
+  fclose(file);
+
+  *data_out = data;
+  *size_out = size;
+  return 0;
+}
+
+/* Helper: Check the header and hash; sets up a reader over the body */
+static int open_checkpoint(const uint8_t* data, size_t size, nblex_ckpt_reader_t* body) {
+  nblex_ckpt_reader_t reader = { data, size, 0, false };
+  const void* magic = nblex_ckpt_get_bytes(&reader, CHECKPOINT_MAGIC_LENGTH);
+  uint32_t version = nblex_ckpt_get_u32(&reader);
+  uint64_t body_length = nblex_ckpt_get_u64(&reader);
+  if (reader.failed || memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LENGTH) != 0 ||
+      version != CHECKPOINT_VERSION || body_length + 8 != nblex_ckpt_remaining(&reader)) {
+    return -1;
+  }
+
+  const uint8_t* body_data = nblex_ckpt_get_bytes(&reader, (size_t)body_length);
+  uint64_t hash = nblex_ckpt_get_u64(&reader);
+  if (reader.failed ||
+      hash != nblex_hash64(body_data, (size_t)body_length, CHECKPOINT_HASH_SEED)) {
+    return -1;
+  }
+
+  body->data = body_data;
+  body->size = (size_t)body_length;
+  body->pos = 0;
+  body->failed = false;
+  return 0;
+}
+
+/* Helper: Apply a checkpoint body to the world */
+static int restore_checkpoint(nblex_checkpoint_t* checkpoint, nblex_ckpt_reader_t* reader) {
+  nblex_world* world = checkpoint->world;
+
+  uint64_t clock_ns = nblex_ckpt_get_u64(reader);
+  bool event_time = nblex_ckpt_get_u8(reader) != 0;
+  uint64_t watermark_ns = nblex_ckpt_get_u64(reader);
+  uint32_t inputs_count = nblex_ckpt_get_u32(reader);
+  if (reader->failed || inputs_count > nblex_ckpt_remaining(reader)) {
+    return -1;
+  }
+
+  free_checkpoint_inputs(checkpoint);
+  checkpoint->inputs = nblex_calloc(inputs_count ? inputs_count : 1,
+                                    sizeof(nblex_checkpoint_input_t));
+  if (!checkpoint->inputs) {
+    return -1;
+  }
+  checkpoint->inputs_count = inputs_count;
+
+  for (uint32_t i = 0; i < inputs_count; i++) {
+    nblex_checkpoint_input_t* saved = &checkpoint->inputs[i];
+    size_t path_length;
+    saved->type = (nblex_input_type)nblex_ckpt_get_u32(reader);
+    const char* path = nblex_ckpt_get_string(reader, &path_length);
+    saved->has_position = nblex_ckpt_get_u8(reader) != 0;
+    saved->inode = nblex_ckpt_get_u64(reader);
+    saved->offset = nblex_ckpt_get_u64(reader);
+    uint64_t event_time_max_ns = nblex_ckpt_get_u64(reader);
+    if (reader->failed) {
+      return -1;
+    }
+    if (path_length > 0) {
+      saved->path = nblex_malloc(path_length + 1);
+      if (!saved->path) {
+        return -1;
+      }
+      memcpy(saved->path, path, path_length);
+      saved->path[path_length] = '\0';
+    }
+
+    /* Inputs are matched by position, type and path */
+    nblex_input* input = i < world->inputs_count ? world->inputs[i] : NULL;
+    const char* input_path = NULL;
+    if (input && input->type == NBLEX_INPUT_FILE && input->data && input->vtable &&
+        strcmp(input->vtable->name, "file") == 0) {
+      input_path = ((nblex_file_input_data*)input->data)->path;
+    }
+    if (input && input->type == saved->type &&
+        ((!input_path && !saved->path) ||
+         (input_path && saved->path && strcmp(input_path, saved->path) == 0)) &&
+        event_time && world->event_time.enabled) {
+      input->event_time_max_ns = event_time_max_ns;
+    }
+  }
+
+  /* Windows are placed on the world clock. In processing time that is
+   * the monotonic clock, which restarts with the machine: state from
+   * before a reboot cannot be placed and is dropped. Input positions
+   * still apply. */
+  if (event_time != world->event_time.enabled) {
+    fprintf(stderr, "Warning: Checkpoint '%s' is from a different time mode; "
+            "not restoring query state\n", checkpoint->path);
+    return 0;
+  }
+  if (event_time) {
+    if (watermark_ns > world->event_time.watermark_ns) {
+      world->event_time.watermark_ns = watermark_ns;
+    }
+  } else if (clock_ns > nblex_world_clock(world)) {
+    fprintf(stderr, "Warning: Checkpoint '%s' predates a restart of the clock; "
+            "not restoring query state\n", checkpoint->path);
+    return 0;
+  }
+
+  return nql_world_restore(world, reader);
+}
+
+/* Helper: Periodic checkpoint timer */
+static void checkpoint_timer_cb(uv_timer_t* handle) {
+  nblex_checkpoint_t* checkpoint = (nblex_checkpoint_t*)handle->data;
+  /* Queued events are behind the input positions; run them first */
+  nblex_world_flush_batch(checkpoint->world);
+  nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+  write_checkpoint(checkpoint, checkpoint->world->event_time.watermark_ns);
+  nblex_mem_account_leave(previous);
+}
+
+/* Helper: Release checkpoint memory */
+static void free_checkpoint(nblex_checkpoint_t* checkpoint) {
+  free_checkpoint_inputs(checkpoint);
+  nblex_free(checkpoint->path);
+  nblex_free(checkpoint->tmp_path);
+  nblex_free(checkpoint);
+}
+
+/* Helper: Timer close callback */
+static void checkpoint_close_cb(uv_handle_t* handle) {
+  free_checkpoint((nblex_checkpoint_t*)handle->data);
+}
+
+void nblex_checkpoint_free(nblex_checkpoint_t* checkpoint) {
+  if (!checkpoint) {
+    return;
+  }
+  if (checkpoint->timer_initialized) {
+    uv_timer_stop(&checkpoint->timer);
+    uv_close((uv_handle_t*)&checkpoint->timer, checkpoint_close_cb);
+    return;
+  }
+  free_checkpoint(checkpoint);
+}
+
+int nblex_checkpoint_start(nblex_world* world) {
+  nblex_checkpoint_t* checkpoint = world ? world->checkpoint : NULL;
+  if (!checkpoint) {
+    return 0;
+  }
+
+  /* A checkpoint that cannot be read is reported, and the world starts
+   * afresh rather than not at all; the next checkpoint replaces it. */
+  if (!checkpoint->restored && nblex_world_restore(world) != 0) {
+    fprintf(stderr, "Warning: Ignoring unreadable checkpoint '%s'\n", checkpoint->path);
+  }
+
+  if (checkpoint->interval_ms == 0) {
+    return 0;
+  }
+  if (!checkpoint->timer_initialized) {
+    if (uv_timer_init(world->loop, &checkpoint->timer) != 0) {
+      return -1;
+    }
+    checkpoint->timer.data = checkpoint;
+    checkpoint->timer_initialized = true;
+  }
+  return uv_timer_start(&checkpoint->timer, checkpoint_timer_cb,
+                        checkpoint->interval_ms, checkpoint->interval_ms) == 0 ? 0 : -1;
+}
+
+void nblex_checkpoint_stop(nblex_world* world, uint64_t watermark_ns) {
+  nblex_checkpoint_t* checkpoint = world ? world->checkpoint : NULL;
+  if (!checkpoint || !world->started) {
+    return;
+  }
+  if (checkpoint->timer_initialized) {
+    uv_timer_stop(&checkpoint->timer);
+  }
+  nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+  write_checkpoint(checkpoint, watermark_ns);
+  nblex_mem_account_leave(previous);
+}
+
+int nblex_checkpoint_file_offset(nblex_input* input, FILE* file, long* offset_out) {
+  nblex_checkpoint_t* checkpoint = input && input->world ? input->world->checkpoint : NULL;
+  if (!checkpoint || !file || !input->data) {
+    return -1;
+  }
+
+  const char* path = ((nblex_file_input_data*)input->data)->path;
+  for (size_t i = 0; i < checkpoint->inputs_count && i < input->world->inputs_count; i++) {
+    const nblex_checkpoint_input_t* saved = &checkpoint->inputs[i];
+    if (input->world->inputs[i] != input) {
+      continue;
+    }
+    /* A different file at the path (rotated), or one shorter than the
+     * position (truncated), is read from the end as without a checkpoint */
+    struct stat st;
+    if (!saved->has_position || !saved->path || strcmp(saved->path, path) != 0 ||
+        fstat(fileno(file), &st) != 0 || (uint64_t)st.st_ino != saved->inode ||
+        (uint64_t)st.st_size < saved->offset) {
+      return -1;
+    }
+    *offset_out = (long)saved->offset;
+    return 0;
+  }
+  return -1;
+}
+
+/* Public API */
+
+int nblex_world_set_checkpoint(nblex_world* world, const char* path, uint32_t interval_ms) {
+  if (!world || world->started) {
+    return -1;
+  }
+
+  if (world->checkpoint) {
+    nblex_checkpoint_free(world->checkpoint);
+    world->checkpoint = NULL;
+  }
+  if (!path) {
+    return 0;
+  }
+
+  nblex_checkpoint_t* checkpoint = nblex_calloc(1, sizeof(nblex_checkpoint_t));
+  if (!checkpoint) {
+    return -1;
+  }
+  checkpoint->world = world;
+  checkpoint->interval_ms = interval_ms;
+  checkpoint->path = nblex_strdup(path);
+  checkpoint->tmp_path = checkpoint->path ? nblex_malloc(strlen(path) + 5) : NULL;
+  if (!checkpoint->tmp_path) {
+    nblex_checkpoint_free(checkpoint);
+    return -1;
+  }
+  snprintf(checkpoint->tmp_path, strlen(path) + 5, "%s.tmp", path);
+
+  world->checkpoint = checkpoint;
+  return 0;
+}
+
+int nblex_world_checkpoint(nblex_world* world) {
+  if (!world || !world->checkpoint) {
+    return -1;
+  }
+  nblex_world_flush_batch(world);
+  nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+  int rc = write_checkpoint(world->checkpoint, world->event_time.watermark_ns);
+  nblex_mem_account_leave(previous);
+  return rc;
+}
+
+int nblex_world_restore(nblex_world* world) {
+  if (!world || !world->checkpoint) {
+    return -1;
+  }
+  nblex_checkpoint_t* checkpoint = world->checkpoint;
+  checkpoint->restored = true;
+
+  uint8_t* data = NULL;
+  size_t size = 0;
+  int rc = read_checkpoint_file(checkpoint->path, &data, &size);
+  if (rc != 0) {
+    return rc > 0 ? 0 : -1;
+  }
+
+  nblex_ckpt_reader_t body;
+  rc = open_checkpoint(data, size, &body);
+  if (rc == 0) {
+    rc = restore_checkpoint(checkpoint, &body);
+  }
+  if (rc != 0) {
+    free_checkpoint_inputs(checkpoint);
+  }
+  nblex_free(data);
+  return rc;
+}
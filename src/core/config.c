@@ -31,11 +31,34 @@ struct nblex_config_s {
     /* Correlation */
     int correlation_enabled;
     int correlation_window_ms;
+    char* correlation_strategy;
+    char* log_id_fields;        /* Comma-separated, for id_based */
+    char* network_id_fields;
+    char* peer_ip_field;        /* For connection */
+    char* peer_port_field;
+    int flow_idle_timeout_ms;   /* 0 for the default */
+    int max_flows;
+    int correlation_coalesce;   /* One correlation per event */
+    int max_matches;            /* Listed per coalesced correlation */
 
     /* Performance */
     int worker_threads;
+    int batch_size;             /* Input events per batch handler call */
     size_t buffer_size;
     size_t memory_limit;
+    size_t query_memory_limit;  /* Each query's own budget, 0 for none */
+    char* evict_policy;         /* "emit" or "fold" */
+
+    /* Event time */
+    int event_time_enabled;
+    char* event_time_field;
+    int event_time_max_delay_ms;
+    char* late_policy;
+    int allowed_lateness_ms;
+
+    /* Checkpoints */
+    char* checkpoint_path;
+    int checkpoint_interval_ms;
 };
 
 /* Configuration structures are defined in nblex_internal.h */
@@ -90,9 +113,12 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
     config->version = strdup("1.0");
     config->correlation_enabled = 1;
     config->correlation_window_ms = 100;
-    config->worker_threads = 4;
+    config->worker_threads = 1;  /* As without a config; more batch queries */
+    config->batch_size = NBLEX_BATCH_SIZE;  /* Only with a batch handler */
     config->buffer_size = 64 * 1024 * 1024;  /* 64MB */
     config->memory_limit = 1024 * 1024 * 1024;  /* 1GB */
+    config->event_time_max_delay_ms = 1000;
+    config->checkpoint_interval_ms = 10000;
     config->inputs_capacity = 8;
     config->outputs_capacity = 8;
     config->inputs = calloc(config->inputs_capacity, sizeof(nblex_input_config_t));
@@ -106,7 +132,8 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
     }
 
     /* Parse YAML */
-    int in_inputs = 0, in_outputs = 0, in_correlation = 0, in_performance = 0;
+    int in_inputs = 0, in_outputs = 0, in_correlation = 0, in_performance = 0, in_event_time = 0;
+    int in_checkpoint = 0;
     int in_logs = 0, in_network = 0;
     int expecting_key = 1;
     char* current_key = NULL;
@@ -158,6 +185,8 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                 if (in_network) in_network = 0;
                 if (in_correlation) in_correlation = 0;
                 if (in_performance) in_performance = 0;
+                if (in_event_time) in_event_time = 0;
+                if (in_checkpoint) in_checkpoint = 0;
                 current_input = NULL;
                 current_output = NULL;
                 expecting_key = 1;  /* Reset to expect next key */
@@ -194,6 +223,10 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                         in_correlation = 1;
                     } else if (strcmp(current_key, "performance") == 0) {
                         in_performance = 1;
+                    } else if (strcmp(current_key, "event_time") == 0) {
+                        in_event_time = 1;
+                    } else if (strcmp(current_key, "checkpoint") == 0) {
+                        in_checkpoint = 1;
                     }
                 } else {
                     /* This is a value */
@@ -213,6 +246,9 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                             current_input->filter = value;
                         } else if (strcmp(current_key, "format") == 0) {
                             current_input->format = value;
+                        } else if (strcmp(current_key, "priority") == 0) {
+                            current_input->priority = atoi(value);
+                            free(value);
                         } else {
                             free(value);
                         }
@@ -237,6 +273,33 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                         } else if (strcmp(current_key, "window_ms") == 0) {
                             config->correlation_window_ms = atoi(value);
                             free(value);
+                        } else if (strcmp(current_key, "strategy") == 0) {
+                            free(config->correlation_strategy);
+                            config->correlation_strategy = value;
+                        } else if (strcmp(current_key, "log_id_fields") == 0) {
+                            free(config->log_id_fields);
+                            config->log_id_fields = value;
+                        } else if (strcmp(current_key, "network_id_fields") == 0) {
+                            free(config->network_id_fields);
+                            config->network_id_fields = value;
+                        } else if (strcmp(current_key, "peer_ip_field") == 0) {
+                            free(config->peer_ip_field);
+                            config->peer_ip_field = value;
+                        } else if (strcmp(current_key, "peer_port_field") == 0) {
+                            free(config->peer_port_field);
+                            config->peer_port_field = value;
+                        } else if (strcmp(current_key, "flow_idle_timeout_ms") == 0) {
+                            config->flow_idle_timeout_ms = atoi(value);
+                            free(value);
+                        } else if (strcmp(current_key, "max_flows") == 0) {
+                            config->max_flows = atoi(value);
+                            free(value);
+                        } else if (strcmp(current_key, "coalesce") == 0) {
+                            config->correlation_coalesce = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+                            free(value);
+                        } else if (strcmp(current_key, "max_matches") == 0) {
+                            config->max_matches = atoi(value);
+                            free(value);
                         } else {
                             free(value);
                         }
@@ -244,6 +307,9 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                         if (strcmp(current_key, "worker_threads") == 0) {
                             config->worker_threads = atoi(value);
                             free(value);
+                        } else if (strcmp(current_key, "batch_size") == 0) {
+                            config->batch_size = atoi(value);
+                            free(value);
                         } else if (strcmp(current_key, "buffer_size") == 0) {
                             /* Parse size with units (MB, GB) */
                             size_t size = atoi(value);
@@ -259,6 +325,46 @@ nblex_config_t* nblex_config_load_yaml(const char* filename) {
                             else if (strstr(value, "KB")) size *= 1024;
                             config->memory_limit = size;
                             free(value);
+                        } else if (strcmp(current_key, "query_memory_limit") == 0) {
+                            size_t size = atoi(value);
+                            if (strstr(value, "GB")) size *= 1024 * 1024 * 1024;
+                            else if (strstr(value, "MB")) size *= 1024 * 1024;
+                            else if (strstr(value, "KB")) size *= 1024;
+                            config->query_memory_limit = size;
+                            free(value);
+                        } else if (strcmp(current_key, "evict_policy") == 0) {
+                            free(config->evict_policy);
+                            config->evict_policy = value;
+                        } else {
+                            free(value);
+                        }
+                    } else if (in_event_time) {
+                        if (strcmp(current_key, "enabled") == 0) {
+                            config->event_time_enabled = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+                            free(value);
+                        } else if (strcmp(current_key, "field") == 0) {
+                            free(config->event_time_field);
+                            config->event_time_field = value;
+                        } else if (strcmp(current_key, "max_delay_ms") == 0) {
+                            config->event_time_max_delay_ms = atoi(value);
+                            free(value);
+                        } else if (strcmp(current_key, "late_policy") == 0) {
+                            free(config->late_policy);
+    free(config->evict_policy);
+                            config->late_policy = value;
+                        } else if (strcmp(current_key, "allowed_lateness_ms") == 0) {
+                            config->allowed_lateness_ms = atoi(value);
+                            free(value);
+                        } else {
+                            free(value);
+                        }
+                    } else if (in_checkpoint) {
+                        if (strcmp(current_key, "path") == 0) {
+                            free(config->checkpoint_path);
+                            config->checkpoint_path = value;
+                        } else if (strcmp(current_key, "interval_ms") == 0) {
+                            config->checkpoint_interval_ms = atoi(value);
+                            free(value);
                         } else {
                             free(value);
                         }
@@ -322,9 +428,45 @@ void nblex_config_free(nblex_config_t* config) {
     }
     free(config->outputs);
 
+    free(config->correlation_strategy);
+    free(config->log_id_fields);
+    free(config->network_id_fields);
+    free(config->peer_ip_field);
+    free(config->peer_port_field);
+    free(config->event_time_field);
+    free(config->late_policy);
+    free(config->checkpoint_path);
+
     free(config);
 }
 
+/* Helper: Add each field of a comma-separated list as a correlation ID field */
+static int apply_id_fields(nblex_correlation* corr, nblex_event_type type, const char* list) {
+    const char* pos = list;
+    while (pos && *pos) {
+        while (*pos == ' ' || *pos == ',') {
+            pos++;
+        }
+        size_t len = strcspn(pos, ",");
+        while (len > 0 && pos[len - 1] == ' ') {
+            len--;
+        }
+        if (len > 0) {
+            char field[256];
+            if (len >= sizeof(field)) {
+                return -1;
+            }
+            memcpy(field, pos, len);
+            field[len] = '\0';
+            if (nblex_correlation_add_id_field(corr, type, field) != 0) {
+                return -1;
+            }
+        }
+        pos += strcspn(pos, ",");
+    }
+    return 0;
+}
+
 /* Apply configuration to world */
 int nblex_config_apply(nblex_config_t* config, nblex_world* world) {
     if (!config || !world) {
@@ -333,9 +475,66 @@ int nblex_config_apply(nblex_config_t* config, nblex_world* world) {
 
     /* Apply correlation settings */
     if (config->correlation_enabled && world->correlation) {
-        nblex_correlation_add_strategy(world->correlation, 
-                                       NBLEX_CORR_TIME_BASED,
+        nblex_correlation_type type = NBLEX_CORR_TIME_BASED;
+        if (config->correlation_strategy && strcmp(config->correlation_strategy, "id_based") == 0) {
+            type = NBLEX_CORR_ID_BASED;
+        } else if (config->correlation_strategy &&
+                   strcmp(config->correlation_strategy, "connection") == 0) {
+            type = NBLEX_CORR_CONNECTION;
+        }
+        nblex_correlation_add_strategy(world->correlation, type,
                                        config->correlation_window_ms);
+        if (apply_id_fields(world->correlation, NBLEX_EVENT_LOG, config->log_id_fields) != 0 ||
+            apply_id_fields(world->correlation, NBLEX_EVENT_NETWORK,
+                            config->network_id_fields) != 0) {
+            return -1;
+        }
+        if ((config->peer_ip_field || config->peer_port_field) &&
+            nblex_correlation_set_peer_fields(world->correlation,
+                config->peer_ip_field ? config->peer_ip_field : "remote_addr",
+                config->peer_port_field ? config->peer_port_field : "remote_port") != 0) {
+            return -1;
+        }
+        nblex_correlation_set_flow_limits(world->correlation,
+            config->flow_idle_timeout_ms > 0 ? (uint32_t)config->flow_idle_timeout_ms : 0,
+            config->max_flows > 0 ? (size_t)config->max_flows : 0);
+        nblex_correlation_set_coalesce(world->correlation, config->correlation_coalesce != 0,
+            config->max_matches > 0 ? (size_t)config->max_matches : 0);
+    }
+
+    /* Apply resource limits and threads */
+    nblex_world_set_memory_limit(world, config->memory_limit);
+    nblex_world_set_query_memory_limit(world, config->query_memory_limit,
+        config->evict_policy && strcmp(config->evict_policy, "fold") == 0 ?
+        NBLEX_EVICT_FOLD : NBLEX_EVICT_EMIT);
+    nblex_world_set_buffer_limit(world, config->buffer_size);
+    nblex_world_set_worker_threads(world, config->worker_threads > 0 ?
+                                   (size_t)config->worker_threads : 1);
+    if (nblex_world_set_batch_size(world, config->batch_size > 0 ?
+                                   (size_t)config->batch_size : 0) != 0) {
+        return -1;
+    }
+
+    /* Apply event time settings, before any query is prepared */
+    if (config->event_time_enabled) {
+        if (nblex_world_set_event_time(world, config->event_time_field,
+                                       (uint32_t)config->event_time_max_delay_ms) != 0) {
+            return -1;
+        }
+        nblex_late_policy policy = NBLEX_LATE_DROP;
+        if (config->late_policy && strcmp(config->late_policy, "side_output") == 0) {
+            policy = NBLEX_LATE_SIDE_OUTPUT;
+        } else if (config->late_policy && strcmp(config->late_policy, "update") == 0) {
+            policy = NBLEX_LATE_UPDATE;
+        }
+        nblex_world_set_late_policy(world, policy, (uint32_t)config->allowed_lateness_ms);
+    }
+
+    /* Apply checkpoints, restored when the world starts */
+    if (config->checkpoint_path &&
+        nblex_world_set_checkpoint(world, config->checkpoint_path,
+                                   (uint32_t)config->checkpoint_interval_ms) != 0) {
+        return -1;
     }
 
     /* Create inputs from config */
@@ -374,6 +573,9 @@ int nblex_config_apply(nblex_config_t* config, nblex_world* world) {
         if (input && input_cfg->filter) {
             nblex_input_set_filter(input, input_cfg->filter);
         }
+        if (input) {
+            nblex_input_set_priority(input, input_cfg->priority);
+        }
     }
 
     return 0;
@@ -388,6 +590,24 @@ const char* nblex_config_get_string(nblex_config_t* config, const char* key) {
     /* Simple key-value lookup for basic config */
     if (strcmp(key, "version") == 0) {
         return config->version;
+    } else if (strcmp(key, "event_time.field") == 0) {
+        return config->event_time_field;
+    } else if (strcmp(key, "event_time.late_policy") == 0) {
+        return config->late_policy;
+    } else if (strcmp(key, "performance.evict_policy") == 0) {
+        return config->evict_policy;
+    } else if (strcmp(key, "checkpoint.path") == 0) {
+        return config->checkpoint_path;
+    } else if (strcmp(key, "correlation.strategy") == 0) {
+        return config->correlation_strategy;
+    } else if (strcmp(key, "correlation.log_id_fields") == 0) {
+        return config->log_id_fields;
+    } else if (strcmp(key, "correlation.network_id_fields") == 0) {
+        return config->network_id_fields;
+    } else if (strcmp(key, "correlation.peer_ip_field") == 0) {
+        return config->peer_ip_field;
+    } else if (strcmp(key, "correlation.peer_port_field") == 0) {
+        return config->peer_port_field;
     }
 
     return NULL;
@@ -403,8 +623,26 @@ int nblex_config_get_int(nblex_config_t* config, const char* key, int default_va
         return config->correlation_enabled;
     } else if (strcmp(key, "correlation.window_ms") == 0) {
         return config->correlation_window_ms;
+    } else if (strcmp(key, "correlation.flow_idle_timeout_ms") == 0) {
+        return config->flow_idle_timeout_ms;
+    } else if (strcmp(key, "correlation.max_flows") == 0) {
+        return config->max_flows;
+    } else if (strcmp(key, "correlation.coalesce") == 0) {
+        return config->correlation_coalesce;
+    } else if (strcmp(key, "correlation.max_matches") == 0) {
+        return config->max_matches;
     } else if (strcmp(key, "performance.worker_threads") == 0) {
         return config->worker_threads;
+    } else if (strcmp(key, "performance.batch_size") == 0) {
+        return config->batch_size;
+    } else if (strcmp(key, "event_time.enabled") == 0) {
+        return config->event_time_enabled;
+    } else if (strcmp(key, "event_time.max_delay_ms") == 0) {
+        return config->event_time_max_delay_ms;
+    } else if (strcmp(key, "event_time.allowed_lateness_ms") == 0) {
+        return config->allowed_lateness_ms;
+    } else if (strcmp(key, "checkpoint.interval_ms") == 0) {
+        return config->checkpoint_interval_ms;
     }
 
     return default_value;
@@ -420,6 +658,8 @@ size_t nblex_config_get_size(nblex_config_t* config, const char* key, size_t def
         return config->buffer_size;
     } else if (strcmp(key, "performance.memory_limit") == 0) {
         return config->memory_limit;
+    } else if (strcmp(key, "performance.query_memory_limit") == 0) {
+        return config->query_memory_limit;
     }
 
     return default_value;
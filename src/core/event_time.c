@@ -0,0 +1,370 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * event_time.c - Event-time stamping and per-input watermarks
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_PER_SEC 1000000000ULL
+#define DEFAULT_TIMESTAMP_FIELD "timestamp"
+
+/* Helper: Days from 1970-01-01 to a proleptic Gregorian date */
+static int64_t days_from_civil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/* Helper: Parse exactly `digits` decimal digits */
+static bool parse_digits(const char** p, int digits, int* out) {
+  int value = 0;
+  for (int i = 0; i < digits; i++) {
+    if (!isdigit((unsigned char)(*p)[i])) {
+      return false;
+    }
+    value = value * 10 + ((*p)[i] - '0');
+  }
+  *p += digits;
+  *out = value;
+  return true;
+}
+
+/* Helper: Parse an optional fraction of a second ".123456789" */
+static uint64_t parse_fraction(const char** p) {
+  if (**p != '.' && **p != ',') {
+    return 0;
+  }
+  (*p)++;
+  uint64_t ns = 0;
+  uint64_t scale = NS_PER_SEC / 10;
+  while (isdigit((unsigned char)**p)) {
+    ns += (uint64_t)(**p - '0') * scale;
+    scale /= 10;
+    (*p)++;
+  }
+  return ns;
+}
+
+/* Helper: Parse a zone suffix "Z", "+HH:MM", "+HHMM" or nothing (UTC)
+ * into an offset east of UTC in seconds
+ */
+static bool parse_zone(const char** p, int64_t* offset_out) {
+  *offset_out = 0;
+  if (**p == '\0') {
+    return true;
+  }
+  if (**p == 'Z' || **p == 'z') {
+    (*p)++;
+    return **p == '\0';
+  }
+  if (**p != '+' && **p != '-') {
+    return false;
+  }
+  int sign = **p == '-' ? -1 : 1;
+  (*p)++;
+  int hours, minutes = 0;
+  if (!parse_digits(p, 2, &hours)) {
+    return false;
+  }
+  if (**p == ':') {
+    (*p)++;
+  }
+  if (**p && !parse_digits(p, 2, &minutes)) {
+    return false;
+  }
+  *offset_out = sign * (hours * 3600 + minutes * 60);
+  return **p == '\0';
+}
+
+/* Helper: Combine civil date-time fields into nanoseconds since the epoch */
+static int civil_to_ns(int year, int month, int day, int hour, int minute, int second,
+                       uint64_t fraction_ns, int64_t offset_s, uint64_t* ns_out) {
+  if (month < 1 || month > 12 || day < 1 || day > 31 ||
+      hour > 23 || minute > 59 || second > 60) {
+    return -1;
+  }
+  int64_t secs = days_from_civil(year, month, day) * 86400 +
+                 hour * 3600 + minute * 60 + second - offset_s;
+  if (secs <= 0) {
+    return -1;
+  }
+  *ns_out = (uint64_t)secs * NS_PER_SEC + fraction_ns;
+  return 0;
+}
+
+/* Helper: Parse "YYYY-MM-DDTHH:MM:SS[.fff][zone]" (a space may replace T) */
+static int parse_iso8601(const char* s, uint64_t* ns_out) {
+  int year, month, day, hour, minute, second;
+  const char* p = s;
+  if (!parse_digits(&p, 4, &year) || *p++ != '-' ||
+      !parse_digits(&p, 2, &month) || *p++ != '-' ||
+      !parse_digits(&p, 2, &day) || (*p != 'T' && *p != 't' && *p != ' ')) {
+    return -1;
+  }
+  p++;
+  if (!parse_digits(&p, 2, &hour) || *p++ != ':' ||
+      !parse_digits(&p, 2, &minute) || *p++ != ':' ||
+      !parse_digits(&p, 2, &second)) {
+    return -1;
+  }
+  uint64_t fraction_ns = parse_fraction(&p);
+  int64_t offset_s;
+  if (!parse_zone(&p, &offset_s)) {
+    return -1;
+  }
+  return civil_to_ns(year, month, day, hour, minute, second, fraction_ns, offset_s, ns_out);
+}
+
+/* Helper: Parse nginx time_local "DD/Mon/YYYY:HH:MM:SS +ZZZZ" */
+static int parse_nginx_time(const char* s, uint64_t* ns_out) {
+  static const char* const months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  int year, month = 0, day, hour, minute, second;
+  const char* p = s;
+  if (!parse_digits(&p, 2, &day) || *p++ != '/') {
+    return -1;
+  }
+  for (int i = 0; i < 12; i++) {
+    if (strncmp(p, months[i], 3) == 0) {
+      month = i + 1;
+      break;
+    }
+  }
+  if (month == 0) {
+    return -1;
+  }
+  p += 3;
+  if (*p++ != '/' || !parse_digits(&p, 4, &year) || *p++ != ':' ||
+      !parse_digits(&p, 2, &hour) || *p++ != ':' ||
+      !parse_digits(&p, 2, &minute) || *p++ != ':' ||
+      !parse_digits(&p, 2, &second)) {
+    return -1;
+  }
+  if (*p == ' ') {
+    p++;
+  }
+  int64_t offset_s;
+  if (!parse_zone(&p, &offset_s)) {
+    return -1;
+  }
+  return civil_to_ns(year, month, day, hour, minute, second, 0, offset_s, ns_out);
+}
+
+/* Helper: Scale an epoch number to nanoseconds by its magnitude:
+ * seconds below 1e11, then milliseconds, microseconds, nanoseconds
+ */
+static int epoch_number_to_ns(double value, uint64_t* ns_out) {
+  double ns;
+  if (!(value > 0)) {
+    return -1;
+  } else if (value < 1e11) {
+    ns = value * 1e9;   /* Seconds */
+  } else if (value < 1e14) {
+    ns = value * 1e6;   /* Milliseconds */
+  } else if (value < 1e17) {
+    ns = value * 1e3;   /* Microseconds */
+  } else {
+    ns = value;         /* Nanoseconds */
+  }
+  if (ns >= 18446744073709551615.0) {
+    return -1;
+  }
+  *ns_out = (uint64_t)ns;
+  return 0;
+}
+
+int nblex_event_time_parse(const json_t* value, uint64_t* ns_out) {
+  if (!value || !ns_out) {
+    return -1;
+  }
+
+  if (json_is_integer(value)) {
+    /* Scaled exactly rather than through a double */
+    json_int_t n = json_integer_value(value);
+    if (n <= 0) {
+      return -1;
+    }
+    uint64_t v = (uint64_t)n;
+    *ns_out = v < 100000000000ULL ? v * NS_PER_SEC :
+              v < 100000000000000ULL ? v * 1000000ULL :
+              v < 100000000000000000ULL ? v * 1000ULL : v;
+    return 0;
+  }
+  if (json_is_real(value)) {
+    return epoch_number_to_ns(json_real_value(value), ns_out);
+  }
+  if (json_is_string(value)) {
+    const char* s = json_string_value(value);
+    if (parse_iso8601(s, ns_out) == 0 || parse_nginx_time(s, ns_out) == 0) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* Helper: An input's watermark, 0 before its first event and the end
+ * of time once it is done */
+static uint64_t input_watermark(const nblex_world* world, const nblex_input* input) {
+  uint64_t max_ns = input->event_time_max_ns;
+  uint64_t delay_ns = world->event_time.max_delay_ns;
+  if (input->event_time_done) {
+    return UINT64_MAX;
+  }
+  if (max_ns == 0) {
+    return 0;
+  }
+  return max_ns > delay_ns ? max_ns - delay_ns : 1;
+}
+
+/* Helper: Advance the world watermark to the lowest of the inputs that
+ * have seen events, `input` (if any) included: a lagging input holds
+ * windows open for everyone */
+static void advance_to_lowest(nblex_world* world, const nblex_input* input) {
+  uint64_t watermark = input ? input_watermark(world, input) : 0;
+  for (size_t i = 0; i < world->inputs_count; i++) {
+    uint64_t input_ns = world->inputs[i] ? input_watermark(world, world->inputs[i]) : 0;
+    if (input_ns != 0 && (watermark == 0 || input_ns < watermark)) {
+      watermark = input_ns;
+    }
+  }
+  nblex_world_advance_watermark(world, watermark);
+}
+
+bool nblex_event_time_observe(nblex_world* world, nblex_event* event) {
+  if (!world || !world->event_time.enabled || !event || !event->input) {
+    return true;
+  }
+  nblex_input* input = event->input;
+
+  /* Network events already carry their capture time; log events are
+   * stamped from their field. One without a usable time (a header, a
+   * malformed line) takes its input's newest time, or the watermark,
+   * so it is never late; it does not move the watermark, which a
+   * guess would throw ahead of a replayed backlog. */
+  if (event->type != NBLEX_EVENT_NETWORK) {
+    const char* field = world->event_time.field ? world->event_time.field :
+                                                  DEFAULT_TIMESTAMP_FIELD;
+    json_t* value = event->data ? json_object_get(event->data, field) : NULL;
+    if (nblex_event_time_parse(value, &event->timestamp_ns) != 0) {
+      world->event_time.missing_timestamps++;
+      event->timestamp_ns = input->event_time_max_ns ? input->event_time_max_ns :
+                                                       world->event_time.watermark_ns;
+      if (event->timestamp_ns == 0) {
+        world->event_time.untimed_skipped++;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  if (event->timestamp_ns > input->event_time_max_ns) {
+    input->event_time_max_ns = event->timestamp_ns;
+    advance_to_lowest(world, input);
+  }
+  return true;
+}
+
+void nblex_event_time_input_done(nblex_world* world, nblex_input* input) {
+  if (!world || !world->event_time.enabled) {
+    return;
+  }
+  if (input) {
+    input->event_time_done = true;
+  } else {
+    for (size_t i = 0; i < world->inputs_count; i++) {
+      if (world->inputs[i]) {
+        world->inputs[i]->event_time_done = true;
+      }
+    }
+  }
+  advance_to_lowest(world, input);
+}
+
+void nblex_world_advance_watermark(nblex_world* world, uint64_t watermark_ns) {
+  if (!world || watermark_ns <= world->event_time.watermark_ns) {
+    return;
+  }
+  /* Queued events run before the watermark passes any of them, so none
+   * becomes late, or misses its window, by waiting in the queue */
+  if (world->batch_count > 0 && watermark_ns > world->batch_min_ns) {
+    nblex_world_flush_batch(world);
+  }
+  world->event_time.watermark_ns = watermark_ns;
+
+  /* A closing window may schedule the next one at or before the same
+   * watermark (sliding windows); run until nothing more is due. */
+  while (nblex_scheduler_run(world->event_time.scheduler, watermark_ns) > 0) {
+  }
+}
+
+nblex_scheduler_t* nblex_world_window_scheduler(nblex_world* world) {
+  if (!world) {
+    return NULL;
+  }
+  if (!world->event_time.enabled) {
+    return nblex_world_scheduler(world);
+  }
+  if (!world->event_time.scheduler) {
+    world->event_time.scheduler = nblex_scheduler_new(NULL);
+  }
+  return world->event_time.scheduler;
+}
+
+uint64_t nblex_world_clock(nblex_world* world) {
+  if (world && world->event_time.enabled) {
+    return world->event_time.watermark_ns;
+  }
+  return nblex_timestamp_now();
+}
+
+int nblex_world_set_event_time(nblex_world* world, const char* timestamp_field,
+                               uint32_t max_delay_ms) {
+  if (!world) {
+    return -1;
+  }
+  /* Queries pick their scheduler when first run */
+  if (world->queries && nql_registry_count(world->queries) > 0) {
+    return -1;
+  }
+
+  char* field = NULL;
+  if (timestamp_field) {
+    field = nblex_strdup(timestamp_field);
+    if (!field) {
+      return -1;
+    }
+  }
+  nblex_free(world->event_time.field);
+  world->event_time.field = field;
+  world->event_time.max_delay_ns = (uint64_t)max_delay_ms * 1000000ULL;
+  world->event_time.enabled = true;
+  return 0;
+}
+
+int nblex_world_set_late_policy(nblex_world* world, nblex_late_policy policy,
+                                uint32_t allowed_lateness_ms) {
+  if (!world || policy < NBLEX_LATE_DROP || policy > NBLEX_LATE_UPDATE) {
+    return -1;
+  }
+  world->event_time.late_policy = policy;
+  world->event_time.allowed_lateness_ns = (uint64_t)allowed_lateness_ms * 1000000ULL;
+  return 0;
+}
+
+uint64_t nblex_world_get_watermark(nblex_world* world) {
+  if (!world || !world->event_time.enabled) {
+    return 0;
+  }
+  return world->event_time.watermark_ns;
+}
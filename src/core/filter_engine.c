@@ -24,6 +24,7 @@
 
 #include "../nblex_internal.h"
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 
@@ -60,6 +61,7 @@ typedef struct {
         double float_val;
         int bool_val;
     } value;
+    char* pattern;     /* Regex source, for =~ and !~ */
     pcre2_code* regex_code;
     pcre2_match_data* regex_match_data;
 } filter_expr_t;
@@ -80,6 +82,8 @@ typedef struct filter_node {
 /* Filter context */
 typedef struct filter_s {
     filter_node_t* root;
+    filter_dag_t* dag;      /* Shared predicate DAG holding this filter, if any */
+    int dag_node;           /* Root node in the DAG */
 } filter_t;
 
 /* Forward declarations */
@@ -87,6 +91,26 @@ static filter_node_t* parse_filter_expr(const char** expr);
 static int evaluate_filter_node(const filter_node_t* node, const json_t* event);
 static void free_filter_node(filter_node_t* node);
 
+/* Helper: Compile an expression's regex pattern */
+static void compile_expr_regex(filter_expr_t* expr) {
+    int error_code;
+    PCRE2_SIZE error_offset;
+    expr->regex_code = pcre2_compile(
+        (PCRE2_SPTR)expr->pattern,
+        PCRE2_ZERO_TERMINATED,
+        PCRE2_UTF | PCRE2_UCP,
+        &error_code,
+        &error_offset,
+        NULL
+    );
+
+    if (expr->regex_code) {
+        expr->regex_match_data = pcre2_match_data_create_from_pattern(
+            expr->regex_code, NULL
+        );
+    }
+}
+
 /* Parse filter expression */
 static filter_node_t* parse_filter_expr(const char** expr) {
     const char* pos = *expr;
@@ -264,29 +288,11 @@ static filter_node_t* parse_filter_expr(const char** expr) {
         }
 
         size_t pattern_len = pos - pattern_start;
-        char* pattern = malloc(pattern_len + 1);
-        if (pattern) {
-            memcpy(pattern, pattern_start, pattern_len);
-            pattern[pattern_len] = '\0';
-
-            int error_code;
-            PCRE2_SIZE error_offset;
-            expr_data->regex_code = pcre2_compile(
-                (PCRE2_SPTR)pattern,
-                PCRE2_ZERO_TERMINATED,
-                PCRE2_UTF | PCRE2_UCP,
-                &error_code,
-                &error_offset,
-                NULL
-            );
-
-            if (expr_data->regex_code) {
-                expr_data->regex_match_data = pcre2_match_data_create_from_pattern(
-                    expr_data->regex_code, NULL
-                );
-            }
-
-            free(pattern);
+        expr_data->pattern = malloc(pattern_len + 1);
+        if (expr_data->pattern) {
+            memcpy(expr_data->pattern, pattern_start, pattern_len);
+            expr_data->pattern[pattern_len] = '\0';
+            compile_expr_regex(expr_data);
         }
     }
 
@@ -507,6 +513,7 @@ static void free_filter_expr(filter_expr_t* expr) {
     if (expr->value_type == JSON_STRING) {
         free(expr->value.string_val);
     }
+    free(expr->pattern);
 
     if (expr->regex_code) {
         pcre2_code_free(expr->regex_code);
@@ -544,6 +551,538 @@ static void free_filter_node(filter_node_t* node) {
     free(node);
 }
 
+/*
+ * Shared predicate DAG
+ *
+ * Filters added to a DAG are hash-consed node by node, so a predicate or
+ * subexpression used by several filters is a single reference-counted
+ * node holding its own copy of the expression. During an evaluation
+ * scope each node memoises its value under the scope's generation, so
+ * it is evaluated at most once per event. String equality tests on the
+ * same field form a group decided by one field lookup and one hash
+ * probe, however many constants the filters test the field against.
+ */
+#define DAG_INITIAL_BUCKETS 64
+#define DAG_GROUP_INITIAL_BUCKETS 16
+
+typedef struct {
+    filter_node_type_t type;
+    filter_expr_t* expr;        /* EXPR: owned copy */
+    int left;                   /* AND/OR operands, NOT operand in left */
+    int right;
+    uint64_t hash;
+    uint32_t refs;              /* 0 when the slot is free */
+    int chain_next;             /* Next in hash chain, or next free slot */
+    int group;                  /* String equality group, -1 if none */
+    int group_next;             /* Next in the group's chain */
+    uint64_t memo_generation;
+    int memo_value;
+} filter_dag_node_t;
+
+/* String equality tests on one field, chained by constant hash */
+typedef struct {
+    char* field;
+    int* buckets;               /* Heads, -1 if empty */
+    size_t buckets_capacity;    /* Power of two */
+    size_t count;
+    uint64_t memo_generation;
+    int memo_node;              /* Node equal to the event's value, -1 if none */
+} filter_dag_group_t;
+
+struct filter_dag_s {
+    filter_dag_node_t* nodes;
+    size_t nodes_used;          /* High-water mark of node IDs */
+    size_t nodes_capacity;
+    int free_head;
+    size_t count;               /* Live nodes */
+
+    int* buckets;               /* Hash chain heads, -1 if empty */
+    size_t buckets_capacity;    /* Power of two */
+
+    filter_dag_group_t* groups;
+    size_t groups_count;
+
+    const nblex_event* event;   /* Event of the current scope, NULL if none */
+    uint64_t generation;        /* Memo generation of the current scope */
+    uint64_t last_generation;
+    uint64_t evaluations;
+};
+
+/* Helper: Is an expression a string equality test? */
+static int expr_is_string_eq(const filter_expr_t* expr) {
+    return expr->op == FILTER_OP_EQ && expr->value_type == JSON_STRING &&
+           expr->value.string_val != NULL;
+}
+
+/* Helper: Hash an expression by field, operator and operand */
+static uint64_t hash_filter_expr(const filter_expr_t* expr) {
+    uint64_t h = nblex_hash64_string(expr->field);
+    h = nblex_hash64_combine(h, (uint64_t)expr->op);
+    h = nblex_hash64_combine(h, (uint64_t)expr->value_type);
+    if (expr->pattern) {
+        return nblex_hash64_combine(h, nblex_hash64_string(expr->pattern));
+    }
+    switch (expr->value_type) {
+        case JSON_STRING:
+            return nblex_hash64_combine(h, expr->value.string_val ?
+                                        nblex_hash64_string(expr->value.string_val) : 0);
+        case JSON_INTEGER:
+            return nblex_hash64_combine(h, (uint64_t)expr->value.int_val);
+        case JSON_REAL:
+            return nblex_hash64_combine(h, nblex_hash64(&expr->value.float_val,
+                                                        sizeof(double), 0));
+        default:
+            return h;
+    }
+}
+
+/* Helper: Do two expressions test the same thing? */
+static int filter_expr_equal(const filter_expr_t* a, const filter_expr_t* b) {
+    if (a->op != b->op || a->value_type != b->value_type || strcmp(a->field, b->field) != 0) {
+        return 0;
+    }
+    if (a->pattern || b->pattern) {
+        return a->pattern && b->pattern && strcmp(a->pattern, b->pattern) == 0;
+    }
+    switch (a->value_type) {
+        case JSON_STRING:
+            if (!a->value.string_val || !b->value.string_val) {
+                return a->value.string_val == b->value.string_val;
+            }
+            return strcmp(a->value.string_val, b->value.string_val) == 0;
+        case JSON_INTEGER:
+            return a->value.int_val == b->value.int_val;
+        case JSON_REAL:
+            return a->value.float_val == b->value.float_val;
+        default:
+            return 1;
+    }
+}
+
+/* Helper: Copy an expression, recompiling any regex */
+static filter_expr_t* copy_filter_expr(const filter_expr_t* expr) {
+    filter_expr_t* copy = calloc(1, sizeof(filter_expr_t));
+    if (!copy) {
+        return NULL;
+    }
+
+    copy->op = expr->op;
+    copy->value_type = expr->value_type;
+    copy->field = strdup(expr->field);
+    if (!copy->field) {
+        free_filter_expr(copy);
+        return NULL;
+    }
+    if (expr->value_type != JSON_STRING) {
+        copy->value = expr->value;
+    } else if (expr->value.string_val) {
+        copy->value.string_val = strdup(expr->value.string_val);
+        if (!copy->value.string_val) {
+            free_filter_expr(copy);
+            return NULL;
+        }
+    }
+    if (expr->pattern) {
+        copy->pattern = strdup(expr->pattern);
+        if (!copy->pattern) {
+            free_filter_expr(copy);
+            return NULL;
+        }
+        compile_expr_regex(copy);
+    }
+    return copy;
+}
+
+/* Helper: Hash of a DAG node's content */
+static uint64_t dag_node_hash(filter_node_type_t type, const filter_expr_t* expr,
+                              int left, int right) {
+    if (type == FILTER_NODE_EXPR) {
+        return hash_filter_expr(expr);
+    }
+    uint64_t h = nblex_hash64_combine((uint64_t)type + 1, (uint64_t)left);
+    return nblex_hash64_combine(h, (uint64_t)right);
+}
+
+/* Helper: Rehash all live nodes into a larger chain table */
+static int dag_grow_buckets(filter_dag_t* dag) {
+    size_t capacity = dag->buckets_capacity ? dag->buckets_capacity * 2 : DAG_INITIAL_BUCKETS;
+    int* buckets = malloc(capacity * sizeof(int));
+    if (!buckets) {
+        return -1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        buckets[i] = -1;
+    }
+    for (size_t id = 0; id < dag->nodes_used; id++) {
+        filter_dag_node_t* node = &dag->nodes[id];
+        if (node->refs == 0) {
+            continue;
+        }
+        size_t pos = (size_t)node->hash & (capacity - 1);
+        node->chain_next = buckets[pos];
+        buckets[pos] = (int)id;
+    }
+    free(dag->buckets);
+    dag->buckets = buckets;
+    dag->buckets_capacity = capacity;
+    return 0;
+}
+
+/* Helper: The string equality group for a field, created on first use */
+static int dag_get_group(filter_dag_t* dag, const char* field) {
+    for (size_t i = 0; i < dag->groups_count; i++) {
+        if (strcmp(dag->groups[i].field, field) == 0) {
+            return (int)i;
+        }
+    }
+
+    filter_dag_group_t* groups = realloc(dag->groups,
+                                         (dag->groups_count + 1) * sizeof(filter_dag_group_t));
+    if (!groups) {
+        return -1;
+    }
+    dag->groups = groups;
+
+    filter_dag_group_t* group = &groups[dag->groups_count];
+    memset(group, 0, sizeof(*group));
+    group->field = strdup(field);
+    group->buckets = malloc(DAG_GROUP_INITIAL_BUCKETS * sizeof(int));
+    if (!group->field || !group->buckets) {
+        free(group->field);
+        free(group->buckets);
+        return -1;
+    }
+    for (size_t i = 0; i < DAG_GROUP_INITIAL_BUCKETS; i++) {
+        group->buckets[i] = -1;
+    }
+    group->buckets_capacity = DAG_GROUP_INITIAL_BUCKETS;
+    return (int)dag->groups_count++;
+}
+
+/* Helper: Chain a string equality node into its group, growing the
+ * group's table above one node per bucket
+ */
+static int dag_group_insert(filter_dag_t* dag, int group_id, int id) {
+    filter_dag_group_t* group = &dag->groups[group_id];
+    if (group->count + 1 > group->buckets_capacity) {
+        size_t capacity = group->buckets_capacity * 2;
+        int* buckets = malloc(capacity * sizeof(int));
+        if (!buckets) {
+            return -1;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            buckets[i] = -1;
+        }
+        for (size_t b = 0; b < group->buckets_capacity; b++) {
+            int member = group->buckets[b];
+            while (member >= 0) {
+                int next = dag->nodes[member].group_next;
+                size_t pos = (size_t)nblex_hash64_string(dag->nodes[member].expr->value.string_val) &
+                             (capacity - 1);
+                dag->nodes[member].group_next = buckets[pos];
+                buckets[pos] = member;
+                member = next;
+            }
+        }
+        free(group->buckets);
+        group->buckets = buckets;
+        group->buckets_capacity = capacity;
+    }
+
+    filter_dag_node_t* node = &dag->nodes[id];
+    size_t pos = (size_t)nblex_hash64_string(node->expr->value.string_val) &
+                 (group->buckets_capacity - 1);
+    node->group = group_id;
+    node->group_next = group->buckets[pos];
+    group->buckets[pos] = id;
+    group->count++;
+    return 0;
+}
+
+/* Helper: Unlink a node from a chain threaded through one of its fields */
+static void dag_unlink(filter_dag_t* dag, int* head, int id, size_t link_offset) {
+    while (*head >= 0) {
+        int* link = (int*)((char*)&dag->nodes[*head] + link_offset);
+        if (*head == id) {
+            *head = *link;
+            return;
+        }
+        head = link;
+    }
+}
+
+/* Helper: Make room for one more node */
+static int dag_reserve_node(filter_dag_t* dag) {
+    if (dag->free_head >= 0 || dag->nodes_used < dag->nodes_capacity) {
+        return 0;
+    }
+    size_t capacity = dag->nodes_capacity ? dag->nodes_capacity * 2 : DAG_INITIAL_BUCKETS;
+    filter_dag_node_t* nodes = realloc(dag->nodes, capacity * sizeof(filter_dag_node_t));
+    if (!nodes) {
+        return -1;
+    }
+    dag->nodes = nodes;
+    dag->nodes_capacity = capacity;
+    return 0;
+}
+
+/* Helper: Drop a reference to a node, freeing it and releasing its
+ * operands when it was the last
+ */
+static void dag_release(filter_dag_t* dag, int id) {
+    if (id < 0 || dag->nodes[id].refs == 0 || --dag->nodes[id].refs > 0) {
+        return;
+    }
+
+    filter_dag_node_t* node = &dag->nodes[id];
+    dag_unlink(dag, &dag->buckets[(size_t)node->hash & (dag->buckets_capacity - 1)], id,
+               offsetof(filter_dag_node_t, chain_next));
+    if (node->group >= 0) {
+        filter_dag_group_t* group = &dag->groups[node->group];
+        size_t pos = (size_t)nblex_hash64_string(node->expr->value.string_val) &
+                     (group->buckets_capacity - 1);
+        dag_unlink(dag, &group->buckets[pos], id, offsetof(filter_dag_node_t, group_next));
+        group->count--;
+    }
+
+    int left = node->left;
+    int right = node->right;
+    free_filter_expr(node->expr);
+    node->expr = NULL;
+    node->chain_next = dag->free_head;
+    dag->free_head = id;
+    dag->count--;
+
+    dag_release(dag, left);
+    dag_release(dag, right);
+}
+
+/* Helper: Find or add the DAG node for a filter subtree, taking a
+ * reference. Returns its ID, or -1 on error.
+ */
+static int dag_intern(filter_dag_t* dag, const filter_node_t* tree) {
+    int left = -1;
+    int right = -1;
+    const filter_expr_t* expr = NULL;
+
+    switch (tree->type) {
+        case FILTER_NODE_AND:
+        case FILTER_NODE_OR:
+            left = dag_intern(dag, tree->data.binary.left);
+            right = left >= 0 ? dag_intern(dag, tree->data.binary.right) : -1;
+            if (right < 0) {
+                dag_release(dag, left);
+                return -1;
+            }
+            break;
+        case FILTER_NODE_NOT:
+            left = dag_intern(dag, tree->data.unary);
+            if (left < 0) {
+                return -1;
+            }
+            break;
+        case FILTER_NODE_EXPR:
+            expr = tree->data.expr;
+            break;
+    }
+
+    uint64_t hash = dag_node_hash(tree->type, expr, left, right);
+    if (dag->buckets_capacity) {
+        int id = dag->buckets[(size_t)hash & (dag->buckets_capacity - 1)];
+        for (; id >= 0; id = dag->nodes[id].chain_next) {
+            filter_dag_node_t* node = &dag->nodes[id];
+            if (node->hash == hash && node->type == tree->type &&
+                (expr ? filter_expr_equal(node->expr, expr) :
+                        node->left == left && node->right == right)) {
+                /* The existing node already holds its operands */
+                dag_release(dag, left);
+                dag_release(dag, right);
+                node->refs++;
+                return id;
+            }
+        }
+    }
+
+    if ((dag->count + 1 > dag->buckets_capacity && dag_grow_buckets(dag) != 0) ||
+        dag_reserve_node(dag) != 0) {
+        dag_release(dag, left);
+        dag_release(dag, right);
+        return -1;
+    }
+
+    filter_expr_t* copy = NULL;
+    if (expr && !(copy = copy_filter_expr(expr))) {
+        dag_release(dag, left);
+        dag_release(dag, right);
+        return -1;
+    }
+
+    int id;
+    if (dag->free_head >= 0) {
+        id = dag->free_head;
+        dag->free_head = dag->nodes[id].chain_next;
+    } else {
+        id = (int)dag->nodes_used++;
+    }
+
+    filter_dag_node_t* node = &dag->nodes[id];
+    memset(node, 0, sizeof(*node));
+    node->type = tree->type;
+    node->expr = copy;
+    node->left = left;
+    node->right = right;
+    node->hash = hash;
+    node->refs = 1;
+    node->group = -1;
+    size_t pos = (size_t)hash & (dag->buckets_capacity - 1);
+    node->chain_next = dag->buckets[pos];
+    dag->buckets[pos] = id;
+    dag->count++;
+
+    /* Not grouped if the group cannot grow; it is then tested alone */
+    if (copy && expr_is_string_eq(copy)) {
+        int group = dag_get_group(dag, copy->field);
+        if (group >= 0) {
+            dag_group_insert(dag, group, id);
+        }
+    }
+    return id;
+}
+
+/* Helper: The node of a string equality group whose constant equals
+ * the event's value of the field, or -1; looked up once per scope
+ */
+static int dag_group_match(filter_dag_t* dag, int group_id, const json_t* data) {
+    filter_dag_group_t* group = &dag->groups[group_id];
+    if (group->memo_generation == dag->generation) {
+        return group->memo_node;
+    }
+
+    dag->evaluations++;
+    group->memo_node = -1;
+    group->memo_generation = dag->generation;
+
+    json_t* value = json_is_object(data) ? json_object_get(data, group->field) : NULL;
+    if (!json_is_string(value)) {
+        return -1;
+    }
+    const char* str = json_string_value(value);
+    size_t pos = (size_t)nblex_hash64_string(str) & (group->buckets_capacity - 1);
+    for (int id = group->buckets[pos]; id >= 0; id = dag->nodes[id].group_next) {
+        if (strcmp(dag->nodes[id].expr->value.string_val, str) == 0) {
+            group->memo_node = id;
+            break;
+        }
+    }
+    return group->memo_node;
+}
+
+/* Helper: Evaluate a DAG node for the scope's event, memoised */
+static int dag_eval(filter_dag_t* dag, int id, const json_t* data) {
+    filter_dag_node_t* node = &dag->nodes[id];
+    if (node->memo_generation == dag->generation) {
+        return node->memo_value;
+    }
+
+    int value = 0;
+    switch (node->type) {
+        case FILTER_NODE_AND:
+            value = dag_eval(dag, node->left, data) && dag_eval(dag, node->right, data);
+            break;
+        case FILTER_NODE_OR:
+            value = dag_eval(dag, node->left, data) || dag_eval(dag, node->right, data);
+            break;
+        case FILTER_NODE_NOT:
+            value = !dag_eval(dag, node->left, data);
+            break;
+        case FILTER_NODE_EXPR:
+            if (node->group >= 0) {
+                value = dag_group_match(dag, node->group, data) == id;
+            } else {
+                dag->evaluations++;
+                value = evaluate_filter_expr(node->expr, data);
+            }
+            break;
+    }
+
+    node->memo_generation = dag->generation;
+    node->memo_value = value;
+    return value;
+}
+
+filter_dag_t* nblex_filter_dag_new(void) {
+    filter_dag_t* dag = calloc(1, sizeof(filter_dag_t));
+    if (!dag) {
+        return NULL;
+    }
+    dag->free_head = -1;
+    return dag;
+}
+
+void nblex_filter_dag_free(filter_dag_t* dag) {
+    if (!dag) {
+        return;
+    }
+
+    for (size_t id = 0; id < dag->nodes_used; id++) {
+        if (dag->nodes[id].refs > 0) {
+            free_filter_expr(dag->nodes[id].expr);
+        }
+    }
+    for (size_t i = 0; i < dag->groups_count; i++) {
+        free(dag->groups[i].field);
+        free(dag->groups[i].buckets);
+    }
+    free(dag->groups);
+    free(dag->nodes);
+    free(dag->buckets);
+    free(dag);
+}
+
+int nblex_filter_dag_add(filter_dag_t* dag, filter_t* filter) {
+    if (!dag || !filter || !filter->root || filter->dag) {
+        return -1;
+    }
+
+    int id = dag_intern(dag, filter->root);
+    if (id < 0) {
+        return -1;
+    }
+    filter->dag = dag;
+    filter->dag_node = id;
+    return 0;
+}
+
+void nblex_filter_dag_remove(filter_t* filter) {
+    if (!filter || !filter->dag) {
+        return;
+    }
+
+    dag_release(filter->dag, filter->dag_node);
+    filter->dag = NULL;
+    filter->dag_node = -1;
+}
+
+void nblex_filter_dag_begin(filter_dag_t* dag, const nblex_event* event, filter_dag_scope_t* saved) {
+    saved->event = dag->event;
+    saved->generation = dag->generation;
+    dag->event = event;
+    dag->generation = ++dag->last_generation;
+}
+
+void nblex_filter_dag_end(filter_dag_t* dag, const filter_dag_scope_t* saved) {
+    dag->event = saved->event;
+    dag->generation = saved->generation;
+}
+
+size_t nblex_filter_dag_size(const filter_dag_t* dag) {
+    return dag ? dag->count : 0;
+}
+
+uint64_t nblex_filter_dag_evaluations(const filter_dag_t* dag) {
+    return dag ? dag->evaluations : 0;
+}
+
 /* Create filter from expression */
 filter_t* nblex_filter_new(const char* expression) {
     if (!expression) {
@@ -571,6 +1110,7 @@ void nblex_filter_free(filter_t* filter) {
         return;
     }
 
+    nblex_filter_dag_remove(filter);
     free_filter_node(filter->root);
     free(filter);
 }
@@ -586,9 +1126,115 @@ int nblex_filter_matches(const filter_t* filter, const nblex_event* event) {
         return 0;
     }
 
+    /* Within its DAG's scope for this event, shared nodes are memoised */
+    if (filter->dag && filter->dag->event == event) {
+        return dag_eval(filter->dag, filter->dag_node, data);
+    }
+
     return evaluate_filter_node(filter->root, data);
 }
 
+/* Batch evaluation narrows a selection vector one node at a time, so
+ * each predicate runs over the whole batch before the next one. */
+
+/* Helper: Keep the selected events that match one expression */
+static size_t select_filter_expr(const filter_expr_t* expr, nblex_event* const* events,
+                                 uint16_t* sel, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (evaluate_filter_expr(expr, events[sel[i]]->data)) {
+            sel[kept++] = sel[i];
+        }
+    }
+    return kept;
+}
+
+/* Helper: Entries of ascending `a` that are not in ascending `b`. `out`
+ * may be `a`: it is written no faster than it is read. */
+static size_t select_difference(const uint16_t* a, size_t a_count,
+                                const uint16_t* b, size_t b_count, uint16_t* out) {
+    size_t kept = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < a_count; i++) {
+        while (j < b_count && b[j] < a[i]) {
+            j++;
+        }
+        if (j < b_count && b[j] == a[i]) {
+            continue;
+        }
+        out[kept++] = a[i];
+    }
+    return kept;
+}
+
+/* Helper: Narrow a selection to the events matching a node */
+static size_t select_filter_node(const filter_node_t* node, nblex_event* const* events,
+                                 uint16_t* sel, size_t count) {
+    if (!node || count == 0) {
+        return count;
+    }
+
+    switch (node->type) {
+        case FILTER_NODE_AND:
+            count = select_filter_node(node->data.binary.left, events, sel, count);
+            return select_filter_node(node->data.binary.right, events, sel, count);
+
+        case FILTER_NODE_OR: {
+            /* The right side only sees what the left side rejected */
+            uint16_t left[NBLEX_BATCH_SIZE];
+            uint16_t rest[NBLEX_BATCH_SIZE];
+            memcpy(left, sel, count * sizeof(uint16_t));
+            size_t left_count = select_filter_node(node->data.binary.left, events, left, count);
+            size_t rest_count = select_difference(sel, count, left, left_count, rest);
+            rest_count = select_filter_node(node->data.binary.right, events, rest, rest_count);
+
+            size_t i = 0, j = 0, kept = 0;
+            while (i < left_count || j < rest_count) {
+                if (j == rest_count || (i < left_count && left[i] < rest[j])) {
+                    sel[kept++] = left[i++];
+                } else {
+                    sel[kept++] = rest[j++];
+                }
+            }
+            return kept;
+        }
+
+        case FILTER_NODE_NOT: {
+            uint16_t hits[NBLEX_BATCH_SIZE];
+            memcpy(hits, sel, count * sizeof(uint16_t));
+            size_t hits_count = select_filter_node(node->data.unary, events, hits, count);
+            return select_difference(sel, count, hits, hits_count, sel);
+        }
+
+        case FILTER_NODE_EXPR:
+            return select_filter_expr(node->data.expr, events, sel, count);
+
+        default:
+            return 0;
+    }
+}
+
+/* Evaluate filter against a batch of events */
+size_t nblex_filter_select(const filter_t* filter, nblex_event* const* events,
+                           uint16_t* sel, size_t count) {
+    if (!filter || !events || !sel) {
+        return 0;
+    }
+    if (count > NBLEX_BATCH_SIZE) {
+        count = NBLEX_BATCH_SIZE;
+    }
+
+    /* Events without data never match, as in nblex_filter_matches() */
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[sel[i]] && events[sel[i]]->data) {
+            sel[kept++] = sel[i];
+        }
+    }
+
+    return select_filter_node(filter->root, events, sel, kept);
+}
+
 /* Helper to check if a field is network-layer and extract BPF equivalent */
 static int extract_bpf_from_expr(const filter_expr_t* expr, char* bpf_buf, size_t buf_size) {
     if (!expr || !expr->field || !bpf_buf) {
@@ -685,3 +1331,76 @@ char* nblex_filter_to_bpf(const filter_t* filter) {
 
     return NULL;
 }
+
+/* Helper: Append formatted text to a fixed buffer, truncating */
+static void append_text(char* buf, size_t buf_size, const char* text) {
+    size_t len = strlen(buf);
+    if (len + 1 < buf_size) {
+        snprintf(buf + len, buf_size - len, "%s", text);
+    }
+}
+
+/* Helper: Render one filter node as an expression, parenthesising
+ * AND and OR */
+static void format_filter_node(const filter_node_t* node, char* buf, size_t buf_size) {
+    static const char* op_names[] = {
+        "==", "!=", "<", "<=", ">", ">=", "=~", "!~", "in", "contains"
+    };
+    char temp_buf[512];
+
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+        case FILTER_NODE_AND:
+        case FILTER_NODE_OR:
+            append_text(buf, buf_size, "(");
+            format_filter_node(node->data.binary.left, buf, buf_size);
+            append_text(buf, buf_size, node->type == FILTER_NODE_AND ? " AND " : " OR ");
+            format_filter_node(node->data.binary.right, buf, buf_size);
+            append_text(buf, buf_size, ")");
+            break;
+
+        case FILTER_NODE_NOT:
+            append_text(buf, buf_size, "NOT ");
+            format_filter_node(node->data.unary, buf, buf_size);
+            break;
+
+        case FILTER_NODE_EXPR: {
+            const filter_expr_t* expr = node->data.expr;
+            if (expr->value_type == JSON_STRING && expr->value.string_val) {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s \"%s\"", expr->field,
+                         op_names[expr->op], expr->value.string_val);
+            } else if (expr->pattern) {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s %s", expr->field,
+                         op_names[expr->op], expr->pattern);
+            } else if (expr->value_type == JSON_INTEGER) {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s %d", expr->field,
+                         op_names[expr->op], expr->value.int_val);
+            } else if (expr->value_type == JSON_REAL) {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s %g", expr->field,
+                         op_names[expr->op], expr->value.float_val);
+            } else if (expr->value_type == JSON_TRUE || expr->value_type == JSON_FALSE) {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s %s", expr->field,
+                         op_names[expr->op], expr->value.bool_val ? "true" : "false");
+            } else {
+                snprintf(temp_buf, sizeof(temp_buf), "%s %s null", expr->field,
+                         op_names[expr->op]);
+            }
+            append_text(buf, buf_size, temp_buf);
+            break;
+        }
+    }
+}
+
+/* Render a filter as an expression, e.g. for query plans */
+char* nblex_filter_to_string(const filter_t* filter) {
+    if (!filter || !filter->root) {
+        return NULL;
+    }
+
+    char buf[1024] = {0};
+    format_filter_node(filter->root, buf, sizeof(buf));
+    return strdup(buf);
+}
@@ -11,22 +11,54 @@
 #include <stdio.h>
 #include <string.h>
 
-nblex_event* nblex_event_new(nblex_event_type type, nblex_input* input) {
-  nblex_event* event = calloc(1, sizeof(nblex_event));
-  if (!event) {
+nblex_event* nblex_world_event_new(nblex_world* world, nblex_event_type type,
+                                   nblex_input* input) {
+  nblex_event* event;
+  if (world && input && !nblex_world_admit(world, input, type)) {
     return NULL;
   }
+  if (world) {
+    /* The pool outlives its world until the last event is released */
+    if (!world->event_pool) {
+      world->event_pool = nblex_pool_new(sizeof(nblex_event), false);
+      if (!world->event_pool) {
+        return NULL;
+      }
+    }
+    event = nblex_pool_calloc(world->event_pool);
+    if (!event) {
+      return NULL;
+    }
+    event->pool = world->event_pool;
+  } else {
+    event = calloc(1, sizeof(nblex_event));
+    if (!event) {
+      return NULL;
+    }
+  }
 
   event->type = type;
   event->input = input;
   event->timestamp_ns = nblex_timestamp_now();
   event->data = NULL;
+  event->refcount = 1;
 
   return event;
 }
 
-void nblex_event_free(nblex_event* event) {
-  if (!event) {
+nblex_event* nblex_event_new(nblex_event_type type, nblex_input* input) {
+  return nblex_world_event_new(input ? input->world : NULL, type, input);
+}
+
+nblex_event* nblex_event_retain(nblex_event* event) {
+  if (event) {
+    event->refcount++;
+  }
+  return event;
+}
+
+void nblex_event_release(nblex_event* event) {
+  if (!event || --event->refcount > 0) {
     return;
   }
 
@@ -34,7 +66,15 @@ void nblex_event_free(nblex_event* event) {
     json_decref(event->data);
   }
 
-  free(event);
+  if (event->pool) {
+    nblex_pool_free(event->pool, event);
+  } else {
+    free(event);
+  }
+}
+
+void nblex_event_free(nblex_event* event) {
+  nblex_event_release(event);
 }
 
 /* Clone an event. The event struct is duplicated, the JSON data (if any)
@@ -43,11 +83,12 @@ void nblex_event_free(nblex_event* event) {
  */
 nblex_event* nblex_event_clone(nblex_event* src) {
   if (!src) return NULL;
-  nblex_event* dst = calloc(1, sizeof(nblex_event));
+  nblex_event* dst = nblex_world_event_new(NULL, src->type, src->input);
   if (!dst) return NULL;
   dst->type = src->type;
   dst->timestamp_ns = src->timestamp_ns;
   dst->input = src->input;
+  dst->flow = src->flow;
   dst->data = src->data;
   if (dst->data) {
     json_incref(dst->data);
@@ -55,8 +96,13 @@ nblex_event* nblex_event_clone(nblex_event* src) {
   return dst;
 }
 
-void nblex_event_emit(nblex_world* world, nblex_event* event) {
-  if (!world || !event) {
+/* Helper: Deliver an event to the correlation engine and handler */
+static void emit_event(nblex_world* world, nblex_event* event) {
+  /* In event time mode, stamp the event and advance watermarks first:
+   * windows the watermark passes close before the event is handled,
+   * whether or not the input filter keeps it. */
+  if (!nblex_event_time_observe(world, event)) {
+    nblex_event_free(event);
     return;
   }
 
@@ -76,15 +122,32 @@ void nblex_event_emit(nblex_world* world, nblex_event* event) {
     nblex_correlation_process_event(world->correlation, event);
   }
 
-  /* Call event handler if registered */
-  if (world->event_handler) {
+  /* Input events go to the batch handler if there is one, the rest to
+   * the event handler */
+  if (event->input && world->batch_handler) {
+    nblex_world_batch_event(world, event);
+  } else if (world->event_handler) {
     world->event_handler(event, world->event_handler_data);
   }
 
-  /* Free event after handling */
+  /* Release the emitter's reference; buffers may still hold the event */
   nblex_event_free(event);
 }
 
+void nblex_event_emit(nblex_world* world, nblex_event* event) {
+  if (!world || !event) {
+    return;
+  }
+
+  /* Whatever handles the event is not charged to the query emitting it,
+   * nor counted against the emitting subsystem */
+  nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+  nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_OTHER);
+  emit_event(world, event);
+  nblex_mem_tag_leave(previous_tag);
+  nblex_mem_account_leave(previous);
+}
+
 nblex_event_type nblex_event_get_type(nblex_event* event) {
   if (!event) {
     return NBLEX_EVENT_ERROR;
@@ -7,6 +7,7 @@
  */
 
 #include "../nblex_internal.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -78,7 +79,10 @@ void nblex_world_free(nblex_world* world) {
     nblex_world_stop(world);
   }
 
-  /* Stop all inputs explicitly to close their handles */
+  /* Stop all inputs explicitly to close their handles, after a final
+   * checkpoint while they still know their positions */
+  nblex_world_flush_batch(world);
+  nblex_checkpoint_stop(world, world->event_time.watermark_ns);
   if (world->started && world->inputs) {
     for (size_t i = 0; i < world->inputs_count; i++) {
       nblex_input* input = world->inputs[i];
@@ -96,11 +100,26 @@ void nblex_world_free(nblex_world* world) {
     world->correlation = NULL;  /* Clear pointer after freeing */
   }
 
-  /* Ask the executor module to shutdown exec-context timers that reference
-   * this world's loop so their close callbacks can be processed during the
-   * loop drain. The executor has access to the internal exec_contexts list.
+  /* Shut down the world's nQL queries, cancelling their deadlines, then
+   * close the scheduler timer; its close callback runs during the loop
+   * drain below.
    */
-  nblex_exec_contexts_shutdown_world(world);
+  nql_world_shutdown(world);
+  nblex_checkpoint_free(world->checkpoint);
+  world->checkpoint = NULL;
+  nblex_worker_pool_free(world->workers);
+  world->workers = NULL;
+  if (world->scheduler) {
+    nblex_scheduler_free(world->scheduler);
+    world->scheduler = NULL;
+  }
+  nblex_scheduler_free(world->event_time.scheduler);
+  world->event_time.scheduler = NULL;
+  nblex_free(world->event_time.field);
+  if (world->batch_check_init) {
+    uv_close((uv_handle_t*)&world->batch_check, NULL);
+  }
+  free(world->batch);
 
   /* Free inputs */
   if (world->inputs) {
@@ -131,9 +150,20 @@ void nblex_world_free(nblex_world* world) {
     free(world->loop);
   }
 
+  /* Events and entries still held elsewhere keep their pools until
+   * released */
+  nblex_pool_detach(world->event_pool);
+  nblex_pool_detach(world->entry_pool);
+
   free(world);
 }
 
+/* Helper: After each loop iteration's input, hand over what is queued
+ * so that no event waits on later input */
+static void batch_check_cb(uv_check_t* handle) {
+  nblex_world_flush_batch((nblex_world*)handle->data);
+}
+
 int nblex_world_start(nblex_world* world) {
   if (!world || !world->opened) {
     return -1;
@@ -150,6 +180,20 @@ int nblex_world_start(nblex_world* world) {
     }
   }
 
+  /* Restore from a checkpoint before inputs pick their read positions */
+  if (nblex_checkpoint_start(world) != 0) {
+    return -1;
+  }
+
+  /* The check handle does not keep the loop alive on its own */
+  if (!world->batch_check_init) {
+    uv_check_init(world->loop, &world->batch_check);
+    world->batch_check.data = world;
+    uv_unref((uv_handle_t*)&world->batch_check);
+    uv_check_start(&world->batch_check, batch_check_cb);
+    world->batch_check_init = true;
+  }
+
   /* Start all inputs */
   for (size_t i = 0; i < world->inputs_count; i++) {
     nblex_input* input = world->inputs[i];
@@ -169,6 +213,18 @@ int nblex_world_stop(nblex_world* world) {
     return -1;
   }
 
+  /* Queued events run before the last windows close */
+  nblex_world_flush_batch(world);
+
+  /* No more events: in event time mode the last windows close. The
+   * final checkpoint follows, while inputs still know their positions,
+   * so a restart does not emit those windows again; it records the
+   * watermark the events reached, not the end of input, so the events
+   * read after a restart are not all late. */
+  uint64_t watermark_ns = world->event_time.watermark_ns;
+  nblex_event_time_input_done(world, NULL);
+  nblex_checkpoint_stop(world, watermark_ns);
+
   /* Stop all inputs - check if inputs array exists */
   if (world->inputs) {
     for (size_t i = 0; i < world->inputs_count; i++) {
@@ -216,6 +272,74 @@ int nblex_set_event_handler(nblex_world* world,
   return 0;
 }
 
+int nblex_set_batch_handler(nblex_world* world,
+                             nblex_batch_handler handler,
+                             void* user_data) {
+  if (!world) {
+    return -1;
+  }
+
+  /* Events already queued go to the handler they were queued for */
+  nblex_world_flush_batch(world);
+  world->batch_handler = handler;
+  world->batch_handler_data = user_data;
+  return 0;
+}
+
+int nblex_world_set_batch_size(nblex_world* world, size_t batch_size) {
+  if (!world) {
+    return -1;
+  }
+
+  nblex_world_flush_batch(world);
+  nblex_event** batch = NULL;
+  if (batch_size > 1) {
+    batch = malloc(batch_size * sizeof(nblex_event*));
+    if (!batch) {
+      return -1;
+    }
+  }
+  free(world->batch);
+  world->batch = batch;
+  world->batch_size = batch_size > 1 ? batch_size : 0;
+  return 0;
+}
+
+void nblex_world_batch_event(nblex_world* world, nblex_event* event) {
+  if (!world || !event || !world->batch_handler) {
+    return;
+  }
+
+  if (!world->batch || world->batch_flushing) {
+    world->batch_handler(&event, 1, world->batch_handler_data);
+    return;
+  }
+
+  if (world->batch_count == 0 || event->timestamp_ns < world->batch_min_ns) {
+    world->batch_min_ns = event->timestamp_ns;
+  }
+  world->batch[world->batch_count++] = nblex_event_retain(event);
+  if (world->batch_count == world->batch_size) {
+    nblex_world_flush_batch(world);
+  }
+}
+
+void nblex_world_flush_batch(nblex_world* world) {
+  if (!world || world->batch_count == 0 || world->batch_flushing) {
+    return;
+  }
+
+  world->batch_flushing = true;
+  if (world->batch_handler) {
+    world->batch_handler(world->batch, world->batch_count, world->batch_handler_data);
+  }
+  for (size_t i = 0; i < world->batch_count; i++) {
+    nblex_event_release(world->batch[i]);
+  }
+  world->batch_count = 0;
+  world->batch_flushing = false;
+}
+
 int nblex_world_add_input(nblex_world* world, nblex_input* input) {
   if (!world || !input) {
     return -1;
@@ -236,3 +360,192 @@ int nblex_world_add_input(nblex_world* world, nblex_input* input) {
   world->inputs[world->inputs_count++] = input;
   return 0;
 }
+
+int nblex_world_set_memory_limit(nblex_world* world, size_t limit_bytes) {
+  if (!world) {
+    return -1;
+  }
+  /* JSON is counted against a limit only through nblex's allocator */
+  if (limit_bytes) {
+    nblex_json_allocator_init();
+  }
+  world->memory.limit = limit_bytes;
+  return 0;
+}
+
+int nblex_world_set_query_memory_limit(nblex_world* world, size_t limit_bytes,
+                                       nblex_evict_policy policy) {
+  if (!world || (policy != NBLEX_EVICT_EMIT && policy != NBLEX_EVICT_FOLD)) {
+    return -1;
+  }
+  world->query_memory_limit = limit_bytes;
+  world->query_evict_policy = policy;
+  /* Queries prepared later take these from the world */
+  size_t count = world->queries ? nql_registry_capacity(world->queries) : 0;
+  for (size_t id = 0; id < count; id++) {
+    nql_prepared_t* prepared = nql_registry_get(world->queries, (int)id);
+    if (prepared) {
+      nql_prepared_set_memory_limit(prepared, limit_bytes, (nql_evict_policy_t)policy);
+    }
+  }
+  return 0;
+}
+
+/* Helper: Bytes held by the world's events. Counted, that is the live
+ * JSON of the process plus the event structs allocated and not yet
+ * released; estimated, the buffered events. Either way buffered events
+ * are included, so the larger of the two is taken. Free structs kept
+ * by the event pool for reuse are not counted. */
+static size_t world_event_bytes(nblex_world* world, size_t* buffered) {
+  nblex_pool_stats_t stats;
+  nblex_pool_get_stats(world->event_pool, &stats);
+  size_t counted = nblex_json_live_bytes() + stats.live * stats.object_size;
+  *buffered = world->correlation ? world->correlation->buffered_bytes : 0;
+  return counted > *buffered ? counted : *buffered;
+}
+
+size_t nblex_world_get_memory_usage(nblex_world* world) {
+  if (!world) {
+    return 0;
+  }
+  size_t used = atomic_load_explicit(&world->memory.used, memory_order_relaxed);
+  size_t buffered;
+  return used + world_event_bytes(world, &buffered);
+}
+
+/* Helper: Does another input of the world have a higher priority? */
+static bool input_sheddable(nblex_world* world, const nblex_input* input) {
+  for (size_t i = 0; i < world->inputs_count; i++) {
+    if (world->inputs[i] && world->inputs[i]->priority > input->priority) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool nblex_world_admit(nblex_world* world, nblex_input* input, nblex_event_type type) {
+  size_t limit = world->memory.limit;
+  if (!limit) {
+    return true;
+  }
+
+  /* The steps only free correlation buffers and hold back events, so
+   * they get what query state leaves of the limit; queries evict their
+   * own state. */
+  size_t used = atomic_load_explicit(&world->memory.used, memory_order_relaxed);
+  size_t budget = used < limit ? limit - used : 0;
+  size_t low_water = budget / 4 * 3;
+  size_t buffered;
+  size_t events = world_event_bytes(world, &buffered);
+
+  if (events && events >= budget) {
+    if (buffered) {
+      nblex_correlation_shrink(world->correlation, events - low_water);
+    }
+    if (world->degrade_level == NBLEX_DEGRADE_NONE) {
+      world->degrade_level = NBLEX_DEGRADE_SHRINK;
+      world->degrade_since_ns = nblex_timestamp_now();
+    } else {
+      world->degrade_pressed = true;
+    }
+  }
+
+  /* Only a degraded world reads the clock */
+  uint64_t now = world->degrade_level != NBLEX_DEGRADE_NONE ? nblex_timestamp_now() : 0;
+  if (world->degrade_level != NBLEX_DEGRADE_NONE &&
+      now - world->degrade_since_ns >= NBLEX_DEGRADE_INTERVAL_NS) {
+    /* A step is judged over a whole interval: another step up if the
+     * buffers still reached the limit, one down if they did not. With
+     * no budget left, sampling and shedding could not help. */
+    if (world->degrade_pressed && budget && world->degrade_level < NBLEX_DEGRADE_SHED) {
+      world->degrade_level++;
+    } else if (!world->degrade_pressed) {
+      world->degrade_level--;
+    }
+    world->degrade_since_ns = now;
+    world->degrade_pressed = false;
+  }
+
+  if (world->degrade_level >= NBLEX_DEGRADE_SHED && input_sheddable(world, input)) {
+    world->input_shed++;
+    return false;
+  }
+  if (world->degrade_level >= NBLEX_DEGRADE_SAMPLE && type == NBLEX_EVENT_NETWORK &&
+      world->network_seen++ % NBLEX_NETWORK_SAMPLE != 0) {
+    world->network_sampled++;
+    return false;
+  }
+  return true;
+}
+
+int nblex_world_set_buffer_limit(nblex_world* world, size_t limit_bytes) {
+  if (!world) {
+    return -1;
+  }
+  world->buffer_limit = limit_bytes;
+  return 0;
+}
+
+size_t nblex_world_get_buffer_usage(nblex_world* world) {
+  if (!world || !world->correlation) {
+    return 0;
+  }
+  return world->correlation->buffered_bytes;
+}
+
+uint64_t nblex_world_get_drops(nblex_world* world, nblex_drop_reason reason) {
+  if (!world) {
+    return 0;
+  }
+  switch (reason) {
+  case NBLEX_DROP_BUFFER_FULL:
+    return world->correlation ? world->correlation->buffer_dropped : 0;
+  case NBLEX_DROP_BUFFER_SHRUNK:
+    return world->correlation ? world->correlation->buffer_shrunk : 0;
+  case NBLEX_DROP_NETWORK_SAMPLED:
+    return world->network_sampled;
+  case NBLEX_DROP_INPUT_SHED:
+    return world->input_shed;
+  default:
+    return 0;
+  }
+}
+
+int nblex_world_set_worker_threads(nblex_world* world, size_t threads) {
+  if (!world) {
+    return -1;
+  }
+  /* A pool of the old size is replaced on next use */
+  if (world->workers && nblex_worker_pool_size(world->workers) != threads) {
+    nblex_worker_pool_free(world->workers);
+    world->workers = NULL;
+  }
+  world->worker_threads = threads;
+  return 0;
+}
+
+nblex_worker_pool_t* nblex_world_workers(nblex_world* world) {
+  if (!world || world->worker_threads <= 1) {
+    return NULL;
+  }
+  if (!world->workers) {
+    world->workers = nblex_worker_pool_new(world->worker_threads);
+    if (!world->workers) {
+      /* Run on the loop thread rather than retry on every batch */
+      fprintf(stderr, "Warning: Failed to start %zu worker threads\n", world->worker_threads);
+      world->worker_threads = 1;
+    }
+  }
+  return world->workers;
+}
+
+nblex_pool_t* nblex_world_entry_pool(nblex_world* world) {
+  if (!world) {
+    return NULL;
+  }
+  if (!world->entry_pool) {
+    /* Entries are charged like the nblex_malloc() blocks they replace */
+    world->entry_pool = nblex_pool_new(sizeof(nblex_event_buffer_entry), true);
+  }
+  return world->entry_pool;
+}
@@ -8,17 +8,30 @@
 
 #include "../nblex_internal.h"
 #include "../parsers/nql_parser.h"
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <math.h>
 
-/* Safety limits */
-#define MAX_SLIDING_WINDOWS 1000
+/* Join slot sizing for keyed correlation */
+#define JOIN_SLOT_INITIAL_CAPACITY 4
+
+/* Batches with fewer bucket updates than this are applied on the
+ * calling thread; handing them to workers costs more than it saves */
+#define PARALLEL_MIN_UPDATES 64
+
+/* Per-function state for percentile() and distinct(), which need more
+ * than the shared count/sum/min/max */
+typedef union {
+    quantile_sketch_t* sketch;  /* percentile() */
+    hll_t* hll;                 /* distinct() */
+} nql_func_state_t;
 
 /* Aggregation bucket for group-by */
 typedef struct nql_agg_bucket_s {
-    char** group_keys;          /* Group key values */
-    size_t group_keys_count;
+    int key_id;                 /* Interned group key tuple (holds a reference) */
     
     /* Aggregation state */
     uint64_t count;
@@ -26,121 +39,335 @@ typedef struct nql_agg_bucket_s {
     double min;
     double max;
     double sum_squares;         /* For stddev */
-    size_t distinct_count;
-    json_t* distinct_values;    /* JSON array for distinct tracking */
     
-    /* Percentile tracking (simplified: store values, compute on flush) */
-    json_t* percentile_values;  /* JSON array of numeric values */
+    /* Indexed like the state's funcs; allocated on first use */
+    nql_func_state_t* func_states;
+    size_t func_states_count;
     
     uint64_t window_start_ns;   /* Window start timestamp */
     uint64_t window_end_ns;     /* Window end timestamp */
     uint64_t last_event_ns;     /* Last event time for session windows */
 
+    uint64_t hash;              /* Hash of (group key, window key) */
+    bool indexed;               /* Present in the bucket index */
+    bool closed;                /* Result emitted, kept for late updates */
+
+    /* Window close (session: expiry) in the world scheduler */
+    nblex_deadline_t deadline;
+
+    struct nql_agg_bucket_s* prev;
     struct nql_agg_bucket_s* next;
+    struct nql_agg_bucket_s* pane_next;  /* Sliding: group's next pane by time */
 } nql_agg_bucket_t;
 
+/* Sliding windows are evaluated over panes: each event updates the one
+ * bucket (pane) of width pane_ns that holds it, and a window's result is
+ * merged from its panes when it closes. A group tracks its open panes
+ * and the close of the next window to emit.
+ */
+typedef struct nql_slide_group_s {
+    int key_id;                 /* Holds a reference */
+    nblex_deadline_t deadline;  /* Close of the next window to emit */
+    nql_agg_bucket_t* panes;    /* Open panes, by start time */
+    nql_agg_bucket_t* panes_tail;
+    uint64_t emitted_end_ns;    /* End of the last window emitted, 0 if none */
+} nql_slide_group_t;
+
+/* A top stage ranks each closing window's results in a bounded heap
+ * with the weakest entry at the root, so a window of any number of
+ * groups holds at most `limit` results. Rank keys are normalised so
+ * that smaller is stronger; ties keep the earlier result.
+ */
+typedef struct {
+    double key;
+    uint64_t seq;
+    nblex_event* result;
+} nql_top_entry_t;
+
+/* Results of one closing window awaiting ranking. Every group of a
+ * window closes in the same scheduler run; the flush deadline is
+ * scheduled from that run, so it fires after all of them. */
+typedef struct nql_top_window_s {
+    uint64_t end_ns;
+    nql_top_entry_t* heap;
+    size_t count;
+    size_t capacity;
+    uint64_t next_seq;
+    nblex_deadline_t flush;
+    struct nql_top_window_s* next;
+} nql_top_window_t;
+
 /* Aggregation execution state */
 typedef struct nql_agg_state_s {
+    nblex_world* world;
+    nql_prepared_t* prepared;       /* Owner, charged for this state */
+    nblex_scheduler_t* scheduler;   /* Window deadlines (event time or wall clock) */
+    bool event_time;                /* Windows close on the world watermark */
+
     /* Window configuration (extracted from query) */
     nql_window_t window;
     
-    /* Aggregation functions (copied from query) */
+    /* Aggregation functions (borrowed from the prepared query's AST) */
     nql_agg_func_t* funcs;
     size_t funcs_count;
     
-    /* Group by fields (copied from query) */
+    /* Group by fields (borrowed from the prepared query's AST) */
     char** group_by_fields;
     size_t group_by_count;
     
-    nql_agg_bucket_t* buckets;  /* Linked list of buckets */
+    /* Group key tuples, plus per-event scratch so that looking up a
+     * known group does not allocate */
+    nql_interner_t* keys;
+    nql_key_part_t* key_parts;  /* group_by_count entries */
+    char (*key_numbers)[64];    /* Formatted numeric key values */
+    nql_agg_bucket_t** event_buckets;
+    size_t event_buckets_capacity;
+    
+    /* Doubly linked list of buckets, most recently updated first */
+    nql_agg_bucket_t* buckets;
+    nql_agg_bucket_t* buckets_tail;
     size_t bucket_count;
     
-    /* Window management */
-    uv_timer_t* window_timer;   /* Timer for window expiration */
-    uint64_t last_flush_ns;     /* Last window flush time */
-    bool timer_active;
+    /* Group that evicted buckets are folded into, -1 until first used */
+    int other_key_id;
+    
+    /* Index of buckets by hash of group key and window key */
+    nblex_index_t index;
+    
+    /* Sliding windows: geometry and per-group pane lists by key ID */
+    uint64_t size_ns;
+    uint64_t slide_ns;
+    uint64_t pane_ns;           /* gcd(size, slide) */
+    nql_slide_group_t** slide_groups;
+    size_t slide_groups_capacity;
+    
+    /* Ranking of closed windows by the next pipeline stage, if a top,
+     * order by or limit stage (borrowed from the prepared query's AST) */
+    const nql_top_t* top;
+    nql_top_window_t* top_windows;
 } nql_agg_state_t;
 
+/* Join slot of a keyed correlation: the buffered events of one side
+ * sharing a join key and a time slot as wide as the window */
+typedef struct nql_join_slot_s {
+    uint64_t hash;              /* Hash of (join key, slot) */
+    uint64_t slot;              /* Event time divided by the slot width */
+    char* key;
+    size_t key_length;
+    
+    /* Borrowed from the side's buffer, in arrival order */
+    nblex_event_buffer_entry** entries;
+    size_t entries_count;
+    size_t entries_capacity;
+    
+    struct nql_join_slot_s* prev;
+    struct nql_join_slot_s* next;
+} nql_join_slot_t;
+
+/* One side's join index: slots by hash of (join key, slot), plus a
+ * list of every slot for expiry */
+typedef struct {
+    nblex_index_t index;
+    nql_join_slot_t* slots;
+} nql_join_index_t;
+
 /* Correlation execution state */
 typedef struct nql_corr_state_s {
-    /* Store only the numeric window config from the parsed query.
-     * We do not keep a pointer to the parsed nql_query_t because the
-     * caller frees that after execution; storing only the value needed
-     * prevents use-after-free.
-     */
+    nblex_world* world;
+    nql_prepared_t* prepared;
+    nblex_scheduler_t* scheduler;
     uint32_t within_ms;
     
-    /* Event buffers */
+    /* Event buffers, their entries from the world's pool */
+    nblex_pool_t* entries;
     nblex_event_buffer_entry* left_events;
     nblex_event_buffer_entry* right_events;
     size_t left_count;
     size_t right_count;
     
-    /* Cleanup timer */
-    uv_timer_t* cleanup_timer;
-    bool timer_active;
+    /* Join indices over the buffers when correlating on a key (borrowed
+     * from the prepared query's AST); NULL for a time-only correlation.
+     * Keyed buffers expire a whole slot at a time. */
+    const char* on_field;
+    uint64_t slot_ns;
+    nql_join_index_t left_index;
+    nql_join_index_t right_index;
+    
+    /* Expiry of the oldest buffered event in the world scheduler */
+    nblex_deadline_t expiry;
 } nql_corr_state_t;
 
-/* Query execution context */
+/* Per-stage execution context. A plain query has one stage; a pipeline
+ * has one per stage. The stage AST is owned by the prepared query.
+ */
 typedef struct nql_exec_ctx_s {
-    nblex_world* world;
-    /* We do NOT retain a pointer to the parsed nql_query_t here because
-     * the caller frees that after nql_execute returns; storing a raw
-     * pointer caused use-after-free when shutdown logic read ctx->query.
-     * Instead store the query type and (optionally) a cached query string
-     * for matching when creating contexts.
-     */
-    nql_query_type_t query_type;
-    char* query_string;  /* Cache query string for matching */
+    nql_prepared_t* prepared;
+    nql_query_t* query;
     
     union {
         nql_agg_state_t* agg_state;
         nql_corr_state_t* corr_state;
     } state;
     
-    struct nql_exec_ctx_s* next;
+    nql_stage_stats_t stats;    /* Collected under explain analyze */
 } nql_exec_ctx_t;
 
-/* Global execution contexts (per world) */
-static nql_exec_ctx_t* exec_contexts = NULL;
+/* Prepared query: parsed once, executed against many events */
+struct nql_prepared_s {
+    nblex_world* world;         /* NULL once the world has been freed */
+    int id;                     /* Query ID in world->queries, -1 if none */
+    bool world_owned;           /* Freed by the world (nql_execute/nql_register) */
+    char* query_string;
+    nql_query_t* query;         /* Owned AST, filters already compiled */
+    
+    nql_exec_ctx_t* stages;
+    size_t stages_count;
+    bool analyze;               /* Collect per-stage counters */
+    
+    /* Executor state is charged here, and to the world's account */
+    nblex_mem_account_t memory;
+    nql_evict_policy_t evict_policy;
+    uint64_t buckets_evicted;
+    uint64_t buckets_folded;
+    uint64_t buckets_dropped;
+};
+
+/* Forward declarations */
+static int execute_filter(nql_query_t* query, nblex_event* event);
+static int execute_correlate(nql_exec_ctx_t* ctx, nblex_event* event);
+static int execute_show(nql_query_t* query, nblex_event* event);
+static int execute_aggregate(nql_exec_ctx_t* ctx, nblex_event* event);
+static int execute_stage(nql_exec_ctx_t* ctx, nblex_event* event);
+static void free_agg_state(nql_agg_state_t* agg_state);
+static void free_corr_state(nql_corr_state_t* corr_state);
 
-/* Called by world teardown to stop and close any timers owned by exec
- * contexts that reference the given world's loop. This schedules close
- * callbacks on the loop; the world free code is responsible for running
- * the loop to process those callbacks and then freeing the context memory.
+/* Helper: Take a prepared query's window and expiry deadlines out of
+ * the world scheduler, so it can outlive the world.
  */
-void nblex_exec_contexts_shutdown_world(nblex_world* world) {
-    nql_exec_ctx_t* ctx = exec_contexts;
-    while (ctx) {
-        if (ctx->world == world) {
-            /* Only inspect the union member that corresponds to the
-             * query type recorded on this context. Accessing the inactive
-             * union member is undefined and may read garbage; use the
-             * stored query type to decide which timer (if any) to stop.
-             */
-            if (ctx->query_type == NQL_QUERY_CORRELATE) {
-                if (ctx->state.corr_state && ctx->state.corr_state->timer_active && ctx->state.corr_state->cleanup_timer) {
-                    uv_timer_stop(ctx->state.corr_state->cleanup_timer);
-                    uv_close((uv_handle_t*)ctx->state.corr_state->cleanup_timer, NULL);
-                }
-            } else if (ctx->query_type == NQL_QUERY_AGGREGATE) {
-                if (ctx->state.agg_state && ctx->state.agg_state->timer_active && ctx->state.agg_state->window_timer) {
-                    uv_timer_stop(ctx->state.agg_state->window_timer);
-                    uv_close((uv_handle_t*)ctx->state.agg_state->window_timer, NULL);
+static void cancel_prepared_deadlines(nql_prepared_t* prepared) {
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        if (!ctx->query) {
+            continue;
+        }
+        if (ctx->query->type == NQL_QUERY_CORRELATE && ctx->state.corr_state) {
+            nblex_deadline_cancel(&ctx->state.corr_state->expiry);
+        } else if (ctx->query->type == NQL_QUERY_AGGREGATE && ctx->state.agg_state) {
+            nql_agg_state_t* agg_state = ctx->state.agg_state;
+            for (nql_agg_bucket_t* bucket = agg_state->buckets; bucket; bucket = bucket->next) {
+                nblex_deadline_cancel(&bucket->deadline);
+            }
+            for (size_t g = 0; g < agg_state->slide_groups_capacity; g++) {
+                if (agg_state->slide_groups[g]) {
+                    nblex_deadline_cancel(&agg_state->slide_groups[g]->deadline);
                 }
             }
+            for (nql_top_window_t* window = agg_state->top_windows; window; window = window->next) {
+                nblex_deadline_cancel(&window->flush);
+            }
         }
-        ctx = ctx->next;
     }
 }
 
-/* Forward declarations */
-static int execute_filter(nql_query_t* query, nblex_event* event);
-static int execute_correlate(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str);
-static int execute_show(nql_query_t* query, nblex_event* event);
-static int execute_aggregate(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str);
-static int execute_pipeline(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str);
-static int execute_query(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str);
+/* Helper: Free a prepared query and all of its execution state */
+static void free_prepared(nql_prepared_t* prepared) {
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&prepared->memory);
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        if (!ctx->query) {
+            continue;
+        }
+        if (ctx->query->type == NQL_QUERY_AGGREGATE) {
+            free_agg_state(ctx->state.agg_state);
+        } else if (ctx->query->type == NQL_QUERY_CORRELATE) {
+            free_corr_state(ctx->state.corr_state);
+        }
+    }
+    nblex_mem_account_leave(previous);
+    
+    nblex_free(prepared->stages);
+    nql_free(prepared->query);
+    nblex_free(prepared->query_string);
+    nblex_free(prepared);
+}
+
+/* Helper: The compiled filters of one stage; returns how many (at most 2) */
+static size_t stage_filters(nql_query_t* query, filter_t** filters) {
+    size_t count = 0;
+    switch (query->type) {
+        case NQL_QUERY_FILTER:
+            filters[count++] = query->data.filter;
+            break;
+        case NQL_QUERY_CORRELATE:
+            filters[count++] = query->data.correlate->left_filter;
+            filters[count++] = query->data.correlate->right_filter;
+            break;
+        case NQL_QUERY_AGGREGATE:
+            filters[count++] = query->data.aggregate->where_filter;
+            break;
+        case NQL_QUERY_SHOW:
+            filters[count++] = query->data.show->where_filter;
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+/* Helper: Add or remove a prepared query's filters in the world's
+ * shared predicate DAG. A filter that cannot be added is evaluated on
+ * its own.
+ */
+static void share_prepared_filters(nql_prepared_t* prepared, filter_dag_t* dag) {
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        filter_t* filters[2];
+        size_t count = stage_filters(prepared->stages[i].query, filters);
+        for (size_t f = 0; f < count; f++) {
+            if (!filters[f]) {
+                continue;
+            }
+            if (dag) {
+                nblex_filter_dag_add(dag, filters[f]);
+            } else {
+                nblex_filter_dag_remove(filters[f]);
+            }
+        }
+    }
+}
+
+/* Called by world teardown, before the world scheduler is freed, to
+ * cancel the deadlines of prepared queries bound to the world.
+ * World-owned queries are freed here; caller-owned handles are detached
+ * from the world and must still be released with nql_prepared_free().
+ */
+void nql_world_shutdown(nblex_world* world) {
+    if (!world || !world->queries) {
+        return;
+    }
+    
+    size_t limit = nql_registry_capacity(world->queries);
+    for (size_t id = 0; id < limit; id++) {
+        nql_prepared_t* prepared = nql_registry_get(world->queries, (int)id);
+        if (!prepared) {
+            continue;
+        }
+        
+        cancel_prepared_deadlines(prepared);
+        share_prepared_filters(prepared, NULL);
+        prepared->world = NULL;
+        prepared->id = -1;
+        prepared->memory.parent = NULL;
+        
+        if (prepared->world_owned) {
+            free_prepared(prepared);
+        }
+    }
+    
+    nql_registry_free(world->queries);
+    world->queries = NULL;
+    nblex_filter_dag_free(world->filter_dag);
+    world->filter_dag = NULL;
+}
 
 /* Helper: Get JSON value by dot-notation path */
 static json_t* json_get_path(json_t* obj, const char* path) {
@@ -160,8 +387,10 @@ static json_t* json_get_path(json_t* obj, const char* path) {
         return json_object_get(obj, path);
     }
     
+    /* Field path components are short; use the heap only for long ones */
     size_t prefix_len = dot - path;
-    char* prefix = malloc(prefix_len + 1);
+    char buffer[128];
+    char* prefix = prefix_len < sizeof(buffer) ? buffer : nblex_malloc(prefix_len + 1);
     if (!prefix) {
         return NULL;
     }
@@ -169,7 +398,9 @@ static json_t* json_get_path(json_t* obj, const char* path) {
     prefix[prefix_len] = '\0';
     
     json_t* nested = json_object_get(obj, prefix);
-    free(prefix);
+    if (prefix != buffer) {
+        nblex_free(prefix);
+    }
     
     if (!nested || !json_is_object(nested)) {
         return NULL;
@@ -178,96 +409,43 @@ static json_t* json_get_path(json_t* obj, const char* path) {
     return json_get_path(nested, dot + 1);
 }
 
-/* Helper: Extract group key values from event
+/* Helper: Intern the event's group key tuple
  *
- * Ownership:
- * - The returned char** (array of strings) is heap-allocated and the
- *   caller takes ownership of the pointer and its contents. The caller
- *   must eventually free the returned array via `free_group_keys()` when
- *   it is no longer needed. If the function returns NULL, no ownership
- *   transfer occurs.
+ * Values are rendered as strings: strings as they are, integers with
+ * %lld, reals with %.6f, anything else (or a missing field) as "null".
+ * String values are referenced in place, so a known tuple is found
+ * without allocating. Returns a key ID holding a reference the caller
+ * must release, or -1.
  */
-static char** extract_group_keys(nql_agg_state_t* agg_state, nblex_event* event, size_t* count_out) {
-    if (!agg_state || !event || !event->data) {
-        *count_out = 0;
-        return NULL;
-    }
-    
-    if (agg_state->group_by_count == 0 || !agg_state->group_by_fields) {
-        *count_out = 0;
-        return NULL;
-    }
-    
-    char** keys = calloc(agg_state->group_by_count, sizeof(char*));
-    if (!keys) {
-        *count_out = 0;
-        return NULL;
-    }
-    
+static int intern_group_key(nql_agg_state_t* agg_state, nblex_event* event) {
     for (size_t i = 0; i < agg_state->group_by_count; i++) {
-        if (!agg_state->group_by_fields[i]) {
-            keys[i] = strdup("null");
-            continue;
+        nql_key_part_t* part = &agg_state->key_parts[i];
+        json_t* value = NULL;
+        if (agg_state->group_by_fields[i] && event->data) {
+            value = json_get_path(event->data, agg_state->group_by_fields[i]);
         }
-        json_t* value = json_get_path(event->data, agg_state->group_by_fields[i]);
-        if (value) {
-            if (json_is_string(value)) {
-                keys[i] = strdup(json_string_value(value));
-            } else if (json_is_integer(value)) {
-                char buf[64];
-                snprintf(buf, sizeof(buf), "%lld", (long long)json_integer_value(value));
-                keys[i] = strdup(buf);
-            } else if (json_is_real(value)) {
-                char buf[64];
-                snprintf(buf, sizeof(buf), "%.6f", json_real_value(value));
-                keys[i] = strdup(buf);
+        
+        if (value && json_is_string(value)) {
+            part->data = json_string_value(value);
+            part->length = json_string_length(value);
+        } else if (value && (json_is_integer(value) || json_is_real(value))) {
+            char* buf = agg_state->key_numbers[i];
+            if (json_is_integer(value)) {
+                snprintf(buf, sizeof(agg_state->key_numbers[i]), "%lld",
+                         (long long)json_integer_value(value));
             } else {
-                keys[i] = strdup("null");
+                snprintf(buf, sizeof(agg_state->key_numbers[i]), "%.6f",
+                         json_real_value(value));
             }
+            part->data = buf;
+            part->length = strlen(buf);
         } else {
-            keys[i] = strdup("null");
+            part->data = "null";
+            part->length = 4;
         }
     }
     
-    *count_out = agg_state->group_by_count;
-    return keys;
-}
-
-/* Helper: Compare group keys */
-static int compare_group_keys(char** keys1, char** keys2, size_t count) {
-    /* Both NULL or both empty means same (no group by) */
-    if (count == 0) {
-        return 0;
-    }
-    
-    if (!keys1 || !keys2) {
-        return keys1 ? 1 : (keys2 ? -1 : 0);
-    }
-    
-    for (size_t i = 0; i < count; i++) {
-        int cmp = strcmp(keys1[i], keys2[i]);
-        if (cmp != 0) {
-            return cmp;
-        }
-    }
-    return 0;
-}
-
-/* Helper: Free group keys
- *
- * This frees the array returned by `extract_group_keys()` and all
- * of the duplicated strings inside it. It is the canonical pair for
- * `extract_group_keys()` and should be used to release ownership of
- * the returned char** when no longer needed.
- */
-static void free_group_keys(char** keys, size_t count) {
-    if (!keys) {
-        return;
-    }
-    for (size_t i = 0; i < count; i++) {
-        free(keys[i]);
-    }
-    free(keys);
+    return nql_interner_intern(agg_state->keys, agg_state->key_parts);
 }
 
 /* Helper: Get numeric value from field */
@@ -290,7 +468,7 @@ static double get_numeric_value(json_t* obj, const char* field) {
 static nblex_event* create_agg_result_event(nql_agg_bucket_t* bucket,
                                             nql_agg_state_t* agg_state,
                                             nblex_world* world) {
-    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, NULL);
+    nblex_event* event = nblex_world_event_new(world, NBLEX_EVENT_LOG, NULL);
     if (!event) {
         return NULL;
     }
@@ -304,11 +482,11 @@ static nblex_event* create_agg_result_event(nql_agg_bucket_t* bucket,
     json_object_set_new(result, "nql_result_type", json_string("aggregation"));
     
     /* Add group keys */
-    if (bucket->group_keys_count > 0 && agg_state->group_by_count > 0 && agg_state->group_by_fields) {
+    if (agg_state->group_by_count > 0 && agg_state->group_by_fields) {
         json_t* groups = json_object();
-        for (size_t i = 0; i < bucket->group_keys_count && i < agg_state->group_by_count; i++) {
+        for (size_t i = 0; i < agg_state->group_by_count; i++) {
             json_object_set_new(groups, agg_state->group_by_fields[i],
-                               json_string(bucket->group_keys[i]));
+                               json_string(nql_interner_part(agg_state->keys, bucket->key_id, i)));
         }
         json_object_set_new(result, "group", groups);
     }
@@ -360,33 +538,12 @@ static nblex_event* create_agg_result_event(nql_agg_bucket_t* bucket,
                 break;
                 
             case NQL_AGG_PERCENTILE:
-                if (func->field && bucket->percentile_values &&
-                    json_array_size(bucket->percentile_values) > 0) {
-                    /* Simple percentile: sort and pick */
-                    size_t size = json_array_size(bucket->percentile_values);
-                    double* values = malloc(size * sizeof(double));
-                    if (values) {
-                        for (size_t j = 0; j < size; j++) {
-                            json_t* v = json_array_get(bucket->percentile_values, j);
-                            values[j] = json_is_number(v) ? json_number_value(v) : 0.0;
-                        }
-                        /* Simple sort */
-                        for (size_t j = 0; j < size - 1; j++) {
-                            for (size_t k = j + 1; k < size; k++) {
-                                if (values[j] > values[k]) {
-                                    double tmp = values[j];
-                                    values[j] = values[k];
-                                    values[k] = tmp;
-                                }
-                            }
-                        }
-                        size_t idx = (size_t)((func->percentile / 100.0) * size);
-                        if (idx >= size) idx = size - 1;
-                        snprintf(name, sizeof(name), "p%.0f_%s", func->percentile, func->field);
-                        func_name = name;
-                        value = json_real(values[idx]);
-                        free(values);
-                    }
+                if (func->field && bucket->func_states && bucket->func_states[i].sketch &&
+                    nblex_quantile_sketch_count(bucket->func_states[i].sketch) > 0) {
+                    snprintf(name, sizeof(name), "p%.0f_%s", func->percentile, func->field);
+                    func_name = name;
+                    value = json_real(nblex_quantile_sketch_quantile(bucket->func_states[i].sketch,
+                                                                     func->percentile / 100.0));
                 }
                 break;
                 
@@ -394,7 +551,8 @@ static nblex_event* create_agg_result_event(nql_agg_bucket_t* bucket,
                 if (func->field) {
                     snprintf(name, sizeof(name), "distinct_%s", func->field);
                     func_name = name;
-                    value = json_integer(bucket->distinct_count);
+                    value = json_integer(bucket->func_states ?
+                                         (json_int_t)nblex_hll_estimate(bucket->func_states[i].hll) : 0);
                 }
                 break;
             }
@@ -419,574 +577,881 @@ static nblex_event* create_agg_result_event(nql_agg_bucket_t* bucket,
     return event;
 }
 
+/* Helper: Per-function state of a bucket, allocating the array on first use */
+static nql_func_state_t* get_func_state(nql_agg_state_t* agg_state,
+                                        nql_agg_bucket_t* bucket,
+                                        size_t func_index) {
+    if (!bucket->func_states) {
+        bucket->func_states = nblex_calloc(agg_state->funcs_count, sizeof(nql_func_state_t));
+        if (!bucket->func_states) {
+            return NULL;
+        }
+        bucket->func_states_count = agg_state->funcs_count;
+    }
+    return &bucket->func_states[func_index];
+}
+
+/* Helper: Free a bucket's per-function states */
+static void free_func_states(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    if (bucket->func_states) {
+        for (size_t i = 0; i < bucket->func_states_count && i < agg_state->funcs_count; i++) {
+            if (agg_state->funcs[i].type == NQL_AGG_PERCENTILE) {
+                nblex_quantile_sketch_free(bucket->func_states[i].sketch);
+            } else if (agg_state->funcs[i].type == NQL_AGG_DISTINCT) {
+                nblex_hll_free(bucket->func_states[i].hll);
+            }
+        }
+        nblex_free(bucket->func_states);
+        bucket->func_states = NULL;
+    }
+}
+
 /* Helper: Free bucket resources */
-static void free_bucket_resources(nql_agg_bucket_t* bucket) {
+static void free_bucket_resources(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
     if (!bucket) {
         return;
     }
     
-    if (bucket->group_keys) {
-        free_group_keys(bucket->group_keys, bucket->group_keys_count);
-        bucket->group_keys = NULL;
+    nblex_deadline_cancel(&bucket->deadline);
+    if (bucket->key_id >= 0) {
+        nql_interner_release(agg_state->keys, bucket->key_id);
+        bucket->key_id = -1;
+    }
+    free_func_states(agg_state, bucket);
+}
+
+/* Helper: Fold one bucket's partial aggregates into another */
+static int merge_bucket(nql_agg_state_t* agg_state, nql_agg_bucket_t* dst,
+                        const nql_agg_bucket_t* src) {
+    dst->count += src->count;
+    dst->sum += src->sum;
+    dst->sum_squares += src->sum_squares;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+    
+    if (!src->func_states) {
+        return 0;
+    }
+    for (size_t i = 0; i < agg_state->funcs_count; i++) {
+        nql_agg_func_t* func = &agg_state->funcs[i];
+        const nql_func_state_t* from = &src->func_states[i];
+        if ((func->type == NQL_AGG_PERCENTILE && !from->sketch) ||
+            (func->type == NQL_AGG_DISTINCT && !from->hll) ||
+            (func->type != NQL_AGG_PERCENTILE && func->type != NQL_AGG_DISTINCT)) {
+            continue;
+        }
+        
+        nql_func_state_t* to = get_func_state(agg_state, dst, i);
+        if (!to) {
+            return -1;
+        }
+        if (func->type == NQL_AGG_PERCENTILE) {
+            if (!to->sketch) {
+                to->sketch = nblex_quantile_sketch_new(func->accuracy);
+            }
+            if (nblex_quantile_sketch_merge(to->sketch, from->sketch) != 0) {
+                return -1;
+            }
+        } else {
+            if (!to->hll) {
+                to->hll = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+            }
+            if (nblex_hll_merge(to->hll, from->hll) != 0) {
+                return -1;
+            }
+        }
     }
-    if (bucket->distinct_values) {
-        json_decref(bucket->distinct_values);
-        bucket->distinct_values = NULL;
+    return 0;
+}
+
+/* Helper: Window component of a bucket's index key. Session buckets are
+ * keyed by group alone: only the group's open session is indexed.
+ */
+static uint64_t bucket_window_key(const nql_agg_state_t* agg_state, uint64_t window_start_ns) {
+    return agg_state->window.type == NQL_WINDOW_SESSION ? 0 : window_start_ns;
+}
+
+/* Helper: Hash an interned group key together with a window key */
+static uint64_t bucket_key_hash(nql_agg_state_t* agg_state, int key_id, uint64_t window_key) {
+    return nblex_hash64_combine(nql_interner_hash(agg_state->keys, key_id), window_key);
+}
+
+/* Helper: Look up an indexed bucket by group key and window key */
+static nql_agg_bucket_t* bucket_index_find(nql_agg_state_t* agg_state,
+                                           int key_id,
+                                           uint64_t window_key) {
+    uint64_t hash = bucket_key_hash(agg_state, key_id, window_key);
+    size_t pos = (size_t)hash;
+    
+    nblex_index_bucket_t* entry;
+    while ((entry = nblex_index_next(&agg_state->index, hash, &pos)) != NULL) {
+        nql_agg_bucket_t* bucket = (nql_agg_bucket_t*)entry->value;
+        if (bucket->key_id == key_id &&
+            bucket_window_key(agg_state, bucket->window_start_ns) == window_key) {
+            return bucket;
+        }
     }
-    if (bucket->percentile_values) {
-        json_decref(bucket->percentile_values);
-        bucket->percentile_values = NULL;
+    return NULL;
+}
+
+/* Helper: Insert a bucket into the index */
+static int bucket_index_insert(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    if (nblex_index_insert(&agg_state->index, bucket->hash, (uintptr_t)bucket) != 0) {
+        return -1;
     }
+    bucket->indexed = true;
+    return 0;
 }
 
-/* Helper: Remove bucket from list */
-static void remove_bucket_from_list(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket_to_remove) {
-    if (!agg_state || !bucket_to_remove) {
+/* Helper: Remove a bucket from the index */
+static void bucket_index_remove(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    if (!bucket->indexed) {
         return;
     }
-    
-    nql_agg_bucket_t** prev_ptr = &agg_state->buckets;
-    nql_agg_bucket_t* current = agg_state->buckets;
-    
-    while (current) {
-        if (current == bucket_to_remove) {
-            *prev_ptr = current->next;
-            free_bucket_resources(current);
-            free(current);
-            agg_state->bucket_count--;
-            return;
+    nblex_index_remove(&agg_state->index, bucket->hash, (uintptr_t)bucket);
+    bucket->indexed = false;
+}
+
+/* Helper: Unlink a bucket from the state and free it */
+static void remove_bucket(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    if (bucket->prev) {
+        bucket->prev->next = bucket->next;
+    } else {
+        agg_state->buckets = bucket->next;
+    }
+    if (bucket->next) {
+        bucket->next->prev = bucket->prev;
+    } else {
+        agg_state->buckets_tail = bucket->prev;
+    }
+    bucket_index_remove(agg_state, bucket);
+    free_bucket_resources(agg_state, bucket);
+    nblex_free(bucket);
+    agg_state->bucket_count--;
+}
+
+/* Helper: When a windowed bucket closes: its window end, or for a
+ * session window the timeout after its last event
+ */
+static uint64_t bucket_close_ns(const nql_agg_state_t* agg_state, const nql_agg_bucket_t* bucket) {
+    if (agg_state->window.type == NQL_WINDOW_SESSION) {
+        return bucket->last_event_ns + agg_state->window.timeout_ms * 1000000ULL;
+    }
+    return bucket->window_end_ns;
+}
+
+/* Helper: Does a window type keep closed windows for late updates? */
+static bool keeps_closed_windows(const nql_agg_state_t* agg_state) {
+    return agg_state->event_time && agg_state->window.type == NQL_WINDOW_TUMBLING &&
+           agg_state->world->event_time.late_policy == NBLEX_LATE_UPDATE &&
+           agg_state->world->event_time.allowed_lateness_ns > 0;
+}
+
+/* Helper: Value of an aggregation function over a bucket, as emitted in
+ * its result; NAN if there is none
+ */
+static double bucket_func_value(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket,
+                                size_t func_index) {
+    const nql_agg_func_t* func = &agg_state->funcs[func_index];
+    nql_func_state_t* state = bucket->func_states ? &bucket->func_states[func_index] : NULL;
+    
+    switch (func->type) {
+    case NQL_AGG_COUNT:
+        return (double)bucket->count;
+    case NQL_AGG_SUM:
+        return bucket->sum;
+    case NQL_AGG_AVG:
+        return bucket->count > 0 ? bucket->sum / bucket->count : 0.0;
+    case NQL_AGG_MIN:
+        return bucket->min;
+    case NQL_AGG_MAX:
+        return bucket->max;
+    case NQL_AGG_PERCENTILE:
+        return state ? nblex_quantile_sketch_quantile(state->sketch, func->percentile / 100.0) : NAN;
+    case NQL_AGG_DISTINCT:
+        return state ? (double)nblex_hll_estimate(state->hll) : 0.0;
+    }
+    return NAN;
+}
+
+/* Helper: Is a ranking entry weaker than another? */
+static bool top_entry_weaker(const nql_top_entry_t* a, const nql_top_entry_t* b) {
+    return a->key > b->key || (a->key == b->key && a->seq > b->seq);
+}
+
+static void top_heap_sift_up(nql_top_entry_t* heap, size_t pos) {
+    nql_top_entry_t entry = heap[pos];
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!top_entry_weaker(&entry, &heap[parent])) {
+            break;
         }
-        prev_ptr = &current->next;
-        current = current->next;
+        heap[pos] = heap[parent];
+        pos = parent;
     }
+    heap[pos] = entry;
 }
 
-/* Window flush callback */
-static void window_flush_cb(uv_timer_t* handle) {
-    nql_agg_state_t* agg_state = (nql_agg_state_t*)handle->data;
-    if (!agg_state) {
-        return;
+static void top_heap_sift_down(nql_top_entry_t* heap, size_t count, size_t pos) {
+    nql_top_entry_t entry = heap[pos];
+    for (;;) {
+        size_t child = pos * 2 + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && top_entry_weaker(&heap[child + 1], &heap[child])) {
+            child++;
+        }
+        if (!top_entry_weaker(&heap[child], &entry)) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
     }
-    
-    nblex_world* world = NULL;
-    
-    /* Find world from context */
-    nql_exec_ctx_t* ctx = exec_contexts;
-    while (ctx) {
-        if (ctx->state.agg_state == agg_state) {
-            world = ctx->world;
+    heap[pos] = entry;
+}
+
+/* Helper: qsort order, strongest first */
+static int compare_top_entries(const void* a, const void* b) {
+    const nql_top_entry_t* ea = (const nql_top_entry_t*)a;
+    const nql_top_entry_t* eb = (const nql_top_entry_t*)b;
+    if (top_entry_weaker(ea, eb)) {
+        return 1;
+    }
+    return top_entry_weaker(eb, ea) ? -1 : 0;
+}
+
+/* Helper: Free a window ranking and any results still in it */
+static void free_top_window(nql_top_window_t* window) {
+    nblex_deadline_cancel(&window->flush);
+    for (size_t i = 0; i < window->count; i++) {
+        nblex_event_free(window->heap[i].result);
+    }
+    nblex_free(window->heap);
+    nblex_free(window);
+}
+
+/* Helper: Emit a window's winners in rank order */
+static void flush_top_window(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nql_top_window_t* window =
+        (nql_top_window_t*)((char*)deadline - offsetof(nql_top_window_t, flush));
+    nblex_world* world = agg_state->world;
+    (void)now_ns;
+    
+    for (nql_top_window_t** link = &agg_state->top_windows; *link; link = &(*link)->next) {
+        if (*link == window) {
+            *link = window->next;
             break;
         }
-        ctx = ctx->next;
     }
     
-    if (!world) {
-        return;
+    /* Detached first: emitting may run the query again */
+    qsort(window->heap, window->count, sizeof(nql_top_entry_t), compare_top_entries);
+    for (size_t i = 0; i < window->count; i++) {
+        nblex_event* result = window->heap[i].result;
+        window->heap[i].result = NULL;
+        json_object_set_new(result->data, "rank", json_integer((json_int_t)i + 1));
+        nblex_event_emit(world, result);
     }
-    
-    uint64_t now = nblex_timestamp_now();
-    uint64_t window_size_ns = agg_state->window.size_ms * 1000000ULL;
+    free_top_window(window);
+}
 
-    /* Process all buckets */
-    nql_agg_bucket_t* bucket = agg_state->buckets;
-    nql_agg_bucket_t* next_bucket = NULL;
-    
-    while (bucket) {
-        next_bucket = bucket->next; /* Save next before potential removal */
-        bool should_flush = false;
-        bool should_remove = false;
-
-        if (agg_state->window.type == NQL_WINDOW_SESSION) {
-            /* Session window: flush if timeout since last event */
-            uint64_t timeout_ns = agg_state->window.timeout_ms * 1000000ULL;
-            if (bucket->count > 0 && (now - bucket->last_event_ns) >= timeout_ns) {
-                should_flush = true;
-                should_remove = true; /* Remove after flush */
-            }
-        } else if (agg_state->window.type == NQL_WINDOW_TUMBLING) {
-            /* Tumbling window: flush if window end reached, then reset for next window */
-            if (bucket->window_end_ns <= now) {
-                if (bucket->count > 0) {
-                    should_flush = true;
-                }
-                /* Reset for next window */
-                bucket->count = 0;
-                bucket->sum = 0.0;
-                bucket->min = INFINITY;
-                bucket->max = -INFINITY;
-                bucket->sum_squares = 0.0;
-                bucket->distinct_count = 0;
-                if (bucket->distinct_values) {
-                    json_decref(bucket->distinct_values);
-                    bucket->distinct_values = json_array();
-                }
-                if (bucket->percentile_values) {
-                    json_decref(bucket->percentile_values);
-                    bucket->percentile_values = json_array();
-                }
-                /* Calculate next window start */
-                uint64_t windows_passed = (now - bucket->window_start_ns) / window_size_ns;
-                bucket->window_start_ns = bucket->window_start_ns + (windows_passed * window_size_ns);
-                bucket->window_end_ns = bucket->window_start_ns + window_size_ns;
-            }
-        } else if (agg_state->window.type == NQL_WINDOW_SLIDING) {
-            /* Sliding window: flush if window end reached, then remove */
-            if (bucket->window_end_ns <= now) {
-                if (bucket->count > 0) {
-                    should_flush = true;
-                }
-                should_remove = true; /* Remove expired sliding window */
-            }
-        }
+/* Top flush callback, charged to the query like its execution */
+static void top_flush_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&agg_state->prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    flush_top_window(deadline, now_ns);
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+}
 
-        if (should_flush) {
-            nblex_event* result_event = create_agg_result_event(bucket, agg_state, world);
-            if (result_event) {
-                nblex_event_emit(world, result_event);
-            }
-        }
-        
-        if (should_remove) {
-            remove_bucket_from_list(agg_state, bucket);
+/* Helper: The ranking of the window ending at end_ns, created on first use */
+static nql_top_window_t* get_top_window(nql_agg_state_t* agg_state, uint64_t end_ns) {
+    for (nql_top_window_t* window = agg_state->top_windows; window; window = window->next) {
+        if (window->end_ns == end_ns) {
+            return window;
         }
-        
-        bucket = next_bucket;
     }
     
-    agg_state->last_flush_ns = now;
+    nql_top_window_t* window = nblex_calloc(1, sizeof(nql_top_window_t));
+    if (!window) {
+        return NULL;
+    }
+    window->end_ns = end_ns;
+    nblex_deadline_init(&window->flush, top_flush_cb, agg_state);
+    if (nblex_deadline_schedule(agg_state->scheduler, &window->flush, end_ns) != 0) {
+        nblex_free(window);
+        return NULL;
+    }
+    window->next = agg_state->top_windows;
+    agg_state->top_windows = window;
+    return window;
 }
 
-/* Helper: Copy aggregation configuration from query to state */
-static int copy_agg_config(nql_agg_state_t* agg_state, nql_aggregate_t* agg) {
-    if (!agg_state || !agg) {
+/* Helper: Offer a closed window's result for one group to the top
+ * stage. Its result event is only built if it ranks among the winners
+ * so far. Returns -1 if it cannot be ranked.
+ */
+static int top_offer(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    const nql_top_t* top = agg_state->top;
+    nql_top_window_t* window = get_top_window(agg_state, bucket->window_end_ns);
+    if (!window) {
         return -1;
     }
     
-    /* Copy window configuration */
-    agg_state->window = agg->window;
+    nql_top_entry_t entry = {0.0, window->next_seq++, NULL};
+    if (top->ordered) {
+        double value = bucket_func_value(agg_state, bucket, (size_t)top->func_index);
+        entry.key = isnan(value) ? INFINITY : (top->descending ? -value : value);
+    }
     
-    /* Copy aggregation functions */
-    agg_state->funcs_count = agg->funcs_count;
-    if (agg->funcs_count > 0 && agg->funcs) {
-        agg_state->funcs = calloc(agg->funcs_count, sizeof(nql_agg_func_t));
-        if (!agg_state->funcs) {
-            return -1;
-        }
-        for (size_t i = 0; i < agg->funcs_count; i++) {
-            agg_state->funcs[i] = agg->funcs[i];
-            agg_state->funcs[i].field = NULL; /* Initialize to NULL */
-            /* Copy field string if present */
-            if (agg->funcs[i].field) {
-                agg_state->funcs[i].field = strdup(agg->funcs[i].field);
-                if (!agg_state->funcs[i].field) {
-                    /* Free already copied fields */
-                    for (size_t j = 0; j < i; j++) {
-                        free(agg_state->funcs[j].field);
-                    }
-                    free(agg_state->funcs);
-                    agg_state->funcs = NULL;
-                    return -1;
-                }
-            }
+    bool full = top->limit && window->count == top->limit;
+    if (full && !top_entry_weaker(&window->heap[0], &entry)) {
+        return 0;
+    }
+    
+    if (!full && window->count == window->capacity) {
+        size_t capacity = window->capacity ? window->capacity * 2 : 16;
+        if (top->limit && capacity > top->limit) {
+            capacity = top->limit;
         }
-    } else {
-        agg_state->funcs = NULL;
-        agg_state->funcs_count = 0;
-    }
-    
-    /* Copy group by fields */
-    agg_state->group_by_count = agg->group_by_count;
-    if (agg->group_by_count > 0 && agg->group_by_fields) {
-        agg_state->group_by_fields = calloc(agg->group_by_count, sizeof(char*));
-        if (!agg_state->group_by_fields) {
-            /* Free funcs */
-            if (agg_state->funcs) {
-                for (size_t i = 0; i < agg_state->funcs_count; i++) {
-                    free(agg_state->funcs[i].field);
-                }
-                free(agg_state->funcs);
-            }
+        nql_top_entry_t* heap = nblex_realloc(window->heap, capacity * sizeof(nql_top_entry_t));
+        if (!heap) {
             return -1;
         }
-        for (size_t i = 0; i < agg->group_by_count; i++) {
-            if (agg->group_by_fields[i]) {
-                agg_state->group_by_fields[i] = strdup(agg->group_by_fields[i]);
-            } else {
-                agg_state->group_by_fields[i] = NULL;
-            }
-            if (agg->group_by_fields[i] && !agg_state->group_by_fields[i]) {
-                /* strdup failed */
-                /* Free already copied fields */
-                for (size_t j = 0; j < i; j++) {
-                    free(agg_state->group_by_fields[j]);
-                }
-                free(agg_state->group_by_fields);
-                /* Free funcs */
-                if (agg_state->funcs) {
-                    for (size_t j = 0; j < agg_state->funcs_count; j++) {
-                        free(agg_state->funcs[j].field);
-                    }
-                    free(agg_state->funcs);
-                }
-                return -1;
-            }
-        }
-    } else {
-        agg_state->group_by_fields = NULL;
-        agg_state->group_by_count = 0;
+        window->heap = heap;
+        window->capacity = capacity;
     }
     
-    /* Note: where_filter is checked before getting state, so we don't need to store it */
+    entry.result = create_agg_result_event(bucket, agg_state, agg_state->world);
+    if (!entry.result) {
+        return -1;
+    }
     
+    if (full) {
+        nblex_event_free(window->heap[0].result);
+        window->heap[0] = entry;
+        top_heap_sift_down(window->heap, window->count, 0);
+    } else {
+        window->heap[window->count++] = entry;
+        top_heap_sift_up(window->heap, window->count - 1);
+    }
     return 0;
 }
 
-/* Helper: Free aggregation state resources */
-/* NOTE: free_agg_state_resources was removed — resource cleanup is handled
- * by the context teardown code that knows ownership of the state. The
- * previous implementation was unused and caused a compiler warning.
+/* Helper: Flush and remove one bucket whose deadline is
+ * due. Session deadlines are not moved on every event, so a session
+ * that has seen events since is rescheduled instead. Under the late
+ * update policy a closed tumbling window stays for the allowed lateness
+ * and is removed when its second deadline fires.
  */
-
-/* Get or create aggregation state */
-static nql_agg_state_t* get_agg_state(nql_query_t* query, nblex_world* world, const char* query_str) {
-    if (!query || query->type != NQL_QUERY_AGGREGATE || !world) {
-        return NULL;
+static void close_bucket(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nql_agg_bucket_t* bucket =
+        (nql_agg_bucket_t*)((char*)deadline - offsetof(nql_agg_bucket_t, deadline));
+    nblex_world* world = agg_state->world;
+    
+    if (bucket->closed) {
+        remove_bucket(agg_state, bucket);
+        return;
     }
     
-    nql_aggregate_t* agg = query->data.aggregate;
-    if (!agg) {
-        return NULL;
+    uint64_t close_ns = bucket_close_ns(agg_state, bucket);
+    if (close_ns > now_ns &&
+        nblex_deadline_schedule(agg_state->scheduler, deadline, close_ns) == 0) {
+        return;
+    }
+    
+    /* Under a top stage the result goes to the window's ranking */
+    nblex_event* result_event = NULL;
+    if (bucket->count > 0 && agg_state->top) {
+        top_offer(agg_state, bucket);
+    } else if (bucket->count > 0) {
+        result_event = create_agg_result_event(bucket, agg_state, world);
     }
     
-    /* Check existing contexts by query string */
-    if (query_str) {
-        nql_exec_ctx_t* ctx = exec_contexts;
-        while (ctx) {
-            if (ctx->query_string && strcmp(ctx->query_string, query_str) == 0 &&
-                ctx->world == world && ctx->state.agg_state) {
-                /* State already exists, return it */
-                return ctx->state.agg_state;
+    if (keeps_closed_windows(agg_state)) {
+        bucket->closed = true;
+        if (nblex_deadline_schedule(agg_state->scheduler, deadline,
+                                    close_ns + world->event_time.allowed_lateness_ns) == 0) {
+            if (result_event) {
+                nblex_event_emit(world, result_event);
             }
-            ctx = ctx->next;
+            return;
         }
     }
     
-    /* Create new context and state */
-    nql_exec_ctx_t* new_ctx = calloc(1, sizeof(nql_exec_ctx_t));
-    if (!new_ctx) {
+    /* Remove before emitting: emitting may run the query again, and a
+     * later event for the group opens a new bucket. */
+    remove_bucket(agg_state, bucket);
+    
+    if (result_event) {
+        nblex_event_emit(world, result_event);
+    }
+}
+
+/* Window close callback */
+static void bucket_deadline_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&agg_state->prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    close_bucket(deadline, now_ns);
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+}
+
+/* Helper: End of the first sliding window that contains a time */
+static uint64_t slide_first_window_end(const nql_agg_state_t* agg_state, uint64_t ts) {
+    uint64_t k = ts < agg_state->size_ns ? 0 : (ts - agg_state->size_ns) / agg_state->slide_ns + 1;
+    return k * agg_state->slide_ns + agg_state->size_ns;
+}
+
+/* Helper: End of the last sliding window that contains a time, or 0 if
+ * the time falls in a gap between windows (slide > size)
+ */
+static uint64_t slide_last_window_end(const nql_agg_state_t* agg_state, uint64_t ts) {
+    uint64_t end = (ts / agg_state->slide_ns) * agg_state->slide_ns + agg_state->size_ns;
+    return end > ts ? end : 0;
+}
+
+/* Helper: Free a sliding group that has no panes left */
+static void free_slide_group(nql_agg_state_t* agg_state, nql_slide_group_t* group) {
+    nblex_deadline_cancel(&group->deadline);
+    agg_state->slide_groups[group->key_id] = NULL;
+    nql_interner_release(agg_state->keys, group->key_id);
+    nblex_free(group);
+}
+
+/* Helper: Schedule a sliding group's next window close, unless an
+ * earlier one is already pending
+ */
+static int slide_group_schedule(nql_agg_state_t* agg_state, nql_slide_group_t* group,
+                                uint64_t end_ns) {
+    if (group->emitted_end_ns && end_ns <= group->emitted_end_ns) {
+        end_ns = group->emitted_end_ns + agg_state->slide_ns;
+    }
+    if (nblex_deadline_pending(&group->deadline) && group->deadline.when_ns <= end_ns) {
+        return 0;
+    }
+    return nblex_deadline_schedule(agg_state->scheduler, &group->deadline, end_ns);
+}
+
+/* Helper: Close a sliding window: merge the group's panes that fall in
+ * the closing window into one result, drop panes no later window
+ * covers, and schedule the next window that has any.
+ */
+static void close_slide_window(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nql_slide_group_t* group =
+        (nql_slide_group_t*)((char*)deadline - offsetof(nql_slide_group_t, deadline));
+    nblex_world* world = agg_state->world;
+    uint64_t end_ns = deadline->when_ns;
+    uint64_t start_ns = end_ns - agg_state->size_ns;
+    (void)now_ns;
+    
+    nql_agg_bucket_t window;
+    memset(&window, 0, sizeof(window));
+    window.key_id = group->key_id;
+    window.min = INFINITY;
+    window.max = -INFINITY;
+    window.window_start_ns = start_ns;
+    window.window_end_ns = end_ns;
+    
+    nblex_event* result_event = NULL;
+    bool merged = true;
+    for (nql_agg_bucket_t* pane = group->panes; pane && pane->window_start_ns < end_ns;
+         pane = pane->pane_next) {
+        if (pane->window_start_ns >= start_ns && merge_bucket(agg_state, &window, pane) != 0) {
+            merged = false;
+            break;
+        }
+    }
+    if (merged && window.count > 0 && agg_state->top) {
+        top_offer(agg_state, &window);
+    } else if (merged && window.count > 0) {
+        result_event = create_agg_result_event(&window, agg_state, world);
+    }
+    free_func_states(agg_state, &window);
+    group->emitted_end_ns = end_ns;
+    
+    /* Panes before the next window's start are no longer needed */
+    uint64_t next_start_ns = start_ns + agg_state->slide_ns;
+    while (group->panes && group->panes->window_start_ns < next_start_ns) {
+        nql_agg_bucket_t* pane = group->panes;
+        group->panes = pane->pane_next;
+        remove_bucket(agg_state, pane);
+    }
+    
+    if (!group->panes) {
+        group->panes_tail = NULL;
+        free_slide_group(agg_state, group);
+    } else {
+        uint64_t next_end_ns = slide_first_window_end(agg_state, group->panes->window_start_ns);
+        if (slide_group_schedule(agg_state, group, next_end_ns) != 0) {
+            /* Cannot schedule: drop the panes rather than hold them forever */
+            while (group->panes) {
+                nql_agg_bucket_t* pane = group->panes;
+                group->panes = pane->pane_next;
+                remove_bucket(agg_state, pane);
+            }
+            group->panes_tail = NULL;
+            free_slide_group(agg_state, group);
+        }
+    }
+    
+    if (result_event) {
+        nblex_event_emit(world, result_event);
+    }
+}
+
+/* Sliding window close callback */
+static void slide_group_deadline_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_agg_state_t* agg_state = (nql_agg_state_t*)deadline->data;
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&agg_state->prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    close_slide_window(deadline, now_ns);
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+}
+
+/* Helper: The sliding group for a key, created on first use */
+static nql_slide_group_t* get_slide_group(nql_agg_state_t* agg_state, int key_id) {
+    if ((size_t)key_id >= agg_state->slide_groups_capacity) {
+        size_t capacity = agg_state->slide_groups_capacity ? agg_state->slide_groups_capacity : 16;
+        while (capacity <= (size_t)key_id) {
+            capacity *= 2;
+        }
+        nql_slide_group_t** groups = nblex_realloc(agg_state->slide_groups,
+                                                   capacity * sizeof(nql_slide_group_t*));
+        if (!groups) {
+            return NULL;
+        }
+        memset(groups + agg_state->slide_groups_capacity, 0,
+               (capacity - agg_state->slide_groups_capacity) * sizeof(nql_slide_group_t*));
+        agg_state->slide_groups = groups;
+        agg_state->slide_groups_capacity = capacity;
+    }
+    
+    nql_slide_group_t* group = agg_state->slide_groups[key_id];
+    if (group) {
+        return group;
+    }
+    
+    group = nblex_calloc(1, sizeof(nql_slide_group_t));
+    if (!group) {
         return NULL;
     }
+    group->key_id = key_id;
+    nql_interner_retain(agg_state->keys, key_id);
+    nblex_deadline_init(&group->deadline, slide_group_deadline_cb, agg_state);
+    agg_state->slide_groups[key_id] = group;
+    return group;
+}
+
+/* Helper: Insert a pane into its group's list, keeping time order */
+static void slide_group_add_pane(nql_slide_group_t* group, nql_agg_bucket_t* pane) {
+    if (!group->panes_tail || group->panes_tail->window_start_ns < pane->window_start_ns) {
+        if (group->panes_tail) {
+            group->panes_tail->pane_next = pane;
+        } else {
+            group->panes = pane;
+        }
+        group->panes_tail = pane;
+        return;
+    }
     
-    nql_agg_state_t* agg_state = calloc(1, sizeof(nql_agg_state_t));
+    /* Out-of-order event: the new pane precedes the tail */
+    nql_agg_bucket_t** link = &group->panes;
+    while ((*link)->window_start_ns < pane->window_start_ns) {
+        link = &(*link)->pane_next;
+    }
+    pane->pane_next = *link;
+    *link = pane;
+}
+
+/* Helper: Free aggregation state and all of its buckets */
+static void free_agg_state(nql_agg_state_t* agg_state) {
     if (!agg_state) {
-        free(new_ctx);
+        return;
+    }
+    
+    for (size_t i = 0; i < agg_state->slide_groups_capacity; i++) {
+        if (agg_state->slide_groups[i]) {
+            free_slide_group(agg_state, agg_state->slide_groups[i]);
+        }
+    }
+    nblex_free(agg_state->slide_groups);
+    
+    while (agg_state->top_windows) {
+        nql_top_window_t* window = agg_state->top_windows;
+        agg_state->top_windows = window->next;
+        free_top_window(window);
+    }
+    
+    nql_agg_bucket_t* bucket = agg_state->buckets;
+    while (bucket) {
+        nql_agg_bucket_t* next = bucket->next;
+        free_bucket_resources(agg_state, bucket);
+        nblex_free(bucket);
+        bucket = next;
+    }
+    nblex_index_free(&agg_state->index);
+    nblex_free(agg_state->event_buckets);
+    nblex_free(agg_state->key_parts);
+    nblex_free(agg_state->key_numbers);
+    if (agg_state->other_key_id >= 0) {
+        nql_interner_release(agg_state->keys, agg_state->other_key_id);
+    }
+    nql_interner_free(agg_state->keys);
+    nblex_free(agg_state);
+}
+
+/* Get or create aggregation state for a stage */
+static nql_agg_state_t* get_agg_state(nql_exec_ctx_t* ctx) {
+    nblex_world* world = ctx->prepared->world;
+    if (!world) {
         return NULL;
     }
     
-    agg_state->buckets = NULL;
-    agg_state->bucket_count = 0;
-    agg_state->timer_active = false;
+    if (ctx->state.agg_state) {
+        return ctx->state.agg_state;
+    }
     
-    /* Copy aggregation configuration from query */
-    if (copy_agg_config(agg_state, agg) != 0) {
-        free(agg_state);
-        free(new_ctx);
+    nql_aggregate_t* agg = ctx->query->data.aggregate;
+    nql_agg_state_t* agg_state = nblex_calloc(1, sizeof(nql_agg_state_t));
+    if (!agg_state) {
         return NULL;
     }
     
-    /* Initialize window timer if needed (will be done lazily if world not started yet) */
-    if (agg_state->window.type != NQL_WINDOW_NONE && world->loop && world->started) {
-        /* Initialize timer immediately if world is already started */
-        if (!agg_state->window_timer) {
-            agg_state->window_timer = calloc(1, sizeof(uv_timer_t));
-            if (agg_state->window_timer) {
-                uv_timer_init(world->loop, agg_state->window_timer);
-                agg_state->window_timer->data = agg_state;
-
-                uint64_t interval_ms;
-                if (agg_state->window.type == NQL_WINDOW_SESSION) {
-                    /* Session window: check frequently for timeout */
-                    interval_ms = agg_state->window.timeout_ms / 2;
-                    if (interval_ms < 100) interval_ms = 100;
-                } else {
-                    /* Tumbling/sliding window */
-                    interval_ms = agg_state->window.slide_ms > 0 ?
-                                  agg_state->window.slide_ms : agg_state->window.size_ms;
-                }
-
-                uv_timer_start(agg_state->window_timer, window_flush_cb,
-                              interval_ms, interval_ms);
-                agg_state->timer_active = true;
-            }
+    agg_state->world = world;
+    agg_state->prepared = ctx->prepared;
+    agg_state->scheduler = nblex_world_window_scheduler(world);
+    agg_state->event_time = world->event_time.enabled;
+    agg_state->window = agg->window;
+    agg_state->funcs = agg->funcs;
+    agg_state->funcs_count = agg->funcs ? agg->funcs_count : 0;
+    agg_state->group_by_fields = agg->group_by_fields;
+    agg_state->group_by_count = agg->group_by_fields ? agg->group_by_count : 0;
+    agg_state->buckets = NULL;
+    agg_state->bucket_count = 0;
+    agg_state->other_key_id = -1;
+    
+    /* The parser only accepts a top stage right after a windowed aggregate */
+    size_t stage = (size_t)(ctx - ctx->prepared->stages);
+    if (stage + 1 < ctx->prepared->stages_count &&
+        ctx->prepared->stages[stage + 1].query->type == NQL_QUERY_TOP) {
+        agg_state->top = ctx->prepared->stages[stage + 1].query->data.top;
+    }
+    
+    if (agg_state->window.type == NQL_WINDOW_SLIDING) {
+        agg_state->size_ns = agg_state->window.size_ms * 1000000ULL;
+        agg_state->slide_ns = agg_state->window.slide_ms > 0 ?
+                              agg_state->window.slide_ms * 1000000ULL : agg_state->size_ns;
+        /* Pane boundaries must include every window start and end */
+        uint64_t a = agg_state->size_ns;
+        uint64_t b = agg_state->slide_ns;
+        while (b != 0) {
+            uint64_t t = a % b;
+            a = b;
+            b = t;
         }
+        agg_state->pane_ns = a;
     }
     
-    new_ctx->world = world;
-    new_ctx->query_type = query->type;
-    new_ctx->query_string = query_str ? strdup(query_str) : NULL;
-    new_ctx->state.agg_state = agg_state;
-    new_ctx->next = exec_contexts;
-    exec_contexts = new_ctx;
+    agg_state->keys = nql_interner_new(agg_state->group_by_count);
+    if (agg_state->group_by_count > 0) {
+        agg_state->key_parts = nblex_calloc(agg_state->group_by_count, sizeof(nql_key_part_t));
+        agg_state->key_numbers = nblex_calloc(agg_state->group_by_count, sizeof(*agg_state->key_numbers));
+    }
+    if (!agg_state->keys ||
+        (agg_state->group_by_count > 0 && (!agg_state->key_parts || !agg_state->key_numbers))) {
+        free_agg_state(agg_state);
+        return NULL;
+    }
     
+    ctx->state.agg_state = agg_state;
     return agg_state;
 }
 
-/* Helper: Find bucket by group keys and window start */
+/* Helper: Find bucket by group key and window start */
 static nql_agg_bucket_t* find_bucket_by_window(nql_agg_state_t* agg_state,
-                                               char** group_keys,
-                                               size_t group_keys_count,
+                                               int key_id,
                                                uint64_t window_start_ns) {
-    nql_agg_bucket_t* bucket = agg_state->buckets;
-    while (bucket) {
-        if (compare_group_keys(bucket->group_keys, group_keys, group_keys_count) == 0 &&
-            bucket->window_start_ns == window_start_ns) {
-            return bucket;
-        }
-        bucket = bucket->next;
-    }
-    return NULL;
+    return bucket_index_find(agg_state, key_id, bucket_window_key(agg_state, window_start_ns));
 }
 
-/* Helper: Create a new bucket with specified window */
+/* Helper: Create a new bucket with specified window and index it */
 static nql_agg_bucket_t* create_bucket_with_window(nql_agg_state_t* agg_state,
-                                                    char** group_keys,
-                                                    size_t group_keys_count,
+                                                    int key_id,
                                                     uint64_t window_start_ns,
                                                     uint64_t window_end_ns) {
-    nql_agg_bucket_t* bucket = calloc(1, sizeof(nql_agg_bucket_t));
+    nql_agg_bucket_t* bucket = nblex_calloc(1, sizeof(nql_agg_bucket_t));
     if (!bucket) {
         return NULL;
     }
     
-    bucket->group_keys = group_keys;
-    bucket->group_keys_count = group_keys_count;
+    bucket->hash = bucket_key_hash(agg_state, key_id, bucket_window_key(agg_state, window_start_ns));
+    if (bucket_index_insert(agg_state, bucket) != 0) {
+        nblex_free(bucket);
+        return NULL;
+    }
+    
+    bucket->key_id = key_id;
+    nql_interner_retain(agg_state->keys, key_id);
     bucket->count = 0;
     bucket->sum = 0.0;
     bucket->min = INFINITY;
     bucket->max = -INFINITY;
     bucket->sum_squares = 0.0;
-    bucket->distinct_count = 0;
-    bucket->distinct_values = json_array();
-    bucket->percentile_values = json_array();
     bucket->window_start_ns = window_start_ns;
     bucket->window_end_ns = window_end_ns;
     bucket->last_event_ns = window_start_ns;
     
+    /* Tumbling and session buckets close on their own deadline; sliding
+     * panes are closed by their group. A window the watermark has
+     * already passed is open only to a late update, and only for the
+     * allowed lateness. */
+    nblex_deadline_init(&bucket->deadline, bucket_deadline_cb, agg_state);
+    uint64_t close_ns = bucket_close_ns(agg_state, bucket);
+    if (agg_state->event_time && agg_state->window.type == NQL_WINDOW_TUMBLING &&
+        close_ns <= agg_state->world->event_time.watermark_ns) {
+        bucket->closed = true;
+        close_ns += agg_state->world->event_time.allowed_lateness_ns;
+    }
+    if ((agg_state->window.type == NQL_WINDOW_TUMBLING ||
+         agg_state->window.type == NQL_WINDOW_SESSION) &&
+        nblex_deadline_schedule(agg_state->scheduler, &bucket->deadline, close_ns) != 0) {
+        bucket_index_remove(agg_state, bucket);
+        free_bucket_resources(agg_state, bucket);
+        nblex_free(bucket);
+        return NULL;
+    }
+    
+    bucket->prev = NULL;
     bucket->next = agg_state->buckets;
+    if (bucket->next) {
+        bucket->next->prev = bucket;
+    } else {
+        agg_state->buckets_tail = bucket;
+    }
     agg_state->buckets = bucket;
     agg_state->bucket_count++;
     
     return bucket;
 }
 
-/* Get or create bucket(s) for group keys and event timestamp
- * Ownership contract (stricter):
- * - The caller transfers ownership of `group_keys` to this function.
- * - On success, if the function attaches the `group_keys` pointer to a
- *   created bucket, the bucket owns the pointer and this function will
- *   NOT free it. Otherwise (e.g., when an existing bucket is used),
- *   this function will free the passed-in `group_keys` before returning.
- * - On failure, this function will free `group_keys` if it was not
- *   attached to a bucket.
- * Return: 0 on success (buckets_out populated), -1 on error.
+/* Helper: Make room for `count` buckets in the per-event bucket list */
+static int reserve_event_buckets(nql_agg_state_t* agg_state, size_t count) {
+    if (count <= agg_state->event_buckets_capacity) {
+        return 0;
+    }
+    nql_agg_bucket_t** buckets = nblex_realloc(agg_state->event_buckets, count * sizeof(nql_agg_bucket_t*));
+    if (!buckets) {
+        return -1;
+    }
+    agg_state->event_buckets = buckets;
+    agg_state->event_buckets_capacity = count;
+    return 0;
+}
+
+/* Get or create bucket(s) for a group key and event timestamp
+ * The buckets are stored in agg_state->event_buckets, which is reused
+ * across events. Buckets take their own reference to the group key.
+ * Every window type updates at most one bucket per event.
+ * Return: number of buckets (0 if no open window takes the event), or
+ * -1 on error.
  */
 static int get_or_create_buckets_for_event(nql_agg_state_t* agg_state,
-                                           char** group_keys,
-                                           size_t group_keys_count,
-                                           uint64_t event_timestamp_ns,
-                                           nql_agg_bucket_t*** buckets_out,
-                                           size_t* buckets_count_out) {
-    if (!agg_state || !buckets_out || !buckets_count_out) {
-        if (group_keys) {
-            free_group_keys(group_keys, group_keys_count);
-        }
+                                           int key_id,
+                                           uint64_t event_timestamp_ns) {
+    if (!agg_state || reserve_event_buckets(agg_state, 1) != 0) {
         return -1;
     }
 
-    bool keys_owned_by_bucket = false;
-    nql_agg_bucket_t** buckets = NULL;
-    size_t count = 0;
-
-    *buckets_count_out = 0;
-    *buckets_out = NULL;
-
     if (agg_state->window.type == NQL_WINDOW_NONE) {
         /* No windowing: single bucket per group */
-        nql_agg_bucket_t* bucket = agg_state->buckets;
-        while (bucket) {
-            if (compare_group_keys(bucket->group_keys, group_keys, group_keys_count) == 0 &&
-                bucket->window_start_ns == 0 && bucket->window_end_ns == UINT64_MAX) {
-                /* Found existing no-window bucket: we do not keep our copied keys */
-                if (group_keys) {
-                    free_group_keys(group_keys, group_keys_count);
-                }
-                *buckets_out = calloc(1, sizeof(nql_agg_bucket_t*));
-                if (!*buckets_out) {
-                    return -1;
-                }
-                (*buckets_out)[0] = bucket;
-                *buckets_count_out = 1;
-                return 0;
-            }
-            bucket = bucket->next;
-        }
-
-        /* Create bucket with no window - ownership of group_keys moves to bucket */
-        bucket = create_bucket_with_window(agg_state, group_keys, group_keys_count, 0, UINT64_MAX);
+        nql_agg_bucket_t* bucket = find_bucket_by_window(agg_state, key_id, 0);
         if (!bucket) {
-            /* create failed -> free keys */
-            if (group_keys) {
-                free_group_keys(group_keys, group_keys_count);
+            bucket = create_bucket_with_window(agg_state, key_id, 0, UINT64_MAX);
+            if (!bucket) {
+                return -1;
             }
-            return -1;
         }
-        keys_owned_by_bucket = true;
-
-        *buckets_out = calloc(1, sizeof(nql_agg_bucket_t*));
-        if (!*buckets_out) {
-            /* Allocation failure - bucket remains in state and owns keys */
-            return -1;
-        }
-        (*buckets_out)[0] = bucket;
-        *buckets_count_out = 1;
-        return 0;
+        agg_state->event_buckets[0] = bucket;
+        return 1;
     }
 
     if (agg_state->window.type == NQL_WINDOW_SESSION) {
-        /* Session window: find or create bucket for this group */
-        nql_agg_bucket_t* bucket = NULL;
-        nql_agg_bucket_t* iter = agg_state->buckets;
+        /* Session window: find the group's open session or start one */
         uint64_t timeout_ns = agg_state->window.timeout_ms * 1000000ULL;
-
-        while (iter) {
-            if (compare_group_keys(iter->group_keys, group_keys, group_keys_count) == 0 &&
-                iter->window_end_ns == UINT64_MAX) {
-                if (event_timestamp_ns >= iter->last_event_ns &&
-                    (event_timestamp_ns - iter->last_event_ns) < timeout_ns) {
-                    bucket = iter;
-                    break;
-                }
-            }
-            iter = iter->next;
+        nql_agg_bucket_t* bucket = find_bucket_by_window(agg_state, key_id, event_timestamp_ns);
+        if (bucket && !(event_timestamp_ns >= bucket->last_event_ns &&
+                        (event_timestamp_ns - bucket->last_event_ns) < timeout_ns)) {
+            /* Session has gone quiet: leave it for its close deadline
+             * and index a new session for the group instead. */
+            bucket_index_remove(agg_state, bucket);
+            bucket = NULL;
         }
 
         if (!bucket) {
-            bucket = create_bucket_with_window(agg_state, group_keys, group_keys_count,
-                                               event_timestamp_ns, UINT64_MAX);
+            bucket = create_bucket_with_window(agg_state, key_id, event_timestamp_ns, UINT64_MAX);
             if (!bucket) {
-                if (group_keys) {
-                    free_group_keys(group_keys, group_keys_count);
-                }
                 return -1;
             }
-            keys_owned_by_bucket = true;
-        } else {
-            /* Existing bucket found; our copied keys are not needed */
-            if (group_keys) {
-                free_group_keys(group_keys, group_keys_count);
-            }
-        }
-
-        *buckets_out = calloc(1, sizeof(nql_agg_bucket_t*));
-        if (!*buckets_out) {
-            /* On allocation failure, if keys were not taken by the bucket, free them */
-            if (!keys_owned_by_bucket && group_keys) {
-                free_group_keys(group_keys, group_keys_count);
-            }
-            return -1;
         }
-        (*buckets_out)[0] = bucket;
-        *buckets_count_out = 1;
-        return 0;
+        agg_state->event_buckets[0] = bucket;
+        return 1;
     }
 
-    /* Tumbling or sliding window */
-    uint64_t window_size_ns = agg_state->window.size_ms * 1000000ULL;
-    uint64_t slide_ns = agg_state->window.slide_ms > 0 ? agg_state->window.slide_ms * 1000000ULL : window_size_ns;
-
     if (agg_state->window.type == NQL_WINDOW_TUMBLING) {
+        uint64_t window_size_ns = agg_state->window.size_ms * 1000000ULL;
         uint64_t window_start = (event_timestamp_ns / window_size_ns) * window_size_ns;
-        nql_agg_bucket_t* bucket = find_bucket_by_window(agg_state, group_keys, group_keys_count, window_start);
+        nql_agg_bucket_t* bucket = find_bucket_by_window(agg_state, key_id, window_start);
         if (!bucket) {
-            bucket = create_bucket_with_window(agg_state, group_keys, group_keys_count,
+            bucket = create_bucket_with_window(agg_state, key_id,
                                                window_start, window_start + window_size_ns);
             if (!bucket) {
-                if (group_keys) {
-                    free_group_keys(group_keys, group_keys_count);
-                }
                 return -1;
             }
-            keys_owned_by_bucket = true;
-        } else {
-            if (group_keys) {
-                free_group_keys(group_keys, group_keys_count);
-            }
-        }
-
-        *buckets_out = calloc(1, sizeof(nql_agg_bucket_t*));
-        if (!*buckets_out) {
-            if (!keys_owned_by_bucket && group_keys) {
-                free_group_keys(group_keys, group_keys_count);
-            }
-            return -1;
         }
-        (*buckets_out)[0] = bucket;
-        *buckets_count_out = 1;
-        return 0;
+        agg_state->event_buckets[0] = bucket;
+        return 1;
     }
 
-    /* Sliding window: event may belong to multiple windows */
-    uint64_t window_start = ((event_timestamp_ns / slide_ns) * slide_ns);
-    uint64_t earliest_window_start = (event_timestamp_ns >= window_size_ns) ?
-                                     (event_timestamp_ns - window_size_ns) : 0;
-    earliest_window_start = ((earliest_window_start / slide_ns) * slide_ns);
-
-    size_t max_windows = ((window_start - earliest_window_start) / slide_ns) + 1;
-    if (max_windows > MAX_SLIDING_WINDOWS) {
-        max_windows = MAX_SLIDING_WINDOWS; /* Safety limit */
+    /* Sliding window: the event updates only the pane that holds it */
+    uint64_t pane_start = (event_timestamp_ns / agg_state->pane_ns) * agg_state->pane_ns;
+    uint64_t last_end = slide_last_window_end(agg_state, pane_start);
+    nql_slide_group_t* group = get_slide_group(agg_state, key_id);
+    if (!group) {
+        return -1;
     }
-
-    buckets = calloc(max_windows, sizeof(nql_agg_bucket_t*));
-    if (!buckets) {
-        if (group_keys) {
-            free_group_keys(group_keys, group_keys_count);
+    if (last_end == 0 || (group->emitted_end_ns && last_end <= group->emitted_end_ns)) {
+        /* In no window, or every window holding it has been emitted */
+        if (!group->panes) {
+            free_slide_group(agg_state, group);
         }
-        return -1;
+        return 0;
     }
-
-    count = 0;
-    uint64_t current_window_start = earliest_window_start;
-
-    while (current_window_start <= event_timestamp_ns &&
-           current_window_start + window_size_ns > event_timestamp_ns &&
-           count < max_windows) {
-        nql_agg_bucket_t* bucket = find_bucket_by_window(agg_state, group_keys, group_keys_count, current_window_start);
-        if (!bucket) {
-            bucket = create_bucket_with_window(agg_state, group_keys, group_keys_count,
-                                               current_window_start, current_window_start + window_size_ns);
-            if (!bucket) {
-                /* Cleanup and free keys if not owned by any bucket */
-                free(buckets);
-                if (!keys_owned_by_bucket && group_keys) {
-                    free_group_keys(group_keys, group_keys_count);
-                }
-                return -1;
+    
+    nql_agg_bucket_t* pane = find_bucket_by_window(agg_state, key_id, pane_start);
+    if (!pane) {
+        pane = create_bucket_with_window(agg_state, key_id,
+                                         pane_start, pane_start + agg_state->pane_ns);
+        if (!pane) {
+            if (!group->panes) {
+                free_slide_group(agg_state, group);
             }
-            keys_owned_by_bucket = true; /* Keys now owned by bucket */
+            return -1;
         }
-        buckets[count++] = bucket;
-
-        current_window_start += slide_ns;
+        slide_group_add_pane(group, pane);
     }
-
-    /* If none of the created buckets claimed the keys, free them */
-    if (!keys_owned_by_bucket && group_keys) {
-        free_group_keys(group_keys, group_keys_count);
+    if (slide_group_schedule(agg_state, group, slide_first_window_end(agg_state, pane_start)) != 0) {
+        return -1;
     }
-
-    *buckets_out = buckets;
-    *buckets_count_out = count;
-    return 0;
+    agg_state->event_buckets[0] = pane;
+    return 1;
 }
 
 /* Helper: Update bucket with event data */
@@ -1018,6 +1483,20 @@ static void update_bucket_with_event(nql_agg_bucket_t* bucket, nblex_event* even
                 continue;
             }
             
+            if (func->type == NQL_AGG_DISTINCT) {
+                /* Strings and numbers are hashed as they are; absent
+                 * and null values are not counted */
+                json_t* field_value = json_get_path(event->data, func->field);
+                nql_func_state_t* state = get_func_state(agg_state, bucket, i);
+                if (field_value && !json_is_null(field_value) && state) {
+                    if (!state->hll) {
+                        state->hll = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+                    }
+                    nblex_hll_add_hash(state->hll, nblex_hash64_json(field_value));
+                }
+                continue;
+            }
+
             double value = get_numeric_value(event->data, func->field);
             
             switch (func->type) {
@@ -1037,33 +1516,17 @@ static void update_bucket_with_event(nql_agg_bucket_t* bucket, nblex_event* even
                     if (value > bucket->max) bucket->max = value;
                     break;
                     
-                case NQL_AGG_PERCENTILE:
-                    if (bucket->percentile_values) {
-                        json_array_append_new(bucket->percentile_values, json_real(value));
+                case NQL_AGG_PERCENTILE: {
+                    nql_func_state_t* state = get_func_state(agg_state, bucket, i);
+                    if (!state) {
+                        break;
                     }
-                    break;
-                    
-                case NQL_AGG_DISTINCT:
-                    /* Simple distinct tracking */
-                    if (bucket->distinct_values) {
-                        json_t* val = json_real(value);
-                        bool found = false;
-                        size_t size = json_array_size(bucket->distinct_values);
-                        for (size_t j = 0; j < size; j++) {
-                            json_t* existing = json_array_get(bucket->distinct_values, j);
-                            if (json_is_number(existing) &&
-                                fabs(json_number_value(existing) - value) < 1e-9) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (!found) {
-                            json_array_append(bucket->distinct_values, val);
-                            bucket->distinct_count++;
-                        }
-                        json_decref(val);
+                    if (!state->sketch) {
+                        state->sketch = nblex_quantile_sketch_new(func->accuracy);
                     }
+                    nblex_quantile_sketch_add(state->sketch, value);
                     break;
+                }
                     
                 case NQL_AGG_COUNT:
                     /* COUNT is handled by bucket->count increment above */
@@ -1076,128 +1539,551 @@ static void update_bucket_with_event(nql_agg_bucket_t* bucket, nblex_event* even
     }
 }
 
-/* Helper: Initialize window timer for aggregation state (lazy initialization) */
-static void ensure_agg_timer_initialized(nql_agg_state_t* agg_state, nblex_world* world) {
-    if (!agg_state || !world || !world->loop) {
+/* Helper: In event time, has the watermark closed every window that
+ * would take an event at this time? Tumbling windows under the late
+ * update policy stay open to late events for the allowed lateness.
+ */
+static bool is_late_event(const nql_agg_state_t* agg_state, uint64_t event_timestamp_ns) {
+    const nblex_event_time_t* event_time = &agg_state->world->event_time;
+    uint64_t watermark_ns = event_time->watermark_ns;
+    
+    switch (agg_state->window.type) {
+    case NQL_WINDOW_TUMBLING: {
+        uint64_t window_size_ns = agg_state->window.size_ms * 1000000ULL;
+        uint64_t window_end = (event_timestamp_ns / window_size_ns) * window_size_ns + window_size_ns;
+        if (event_time->late_policy == NBLEX_LATE_UPDATE) {
+            window_end += event_time->allowed_lateness_ns;
+        }
+        return window_end <= watermark_ns;
+    }
+    case NQL_WINDOW_SLIDING: {
+        uint64_t pane_start = (event_timestamp_ns / agg_state->pane_ns) * agg_state->pane_ns;
+        uint64_t last_end = slide_last_window_end(agg_state, pane_start);
+        return last_end != 0 && last_end <= watermark_ns;
+    }
+    case NQL_WINDOW_SESSION:
+        return event_timestamp_ns + agg_state->window.timeout_ms * 1000000ULL <= watermark_ns;
+    default:
+        return false;
+    }
+}
+
+/* Helper: Route a late event per the world's late policy. Only the side
+ * output policy emits it; anything else that reaches here (including
+ * an update the window type cannot take) is dropped and counted.
+ */
+static void route_late_event(nql_agg_state_t* agg_state, nblex_event* event) {
+    nblex_world* world = agg_state->world;
+    nblex_event_time_t* event_time = &world->event_time;
+    
+    if (event_time->late_policy != NBLEX_LATE_SIDE_OUTPUT) {
+        event_time->late_dropped++;
         return;
     }
     
-    /* Only initialize if windowing is enabled, timer doesn't exist, and world is started */
-    if (agg_state->window.type != NQL_WINDOW_NONE && 
-        !agg_state->window_timer && 
-        world->started) {
-        agg_state->window_timer = calloc(1, sizeof(uv_timer_t));
-        if (agg_state->window_timer) {
-            uv_timer_init(world->loop, agg_state->window_timer);
-            agg_state->window_timer->data = agg_state;
-
-            uint64_t interval_ms;
-            if (agg_state->window.type == NQL_WINDOW_SESSION) {
-                /* Session window: check frequently for timeout */
-                interval_ms = agg_state->window.timeout_ms / 2;
-                if (interval_ms < 100) interval_ms = 100;
-            } else {
-                /* Tumbling/sliding window */
-                interval_ms = agg_state->window.slide_ms > 0 ?
-                              agg_state->window.slide_ms : agg_state->window.size_ms;
-            }
+    nblex_event* late_event = nblex_world_event_new(world, NBLEX_EVENT_LOG, NULL);
+    json_t* result = json_object();
+    if (!late_event || !result) {
+        nblex_event_free(late_event);
+        json_decref(result);
+        event_time->late_dropped++;
+        return;
+    }
+    json_object_set_new(result, "nql_result_type", json_string("late_event"));
+    json_object_set_new(result, "timestamp_ns", json_integer((json_int_t)event->timestamp_ns));
+    json_object_set_new(result, "watermark_ns", json_integer((json_int_t)event_time->watermark_ns));
+    if (event->data) {
+        json_object_set(result, "event", event->data);
+    }
+    late_event->data = result;
+    late_event->timestamp_ns = event->timestamp_ns;
+    
+    event_time->late_side_output++;
+    nblex_event_emit(world, late_event);
+}
+
+/* Helper: Move a bucket to the head of the list, most recently updated */
+static void touch_bucket(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    if (agg_state->buckets == bucket) {
+        return;
+    }
+    bucket->prev->next = bucket->next;
+    if (bucket->next) {
+        bucket->next->prev = bucket->prev;
+    } else {
+        agg_state->buckets_tail = bucket->prev;
+    }
+    bucket->prev = NULL;
+    bucket->next = agg_state->buckets;
+    agg_state->buckets->prev = bucket;
+    agg_state->buckets = bucket;
+}
 
-            uv_timer_start(agg_state->window_timer, window_flush_cb,
-                          interval_ms, interval_ms);
-            agg_state->timer_active = true;
+/* Helper: Unlink a sliding pane from its group, freeing the group if
+ * no panes are left
+ */
+static void slide_group_remove_pane(nql_agg_state_t* agg_state, nql_agg_bucket_t* pane) {
+    nql_slide_group_t* group = agg_state->slide_groups[pane->key_id];
+    if (!group) {
+        return;
+    }
+    nql_agg_bucket_t** link = &group->panes;
+    nql_agg_bucket_t* before = NULL;
+    while (*link && *link != pane) {
+        before = *link;
+        link = &(*link)->pane_next;
+    }
+    if (*link) {
+        *link = pane->pane_next;
+        if (group->panes_tail == pane) {
+            group->panes_tail = before;
         }
     }
+    pane->pane_next = NULL;
+    if (!group->panes) {
+        free_slide_group(agg_state, group);
+    }
 }
 
-/* Execute aggregate query */
-static int execute_aggregate(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str) {
-    if (!query || query->type != NQL_QUERY_AGGREGATE || !query->data.aggregate || !event) {
-        return 0;
+/* Helper: Fold an evicted bucket into the "__other__" group's bucket for
+ * the same window, dropping it if that cannot be done
+ */
+static void fold_bucket(nql_agg_state_t* agg_state, nql_agg_bucket_t* bucket) {
+    nql_prepared_t* prepared = agg_state->prepared;
+    
+    if (agg_state->other_key_id < 0) {
+        for (size_t i = 0; i < agg_state->group_by_count; i++) {
+            agg_state->key_parts[i].data = "__other__";
+            agg_state->key_parts[i].length = 9;
+        }
+        agg_state->other_key_id = nql_interner_intern(agg_state->keys, agg_state->key_parts);
     }
     
-    nql_aggregate_t* agg = query->data.aggregate;
+    int count = -1;
+    if (agg_state->other_key_id >= 0) {
+        count = get_or_create_buckets_for_event(agg_state, agg_state->other_key_id,
+                                                bucket->window_start_ns);
+    }
+    if (count > 0 && merge_bucket(agg_state, agg_state->event_buckets[0], bucket) == 0) {
+        nql_agg_bucket_t* other = agg_state->event_buckets[0];
+        if (bucket->last_event_ns > other->last_event_ns) {
+            other->last_event_ns = bucket->last_event_ns;
+        }
+        prepared->buckets_folded++;
+    } else {
+        prepared->buckets_dropped++;
+    }
     
-    /* Check WHERE clause */
-    if (agg->where_filter) {
-        if (!nblex_filter_matches(agg->where_filter, event)) {
-            return 0;
+    if (agg_state->window.type == NQL_WINDOW_SLIDING) {
+        slide_group_remove_pane(agg_state, bucket);
+    }
+    remove_bucket(agg_state, bucket);
+}
+
+/* Helper: Evict the least recently updated buckets while the query or
+ * its world is over budget. Windows kept only for late updates go
+ * first. Sliding panes are always folded, as a pane is not a result on
+ * its own; without group-by there is no "__other__" group to fold into
+ * and buckets are emitted instead. Evicted results bypass any top stage.
+ */
+static void evict_buckets(nql_agg_state_t* agg_state) {
+    nql_prepared_t* prepared = agg_state->prepared;
+    bool fold = agg_state->group_by_count > 0 &&
+                (prepared->evict_policy == NQL_EVICT_FOLD ||
+                 agg_state->window.type == NQL_WINDOW_SLIDING);
+    
+    nql_agg_bucket_t* bucket = agg_state->buckets_tail;
+    while (bucket && nblex_mem_account_over_limit(&prepared->memory)) {
+        nql_agg_bucket_t* prev = bucket->prev;
+        if (bucket->key_id == agg_state->other_key_id) {
+            bucket = prev;
+            continue;
+        }
+        if (bucket->closed) {
+            remove_bucket(agg_state, bucket);
+            bucket = prev;
+            continue;
+        }
+        if (fold) {
+            fold_bucket(agg_state, bucket);
+            bucket = prev;
+            continue;
+        }
+        
+        nblex_event* result_event = NULL;
+        if (bucket->count > 0) {
+            result_event = create_agg_result_event(bucket, agg_state, agg_state->world);
+        }
+        if (result_event) {
+            json_object_set_new(result_event->data, "evicted", json_true());
+            prepared->buckets_evicted++;
+        } else {
+            prepared->buckets_dropped++;
+        }
+        if (agg_state->window.type == NQL_WINDOW_SLIDING) {
+            slide_group_remove_pane(agg_state, bucket);
         }
+        remove_bucket(agg_state, bucket);
+        
+        /* Emitting may run the query again; rescan from the tail */
+        if (result_event) {
+            nblex_event_emit(agg_state->world, result_event);
+        }
+        bucket = agg_state->buckets_tail;
     }
+}
+
+/* Helper: Fold one event that passed the WHERE clause into its buckets */
+static int aggregate_event(nql_agg_state_t* agg_state, nblex_event* event) {
+    nblex_world* world = agg_state->world;
     
-    /* Get aggregation state */
-    nql_agg_state_t* agg_state = get_agg_state(query, world, query_str);
-    if (!agg_state) {
+    /* Intern the group key; buckets take their own references */
+    int key_id = intern_group_key(agg_state, event);
+    if (key_id < 0) {
         return 0;
     }
     
-    /* Ensure window timer is initialized (lazy initialization for queries created before world start) */
-    ensure_agg_timer_initialized(agg_state, world);
-    
-    /* Extract group keys */
-    size_t group_keys_count = 0;
-    char** group_keys = extract_group_keys(agg_state, event, &group_keys_count);
-    
     /* Get event timestamp */
     uint64_t event_timestamp_ns = event->timestamp_ns ? event->timestamp_ns : nblex_timestamp_now();
     
+    if (agg_state->event_time && is_late_event(agg_state, event_timestamp_ns)) {
+        nql_interner_release(agg_state->keys, key_id);
+        route_late_event(agg_state, event);
+        return 0;
+    }
+    
     /* Get or create buckets for this event */
-    nql_agg_bucket_t** buckets = NULL;
-    size_t buckets_count = 0;
-    if (get_or_create_buckets_for_event(agg_state, group_keys, group_keys_count,
-                                        event_timestamp_ns, &buckets, &buckets_count) != 0) {
-        /* get_or_create_buckets_for_event takes ownership of group_keys
-         * (frees it on error). Null out local pointer to avoid accidental
-         * use/free by caller. */
-        group_keys = NULL;
+    int buckets_count = get_or_create_buckets_for_event(agg_state, key_id, event_timestamp_ns);
+    if (buckets_count < 0) {
+        nql_interner_release(agg_state->keys, key_id);
         return 0;
     }
-    /* Ownership of group_keys has been transferred to the helper; clear
-     * local pointer to avoid accidental use/free. */
-    group_keys = NULL;
     
     /* Update all buckets with event data */
-    for (size_t i = 0; i < buckets_count; i++) {
-        update_bucket_with_event(buckets[i], event, agg_state);
+    for (int i = 0; i < buckets_count; i++) {
+        update_bucket_with_event(agg_state->event_buckets[i], event, agg_state);
+        touch_bucket(agg_state, agg_state->event_buckets[i]);
     }
     
-    /* For non-windowed queries, emit immediately */
+    /* For non-windowed queries, emit immediately; a late update to a
+     * closed window emits the revised result */
     nblex_event* result_event = NULL;
-    if (agg_state->window.type == NQL_WINDOW_NONE && buckets_count > 0) {
-        result_event = create_agg_result_event(buckets[0], agg_state, world);
+    if (buckets_count > 0 && agg_state->window.type == NQL_WINDOW_NONE) {
+        result_event = create_agg_result_event(agg_state->event_buckets[0], agg_state, world);
+    } else if (buckets_count > 0 && agg_state->event_buckets[0]->closed) {
+        result_event = create_agg_result_event(agg_state->event_buckets[0], agg_state, world);
+        if (result_event) {
+            json_object_set_new(result_event->data, "late_update", json_true());
+        }
+        world->event_time.late_updates++;
     }
     
-    free(buckets);
+    nql_interner_release(agg_state->keys, key_id);
     
     if (result_event) {
         nblex_event_emit(world, result_event);
     }
     
+    if (nblex_mem_account_over_limit(&agg_state->prepared->memory)) {
+        evict_buckets(agg_state);
+    }
+    
     return 1;
 }
 
-/* Execute filter query */
-static int execute_filter(nql_query_t* query, nblex_event* event) {
-    if (!query || query->type != NQL_QUERY_FILTER || !query->data.filter) {
-        return 0;
+/* A batch's bucket updates, shared out among worker threads by bucket
+ * hash. Entries are in event order. */
+typedef struct {
+    nql_agg_state_t* agg_state;
+    nblex_event* events[NBLEX_BATCH_SIZE];
+    nql_agg_bucket_t* buckets[NBLEX_BATCH_SIZE];
+    size_t count;
+    size_t workers;
+} nql_agg_batch_t;
+
+/* Helper: Worker body: apply the updates of the buckets this worker owns */
+static void update_batch_buckets(void* arg, size_t worker) {
+    nql_agg_batch_t* batch = (nql_agg_batch_t*)arg;
+    nql_agg_state_t* agg_state = batch->agg_state;
+    
+    /* Sketches and function states grow on the worker */
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&agg_state->prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    for (size_t i = 0; i < batch->count; i++) {
+        if (batch->buckets[i]->hash % batch->workers == worker) {
+            update_bucket_with_event(batch->buckets[i], batch->events[i], agg_state);
+        }
     }
-    
-    return nblex_filter_matches(query->data.filter, event);
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
 }
 
-/* Correlation buffer management */
-static int add_corr_event(nql_corr_state_t* corr_state, nblex_event* event, bool is_left) {
-    nblex_event_buffer_entry* entry = calloc(1, sizeof(nblex_event_buffer_entry));
-    if (!entry) {
-        return -1;
-    }
+/* Helper: Fold the selected events of a batch into their buckets, with
+ * bucket updates on the world's worker threads. Buckets are found or
+ * created and moved up the LRU list here, in event order; then each
+ * bucket's events are applied by one worker, still in event order, so
+ * every bucket ends exactly as it would one event at a time. Late
+ * events and late updates to closed windows emit results, so they are
+ * applied afterwards on this thread. The memory budget is enforced
+ * once per batch rather than per event. Narrows the selection as
+ * aggregate_event() would.
+ */
+static size_t aggregate_batch(nql_agg_state_t* agg_state, nblex_worker_pool_t* pool,
+                              nblex_event** events, uint16_t* sel, size_t count) {
+    nql_agg_batch_t batch;
+    batch.agg_state = agg_state;
+    batch.count = 0;
+    uint16_t deferred[NBLEX_BATCH_SIZE];
+    size_t deferred_count = 0;
+    bool kept[NBLEX_BATCH_SIZE];
+    
+    for (size_t i = 0; i < count; i++) {
+        nblex_event* event = events[sel[i]];
+        kept[i] = false;
+        
+        int key_id = intern_group_key(agg_state, event);
+        if (key_id < 0) {
+            continue;
+        }
+        uint64_t event_timestamp_ns = event->timestamp_ns ? event->timestamp_ns : nblex_timestamp_now();
+        if (agg_state->event_time && is_late_event(agg_state, event_timestamp_ns)) {
+            nql_interner_release(agg_state->keys, key_id);
+            deferred[deferred_count++] = (uint16_t)i;
+            continue;
+        }
+        int buckets_count = get_or_create_buckets_for_event(agg_state, key_id, event_timestamp_ns);
+        nql_interner_release(agg_state->keys, key_id);
+        if (buckets_count < 0) {
+            continue;
+        }
+        if (buckets_count > 0 && agg_state->event_buckets[0]->closed) {
+            deferred[deferred_count++] = (uint16_t)i;
+            continue;
+        }
+        kept[i] = true;
+        if (buckets_count > 0) {
+            touch_bucket(agg_state, agg_state->event_buckets[0]);
+            batch.events[batch.count] = event;
+            batch.buckets[batch.count] = agg_state->event_buckets[0];
+            batch.count++;
+        }
+    }
+    
+    if (batch.count >= PARALLEL_MIN_UPDATES) {
+        batch.workers = nblex_worker_pool_size(pool);
+        nblex_worker_pool_run(pool, update_batch_buckets, &batch);
+    } else {
+        batch.workers = 1;
+        update_batch_buckets(&batch, 0);
+    }
+    
+    for (size_t i = 0; i < deferred_count; i++) {
+        kept[deferred[i]] = aggregate_event(agg_state, events[sel[deferred[i]]]) != 0;
+    }
+    
+    if (nblex_mem_account_over_limit(&agg_state->prepared->memory)) {
+        evict_buckets(agg_state);
+    }
+    
+    size_t kept_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (kept[i]) {
+            sel[kept_count++] = sel[i];
+        }
+    }
+    return kept_count;
+}
+
+/* Execute aggregate query */
+static int execute_aggregate(nql_exec_ctx_t* ctx, nblex_event* event) {
+    nql_query_t* query = ctx->query;
+    if (!query || query->type != NQL_QUERY_AGGREGATE || !query->data.aggregate || !event) {
+        return 0;
+    }
+    
+    nql_aggregate_t* agg = query->data.aggregate;
+    
+    /* Check WHERE clause */
+    if (agg->where_filter) {
+        if (!nblex_filter_matches(agg->where_filter, event)) {
+            return 0;
+        }
+    }
+    
+    /* Get aggregation state */
+    nql_agg_state_t* agg_state = get_agg_state(ctx);
+    if (!agg_state) {
+        return 0;
+    }
+    
+    return aggregate_event(agg_state, event);
+}
+
+/* Execute filter query */
+static int execute_filter(nql_query_t* query, nblex_event* event) {
+    if (!query || query->type != NQL_QUERY_FILTER || !query->data.filter) {
+        return 0;
+    }
+    
+    return nblex_filter_matches(query->data.filter, event);
+}
+
+/* Helper: How long a correlation buffer keeps an event */
+static uint64_t corr_retention_ns(const nql_corr_state_t* corr_state) {
+    return (uint64_t)corr_state->within_ms * 1000000ULL * 2;
+}
+
+/* Helper: When an event buffered at a time is due to expire. A keyed
+ * buffer keeps it until its whole join slot is past retention. */
+static uint64_t corr_expire_ns(const nql_corr_state_t* corr_state, uint64_t timestamp_ns) {
+    if (corr_state->on_field) {
+        return (timestamp_ns / corr_state->slot_ns + 1) * corr_state->slot_ns +
+               corr_retention_ns(corr_state);
+    }
+    return timestamp_ns + corr_retention_ns(corr_state) + 1;
+}
+
+/* Helper: Render an event's join key like a group key part; NULL if the
+ * event has no string or number there and so can join nothing */
+static const char* corr_join_key(const nql_corr_state_t* corr_state, nblex_event* event,
+                                 char* number, size_t number_size, size_t* length) {
+    json_t* value = event->data ? json_get_path(event->data, corr_state->on_field) : NULL;
+    if (value && json_is_string(value)) {
+        *length = json_string_length(value);
+        return json_string_value(value);
+    }
+    if (value && json_is_integer(value)) {
+        snprintf(number, number_size, "%lld", (long long)json_integer_value(value));
+    } else if (value && json_is_real(value)) {
+        snprintf(number, number_size, "%.6f", json_real_value(value));
+    } else {
+        return NULL;
+    }
+    *length = strlen(number);
+    return number;
+}
+
+/* Helper: Hash a join key together with a time slot */
+static uint64_t join_slot_hash(const char* key, size_t key_length, uint64_t slot) {
+    return nblex_hash64_combine(nblex_hash64(key, key_length, 0), slot);
+}
+
+/* Helper: Look up a join slot by key and time slot */
+static nql_join_slot_t* join_index_find(const nql_join_index_t* join, uint64_t hash,
+                                        const char* key, size_t key_length, uint64_t slot) {
+    size_t pos = (size_t)hash;
+    
+    nblex_index_bucket_t* entry;
+    while ((entry = nblex_index_next(&join->index, hash, &pos)) != NULL) {
+        nql_join_slot_t* join_slot = (nql_join_slot_t*)entry->value;
+        if (join_slot->slot == slot && join_slot->key_length == key_length &&
+            memcmp(join_slot->key, key, key_length) == 0) {
+            return join_slot;
+        }
+    }
+    return NULL;
+}
+
+/* Helper: Free a join slot; its entries belong to the side's buffer */
+static void free_join_slot(nql_join_slot_t* join_slot) {
+    nblex_free(join_slot->entries);
+    nblex_free(join_slot->key);
+    nblex_free(join_slot);
+}
+
+/* Helper: Index a buffered entry under its join key and time slot */
+static int join_index_add(nql_corr_state_t* corr_state, nql_join_index_t* join,
+                          nblex_event_buffer_entry* entry, const char* key, size_t key_length) {
+    uint64_t slot = entry->event->timestamp_ns / corr_state->slot_ns;
+    uint64_t hash = join_slot_hash(key, key_length, slot);
+    nql_join_slot_t* join_slot = join_index_find(join, hash, key, key_length, slot);
+    
+    if (!join_slot) {
+        join_slot = nblex_calloc(1, sizeof(nql_join_slot_t));
+        if (!join_slot) {
+            return -1;
+        }
+        join_slot->key = nblex_malloc(key_length + 1);
+        if (!join_slot->key) {
+            nblex_free(join_slot);
+            return -1;
+        }
+        memcpy(join_slot->key, key, key_length);
+        join_slot->key[key_length] = '\0';
+        join_slot->key_length = key_length;
+        join_slot->hash = hash;
+        join_slot->slot = slot;
+        if (nblex_index_insert(&join->index, hash, (uintptr_t)join_slot) != 0) {
+            free_join_slot(join_slot);
+            return -1;
+        }
+        join_slot->next = join->slots;
+        if (join->slots) {
+            join->slots->prev = join_slot;
+        }
+        join->slots = join_slot;
+    }
     
-    /* Duplicate event (use helper to ensure proper JSON refcounting) */
-    nblex_event* event_copy = nblex_event_clone(event);
-    if (!event_copy) {
-        free(entry);
+    if (join_slot->entries_count == join_slot->entries_capacity) {
+        size_t capacity = join_slot->entries_capacity ? join_slot->entries_capacity * 2 :
+                                                        JOIN_SLOT_INITIAL_CAPACITY;
+        nblex_event_buffer_entry** entries =
+            nblex_realloc(join_slot->entries, capacity * sizeof(nblex_event_buffer_entry*));
+        if (!entries) {
+            return -1;
+        }
+        join_slot->entries = entries;
+        join_slot->entries_capacity = capacity;
+    }
+    join_slot->entries[join_slot->entries_count++] = entry;
+    return 0;
+}
+
+/* Helper: Drop the join slots before a cutoff slot */
+static void join_index_expire(nql_join_index_t* join, uint64_t cutoff_slot) {
+    nql_join_slot_t* join_slot = join->slots;
+    while (join_slot) {
+        nql_join_slot_t* next = join_slot->next;
+        if (join_slot->slot < cutoff_slot) {
+            nblex_index_remove(&join->index, join_slot->hash, (uintptr_t)join_slot);
+            if (join_slot->prev) {
+                join_slot->prev->next = next;
+            } else {
+                join->slots = next;
+            }
+            if (next) {
+                next->prev = join_slot->prev;
+            }
+            free_join_slot(join_slot);
+        }
+        join_slot = next;
+    }
+}
+
+/* Helper: Free a join index and its slots */
+static void free_join_index(nql_join_index_t* join) {
+    nql_join_slot_t* join_slot = join->slots;
+    while (join_slot) {
+        nql_join_slot_t* next = join_slot->next;
+        free_join_slot(join_slot);
+        join_slot = next;
+    }
+    nblex_index_free(&join->index);
+    memset(join, 0, sizeof(*join));
+}
+
+/* Correlation buffer management. A keyed correlation also indexes the
+ * event under its join key. */
+static int add_corr_event(nql_corr_state_t* corr_state, nblex_event* event, bool is_left,
+                          const char* key, size_t key_length) {
+    nblex_event_buffer_entry* entry = nblex_pool_calloc(corr_state->entries);
+    if (!entry) {
         return -1;
     }
-    entry->event = event_copy;
+    
+    /* Share the event rather than copy it */
+    nblex_event* shared = nblex_event_retain(event);
+    entry->event = shared;
     
     if (is_left) {
         entry->next = corr_state->left_events;
@@ -1209,120 +2095,130 @@ static int add_corr_event(nql_corr_state_t* corr_state, nblex_event* event, bool
         corr_state->right_count++;
     }
     
+    /* The expiry deadline tracks the oldest buffered event */
+    uint64_t expire_ns = corr_expire_ns(corr_state, shared->timestamp_ns);
+    if (!nblex_deadline_pending(&corr_state->expiry) || expire_ns < corr_state->expiry.when_ns) {
+        nblex_deadline_schedule(corr_state->scheduler, &corr_state->expiry, expire_ns);
+    }
+    
+    if (key) {
+        return join_index_add(corr_state, is_left ? &corr_state->left_index :
+                                                    &corr_state->right_index,
+                              entry, key, key_length);
+    }
     return 0;
 }
 
-/* Correlation cleanup callback */
-static void corr_cleanup_cb(uv_timer_t* handle) {
-    nql_corr_state_t* corr_state = (nql_corr_state_t*)handle->data;
-    if (!corr_state) {
-        return;
-    }
-    uint64_t now = nblex_timestamp_now();
-    uint64_t window_ns = (uint64_t)corr_state->within_ms * 1000000ULL;
-    uint64_t cutoff = now - (window_ns * 2);
-    
-    /* Clean left buffer */
-    nblex_event_buffer_entry** entry_ptr = &corr_state->left_events;
+/* Helper: Drop entries older than the cutoff from a correlation buffer,
+ * tracking the oldest timestamp kept
+ */
+static void expire_corr_buffer(nql_corr_state_t* corr_state,
+                               nblex_event_buffer_entry** entry_ptr, size_t* count,
+                               uint64_t cutoff, uint64_t* oldest_ns) {
     while (*entry_ptr) {
-        if ((*entry_ptr)->event->timestamp_ns < cutoff) {
+        uint64_t ts = (*entry_ptr)->event->timestamp_ns;
+        if (ts < cutoff) {
             nblex_event_buffer_entry* old = *entry_ptr;
             *entry_ptr = old->next;
             nblex_event_free(old->event);
-            free(old);
-            corr_state->left_count--;
+            nblex_pool_free(corr_state->entries, old);
+            (*count)--;
         } else {
+            if (ts < *oldest_ns) {
+                *oldest_ns = ts;
+            }
             entry_ptr = &(*entry_ptr)->next;
         }
     }
-    
-    /* Clean right buffer */
-    entry_ptr = &corr_state->right_events;
-    while (*entry_ptr) {
-        if ((*entry_ptr)->event->timestamp_ns < cutoff) {
-            nblex_event_buffer_entry* old = *entry_ptr;
-            *entry_ptr = old->next;
-            nblex_event_free(old->event);
-            free(old);
-            corr_state->right_count--;
-        } else {
-            entry_ptr = &(*entry_ptr)->next;
-        }
+}
+
+/* Correlation expiry callback: runs only when the oldest buffered event
+ * is due, then waits for the next oldest
+ */
+static void corr_expiry_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+    nql_corr_state_t* corr_state = (nql_corr_state_t*)deadline->data;
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&corr_state->prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    uint64_t retention_ns = corr_retention_ns(corr_state);
+    uint64_t cutoff = now_ns > retention_ns ? now_ns - retention_ns : 0;
+    uint64_t oldest_ns = UINT64_MAX;
+    
+    /* Keyed buffers drop whole slots, so the indices never point at a
+     * freed entry */
+    if (corr_state->on_field) {
+        uint64_t cutoff_slot = cutoff / corr_state->slot_ns;
+        cutoff = cutoff_slot * corr_state->slot_ns;
+        join_index_expire(&corr_state->left_index, cutoff_slot);
+        join_index_expire(&corr_state->right_index, cutoff_slot);
+    }
+    
+    expire_corr_buffer(corr_state, &corr_state->left_events, &corr_state->left_count,
+                       cutoff, &oldest_ns);
+    expire_corr_buffer(corr_state, &corr_state->right_events, &corr_state->right_count,
+                       cutoff, &oldest_ns);
+    
+    if (oldest_ns != UINT64_MAX) {
+        nblex_deadline_schedule(corr_state->scheduler, deadline,
+                                corr_expire_ns(corr_state, oldest_ns));
+    }
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+}
+
+/* Helper: Free a correlation buffer list */
+static void free_corr_buffer(nql_corr_state_t* corr_state, nblex_event_buffer_entry* entry) {
+    while (entry) {
+        nblex_event_buffer_entry* next = entry->next;
+        nblex_event_free(entry->event);
+        nblex_pool_free(corr_state->entries, entry);
+        entry = next;
     }
 }
 
-/* Get or create correlation state */
-static nql_corr_state_t* get_corr_state(nql_query_t* query, nblex_world* world, const char* query_str) {
-    if (!query || query->type != NQL_QUERY_CORRELATE || !world) {
-        return NULL;
+/* Helper: Free correlation state and its buffered events */
+static void free_corr_state(nql_corr_state_t* corr_state) {
+    if (!corr_state) {
+        return;
     }
-    
-    /* Check existing contexts by query string */
-    if (query_str) {
-        nql_exec_ctx_t* ctx = exec_contexts;
-        while (ctx) {
-            if (ctx->query_string && strcmp(ctx->query_string, query_str) == 0 &&
-                ctx->world == world && ctx->state.corr_state) {
-                return ctx->state.corr_state;
-            }
-            ctx = ctx->next;
-        }
+    nblex_deadline_cancel(&corr_state->expiry);
+    free_join_index(&corr_state->left_index);
+    free_join_index(&corr_state->right_index);
+    free_corr_buffer(corr_state, corr_state->left_events);
+    free_corr_buffer(corr_state, corr_state->right_events);
+    nblex_free(corr_state);
+}
+
+/* Get or create correlation state for a stage */
+static nql_corr_state_t* get_corr_state(nql_exec_ctx_t* ctx) {
+    nblex_world* world = ctx->prepared->world;
+    if (!world) {
+        return NULL;
     }
     
-    /* If no query_str was provided we cannot match by string; in that
-     * unusual case we simply fall through and create a new context. The
-     * previous implementation attempted to match by retaining the raw
-     * parsed query pointer in the context which led to use-after-free
-     * when the caller freed the parsed query. We avoid that class of bug
-     * by not storing the parsed query pointer here.
-     */
-    
-    /* Create new context and state */
-    nql_exec_ctx_t* new_ctx = calloc(1, sizeof(nql_exec_ctx_t));
-    if (!new_ctx) {
-        return NULL;
+    if (ctx->state.corr_state) {
+        return ctx->state.corr_state;
     }
     
-    nql_corr_state_t* corr_state = calloc(1, sizeof(nql_corr_state_t));
+    nblex_pool_t* entries = nblex_world_entry_pool(world);
+    nql_corr_state_t* corr_state = entries ? nblex_calloc(1, sizeof(nql_corr_state_t)) : NULL;
     if (!corr_state) {
-        free(new_ctx);
         return NULL;
     }
     
-    /* Store a copy of the important numeric configuration (window)
-     * from the parsed query. We don't retain the parsed query pointer
-     * because the caller frees it after execution. */
-    if (query && query->data.correlate) {
-        corr_state->within_ms = query->data.correlate->within_ms;
-    } else {
-        corr_state->within_ms = 0;
-    }
+    corr_state->world = world;
+    corr_state->entries = entries;
+    corr_state->prepared = ctx->prepared;
+    corr_state->scheduler = nblex_world_window_scheduler(world);
+    corr_state->within_ms = ctx->query->data.correlate->within_ms;
+    corr_state->on_field = ctx->query->data.correlate->on_field;
+    corr_state->slot_ns = corr_state->within_ms ? (uint64_t)corr_state->within_ms * 1000000ULL : 1;
     corr_state->left_events = NULL;
     corr_state->right_events = NULL;
     corr_state->left_count = 0;
     corr_state->right_count = 0;
-    corr_state->timer_active = false;
-    
-    /* Initialize cleanup timer if world is started (will be done lazily otherwise) */
-    if (world->loop && world->started) {
-        if (!corr_state->cleanup_timer) {
-            corr_state->cleanup_timer = calloc(1, sizeof(uv_timer_t));
-            if (corr_state->cleanup_timer) {
-                uv_timer_init(world->loop, corr_state->cleanup_timer);
-                corr_state->cleanup_timer->data = corr_state;
-                uv_timer_start(corr_state->cleanup_timer, corr_cleanup_cb, 1000, 1000);
-                corr_state->timer_active = true;
-            }
-        }
-    }
-    
-    new_ctx->world = world;
-    new_ctx->query_type = query->type;
-    new_ctx->query_string = query_str ? strdup(query_str) : NULL;
-    new_ctx->state.corr_state = corr_state;
-    new_ctx->next = exec_contexts;
-    exec_contexts = new_ctx;
+    nblex_deadline_init(&corr_state->expiry, corr_expiry_cb, corr_state);
     
+    ctx->state.corr_state = corr_state;
     return corr_state;
 }
 
@@ -1331,7 +2227,7 @@ static nblex_event* create_corr_result_event(nblex_event* left_event,
                                             nblex_event* right_event,
                                             nql_correlate_t* corr,
                                             nblex_world* world) {
-    nblex_event* result = nblex_event_new(NBLEX_EVENT_CORRELATION, NULL);
+    nblex_event* result = nblex_world_event_new(world, NBLEX_EVENT_CORRELATION, NULL);
     if (!result) {
         return NULL;
     }
@@ -1364,75 +2260,128 @@ static nblex_event* create_corr_result_event(nblex_event* left_event,
     return result;
 }
 
-/* Execute correlation query */
-static int execute_correlate(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str) {
-    if (!query || query->type != NQL_QUERY_CORRELATE || !query->data.correlate || !event) {
-        return 0;
-    }
-    
-    nql_correlate_t* corr = query->data.correlate;
-    bool matches_left = corr->left_filter && nblex_filter_matches(corr->left_filter, event);
-    bool matches_right = corr->right_filter && nblex_filter_matches(corr->right_filter, event);
-    
-    if (!matches_left && !matches_right) {
-        return 0;
-    }
-    
-    /* Get correlation state */
-    nql_corr_state_t* corr_state = get_corr_state(query, world, query_str);
-    if (!corr_state) {
-        return 0;
-    }
-    
-    /* Ensure cleanup timer is initialized (lazy initialization for queries created before world start) */
-    if (world->loop && world->started && !corr_state->cleanup_timer) {
-        corr_state->cleanup_timer = calloc(1, sizeof(uv_timer_t));
-        if (corr_state->cleanup_timer) {
-            uv_timer_init(world->loop, corr_state->cleanup_timer);
-            corr_state->cleanup_timer->data = corr_state;
-            uv_timer_start(corr_state->cleanup_timer, corr_cleanup_cb, 1000, 1000);
-            corr_state->timer_active = true;
+/* Helper: Emit a result for each buffered event of the key's join slots
+ * around an event that is within the window of it */
+static void probe_join_index(nql_corr_state_t* corr_state, nql_correlate_t* corr,
+                             nql_join_index_t* join, nblex_event* event, bool event_is_left,
+                             const char* key, size_t key_length) {
+    nblex_world* world = corr_state->world;
+    uint64_t window_ns = corr->within_ms * 1000000ULL;
+    uint64_t slot = event->timestamp_ns / corr_state->slot_ns;
+    
+    /* Slots are as wide as the window, so matches lie in the event's
+     * slot or either neighbour */
+    for (uint64_t s = slot ? slot - 1 : 0; s <= slot + 1; s++) {
+        nql_join_slot_t* join_slot = join_index_find(join, join_slot_hash(key, key_length, s),
+                                                     key, key_length, s);
+        if (!join_slot) {
+            continue;
+        }
+        /* Index, not pointer: emitting may append to this slot */
+        for (size_t i = 0; i < join_slot->entries_count; i++) {
+            nblex_event* other = join_slot->entries[i]->event;
+            int64_t diff = (int64_t)event->timestamp_ns - (int64_t)other->timestamp_ns;
+            if (llabs(diff) > (int64_t)window_ns) {
+                continue;
+            }
+            nblex_event* result = event_is_left ?
+                create_corr_result_event(event, other, corr, world) :
+                create_corr_result_event(other, event, corr, world);
+            if (result) {
+                nblex_event_emit(world, result);
+            }
         }
     }
-    
+}
+
+/* Helper: Buffer an event matching either side of a correlation and
+ * emit a result for each event on the other side within the window.
+ * A keyed correlation probes only the other side's events sharing the
+ * event's join key. */
+static void correlate_event(nql_corr_state_t* corr_state, nql_correlate_t* corr,
+                            nblex_event* event, bool matches_left, bool matches_right) {
+    nblex_world* world = corr_state->world;
     uint64_t window_ns = corr->within_ms * 1000000ULL;
     uint64_t now = event->timestamp_ns;
     
+    const char* key = NULL;
+    size_t key_length = 0;
+    char number[64];
+    if (corr_state->on_field) {
+        key = corr_join_key(corr_state, event, number, sizeof(number), &key_length);
+        if (!key) {
+            return;
+        }
+    }
+    
     /* Check for matches */
     if (matches_left) {
-        add_corr_event(corr_state, event, true);
+        add_corr_event(corr_state, event, true, key, key_length);
         
         /* Check against right buffer */
-        nblex_event_buffer_entry* entry = corr_state->right_events;
-        while (entry) {
-            int64_t diff = (int64_t)now - (int64_t)entry->event->timestamp_ns;
-            if (llabs(diff) <= (int64_t)window_ns) {
-                nblex_event* result = create_corr_result_event(event, entry->event, corr, world);
-                if (result) {
-                    nblex_event_emit(world, result);
+        if (key) {
+            probe_join_index(corr_state, corr, &corr_state->right_index, event, true,
+                             key, key_length);
+        } else {
+            nblex_event_buffer_entry* entry = corr_state->right_events;
+            while (entry) {
+                int64_t diff = (int64_t)now - (int64_t)entry->event->timestamp_ns;
+                if (llabs(diff) <= (int64_t)window_ns) {
+                    nblex_event* result = create_corr_result_event(event, entry->event, corr, world);
+                    if (result) {
+                        nblex_event_emit(world, result);
+                    }
                 }
+                entry = entry->next;
             }
-            entry = entry->next;
         }
     }
     
     if (matches_right) {
-        add_corr_event(corr_state, event, false);
+        add_corr_event(corr_state, event, false, key, key_length);
         
         /* Check against left buffer */
-        nblex_event_buffer_entry* entry = corr_state->left_events;
-        while (entry) {
-            int64_t diff = (int64_t)now - (int64_t)entry->event->timestamp_ns;
-            if (llabs(diff) <= (int64_t)window_ns) {
-                nblex_event* result = create_corr_result_event(entry->event, event, corr, world);
-                if (result) {
-                    nblex_event_emit(world, result);
+        if (key) {
+            probe_join_index(corr_state, corr, &corr_state->left_index, event, false,
+                             key, key_length);
+        } else {
+            nblex_event_buffer_entry* entry = corr_state->left_events;
+            while (entry) {
+                int64_t diff = (int64_t)now - (int64_t)entry->event->timestamp_ns;
+                if (llabs(diff) <= (int64_t)window_ns) {
+                    nblex_event* result = create_corr_result_event(entry->event, event, corr, world);
+                    if (result) {
+                        nblex_event_emit(world, result);
+                    }
                 }
+                entry = entry->next;
             }
-            entry = entry->next;
         }
     }
+}
+
+/* Execute correlation query */
+static int execute_correlate(nql_exec_ctx_t* ctx, nblex_event* event) {
+    nql_query_t* query = ctx->query;
+    if (!query || query->type != NQL_QUERY_CORRELATE || !query->data.correlate || !event) {
+        return 0;
+    }
+    
+    nql_correlate_t* corr = query->data.correlate;
+    bool matches_left = corr->left_filter && nblex_filter_matches(corr->left_filter, event);
+    bool matches_right = corr->right_filter && nblex_filter_matches(corr->right_filter, event);
+    
+    if (!matches_left && !matches_right) {
+        return 0;
+    }
     
+    /* Get correlation state */
+    nql_corr_state_t* corr_state = get_corr_state(ctx);
+    if (!corr_state) {
+        return 0;
+    }
+    
+    correlate_event(corr_state, corr, event, matches_left, matches_right);
     return 1;
 }
 
@@ -1453,23 +2402,9 @@ static int execute_show(nql_query_t* query, nblex_event* event) {
     return 1;
 }
 
-/* Execute pipeline query */
-static int execute_pipeline(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str) {
-    if (!query || query->type != NQL_QUERY_PIPELINE || !query->data.pipeline.stages) {
-        return 0;
-    }
-
-    for (size_t i = 0; i < query->data.pipeline.count; i++) {
-        if (!execute_query(query->data.pipeline.stages[i], event, world, query_str)) {
-            return 0;
-        }
-    }
-
-    return 1;
-}
-
-/* Execute query (main entry point) */
-int execute_query(nql_query_t* query, nblex_event* event, nblex_world* world, const char* query_str) {
+/* Execute a single (non-pipeline) stage */
+static int execute_stage(nql_exec_ctx_t* ctx, nblex_event* event) {
+    nql_query_t* query = ctx->query;
     if (!query || !event) {
         return 0;
     }
@@ -1479,35 +2414,1211 @@ int execute_query(nql_query_t* query, nblex_event* event, nblex_world* world, co
             return execute_filter(query, event);
             
         case NQL_QUERY_CORRELATE:
-            return execute_correlate(query, event, world, query_str);
+            return execute_correlate(ctx, event);
             
         case NQL_QUERY_SHOW:
             return execute_show(query, event);
             
         case NQL_QUERY_AGGREGATE:
-            return execute_aggregate(query, event, world, query_str);
+            return execute_aggregate(ctx, event);
             
-        case NQL_QUERY_PIPELINE:
-            return execute_pipeline(query, event, world, query_str);
+        case NQL_QUERY_TOP:
+            /* Ranks the aggregate stage's windows as they close */
+            return 1;
             
         default:
             return 0;
     }
 }
 
-/* Public API: Create query from string and execute on event */
-int nql_execute(const char* query_str, nblex_event* event, nblex_world* world) {
-    if (!query_str || !event) {
+/* Helper: Run one stage over the selected events of a batch, narrowing
+ * the selection to the events that pass. Stateful stages see the
+ * selected events in batch order, as they would one at a time.
+ */
+static size_t execute_stage_batch(nql_exec_ctx_t* ctx, nblex_event** events,
+                                  uint16_t* sel, size_t count) {
+    nql_query_t* query = ctx->query;
+    if (!query || count == 0) {
         return 0;
     }
     
-    nql_query_t* query = nql_parse(query_str);
-    if (!query) {
-        return 0;
+    switch (query->type) {
+        case NQL_QUERY_FILTER:
+            if (!query->data.filter) {
+                return 0;
+            }
+            return nblex_filter_select(query->data.filter, events, sel, count);
+            
+        case NQL_QUERY_SHOW:
+            if (!query->data.show) {
+                return 0;
+            }
+            if (query->data.show->where_filter) {
+                return nblex_filter_select(query->data.show->where_filter, events, sel, count);
+            }
+            return count;
+            
+        case NQL_QUERY_AGGREGATE: {
+            nql_aggregate_t* agg = query->data.aggregate;
+            if (!agg) {
+                return 0;
+            }
+            if (agg->where_filter) {
+                count = nblex_filter_select(agg->where_filter, events, sel, count);
+                if (count == 0) {
+                    return 0;
+                }
+            }
+            nql_agg_state_t* agg_state = get_agg_state(ctx);
+            if (!agg_state) {
+                return 0;
+            }
+            /* A session is found by its last update, and without a
+             * window every event emits; those stay one at a time */
+            if (agg_state->window.type == NQL_WINDOW_TUMBLING ||
+                agg_state->window.type == NQL_WINDOW_SLIDING) {
+                nblex_worker_pool_t* pool = nblex_world_workers(agg_state->world);
+                if (pool) {
+                    return aggregate_batch(agg_state, pool, events, sel, count);
+                }
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < count; i++) {
+                if (aggregate_event(agg_state, events[sel[i]])) {
+                    sel[kept++] = sel[i];
+                }
+            }
+            return kept;
+        }
+            
+        case NQL_QUERY_CORRELATE: {
+            nql_correlate_t* corr = query->data.correlate;
+            if (!corr) {
+                return 0;
+            }
+            /* Select each side over the batch, then buffer and match the
+             * events of either side in order */
+            uint16_t left[NBLEX_BATCH_SIZE];
+            uint16_t right[NBLEX_BATCH_SIZE];
+            size_t left_count = 0, right_count = 0;
+            if (corr->left_filter) {
+                memcpy(left, sel, count * sizeof(uint16_t));
+                left_count = nblex_filter_select(corr->left_filter, events, left, count);
+            }
+            if (corr->right_filter) {
+                memcpy(right, sel, count * sizeof(uint16_t));
+                right_count = nblex_filter_select(corr->right_filter, events, right, count);
+            }
+            if (left_count == 0 && right_count == 0) {
+                return 0;
+            }
+            nql_corr_state_t* corr_state = get_corr_state(ctx);
+            if (!corr_state) {
+                return 0;
+            }
+            
+            size_t i = 0, j = 0, kept = 0;
+            while (i < left_count || j < right_count) {
+                bool is_left = i < left_count && (j == right_count || left[i] <= right[j]);
+                bool is_right = j < right_count && (i == left_count || right[j] <= left[i]);
+                uint16_t index = is_left ? left[i] : right[j];
+                correlate_event(corr_state, corr, events[index], is_left, is_right);
+                sel[kept++] = index;
+                i += is_left;
+                j += is_right;
+            }
+            return kept;
+        }
+            
+        case NQL_QUERY_TOP:
+            return count;
+            
+        default:
+            return 0;
     }
-    
-    int result = execute_query(query, event, world, query_str);
-    nql_free(query);
-    
-    return result;
+}
+
+/* Helper: Run one stage on an event, counting its events, time and
+ * allocations. Time includes emitting any results the stage produces.
+ */
+static int execute_stage_analyzed(nql_exec_ctx_t* ctx, nblex_event* event) {
+    nblex_memory_stats_t before;
+    nblex_memory_stats_t after;
+    nblex_memory_get_stats(&before);
+    uint64_t start_ns = nblex_timestamp_now();
+    
+    int passed = execute_stage(ctx, event);
+    
+    ctx->stats.time_ns += nblex_timestamp_now() - start_ns;
+    nblex_memory_get_stats(&after);
+    ctx->stats.allocations += after.allocations - before.allocations;
+    ctx->stats.events_in++;
+    ctx->stats.events_out += passed ? 1 : 0;
+    return passed;
+}
+
+/* Helper: Batch counterpart of execute_stage_analyzed() */
+static size_t execute_stage_batch_analyzed(nql_exec_ctx_t* ctx, nblex_event** events,
+                                           uint16_t* sel, size_t count) {
+    nblex_memory_stats_t before;
+    nblex_memory_stats_t after;
+    nblex_memory_get_stats(&before);
+    uint64_t start_ns = nblex_timestamp_now();
+    
+    size_t kept = execute_stage_batch(ctx, events, sel, count);
+    
+    ctx->stats.time_ns += nblex_timestamp_now() - start_ns;
+    nblex_memory_get_stats(&after);
+    ctx->stats.allocations += after.allocations - before.allocations;
+    ctx->stats.events_in += count;
+    ctx->stats.events_out += kept;
+    return kept;
+}
+
+/* Helper: Parse a query and set up per-stage execution contexts. When a
+ * world is given the query is entered in its registry, indexed by the
+ * query string if `indexed` is set.
+ */
+static nql_prepared_t* prepare_query(const char* query_str, nblex_world* world,
+                                     bool indexed, char** error_out) {
+    if (error_out) {
+        *error_out = NULL;
+    }
+    if (!query_str) {
+        return NULL;
+    }
+    
+    nql_query_t* query = nql_parse_ex(query_str, error_out);
+    if (!query) {
+        return NULL;
+    }
+    
+    nql_prepared_t* prepared = nblex_calloc(1, sizeof(nql_prepared_t));
+    if (!prepared) {
+        nql_free(query);
+        return NULL;
+    }
+    
+    prepared->id = -1;
+    prepared->query = query;
+    prepared->query_string = nblex_strdup(query_str);
+    nblex_mem_account_init(&prepared->memory, world ? &world->memory : NULL);
+    prepared->evict_policy = world ? (nql_evict_policy_t)world->query_evict_policy :
+                                     NQL_EVICT_EMIT;
+    if (world) {
+        prepared->memory.limit = world->query_memory_limit;
+    }
+    
+    if (query->type == NQL_QUERY_PIPELINE) {
+        prepared->stages_count = query->data.pipeline.count;
+    } else {
+        prepared->stages_count = 1;
+    }
+    
+    prepared->stages = nblex_calloc(prepared->stages_count ? prepared->stages_count : 1,
+                              sizeof(nql_exec_ctx_t));
+    if (!prepared->query_string || !prepared->stages) {
+        if (!prepared->stages) {
+            prepared->stages_count = 0;
+        }
+        free_prepared(prepared);
+        return NULL;
+    }
+    
+    prepared->analyze = query->explain == NQL_EXPLAIN_ANALYZE;
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        prepared->stages[i].prepared = prepared;
+        prepared->stages[i].query = (query->type == NQL_QUERY_PIPELINE) ?
+                                    query->data.pipeline.stages[i] : query;
+    }
+    
+    if (world) {
+        if (!world->queries) {
+            world->queries = nql_registry_new();
+        }
+        prepared->id = nql_registry_add(world->queries, prepared,
+                                        indexed ? prepared->query_string : NULL);
+        if (prepared->id < 0) {
+            free_prepared(prepared);
+            return NULL;
+        }
+        prepared->world = world;
+        
+        if (!world->filter_dag) {
+            world->filter_dag = nblex_filter_dag_new();
+        }
+        share_prepared_filters(prepared, world->filter_dag);
+    }
+    
+    return prepared;
+}
+
+/* Prepare a query: parse once and set up per-stage execution contexts */
+nql_prepared_t* nql_prepare_ex(const char* query_str, nblex_world* world, char** error_out) {
+    return prepare_query(query_str, world, false, error_out);
+}
+
+/* Prepare a query without error details */
+nql_prepared_t* nql_prepare(const char* query_str, nblex_world* world) {
+    return nql_prepare_ex(query_str, world, NULL);
+}
+
+/* Execute a prepared query on an event */
+int nql_execute_prepared(nql_prepared_t* prepared, nblex_event* event) {
+    if (!prepared || !event) {
+        return 0;
+    }
+    
+    if (prepared->stages_count == 0) {
+        return 0;
+    }
+    
+    /* explain alone describes the query without running it */
+    if (prepared->query->explain == NQL_EXPLAIN_PLAN) {
+        return 0;
+    }
+    
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    int result = 1;
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        if (!(prepared->analyze ? execute_stage_analyzed(ctx, event) : execute_stage(ctx, event))) {
+            result = 0;
+            break;
+        }
+    }
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+    
+    return result;
+}
+
+/* Execute a prepared query on a batch of events, stage by stage */
+size_t nql_execute_prepared_batch(nql_prepared_t* prepared, nblex_event** events,
+                                  size_t count, uint32_t* matched_out) {
+    if (!prepared || !events || prepared->stages_count == 0 ||
+        prepared->query->explain == NQL_EXPLAIN_PLAN) {
+        return 0;
+    }
+    
+    nblex_mem_account_t* previous = nblex_mem_account_enter(&prepared->memory);
+    nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+    size_t matched = 0;
+    for (size_t base = 0; base < count; base += NBLEX_BATCH_SIZE) {
+        size_t batch_count = count - base < NBLEX_BATCH_SIZE ? count - base : NBLEX_BATCH_SIZE;
+        nblex_event** batch = events + base;
+        
+        uint16_t sel[NBLEX_BATCH_SIZE];
+        size_t selected = 0;
+        for (size_t i = 0; i < batch_count; i++) {
+            if (batch[i]) {
+                sel[selected++] = (uint16_t)i;
+            }
+        }
+        
+        for (size_t i = 0; i < prepared->stages_count && selected > 0; i++) {
+            nql_exec_ctx_t* ctx = &prepared->stages[i];
+            selected = prepared->analyze ?
+                       execute_stage_batch_analyzed(ctx, batch, sel, selected) :
+                       execute_stage_batch(ctx, batch, sel, selected);
+        }
+        
+        if (matched_out) {
+            for (size_t i = 0; i < selected; i++) {
+                matched_out[matched + i] = (uint32_t)(base + sel[i]);
+            }
+        }
+        matched += selected;
+    }
+    nblex_mem_tag_leave(previous_tag);
+    nblex_mem_account_leave(previous);
+    
+    return matched;
+}
+
+/* Free a prepared query */
+void nql_prepared_free(nql_prepared_t* prepared) {
+    if (!prepared) {
+        return;
+    }
+    
+    if (prepared->world && prepared->id >= 0) {
+        nql_registry_remove(prepared->world->queries, prepared->id);
+    }
+    free_prepared(prepared);
+}
+
+/* Query ID of a prepared query */
+int nql_prepared_id(const nql_prepared_t* prepared) {
+    return prepared ? prepared->id : -1;
+}
+
+/* Parsed AST of a prepared query */
+const nql_query_t* nql_prepared_query(const nql_prepared_t* prepared) {
+    return prepared ? prepared->query : NULL;
+}
+
+/* Set a prepared query's memory budget (0 for none) and eviction policy */
+int nql_prepared_set_memory_limit(nql_prepared_t* prepared, size_t limit_bytes,
+                                  nql_evict_policy_t policy) {
+    if (!prepared || (policy != NQL_EVICT_EMIT && policy != NQL_EVICT_FOLD)) {
+        return -1;
+    }
+    prepared->memory.limit = limit_bytes;
+    prepared->evict_policy = policy;
+    return 0;
+}
+
+/* Memory use and eviction counters of a prepared query */
+int nql_prepared_get_memory_stats(const nql_prepared_t* prepared, nql_memory_stats_t* stats) {
+    if (!prepared || !stats) {
+        return -1;
+    }
+    stats->used = prepared->memory.used;
+    stats->peak = prepared->memory.peak;
+    stats->limit = prepared->memory.limit;
+    stats->evicted = prepared->buckets_evicted;
+    stats->folded = prepared->buckets_folded;
+    stats->dropped = prepared->buckets_dropped;
+    return 0;
+}
+
+/* Checkpoints
+ *
+ * Each query is written as its string and a length-prefixed record of
+ * its stages, so that records nothing matches on restore are skipped.
+ * An aggregation stage writes its buckets least recently updated first
+ * (sliding windows group by group, with their panes); a correlation
+ * stage writes its buffered events. Results waiting in a top stage are
+ * flushed in the scheduler run that closes their window, so there are
+ * none between events. Restoring goes through the helpers events use,
+ * which schedule deadlines afresh.
+ */
+
+#define CHECKPOINT_BUCKET_INDEXED 0x01
+
+/* Helper: Write an interned group key, part by part */
+static void checkpoint_group_key(nql_agg_state_t* agg_state, int key_id,
+                                 nblex_ckpt_writer_t* writer) {
+    for (size_t i = 0; i < agg_state->group_by_count; i++) {
+        const char* part = nql_interner_part(agg_state->keys, key_id, i);
+        nblex_ckpt_put_string(writer, part, part ? strlen(part) : 0);
+    }
+}
+
+/* Helper: Read and intern a group key; returns a key ID holding a
+ * reference the caller must release, or -1
+ */
+static int restore_group_key(nql_agg_state_t* agg_state, nblex_ckpt_reader_t* reader) {
+    for (size_t i = 0; i < agg_state->group_by_count; i++) {
+        size_t length;
+        const char* part = nblex_ckpt_get_string(reader, &length);
+        if (!part) {
+            return -1;
+        }
+        agg_state->key_parts[i].data = part;
+        agg_state->key_parts[i].length = length;
+    }
+    return nql_interner_intern(agg_state->keys, agg_state->key_parts);
+}
+
+/* Helper: Write a bucket's group key, window and partial aggregates */
+static void checkpoint_bucket(nql_agg_state_t* agg_state, const nql_agg_bucket_t* bucket,
+                              nblex_ckpt_writer_t* writer) {
+    checkpoint_group_key(agg_state, bucket->key_id, writer);
+    nblex_ckpt_put_u64(writer, bucket->window_start_ns);
+    nblex_ckpt_put_u64(writer, bucket->window_end_ns);
+    nblex_ckpt_put_u64(writer, bucket->last_event_ns);
+    nblex_ckpt_put_u8(writer, bucket->indexed ? CHECKPOINT_BUCKET_INDEXED : 0);
+    nblex_ckpt_put_u64(writer, bucket->count);
+    nblex_ckpt_put_double(writer, bucket->sum);
+    nblex_ckpt_put_double(writer, bucket->min);
+    nblex_ckpt_put_double(writer, bucket->max);
+    nblex_ckpt_put_double(writer, bucket->sum_squares);
+    
+    for (size_t i = 0; i < agg_state->funcs_count; i++) {
+        const nql_func_state_t* state = bucket->func_states ? &bucket->func_states[i] : NULL;
+        if (agg_state->funcs[i].type == NQL_AGG_PERCENTILE && state && state->sketch) {
+            nblex_ckpt_put_u8(writer, 1);
+            nblex_quantile_sketch_write(state->sketch, writer);
+        } else if (agg_state->funcs[i].type == NQL_AGG_DISTINCT && state && state->hll) {
+            nblex_ckpt_put_u8(writer, 1);
+            nblex_hll_write(state->hll, writer);
+        } else {
+            nblex_ckpt_put_u8(writer, 0);
+        }
+    }
+}
+
+/* Helper: Recreate a bucket written by checkpoint_bucket() */
+static nql_agg_bucket_t* restore_bucket(nql_agg_state_t* agg_state, nblex_ckpt_reader_t* reader) {
+    int key_id = restore_group_key(agg_state, reader);
+    if (key_id < 0) {
+        return NULL;
+    }
+    uint64_t window_start_ns = nblex_ckpt_get_u64(reader);
+    uint64_t window_end_ns = nblex_ckpt_get_u64(reader);
+    uint64_t last_event_ns = nblex_ckpt_get_u64(reader);
+    uint8_t flags = nblex_ckpt_get_u8(reader);
+    nql_agg_bucket_t* bucket = NULL;
+    if (!reader->failed) {
+        bucket = create_bucket_with_window(agg_state, key_id, window_start_ns, window_end_ns);
+    }
+    nql_interner_release(agg_state->keys, key_id);
+    if (!bucket) {
+        return NULL;
+    }
+    
+    bucket->last_event_ns = last_event_ns;
+    bucket->count = nblex_ckpt_get_u64(reader);
+    bucket->sum = nblex_ckpt_get_double(reader);
+    bucket->min = nblex_ckpt_get_double(reader);
+    bucket->max = nblex_ckpt_get_double(reader);
+    bucket->sum_squares = nblex_ckpt_get_double(reader);
+    
+    for (size_t i = 0; i < agg_state->funcs_count && !reader->failed; i++) {
+        if (nblex_ckpt_get_u8(reader) == 0) {
+            continue;
+        }
+        nql_func_state_t* state = get_func_state(agg_state, bucket, i);
+        if (!state) {
+            return NULL;
+        }
+        if (agg_state->funcs[i].type == NQL_AGG_PERCENTILE) {
+            state->sketch = nblex_quantile_sketch_read(reader);
+            if (!state->sketch) {
+                return NULL;
+            }
+        } else if (agg_state->funcs[i].type == NQL_AGG_DISTINCT) {
+            state->hll = nblex_hll_read(reader);
+            if (!state->hll) {
+                return NULL;
+            }
+        } else {
+            return NULL;
+        }
+    }
+    if (reader->failed) {
+        return NULL;
+    }
+    
+    /* A session that had gone quiet was out of the index, and closes
+     * after its last event rather than its first */
+    if (!(flags & CHECKPOINT_BUCKET_INDEXED)) {
+        bucket_index_remove(agg_state, bucket);
+    }
+    if (agg_state->window.type == NQL_WINDOW_SESSION &&
+        nblex_deadline_schedule(agg_state->scheduler, &bucket->deadline,
+                                bucket_close_ns(agg_state, bucket)) != 0) {
+        return NULL;
+    }
+    return bucket;
+}
+
+/* Helper: Write an aggregation stage's buckets */
+static void checkpoint_agg_state(nql_agg_state_t* agg_state, nblex_ckpt_writer_t* writer) {
+    if (agg_state->window.type != NQL_WINDOW_SLIDING) {
+        nblex_ckpt_put_u32(writer, (uint32_t)agg_state->bucket_count);
+        for (nql_agg_bucket_t* bucket = agg_state->buckets_tail; bucket; bucket = bucket->prev) {
+            checkpoint_bucket(agg_state, bucket, writer);
+        }
+        return;
+    }
+    
+    size_t groups_offset = writer->size;
+    uint32_t groups = 0;
+    nblex_ckpt_put_u32(writer, 0);
+    for (size_t g = 0; g < agg_state->slide_groups_capacity; g++) {
+        nql_slide_group_t* group = agg_state->slide_groups[g];
+        if (!group) {
+            continue;
+        }
+        checkpoint_group_key(agg_state, group->key_id, writer);
+        nblex_ckpt_put_u64(writer, group->emitted_end_ns);
+        size_t panes_offset = writer->size;
+        uint32_t panes = 0;
+        nblex_ckpt_put_u32(writer, 0);
+        for (nql_agg_bucket_t* pane = group->panes; pane; pane = pane->pane_next) {
+            checkpoint_bucket(agg_state, pane, writer);
+            panes++;
+        }
+        nblex_ckpt_patch_u32(writer, panes_offset, panes);
+        groups++;
+    }
+    nblex_ckpt_patch_u32(writer, groups_offset, groups);
+}
+
+/* Helper: Restore an aggregation stage's buckets */
+static int restore_agg_state(nql_agg_state_t* agg_state, nblex_ckpt_reader_t* reader) {
+    uint32_t count = nblex_ckpt_get_u32(reader);
+    if (agg_state->window.type != NQL_WINDOW_SLIDING) {
+        for (uint32_t i = 0; i < count && !reader->failed; i++) {
+            if (!restore_bucket(agg_state, reader)) {
+                return -1;
+            }
+        }
+        return reader->failed ? -1 : 0;
+    }
+    
+    for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        int key_id = restore_group_key(agg_state, reader);
+        if (key_id < 0) {
+            return -1;
+        }
+        nql_slide_group_t* group = get_slide_group(agg_state, key_id);
+        nql_interner_release(agg_state->keys, key_id);
+        if (!group) {
+            return -1;
+        }
+        group->emitted_end_ns = nblex_ckpt_get_u64(reader);
+        uint32_t panes = nblex_ckpt_get_u32(reader);
+        for (uint32_t p = 0; p < panes && !reader->failed; p++) {
+            nql_agg_bucket_t* pane = restore_bucket(agg_state, reader);
+            if (!pane) {
+                return -1;
+            }
+            slide_group_add_pane(group, pane);
+            if (slide_group_schedule(agg_state, group,
+                                     slide_first_window_end(agg_state, pane->window_start_ns)) != 0) {
+                return -1;
+            }
+        }
+        if (!group->panes) {
+            free_slide_group(agg_state, group);
+        }
+    }
+    return reader->failed ? -1 : 0;
+}
+
+/* Helper: Write a correlation buffer, newest first as held */
+static void checkpoint_corr_buffer(const nblex_event_buffer_entry* entry, size_t count,
+                                   nblex_ckpt_writer_t* writer) {
+    nblex_ckpt_put_u32(writer, (uint32_t)count);
+    for (; entry; entry = entry->next) {
+        char* data = entry->event->data ? nblex_json_dumps(entry->event->data, JSON_COMPACT) : NULL;
+        nblex_ckpt_put_u32(writer, (uint32_t)entry->event->type);
+        nblex_ckpt_put_u64(writer, entry->event->timestamp_ns);
+        nblex_ckpt_put_string(writer, data, data ? strlen(data) : 0);
+        free(data);
+    }
+}
+
+/* Helper: Restore a correlation buffer; returns the oldest event time
+ * restored, UINT64_MAX if none, or 0 on error
+ */
+static uint64_t restore_corr_buffer(nql_corr_state_t* corr_state,
+                                    nblex_event_buffer_entry** head, size_t* count,
+                                    nblex_ckpt_reader_t* reader) {
+    uint64_t oldest_ns = UINT64_MAX;
+    uint32_t entries = nblex_ckpt_get_u32(reader);
+    nblex_event_buffer_entry** tail = head;
+    for (uint32_t i = 0; i < entries && !reader->failed; i++) {
+        nblex_event_type type = (nblex_event_type)nblex_ckpt_get_u32(reader);
+        uint64_t timestamp_ns = nblex_ckpt_get_u64(reader);
+        size_t length;
+        const char* data = nblex_ckpt_get_string(reader, &length);
+        if (!data) {
+            return 0;
+        }
+        
+        nblex_event_buffer_entry* entry = nblex_pool_calloc(corr_state->entries);
+        nblex_event* event = entry ? nblex_event_new(type, NULL) : NULL;
+        if (!event) {
+            nblex_pool_free(corr_state->entries, entry);
+            return 0;
+        }
+        event->timestamp_ns = timestamp_ns;
+        event->data = length > 0 ? json_loadb(data, length, 0, NULL) : NULL;
+        entry->event = event;
+        *tail = entry;
+        tail = &entry->next;
+        (*count)++;
+        if (length > 0 && !event->data) {
+            return 0;
+        }
+        if (timestamp_ns < oldest_ns) {
+            oldest_ns = timestamp_ns;
+        }
+    }
+    return reader->failed ? 0 : oldest_ns;
+}
+
+/* Helper: Rebuild a keyed correlation's join index over a restored
+ * buffer, oldest first so slots keep arrival order */
+static int index_corr_buffer(nql_corr_state_t* corr_state, nql_join_index_t* join,
+                             nblex_event_buffer_entry* head, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    nblex_event_buffer_entry** entries = nblex_malloc(count * sizeof(nblex_event_buffer_entry*));
+    if (!entries) {
+        return -1;
+    }
+    size_t n = 0;
+    for (nblex_event_buffer_entry* entry = head; entry && n < count; entry = entry->next) {
+        entries[n++] = entry;
+    }
+    
+    int rc = 0;
+    while (n > 0 && rc == 0) {
+        nblex_event_buffer_entry* entry = entries[--n];
+        char number[64];
+        size_t key_length;
+        const char* key = corr_join_key(corr_state, entry->event, number, sizeof(number),
+                                        &key_length);
+        if (key) {
+            rc = join_index_add(corr_state, join, entry, key, key_length);
+        }
+    }
+    nblex_free(entries);
+    return rc;
+}
+
+/* Helper: Write a prepared query's stage states */
+static void checkpoint_prepared(nql_prepared_t* prepared, nblex_ckpt_writer_t* writer) {
+    nblex_ckpt_put_u32(writer, (uint32_t)prepared->stages_count);
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        nblex_ckpt_put_u8(writer, (uint8_t)ctx->query->type);
+        if (ctx->query->type == NQL_QUERY_AGGREGATE && ctx->state.agg_state) {
+            nblex_ckpt_put_u8(writer, 1);
+            checkpoint_agg_state(ctx->state.agg_state, writer);
+        } else if (ctx->query->type == NQL_QUERY_CORRELATE && ctx->state.corr_state) {
+            nql_corr_state_t* corr_state = ctx->state.corr_state;
+            nblex_ckpt_put_u8(writer, 1);
+            checkpoint_corr_buffer(corr_state->left_events, corr_state->left_count, writer);
+            checkpoint_corr_buffer(corr_state->right_events, corr_state->right_count, writer);
+        } else {
+            nblex_ckpt_put_u8(writer, 0);
+        }
+    }
+}
+
+/* Helper: Free every stage's state, as before the query first ran */
+static void reset_prepared_state(nql_prepared_t* prepared) {
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        if (ctx->query->type == NQL_QUERY_AGGREGATE) {
+            free_agg_state(ctx->state.agg_state);
+            ctx->state.agg_state = NULL;
+        } else if (ctx->query->type == NQL_QUERY_CORRELATE) {
+            free_corr_state(ctx->state.corr_state);
+            ctx->state.corr_state = NULL;
+        }
+    }
+}
+
+/* Helper: Does a prepared query hold any stage state? */
+static bool prepared_has_state(const nql_prepared_t* prepared) {
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        if (prepared->stages[i].state.agg_state) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Helper: Restore a prepared query's stage states; -1 if the record
+ * does not fit the query or cannot be read
+ */
+static int restore_prepared(nql_prepared_t* prepared, nblex_ckpt_reader_t* reader) {
+    if (nblex_ckpt_get_u32(reader) != prepared->stages_count) {
+        return -1;
+    }
+    for (size_t i = 0; i < prepared->stages_count && !reader->failed; i++) {
+        nql_exec_ctx_t* ctx = &prepared->stages[i];
+        uint8_t type = nblex_ckpt_get_u8(reader);
+        bool has_state = nblex_ckpt_get_u8(reader) != 0;
+        if (reader->failed || type != (uint8_t)ctx->query->type) {
+            return -1;
+        }
+        if (!has_state) {
+            continue;
+        }
+        
+        if (ctx->query->type == NQL_QUERY_AGGREGATE) {
+            nql_agg_state_t* agg_state = get_agg_state(ctx);
+            if (!agg_state || restore_agg_state(agg_state, reader) != 0) {
+                return -1;
+            }
+        } else if (ctx->query->type == NQL_QUERY_CORRELATE) {
+            nql_corr_state_t* corr_state = get_corr_state(ctx);
+            if (!corr_state) {
+                return -1;
+            }
+            uint64_t left_ns = restore_corr_buffer(corr_state, &corr_state->left_events,
+                                                   &corr_state->left_count, reader);
+            uint64_t right_ns = restore_corr_buffer(corr_state, &corr_state->right_events,
+                                                    &corr_state->right_count, reader);
+            if (left_ns == 0 || right_ns == 0) {
+                return -1;
+            }
+            if (corr_state->on_field &&
+                (index_corr_buffer(corr_state, &corr_state->left_index,
+                                   corr_state->left_events, corr_state->left_count) != 0 ||
+                 index_corr_buffer(corr_state, &corr_state->right_index,
+                                   corr_state->right_events, corr_state->right_count) != 0)) {
+                return -1;
+            }
+            uint64_t oldest_ns = left_ns < right_ns ? left_ns : right_ns;
+            if (oldest_ns != UINT64_MAX &&
+                nblex_deadline_schedule(corr_state->scheduler, &corr_state->expiry,
+                                        corr_expire_ns(corr_state, oldest_ns)) != 0) {
+                return -1;
+            }
+        } else {
+            return -1;
+        }
+    }
+    return reader->failed ? -1 : 0;
+}
+
+/* Write the state of every query bound to a world */
+int nql_world_checkpoint(nblex_world* world, nblex_ckpt_writer_t* writer) {
+    if (!world || !writer) {
+        return -1;
+    }
+    
+    size_t count_offset = writer->size;
+    uint32_t count = 0;
+    nblex_ckpt_put_u32(writer, 0);
+    size_t limit = world->queries ? nql_registry_capacity(world->queries) : 0;
+    for (size_t id = 0; id < limit; id++) {
+        nql_prepared_t* prepared = nql_registry_get(world->queries, (int)id);
+        if (!prepared || !prepared_has_state(prepared)) {
+            continue;
+        }
+        nblex_ckpt_put_string(writer, prepared->query_string, strlen(prepared->query_string));
+        size_t length_offset = writer->size;
+        nblex_ckpt_put_u32(writer, 0);
+        checkpoint_prepared(prepared, writer);
+        nblex_ckpt_patch_u32(writer, length_offset,
+                             (uint32_t)(writer->size - length_offset - sizeof(uint32_t)));
+        count++;
+    }
+    nblex_ckpt_patch_u32(writer, count_offset, count);
+    return writer->failed ? -1 : 0;
+}
+
+/* Restore query state into the world's queries that have not run yet */
+int nql_world_restore(nblex_world* world, nblex_ckpt_reader_t* reader) {
+    if (!world || !reader) {
+        return -1;
+    }
+    
+    uint32_t count = nblex_ckpt_get_u32(reader);
+    for (uint32_t i = 0; i < count && !reader->failed; i++) {
+        size_t query_length;
+        const char* query_str = nblex_ckpt_get_string(reader, &query_length);
+        uint32_t record_length = nblex_ckpt_get_u32(reader);
+        const void* record = nblex_ckpt_get_bytes(reader, record_length);
+        if (!record) {
+            break;
+        }
+        
+        /* The first query of the same string that has not run yet */
+        nql_prepared_t* prepared = NULL;
+        size_t limit = world->queries ? nql_registry_capacity(world->queries) : 0;
+        for (size_t id = 0; id < limit && !prepared; id++) {
+            nql_prepared_t* candidate = nql_registry_get(world->queries, (int)id);
+            if (candidate && strlen(candidate->query_string) == query_length &&
+                memcmp(candidate->query_string, query_str, query_length) == 0 &&
+                !prepared_has_state(candidate)) {
+                prepared = candidate;
+            }
+        }
+        if (!prepared) {
+            continue;
+        }
+        
+        nblex_ckpt_reader_t record_reader = { record, record_length, 0, false };
+        nblex_mem_account_t* previous = nblex_mem_account_enter(&prepared->memory);
+        nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_EXECUTOR);
+        if (restore_prepared(prepared, &record_reader) != 0) {
+            fprintf(stderr, "Warning: Cannot restore checkpointed state of query '%s'\n",
+                    prepared->query_string);
+            reset_prepared_state(prepared);
+        }
+        nblex_mem_tag_leave(previous_tag);
+        nblex_mem_account_leave(previous);
+    }
+    
+    return reader->failed ? -1 : 0;
+}
+
+/* Growable text for query plans */
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} nql_text_t;
+
+/* Helper: Append formatted text, growing the buffer as needed */
+static void text_appendf(nql_text_t* text, const char* fmt, ...) {
+    if (text->failed) {
+        return;
+    }
+    
+    va_list ap;
+    va_start(ap, fmt);
+    int needed = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (needed < 0) {
+        text->failed = true;
+        return;
+    }
+    
+    if (text->length + (size_t)needed + 1 > text->capacity) {
+        size_t capacity = text->capacity ? text->capacity : 256;
+        while (text->length + (size_t)needed + 1 > capacity) {
+            capacity *= 2;
+        }
+        char* data = nblex_realloc(text->data, capacity);
+        if (!data) {
+            text->failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+    
+    va_start(ap, fmt);
+    vsnprintf(text->data + text->length, text->capacity - text->length, fmt, ap);
+    va_end(ap);
+    text->length += (size_t)needed;
+}
+
+/* Helper: Append a filter line of a stage, if it has the filter */
+static void explain_filter(nql_text_t* text, const char* label, const filter_t* filter) {
+    if (!filter) {
+        return;
+    }
+    char* expr = nblex_filter_to_string(filter);
+    text_appendf(text, "    %s: %s\n", label, expr ? expr : "?");
+    free(expr);
+}
+
+/* Helper: Append an aggregate function as written in a query */
+static void explain_agg_func(nql_text_t* text, const nql_agg_func_t* func) {
+    static const char* names[] = {
+        "count", "sum", "avg", "min", "max", "percentile", "distinct"
+    };
+    const char* field = func->field ? func->field : "";
+    if (func->type == NQL_AGG_PERCENTILE) {
+        text_appendf(text, "percentile(%s, %g%s)", field, func->percentile,
+                     func->accuracy == 0.0 ? ", exact" : "");
+    } else {
+        text_appendf(text, "%s(%s)", names[func->type], field);
+    }
+}
+
+/* Helper: Append the plan of one aggregate stage */
+static void explain_aggregate(nql_text_t* text, const nql_aggregate_t* agg) {
+    explain_filter(text, "where", agg->where_filter);
+    
+    text_appendf(text, "    functions: ");
+    for (size_t i = 0; i < agg->funcs_count; i++) {
+        if (i > 0) {
+            text_appendf(text, ", ");
+        }
+        explain_agg_func(text, &agg->funcs[i]);
+    }
+    text_appendf(text, "\n");
+    
+    if (agg->group_by_count > 0) {
+        text_appendf(text, "    group by: ");
+        for (size_t i = 0; i < agg->group_by_count; i++) {
+            text_appendf(text, "%s%s", i > 0 ? ", " : "", agg->group_by_fields[i]);
+        }
+        text_appendf(text, "\n");
+    }
+    
+    const nql_window_t* window = &agg->window;
+    switch (window->type) {
+        case NQL_WINDOW_TUMBLING:
+            text_appendf(text, "    window: tumbling %llu ms\n",
+                         (unsigned long long)window->size_ms);
+            break;
+        case NQL_WINDOW_SLIDING:
+            text_appendf(text, "    window: sliding %llu ms every %llu ms\n",
+                         (unsigned long long)window->size_ms,
+                         (unsigned long long)window->slide_ms);
+            break;
+        case NQL_WINDOW_SESSION:
+            text_appendf(text, "    window: session, %llu ms gap\n",
+                         (unsigned long long)window->timeout_ms);
+            break;
+        default:
+            text_appendf(text, "    window: none, result per event\n");
+            break;
+    }
+}
+
+/* Helper: Append the counters collected for one stage */
+static void explain_stage_stats(nql_text_t* text, const nql_exec_ctx_t* ctx) {
+    const nql_stage_stats_t* stats = &ctx->stats;
+    double selectivity = stats->events_in ?
+                         100.0 * (double)stats->events_out / (double)stats->events_in : 0.0;
+    text_appendf(text, "    events: %llu in, %llu out (%.1f%%)\n",
+                 (unsigned long long)stats->events_in,
+                 (unsigned long long)stats->events_out, selectivity);
+    text_appendf(text, "    time: %llu ns (%llu ns/event)\n",
+                 (unsigned long long)stats->time_ns,
+                 (unsigned long long)(stats->events_in ? stats->time_ns / stats->events_in : 0));
+    text_appendf(text, "    allocations: %llu\n", (unsigned long long)stats->allocations);
+    
+    if (ctx->query->type == NQL_QUERY_AGGREGATE && ctx->state.agg_state) {
+        text_appendf(text, "    buckets: %zu open\n", ctx->state.agg_state->bucket_count);
+    } else if (ctx->query->type == NQL_QUERY_CORRELATE && ctx->state.corr_state) {
+        text_appendf(text, "    buffered: %zu left, %zu right\n",
+                     ctx->state.corr_state->left_count, ctx->state.corr_state->right_count);
+        if (ctx->state.corr_state->on_field) {
+            text_appendf(text, "    join slots: %zu left, %zu right\n",
+                         ctx->state.corr_state->left_index.index.count,
+                         ctx->state.corr_state->right_index.index.count);
+        }
+    }
+}
+
+/* Describe a prepared query's plan, with its counters under analyze */
+char* nql_explain(const nql_prepared_t* prepared) {
+    if (!prepared) {
+        return NULL;
+    }
+    
+    nql_text_t text = {0};
+    text_appendf(&text, "%s\n", prepared->query_string);
+    
+    for (size_t i = 0; i < prepared->stages_count; i++) {
+        const nql_exec_ctx_t* ctx = &prepared->stages[i];
+        const nql_query_t* query = ctx->query;
+        
+        switch (query->type) {
+            case NQL_QUERY_FILTER:
+                text_appendf(&text, "  stage %zu: filter\n", i + 1);
+                explain_filter(&text, "where", query->data.filter);
+                break;
+                
+            case NQL_QUERY_SHOW:
+                text_appendf(&text, "  stage %zu: show\n", i + 1);
+                if (query->data.show->select_all) {
+                    text_appendf(&text, "    fields: *\n");
+                } else {
+                    text_appendf(&text, "    fields: ");
+                    for (size_t f = 0; f < query->data.show->fields_count; f++) {
+                        text_appendf(&text, "%s%s", f > 0 ? ", " : "",
+                                     query->data.show->fields[f]);
+                    }
+                    text_appendf(&text, "\n");
+                }
+                explain_filter(&text, "where", query->data.show->where_filter);
+                break;
+                
+            case NQL_QUERY_AGGREGATE:
+                text_appendf(&text, "  stage %zu: aggregate\n", i + 1);
+                explain_aggregate(&text, query->data.aggregate);
+                break;
+                
+            case NQL_QUERY_CORRELATE:
+                text_appendf(&text, "  stage %zu: correlate\n", i + 1);
+                explain_filter(&text, "left", query->data.correlate->left_filter);
+                explain_filter(&text, "right", query->data.correlate->right_filter);
+                if (query->data.correlate->on_field) {
+                    text_appendf(&text, "    on: %s (hash join)\n", query->data.correlate->on_field);
+                }
+                text_appendf(&text, "    within: %llu ms\n",
+                             (unsigned long long)query->data.correlate->within_ms);
+                break;
+                
+            case NQL_QUERY_TOP: {
+                const nql_top_t* top = query->data.top;
+                text_appendf(&text, "  stage %zu: top\n", i + 1);
+                if (top->ordered) {
+                    text_appendf(&text, "    order by: ");
+                    explain_agg_func(&text, &top->order_func);
+                    text_appendf(&text, " %s\n", top->descending ? "desc" : "asc");
+                }
+                if (top->limit) {
+                    text_appendf(&text, "    limit: %llu\n", (unsigned long long)top->limit);
+                }
+                break;
+            }
+                
+            default:
+                continue;
+        }
+        
+        if (prepared->analyze) {
+            explain_stage_stats(&text, ctx);
+        }
+    }
+    
+    if (prepared->analyze) {
+        text_appendf(&text, "  memory: %zu bytes, peak %zu", prepared->memory.used,
+                     prepared->memory.peak);
+        if (prepared->memory.limit) {
+            text_appendf(&text, ", limit %zu", prepared->memory.limit);
+        }
+        text_appendf(&text, "\n");
+        if (prepared->buckets_evicted || prepared->buckets_folded || prepared->buckets_dropped) {
+            text_appendf(&text, "  buckets evicted: %llu emitted, %llu folded, %llu dropped\n",
+                         (unsigned long long)prepared->buckets_evicted,
+                         (unsigned long long)prepared->buckets_folded,
+                         (unsigned long long)prepared->buckets_dropped);
+        }
+    }
+    
+    if (text.failed) {
+        nblex_free(text.data);
+        return NULL;
+    }
+    return text.data;
+}
+
+/* Counters of one stage of a query prepared with explain analyze */
+int nql_prepared_get_stage_stats(const nql_prepared_t* prepared, size_t stage,
+                                 nql_stage_stats_t* stats) {
+    if (!prepared || !stats || stage >= prepared->stages_count) {
+        return -1;
+    }
+    *stats = prepared->stages[stage].stats;
+    return 0;
+}
+
+/* Public API: Execute a query string on event.
+ *
+ * The query is prepared on first use and kept in the world's registry,
+ * indexed by its string, so repeated calls with the same string share
+ * state and do not re-parse. Without a world only stateless queries are
+ * evaluated and nothing is kept.
+ */
+int nql_execute(const char* query_str, nblex_event* event, nblex_world* world) {
+    if (!query_str || !event) {
+        return 0;
+    }
+    
+    if (!world) {
+        nql_prepared_t* prepared = nql_prepare(query_str, NULL);
+        int result = nql_execute_prepared(prepared, event);
+        nql_prepared_free(prepared);
+        return result;
+    }
+    
+    nql_prepared_t* prepared = nql_registry_find(world->queries, query_str);
+    if (!prepared) {
+        prepared = prepare_query(query_str, world, true, NULL);
+        if (!prepared) {
+            return 0;
+        }
+        prepared->world_owned = true;
+    }
+    
+    return nql_execute_prepared(prepared, event);
+}
+
+/* Register a standing query owned by the world; returns its query ID */
+int nql_register(nblex_world* world, const char* query_str, char** error_out) {
+    if (!world) {
+        if (error_out) {
+            *error_out = NULL;
+        }
+        return -1;
+    }
+    
+    nql_prepared_t* prepared = prepare_query(query_str, world, false, error_out);
+    if (!prepared) {
+        return -1;
+    }
+    prepared->world_owned = true;
+    return prepared->id;
+}
+
+/* Execute a registered query by ID */
+int nql_execute_id(nblex_world* world, int query_id, nblex_event* event) {
+    if (!world) {
+        return 0;
+    }
+    return nql_execute_prepared(nql_registry_get(world->queries, query_id), event);
+}
+
+/* Execute every query bound to a world against one event. Their
+ * filters are in the world's predicate DAG, so within this scope each
+ * predicate they share is evaluated once for the event.
+ */
+int nql_execute_all(nblex_world* world, nblex_event* event, nql_match_cb matched, void* user_data) {
+    if (!world || !event || !world->queries) {
+        return 0;
+    }
+    
+    filter_dag_scope_t scope;
+    if (world->filter_dag) {
+        nblex_filter_dag_begin(world->filter_dag, event, &scope);
+    }
+    
+    /* Queries may be unregistered by a callback; look each ID up afresh */
+    int count = 0;
+    for (size_t id = 0; id < nql_registry_capacity(world->queries); id++) {
+        nql_prepared_t* prepared = nql_registry_get(world->queries, (int)id);
+        if (prepared && nql_execute_prepared(prepared, event)) {
+            count++;
+            if (matched) {
+                matched((int)id, event, user_data);
+            }
+        }
+    }
+    
+    if (world->filter_dag) {
+        nblex_filter_dag_end(world->filter_dag, &scope);
+    }
+    return count;
+}
+
+/* Execute every query bound to a world against a batch of events. Each
+ * query runs over up to NBLEX_BATCH_SIZE events before the next query,
+ * so within a query events are still seen in order.
+ */
+size_t nql_execute_all_batch(nblex_world* world, nblex_event** events, size_t count,
+                             nql_match_cb matched, void* user_data) {
+    if (!world || !events || !world->queries) {
+        return 0;
+    }
+    
+    size_t total = 0;
+    for (size_t base = 0; base < count; base += NBLEX_BATCH_SIZE) {
+        size_t batch_count = count - base < NBLEX_BATCH_SIZE ? count - base : NBLEX_BATCH_SIZE;
+        nblex_event** batch = events + base;
+        uint32_t matched_idx[NBLEX_BATCH_SIZE];
+        
+        /* Queries may be unregistered by a callback; look each ID up afresh */
+        for (size_t id = 0; id < nql_registry_capacity(world->queries); id++) {
+            nql_prepared_t* prepared = nql_registry_get(world->queries, (int)id);
+            if (!prepared) {
+                continue;
+            }
+            size_t matched_count = nql_execute_prepared_batch(prepared, batch, batch_count,
+                                                              matched_idx);
+            total += matched_count;
+            for (size_t i = 0; matched && i < matched_count; i++) {
+                matched((int)id, batch[matched_idx[i]], user_data);
+            }
+        }
+    }
+    return total;
+}
+
+/* Unregister and free a world-owned query */
+int nql_unregister(nblex_world* world, int query_id) {
+    if (!world) {
+        return -1;
+    }
+    
+    nql_prepared_t* prepared = nql_registry_get(world->queries, query_id);
+    if (!prepared || !prepared->world_owned) {
+        return -1;
+    }
+    
+    nql_prepared_free(prepared);
+    return 0;
 }
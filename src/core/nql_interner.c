@@ -0,0 +1,290 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * nql_interner.c - Interned group-key tuples for nQL aggregation
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_ARENA_SIZE 4096
+#define INITIAL_KEYS_CAPACITY 16
+#define COMPACT_MIN_DEAD_BYTES 4096
+
+/* Interned tuple: its bytes live in the arena at `offset` */
+typedef struct {
+  uint64_t hash;
+  size_t offset;
+  size_t size;
+  uint32_t refs;
+  int next_free;          /* Next free key ID when unused, -1 terminates */
+} nql_interned_key_t;
+
+/*
+ * Interner structure
+ *
+ * Each distinct tuple of `parts_count` strings is stored once in a
+ * contiguous arena as consecutive length-prefixed, NUL-terminated parts,
+ * and is named by a stable ID into `keys`. A hash index of key IDs finds
+ * a tuple from its parts without copying them. Keys are reference
+ * counted; released keys leave the index, their IDs are reused and their
+ * arena bytes are reclaimed by compaction once enough are dead.
+ * Allocation happens only when a table or the arena grows, so interning
+ * a known tuple never touches the heap.
+ */
+struct nql_interner_s {
+  size_t parts_count;
+
+  char* arena;
+  size_t arena_size;
+  size_t arena_used;
+  size_t arena_dead;      /* Bytes of released keys */
+
+  nql_interned_key_t* keys;
+  size_t keys_capacity;
+  size_t keys_used;       /* High-water mark of assigned IDs */
+  size_t count;           /* Live keys */
+  int free_head;
+
+  nblex_index_t index;    /* Key ID + 1 by tuple hash */
+};
+
+nql_interner_t* nql_interner_new(size_t parts_count) {
+  nql_interner_t* interner = nblex_calloc(1, sizeof(nql_interner_t));
+  if (!interner) {
+    return NULL;
+  }
+  interner->parts_count = parts_count;
+  interner->free_head = -1;
+  return interner;
+}
+
+void nql_interner_free(nql_interner_t* interner) {
+  if (!interner) {
+    return;
+  }
+  nblex_free(interner->arena);
+  nblex_free(interner->keys);
+  nblex_index_free(&interner->index);
+  nblex_free(interner);
+}
+
+uint64_t nql_interner_hash_parts(const nql_key_part_t* parts, size_t parts_count) {
+  uint64_t hash = 0;
+  for (size_t i = 0; i < parts_count; i++) {
+    hash = nblex_hash64_combine(hash, nblex_hash64(parts[i].data, parts[i].length, i));
+  }
+  return hash;
+}
+
+/* Helper: Does a stored tuple equal the given parts? */
+static bool key_equals(const nql_interner_t* interner, const nql_interned_key_t* key,
+                       const nql_key_part_t* parts) {
+  const char* p = interner->arena + key->offset;
+  for (size_t i = 0; i < interner->parts_count; i++) {
+    uint32_t length;
+    memcpy(&length, p, sizeof(length));
+    p += sizeof(length);
+    if (length != parts[i].length || memcmp(p, parts[i].data, length) != 0) {
+      return false;
+    }
+    p += length + 1;
+  }
+  return true;
+}
+
+/* Helper: Copy live tuples into a fresh arena; IDs are unchanged */
+static int arena_compact(nql_interner_t* interner, size_t needed) {
+  size_t live = interner->arena_used - interner->arena_dead;
+  size_t size = INITIAL_ARENA_SIZE;
+  while (size < (live + needed) * 2) {
+    size *= 2;
+  }
+
+  char* arena = nblex_malloc(size);
+  if (!arena) {
+    return -1;
+  }
+
+  size_t used = 0;
+  for (size_t id = 0; id < interner->keys_used; id++) {
+    nql_interned_key_t* key = &interner->keys[id];
+    if (key->refs > 0) {
+      memcpy(arena + used, interner->arena + key->offset, key->size);
+      key->offset = used;
+      used += key->size;
+    }
+  }
+
+  nblex_free(interner->arena);
+  interner->arena = arena;
+  interner->arena_size = size;
+  interner->arena_used = used;
+  interner->arena_dead = 0;
+  return 0;
+}
+
+/* Helper: Make room for `needed` more arena bytes */
+static int arena_reserve(nql_interner_t* interner, size_t needed) {
+  if (interner->arena && interner->arena_used + needed <= interner->arena_size) {
+    return 0;
+  }
+
+  /* Reclaim released tuples rather than grow when they dominate */
+  if (interner->arena_dead >= COMPACT_MIN_DEAD_BYTES &&
+      interner->arena_dead * 2 >= interner->arena_used) {
+    return arena_compact(interner, needed);
+  }
+
+  size_t size = interner->arena_size ? interner->arena_size : INITIAL_ARENA_SIZE;
+  while (size < interner->arena_used + needed) {
+    size *= 2;
+  }
+  char* arena = nblex_realloc(interner->arena, size);
+  if (!arena) {
+    return -1;
+  }
+  interner->arena = arena;
+  interner->arena_size = size;
+  return 0;
+}
+
+/* Helper: Take a free key ID, growing the key table if needed */
+static int key_alloc(nql_interner_t* interner) {
+  if (interner->free_head >= 0) {
+    int id = interner->free_head;
+    interner->free_head = interner->keys[id].next_free;
+    return id;
+  }
+
+  if (interner->keys_used == interner->keys_capacity) {
+    size_t capacity = interner->keys_capacity ? interner->keys_capacity * 2 :
+                                                INITIAL_KEYS_CAPACITY;
+    nql_interned_key_t* keys =
+        nblex_realloc(interner->keys, capacity * sizeof(nql_interned_key_t));
+    if (!keys) {
+      return -1;
+    }
+    interner->keys = keys;
+    interner->keys_capacity = capacity;
+  }
+  return (int)interner->keys_used++;
+}
+
+int nql_interner_intern(nql_interner_t* interner, const nql_key_part_t* parts) {
+  if (!interner || (!parts && interner->parts_count > 0)) {
+    return -1;
+  }
+
+  uint64_t hash = nql_interner_hash_parts(parts, interner->parts_count);
+
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket;
+  while ((bucket = nblex_index_next(&interner->index, hash, &pos)) != NULL) {
+    int id = (int)bucket->value - 1;
+    nql_interned_key_t* key = &interner->keys[id];
+    if (key_equals(interner, key, parts)) {
+      key->refs++;
+      return id;
+    }
+  }
+
+  size_t size = 0;
+  for (size_t i = 0; i < interner->parts_count; i++) {
+    if (parts[i].length > UINT32_MAX) {
+      return -1;
+    }
+    size += sizeof(uint32_t) + parts[i].length + 1;
+  }
+
+  if (arena_reserve(interner, size) != 0) {
+    return -1;
+  }
+  int id = key_alloc(interner);
+  if (id < 0) {
+    return -1;
+  }
+
+  char* p = interner->arena + interner->arena_used;
+  for (size_t i = 0; i < interner->parts_count; i++) {
+    uint32_t length = (uint32_t)parts[i].length;
+    memcpy(p, &length, sizeof(length));
+    p += sizeof(length);
+    memcpy(p, parts[i].data, length);
+    p[length] = '\0';
+    p += length + 1;
+  }
+
+  nql_interned_key_t* key = &interner->keys[id];
+  key->hash = hash;
+  key->offset = interner->arena_used;
+  key->size = size;
+  key->refs = 1;
+  key->next_free = -1;
+  if (nblex_index_insert(&interner->index, hash, (uintptr_t)id + 1) != 0) {
+    key->refs = 0;
+    key->next_free = interner->free_head;
+    interner->free_head = id;
+    return -1;
+  }
+  interner->arena_used += size;
+  interner->count++;
+  return id;
+}
+
+void nql_interner_retain(nql_interner_t* interner, int id) {
+  if (interner && id >= 0 && (size_t)id < interner->keys_used) {
+    interner->keys[id].refs++;
+  }
+}
+
+void nql_interner_release(nql_interner_t* interner, int id) {
+  if (!interner || id < 0 || (size_t)id >= interner->keys_used ||
+      interner->keys[id].refs == 0) {
+    return;
+  }
+
+  nql_interned_key_t* key = &interner->keys[id];
+  if (--key->refs > 0) {
+    return;
+  }
+
+  nblex_index_remove(&interner->index, key->hash, (uintptr_t)id + 1);
+  interner->arena_dead += key->size;
+  key->next_free = interner->free_head;
+  interner->free_head = id;
+  interner->count--;
+}
+
+uint64_t nql_interner_hash(const nql_interner_t* interner, int id) {
+  if (!interner || id < 0 || (size_t)id >= interner->keys_used) {
+    return 0;
+  }
+  return interner->keys[id].hash;
+}
+
+const char* nql_interner_part(const nql_interner_t* interner, int id, size_t part) {
+  if (!interner || id < 0 || (size_t)id >= interner->keys_used ||
+      part >= interner->parts_count || interner->keys[id].refs == 0) {
+    return NULL;
+  }
+
+  const char* p = interner->arena + interner->keys[id].offset;
+  for (size_t i = 0; i < part; i++) {
+    uint32_t length;
+    memcpy(&length, p, sizeof(length));
+    p += sizeof(length) + length + 1;
+  }
+  return p + sizeof(uint32_t);
+}
+
+size_t nql_interner_count(const nql_interner_t* interner) {
+  return interner ? interner->count : 0;
+}
+
+size_t nql_interner_arena_size(const nql_interner_t* interner) {
+  return interner ? interner->arena_size : 0;
+}
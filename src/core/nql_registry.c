@@ -0,0 +1,146 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * nql_registry.c - Per-world registry of prepared nQL queries
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS_CAPACITY 8
+
+/* Registry slot: a prepared query plus its optional string key */
+typedef struct {
+  nql_prepared_t* prepared;
+  const char* key;        /* Borrowed from the prepared query; NULL if not indexed */
+  uint64_t key_hash;
+  int next_free;          /* Next free slot ID when unused, -1 terminates */
+} nql_registry_slot_t;
+
+/*
+ * Registry structure
+ *
+ * Query IDs index directly into `slots`, so lookup by ID is O(1). Queries
+ * registered with a key (the query string, used by nql_execute()) are
+ * also entered in a hash index of slot IDs, so lookup by string costs
+ * one hash and one string compare.
+ */
+struct nql_registry_s {
+  nql_registry_slot_t* slots;
+  size_t slots_capacity;
+  size_t slots_used;      /* High-water mark of assigned IDs */
+  size_t count;           /* Live queries */
+  int free_head;          /* Head of the free slot list, -1 if empty */
+
+  nblex_index_t index;    /* Slot ID + 1 by key hash */
+};
+
+nql_registry_t* nql_registry_new(void) {
+  nql_registry_t* registry = nblex_calloc(1, sizeof(nql_registry_t));
+  if (!registry) {
+    return NULL;
+  }
+  registry->free_head = -1;
+  return registry;
+}
+
+void nql_registry_free(nql_registry_t* registry) {
+  if (!registry) {
+    return;
+  }
+  nblex_free(registry->slots);
+  nblex_index_free(&registry->index);
+  nblex_free(registry);
+}
+
+int nql_registry_add(nql_registry_t* registry, nql_prepared_t* prepared, const char* key) {
+  if (!registry || !prepared) {
+    return -1;
+  }
+
+  int id;
+  if (registry->free_head >= 0) {
+    id = registry->free_head;
+    registry->free_head = registry->slots[id].next_free;
+  } else {
+    if (registry->slots_used == registry->slots_capacity) {
+      size_t capacity = registry->slots_capacity ? registry->slots_capacity * 2 :
+                                                   INITIAL_SLOTS_CAPACITY;
+      nql_registry_slot_t* slots =
+          nblex_realloc(registry->slots, capacity * sizeof(nql_registry_slot_t));
+      if (!slots) {
+        return -1;
+      }
+      registry->slots = slots;
+      registry->slots_capacity = capacity;
+    }
+    id = (int)registry->slots_used++;
+  }
+
+  nql_registry_slot_t* slot = &registry->slots[id];
+  slot->prepared = prepared;
+  slot->key = key;
+  slot->key_hash = key ? nblex_hash64_string(key) : 0;
+  slot->next_free = -1;
+  registry->count++;
+
+  if (key && nblex_index_insert(&registry->index, slot->key_hash, (uintptr_t)id + 1) != 0) {
+    nql_registry_remove(registry, id);
+    return -1;
+  }
+
+  return id;
+}
+
+void nql_registry_remove(nql_registry_t* registry, int id) {
+  if (!registry || id < 0 || (size_t)id >= registry->slots_used ||
+      !registry->slots[id].prepared) {
+    return;
+  }
+
+  nql_registry_slot_t* slot = &registry->slots[id];
+  if (slot->key) {
+    nblex_index_remove(&registry->index, slot->key_hash, (uintptr_t)id + 1);
+  }
+
+  slot->prepared = NULL;
+  slot->key = NULL;
+  slot->next_free = registry->free_head;
+  registry->free_head = id;
+  registry->count--;
+}
+
+nql_prepared_t* nql_registry_get(const nql_registry_t* registry, int id) {
+  if (!registry || id < 0 || (size_t)id >= registry->slots_used) {
+    return NULL;
+  }
+  return registry->slots[id].prepared;
+}
+
+nql_prepared_t* nql_registry_find(const nql_registry_t* registry, const char* key) {
+  if (!registry || !key) {
+    return NULL;
+  }
+
+  uint64_t hash = nblex_hash64_string(key);
+  size_t pos = (size_t)hash;
+  const nblex_index_bucket_t* bucket;
+  while ((bucket = nblex_index_next(&registry->index, hash, &pos)) != NULL) {
+    const nql_registry_slot_t* slot = &registry->slots[bucket->value - 1];
+    if (strcmp(slot->key, key) == 0) {
+      return slot->prepared;
+    }
+  }
+  return NULL;
+}
+
+size_t nql_registry_count(const nql_registry_t* registry) {
+  return registry ? registry->count : 0;
+}
+
+size_t nql_registry_capacity(const nql_registry_t* registry) {
+  return registry ? registry->slots_used : 0;
+}
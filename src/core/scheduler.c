@@ -0,0 +1,282 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * scheduler.c - Per-world deadline scheduler for window and expiry timers
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_HEAP_CAPACITY 64
+#define NOT_ARMED UINT64_MAX
+
+/*
+ * Scheduler structure
+ *
+ * Deadlines form a binary min-heap ordered by (when_ns, seq); each
+ * deadline records its heap position so cancelling or moving one is
+ * O(log n). A single libuv timer is armed for the earliest deadline, so
+ * a tick touches only the deadlines that are due, however many windows
+ * are open across however many queries. A scheduler made without a loop
+ * has no timer: its clock is whatever the caller passes to run, such as
+ * an event-time watermark.
+ */
+struct nblex_scheduler_s {
+  uv_timer_t timer;
+  nblex_deadline_t** heap;
+  size_t count;
+  size_t capacity;
+  uint64_t next_seq;
+  uint64_t armed_ns;        /* Deadline the timer is armed for */
+  bool has_timer;           /* False when only driven by nblex_scheduler_run() */
+};
+
+/* Helper: Heap order, earliest first and FIFO among equals */
+static bool deadline_before(const nblex_deadline_t* a, const nblex_deadline_t* b) {
+  return a->when_ns < b->when_ns || (a->when_ns == b->when_ns && a->seq < b->seq);
+}
+
+/* Helper: Put a deadline at a heap position */
+static void heap_set(nblex_scheduler_t* scheduler, size_t pos, nblex_deadline_t* deadline) {
+  scheduler->heap[pos] = deadline;
+  deadline->heap_index = pos;
+}
+
+static void heap_sift_up(nblex_scheduler_t* scheduler, size_t pos) {
+  nblex_deadline_t* deadline = scheduler->heap[pos];
+  while (pos > 0) {
+    size_t parent = (pos - 1) / 2;
+    if (!deadline_before(deadline, scheduler->heap[parent])) {
+      break;
+    }
+    heap_set(scheduler, pos, scheduler->heap[parent]);
+    pos = parent;
+  }
+  heap_set(scheduler, pos, deadline);
+}
+
+static void heap_sift_down(nblex_scheduler_t* scheduler, size_t pos) {
+  nblex_deadline_t* deadline = scheduler->heap[pos];
+  for (;;) {
+    size_t child = pos * 2 + 1;
+    if (child >= scheduler->count) {
+      break;
+    }
+    if (child + 1 < scheduler->count &&
+        deadline_before(scheduler->heap[child + 1], scheduler->heap[child])) {
+      child++;
+    }
+    if (!deadline_before(scheduler->heap[child], deadline)) {
+      break;
+    }
+    heap_set(scheduler, pos, scheduler->heap[child]);
+    pos = child;
+  }
+  heap_set(scheduler, pos, deadline);
+}
+
+/* Helper: Take a deadline out of the heap */
+static void heap_remove(nblex_scheduler_t* scheduler, nblex_deadline_t* deadline) {
+  size_t pos = deadline->heap_index;
+  nblex_deadline_t* last = scheduler->heap[--scheduler->count];
+  if (last != deadline) {
+    heap_set(scheduler, pos, last);
+    if (pos > 0 && deadline_before(last, scheduler->heap[(pos - 1) / 2])) {
+      heap_sift_up(scheduler, pos);
+    } else {
+      heap_sift_down(scheduler, pos);
+    }
+  }
+  deadline->scheduler = NULL;
+}
+
+static void scheduler_timer_cb(uv_timer_t* handle);
+
+/* Helper: Arm the timer for the earliest deadline, or stop it */
+static void scheduler_arm(nblex_scheduler_t* scheduler, uint64_t now_ns) {
+  if (!scheduler->has_timer) {
+    return;
+  }
+  if (scheduler->count == 0) {
+    if (scheduler->armed_ns != NOT_ARMED) {
+      uv_timer_stop(&scheduler->timer);
+      scheduler->armed_ns = NOT_ARMED;
+    }
+    return;
+  }
+
+  uint64_t when_ns = scheduler->heap[0]->when_ns;
+  if (when_ns == scheduler->armed_ns) {
+    return;
+  }
+
+  /* Round up so the timer never fires before the deadline is due */
+  uint64_t delay_ms = 0;
+  if (when_ns > now_ns) {
+    delay_ms = (when_ns - now_ns + 999999ULL) / 1000000ULL;
+  }
+  uv_timer_start(&scheduler->timer, scheduler_timer_cb, delay_ms, 0);
+  scheduler->armed_ns = when_ns;
+}
+
+static void scheduler_timer_cb(uv_timer_t* handle) {
+  nblex_scheduler_t* scheduler = (nblex_scheduler_t*)handle->data;
+  scheduler->armed_ns = NOT_ARMED;
+  nblex_scheduler_run(scheduler, nblex_timestamp_now());
+}
+
+nblex_scheduler_t* nblex_scheduler_new(uv_loop_t* loop) {
+  /* Shared by queries and lazily created by one: charge no query for it */
+  nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+  nblex_scheduler_t* scheduler = nblex_calloc(1, sizeof(nblex_scheduler_t));
+  nblex_mem_account_leave(previous);
+  if (!scheduler) {
+    return NULL;
+  }
+  scheduler->armed_ns = NOT_ARMED;
+
+  if (!loop) {
+    return scheduler;
+  }
+  if (uv_timer_init(loop, &scheduler->timer) != 0) {
+    nblex_free(scheduler);
+    return NULL;
+  }
+  scheduler->timer.data = scheduler;
+  scheduler->has_timer = true;
+  return scheduler;
+}
+
+/* Helper: Release the scheduler once libuv has finished closing its timer */
+static void scheduler_close_cb(uv_handle_t* handle) {
+  nblex_free(handle->data);
+}
+
+void nblex_scheduler_free(nblex_scheduler_t* scheduler) {
+  if (!scheduler) {
+    return;
+  }
+
+  for (size_t i = 0; i < scheduler->count; i++) {
+    scheduler->heap[i]->scheduler = NULL;
+  }
+  nblex_free(scheduler->heap);
+  scheduler->heap = NULL;
+  scheduler->count = 0;
+
+  if (!scheduler->has_timer) {
+    nblex_free(scheduler);
+    return;
+  }
+  uv_timer_stop(&scheduler->timer);
+  uv_close((uv_handle_t*)&scheduler->timer, scheduler_close_cb);
+}
+
+void nblex_deadline_init(nblex_deadline_t* deadline, nblex_deadline_cb cb, void* data) {
+  memset(deadline, 0, sizeof(*deadline));
+  deadline->cb = cb;
+  deadline->data = data;
+}
+
+int nblex_deadline_schedule(nblex_scheduler_t* scheduler, nblex_deadline_t* deadline,
+                            uint64_t when_ns) {
+  if (!scheduler || !deadline) {
+    return -1;
+  }
+
+  if (deadline->scheduler && deadline->scheduler != scheduler) {
+    nblex_deadline_cancel(deadline);
+  }
+
+  deadline->when_ns = when_ns;
+  deadline->seq = scheduler->next_seq++;
+
+  if (deadline->scheduler) {
+    /* Already queued here: move it; a later deadline can only sink */
+    size_t pos = deadline->heap_index;
+    if (pos > 0 && deadline_before(deadline, scheduler->heap[(pos - 1) / 2])) {
+      heap_sift_up(scheduler, pos);
+    } else {
+      heap_sift_down(scheduler, pos);
+    }
+  } else {
+    if (scheduler->count == scheduler->capacity) {
+      size_t capacity = scheduler->capacity ? scheduler->capacity * 2 : INITIAL_HEAP_CAPACITY;
+      nblex_mem_account_t* previous = nblex_mem_account_enter(NULL);
+      nblex_deadline_t** heap = nblex_realloc(scheduler->heap, capacity * sizeof(nblex_deadline_t*));
+      nblex_mem_account_leave(previous);
+      if (!heap) {
+        return -1;
+      }
+      scheduler->heap = heap;
+      scheduler->capacity = capacity;
+    }
+    deadline->scheduler = scheduler;
+    heap_set(scheduler, scheduler->count++, deadline);
+    heap_sift_up(scheduler, deadline->heap_index);
+  }
+
+  /* Re-arm only when the earliest deadline moves earlier; a timer that
+   * fires early finds nothing due and re-arms itself. */
+  if (scheduler->armed_ns == NOT_ARMED || scheduler->heap[0]->when_ns < scheduler->armed_ns) {
+    scheduler_arm(scheduler, nblex_timestamp_now());
+  }
+  return 0;
+}
+
+void nblex_deadline_cancel(nblex_deadline_t* deadline) {
+  if (!deadline || !deadline->scheduler) {
+    return;
+  }
+  /* The timer stays armed; if it fires with nothing due it re-arms */
+  heap_remove(deadline->scheduler, deadline);
+}
+
+bool nblex_deadline_pending(const nblex_deadline_t* deadline) {
+  return deadline && deadline->scheduler != NULL;
+}
+
+size_t nblex_scheduler_run(nblex_scheduler_t* scheduler, uint64_t now_ns) {
+  if (!scheduler) {
+    return 0;
+  }
+
+  /* Deadlines are dequeued before their callback runs, so callbacks may
+   * reschedule them or schedule, cancel and free others. Anything
+   * scheduled from a callback waits for the next run, even if due. */
+  uint64_t run_seq = scheduler->next_seq;
+  size_t fired = 0;
+  while (scheduler->count > 0 && scheduler->heap[0]->when_ns <= now_ns &&
+         scheduler->heap[0]->seq < run_seq) {
+    nblex_deadline_t* deadline = scheduler->heap[0];
+    heap_remove(scheduler, deadline);
+    fired++;
+    if (deadline->cb) {
+      deadline->cb(deadline, now_ns);
+    }
+  }
+
+  if (scheduler->has_timer) {
+    scheduler->armed_ns = NOT_ARMED;
+    uv_timer_stop(&scheduler->timer);
+    scheduler_arm(scheduler, now_ns);
+  }
+  return fired;
+}
+
+size_t nblex_scheduler_pending(const nblex_scheduler_t* scheduler) {
+  return scheduler ? scheduler->count : 0;
+}
+
+nblex_scheduler_t* nblex_world_scheduler(nblex_world* world) {
+  if (!world) {
+    return NULL;
+  }
+  if (!world->scheduler) {
+    world->scheduler = nblex_scheduler_new(world->loop);
+  }
+  return world->scheduler;
+}
@@ -0,0 +1,546 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * connection_correlation.c - Connection-based event correlation
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Network events keep a table of live flows keyed by their normalized
+ * 5-tuple, and of the flow each endpoint (address, port) last had
+ * traffic on. A log event naming its peer endpoint is joined to that
+ * flow with one lookup, rather than to whatever traffic happened to be
+ * near it in time. Flows idle for the idle timeout expire; at the size
+ * cap the longest idle one is evicted for a new one.
+ */
+
+#define FLOW_DEFAULT_IDLE_MS 60000
+#define FLOW_DEFAULT_MAX 65536
+
+/* Log fields naming the peer when none are configured (nginx names) */
+#define DEFAULT_PEER_IP_FIELD "remote_addr"
+#define DEFAULT_PEER_PORT_FIELD "remote_port"
+
+static const uint8_t ipv4_mapped_prefix[12] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+};
+
+/*
+ * A live flow and its traffic so far
+ */
+typedef struct flow_entry_s {
+  uint64_t hash;
+  nblex_flow_key key;
+  uint64_t first_seen_ns;
+  uint64_t last_seen_ns;
+  uint64_t packets;
+  uint64_t bytes;
+
+  struct flow_entry_s* older;    /* Idle order, by last packet */
+  struct flow_entry_s* newer;
+} flow_entry_t;
+
+/*
+ * Flow table: flows by 5-tuple hash and the flow each endpoint last had
+ * traffic on by endpoint hash, plus an idle-ordered list for expiry and
+ * eviction
+ */
+struct nblex_flow_table_s {
+  nblex_index_t flows;
+  nblex_index_t endpoints;
+
+  flow_entry_t* oldest;
+  flow_entry_t* newest;
+};
+
+/*
+ * Set the log fields naming the peer endpoint of a log event
+ */
+int nblex_correlation_set_peer_fields(nblex_correlation* corr,
+                                      const char* ip_field,
+                                      const char* port_field) {
+  if (!corr || !ip_field || !*ip_field || !port_field || !*port_field) {
+    return -1;
+  }
+
+  char* ip_copy = nblex_strdup(ip_field);
+  char* port_copy = nblex_strdup(port_field);
+  if (!ip_copy || !port_copy) {
+    nblex_free(ip_copy);
+    nblex_free(port_copy);
+    return -1;
+  }
+  nblex_free(corr->peer_ip_field);
+  nblex_free(corr->peer_port_field);
+  corr->peer_ip_field = ip_copy;
+  corr->peer_port_field = port_copy;
+  return 0;
+}
+
+/*
+ * Set the flow idle timeout and the flow table size cap
+ */
+int nblex_correlation_set_flow_limits(nblex_correlation* corr,
+                                      uint32_t idle_timeout_ms,
+                                      size_t max_flows) {
+  if (!corr) {
+    return -1;
+  }
+
+  corr->flow_idle_ns = (uint64_t)(idle_timeout_ms ? idle_timeout_ms : FLOW_DEFAULT_IDLE_MS) *
+                       1000000ULL;
+  corr->max_flows = max_flows ? max_flows : FLOW_DEFAULT_MAX;
+  return 0;
+}
+
+/*
+ * Store an IPv4 address IPv4-mapped
+ */
+void nblex_flow_map_ipv4(uint8_t addr[16], const struct in_addr* ipv4) {
+  memcpy(addr, ipv4_mapped_prefix, sizeof(ipv4_mapped_prefix));
+  memcpy(addr + sizeof(ipv4_mapped_prefix), ipv4, 4);
+}
+
+/*
+ * Put the lower (address, port) endpoint first
+ */
+void nblex_flow_key_normalize(nblex_flow_key* key) {
+  int order = memcmp(key->addr[0], key->addr[1], sizeof(key->addr[0]));
+  if (order > 0 || (order == 0 && key->port[0] > key->port[1])) {
+    uint8_t addr[16];
+    memcpy(addr, key->addr[0], sizeof(addr));
+    memcpy(key->addr[0], key->addr[1], sizeof(addr));
+    memcpy(key->addr[1], addr, sizeof(addr));
+    uint16_t port = key->port[0];
+    key->port[0] = key->port[1];
+    key->port[1] = port;
+  }
+}
+
+/*
+ * Hash a flow key; the bytes after the protocol are padding
+ */
+static uint64_t flow_key_hash(const nblex_flow_key* key) {
+  return nblex_hash64_combine(nblex_hash64(key, offsetof(nblex_flow_key, protocol), 0),
+                              key->protocol);
+}
+
+static bool flow_key_equal(const nblex_flow_key* a, const nblex_flow_key* b) {
+  return a->protocol == b->protocol &&
+         memcmp(a->addr, b->addr, sizeof(a->addr)) == 0 &&
+         memcmp(a->port, b->port, sizeof(a->port)) == 0;
+}
+
+static uint64_t endpoint_hash(const uint8_t addr[16], uint16_t port) {
+  return nblex_hash64(addr, 16, port);
+}
+
+/*
+ * Parse a textual IPv4 or IPv6 address
+ */
+static int parse_address(json_t* value, uint8_t addr[16]) {
+  if (!json_is_string(value)) {
+    return -1;
+  }
+  const char* text = json_string_value(value);
+  struct in_addr ipv4;
+  if (inet_pton(AF_INET, text, &ipv4) == 1) {
+    nblex_flow_map_ipv4(addr, &ipv4);
+    return 0;
+  }
+  return inet_pton(AF_INET6, text, addr) == 1 ? 0 : -1;
+}
+
+/*
+ * Parse a port given as an integer or a numeric string
+ */
+static int parse_port(json_t* value, uint16_t* port) {
+  long long number;
+  if (json_is_integer(value)) {
+    number = json_integer_value(value);
+  } else if (json_is_string(value) && json_string_length(value) > 0) {
+    char* end;
+    number = strtoll(json_string_value(value), &end, 10);
+    if (*end) {
+      return -1;
+    }
+  } else {
+    return -1;
+  }
+  if (number < 0 || number > 65535) {
+    return -1;
+  }
+  *port = (uint16_t)number;
+  return 0;
+}
+
+/*
+ * The flow of a network event: the key packet inputs set, or for events
+ * from other sources one built from their ip_src/ip_dst and port fields
+ */
+static int network_flow_key(const nblex_event* event, nblex_flow_key* key) {
+  if (event->flow.protocol) {
+    *key = event->flow;
+    return 0;
+  }
+
+  json_t* protocol = json_object_get(event->data, "protocol");
+  const char* src_port_field;
+  const char* dst_port_field;
+  memset(key, 0, sizeof(*key));
+  if (json_is_string(protocol) && strcmp(json_string_value(protocol), "tcp") == 0) {
+    key->protocol = IPPROTO_TCP;
+    src_port_field = "tcp_src_port";
+    dst_port_field = "tcp_dst_port";
+  } else if (json_is_string(protocol) && strcmp(json_string_value(protocol), "udp") == 0) {
+    key->protocol = IPPROTO_UDP;
+    src_port_field = "udp_src_port";
+    dst_port_field = "udp_dst_port";
+  } else {
+    return -1;
+  }
+
+  if (parse_address(json_object_get(event->data, "ip_src"), key->addr[0]) != 0 ||
+      parse_address(json_object_get(event->data, "ip_dst"), key->addr[1]) != 0 ||
+      parse_port(json_object_get(event->data, src_port_field), &key->port[0]) != 0 ||
+      parse_port(json_object_get(event->data, dst_port_field), &key->port[1]) != 0) {
+    return -1;
+  }
+  nblex_flow_key_normalize(key);
+  return 0;
+}
+
+/*
+ * Format an address, IPv4-mapped ones as IPv4
+ */
+static json_t* address_json(const uint8_t addr[16]) {
+  char text[INET6_ADDRSTRLEN];
+  if (memcmp(addr, ipv4_mapped_prefix, sizeof(ipv4_mapped_prefix)) == 0) {
+    inet_ntop(AF_INET, addr + sizeof(ipv4_mapped_prefix), text, sizeof(text));
+  } else {
+    inet_ntop(AF_INET6, addr, text, sizeof(text));
+  }
+  return json_string(text);
+}
+
+/*
+ * Look up a flow
+ */
+static flow_entry_t* flow_find(const nblex_flow_table* table, uint64_t hash,
+                               const nblex_flow_key* key) {
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket;
+  while ((bucket = nblex_index_next(&table->flows, hash, &pos)) != NULL) {
+    flow_entry_t* flow = (flow_entry_t*)bucket->value;
+    if (flow_key_equal(&flow->key, key)) {
+      return flow;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Side of a flow an endpoint is on, or -1
+ */
+static int flow_endpoint_side(const flow_entry_t* flow, const uint8_t addr[16], uint16_t port) {
+  for (int side = 0; side < 2; side++) {
+    if (flow->key.port[side] == port && memcmp(flow->key.addr[side], addr, 16) == 0) {
+      return side;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Index bucket of an endpoint, or NULL
+ */
+static nblex_index_bucket_t* endpoint_find(const nblex_flow_table* table, uint64_t hash,
+                                           const uint8_t addr[16], uint16_t port) {
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket;
+  while ((bucket = nblex_index_next(&table->endpoints, hash, &pos)) != NULL) {
+    if (flow_endpoint_side((const flow_entry_t*)bucket->value, addr, port) >= 0) {
+      return bucket;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Point an endpoint at a flow
+ */
+static int endpoint_set(nblex_flow_table* table, const uint8_t addr[16], uint16_t port,
+                        flow_entry_t* flow) {
+  uint64_t hash = endpoint_hash(addr, port);
+  nblex_index_bucket_t* bucket = endpoint_find(table, hash, addr, port);
+  if (bucket) {
+    bucket->value = (uintptr_t)flow;
+    return 0;
+  }
+  return nblex_index_insert(&table->endpoints, hash, (uintptr_t)flow);
+}
+
+/*
+ * Unlink a flow from the idle order
+ */
+static void flow_order_unlink(nblex_flow_table* table, flow_entry_t* flow) {
+  if (flow->older) {
+    flow->older->newer = flow->newer;
+  } else {
+    table->oldest = flow->newer;
+  }
+  if (flow->newer) {
+    flow->newer->older = flow->older;
+  } else {
+    table->newest = flow->older;
+  }
+  flow->older = flow->newer = NULL;
+}
+
+/*
+ * Make a flow the most recently active
+ */
+static void flow_order_touch(nblex_flow_table* table, flow_entry_t* flow) {
+  if (table->newest == flow) {
+    return;
+  }
+  if (flow->older || flow->newer || table->oldest == flow) {
+    flow_order_unlink(table, flow);
+  }
+  flow->older = table->newest;
+  if (table->newest) {
+    table->newest->newer = flow;
+  } else {
+    table->oldest = flow;
+  }
+  table->newest = flow;
+}
+
+/*
+ * Remove a flow and the endpoints still pointing at it
+ */
+static void flow_drop(nblex_flow_table* table, flow_entry_t* flow) {
+  nblex_index_remove(&table->flows, flow->hash, (uintptr_t)flow);
+  flow_order_unlink(table, flow);
+  /* Endpoints that moved on to a newer flow no longer point here */
+  for (int side = 0; side < 2; side++) {
+    nblex_index_remove(&table->endpoints,
+                       endpoint_hash(flow->key.addr[side], flow->key.port[side]),
+                       (uintptr_t)flow);
+  }
+  nblex_free(flow);
+}
+
+/*
+ * Count a packet on its flow, creating the flow (evicting the longest
+ * idle one at the cap) if it is new
+ */
+static void connection_observe_packet(nblex_correlation* corr, nblex_event* event) {
+  nblex_flow_key key;
+  if (network_flow_key(event, &key) != 0) {
+    return;
+  }
+
+  nblex_flow_table* table = corr->flow_table;
+  uint64_t hash = flow_key_hash(&key);
+  flow_entry_t* flow = flow_find(table, hash, &key);
+  if (!flow) {
+    size_t max_flows = corr->max_flows ? corr->max_flows : FLOW_DEFAULT_MAX;
+    while (table->flows.count >= max_flows && table->oldest) {
+      flow_drop(table, table->oldest);
+      corr->flows_evicted++;
+    }
+
+    flow = nblex_calloc(1, sizeof(flow_entry_t));
+    if (!flow) {
+      return;
+    }
+    flow->hash = hash;
+    flow->key = key;
+    flow->first_seen_ns = event->timestamp_ns;
+    if (nblex_index_insert(&table->flows, hash, (uintptr_t)flow) != 0) {
+      nblex_free(flow);
+      return;
+    }
+  }
+
+  if (event->timestamp_ns < flow->first_seen_ns) {
+    flow->first_seen_ns = event->timestamp_ns;
+  }
+  if (event->timestamp_ns > flow->last_seen_ns) {
+    flow->last_seen_ns = event->timestamp_ns;
+  }
+  flow->packets++;
+  flow->bytes += nblex_network_event_bytes(event);
+  flow_order_touch(table, flow);
+
+  /* An endpoint follows its most recently active flow */
+  endpoint_set(table, flow->key.addr[0], flow->key.port[0], flow);
+  endpoint_set(table, flow->key.addr[1], flow->key.port[1], flow);
+}
+
+/*
+ * Create correlation event joining a log event to its flow
+ */
+static nblex_event* create_connection_correlation_event(nblex_correlation* corr,
+                                                        const flow_entry_t* flow,
+                                                        int peer,
+                                                        nblex_event* log_event) {
+  nblex_event* corr_event = nblex_world_event_new(corr->world, NBLEX_EVENT_CORRELATION, NULL);
+  if (!corr_event) {
+    return NULL;
+  }
+  corr_event->timestamp_ns = log_event->timestamp_ns;
+
+  json_t* corr_data = json_object();
+  json_t* flow_data = json_object();
+  if (!corr_data || !flow_data) {
+    json_decref(corr_data);
+    json_decref(flow_data);
+    nblex_event_free(corr_event);
+    return NULL;
+  }
+
+  const nblex_flow_key* key = &flow->key;
+  json_object_set_new(flow_data, "protocol",
+                      json_string(key->protocol == IPPROTO_TCP ? "tcp" : "udp"));
+  json_object_set_new(flow_data, "peer_ip", address_json(key->addr[peer]));
+  json_object_set_new(flow_data, "peer_port", json_integer(key->port[peer]));
+  json_object_set_new(flow_data, "local_ip", address_json(key->addr[1 - peer]));
+  json_object_set_new(flow_data, "local_port", json_integer(key->port[1 - peer]));
+  json_object_set_new(flow_data, "packets", json_integer((json_int_t)flow->packets));
+  json_object_set_new(flow_data, "bytes", json_integer((json_int_t)flow->bytes));
+  json_object_set_new(flow_data, "duration_ms",
+                      json_real((flow->last_seen_ns - flow->first_seen_ns) / 1000000.0));
+
+  json_object_set_new(corr_data, "correlation_type", json_string("connection"));
+  json_object_set_new(corr_data, "window_ms",
+                      json_integer(corr->window_ns / 1000000ULL));
+  if (log_event->data) {
+    json_object_set(corr_data, "log", log_event->data);
+  }
+  json_object_set_new(corr_data, "flow", flow_data);
+
+  int64_t time_diff_ns = (int64_t)log_event->timestamp_ns -
+                         (int64_t)flow->last_seen_ns;
+  json_object_set_new(corr_data, "time_diff_ms", json_real(time_diff_ns / 1000000.0));
+
+  corr_event->data = corr_data;
+  return corr_event;
+}
+
+/*
+ * Join a log event to the flow its peer endpoint last had traffic on,
+ * if the log is no earlier than a window before the flow began
+ */
+static void connection_match_log(nblex_correlation* corr, nblex_event* event) {
+  if (!json_is_object(event->data)) {
+    return;
+  }
+  const char* ip_field = corr->peer_ip_field ? corr->peer_ip_field : DEFAULT_PEER_IP_FIELD;
+  const char* port_field = corr->peer_port_field ? corr->peer_port_field : DEFAULT_PEER_PORT_FIELD;
+
+  uint8_t addr[16];
+  uint16_t port;
+  if (parse_address(nblex_correlation_field_value(event->data, ip_field), addr) != 0 ||
+      parse_port(nblex_correlation_field_value(event->data, port_field), &port) != 0) {
+    return;
+  }
+
+  nblex_flow_table* table = corr->flow_table;
+  nblex_index_bucket_t* bucket = endpoint_find(table, endpoint_hash(addr, port), addr, port);
+  if (!bucket) {
+    return;
+  }
+  flow_entry_t* flow = (flow_entry_t*)bucket->value;
+  if (event->timestamp_ns + corr->window_ns < flow->first_seen_ns) {
+    return;
+  }
+  int peer = flow_endpoint_side(flow, addr, port);
+
+  nblex_event* corr_event = create_connection_correlation_event(corr, flow, peer, event);
+  if (corr_event) {
+    corr->correlations_found++;
+    if (corr->world) {
+      corr->world->events_correlated++;
+      nblex_event_emit(corr->world, corr_event);
+    } else {
+      nblex_event_free(corr_event);
+    }
+  }
+}
+
+/*
+ * Process an event through connection-based correlation
+ */
+void nblex_connection_correlation_process_event(nblex_correlation* corr, nblex_event* event) {
+  if (!corr || !event ||
+      (event->type != NBLEX_EVENT_LOG && event->type != NBLEX_EVENT_NETWORK)) {
+    return;
+  }
+
+  if (!corr->flow_table) {
+    corr->flow_table = nblex_calloc(1, sizeof(nblex_flow_table));
+    if (!corr->flow_table) {
+      return;
+    }
+  }
+
+  if (event->type == NBLEX_EVENT_NETWORK) {
+    connection_observe_packet(corr, event);
+  } else {
+    connection_match_log(corr, event);
+  }
+}
+
+/*
+ * Drop flows idle for the idle timeout, longest idle first
+ */
+void nblex_connection_correlation_expire(nblex_correlation* corr, uint64_t now_ns) {
+  if (!corr || !corr->flow_table) {
+    return;
+  }
+  nblex_flow_table* table = corr->flow_table;
+  uint64_t idle_ns = corr->flow_idle_ns ? corr->flow_idle_ns :
+                     FLOW_DEFAULT_IDLE_MS * 1000000ULL;
+  uint64_t cutoff = now_ns > idle_ns ? now_ns - idle_ns : 0;
+
+  /* Idle order follows packet time closely; a flow behind a newer one
+   * waits for a later pass */
+  while (table->oldest && table->oldest->last_seen_ns < cutoff) {
+    flow_drop(table, table->oldest);
+    corr->flows_expired++;
+  }
+}
+
+/*
+ * Free the flow table and the configured peer fields
+ */
+void nblex_connection_correlation_free(nblex_correlation* corr) {
+  if (!corr) {
+    return;
+  }
+
+  nblex_flow_table* table = corr->flow_table;
+  if (table) {
+    flow_entry_t* flow = table->oldest;
+    while (flow) {
+      flow_entry_t* newer = flow->newer;
+      nblex_free(flow);
+      flow = newer;
+    }
+    nblex_index_free(&table->endpoints);
+    nblex_index_free(&table->flows);
+    nblex_free(table);
+    corr->flow_table = NULL;
+  }
+
+  nblex_free(corr->peer_ip_field);
+  nblex_free(corr->peer_port_field);
+  corr->peer_ip_field = corr->peer_port_field = NULL;
+}
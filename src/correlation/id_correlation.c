@@ -0,0 +1,600 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * id_correlation.c - ID-based event correlation
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Log and network events carrying the same ID (a request or trace ID)
+ * are joined through a hash index from ID to the events buffered under
+ * it, so matching costs one lookup however much is buffered. A Bloom
+ * filter in front answers most lookups for IDs never seen. IDs unused
+ * for the correlation window expire.
+ */
+
+#define ID_MAX_EVENTS 64          /* Newest events kept per ID and side */
+#define ID_BLOOM_BITS_LOG2 20     /* 128KB Bloom filter */
+#define ID_BLOOM_HASHES 4
+
+/* IDs looked for when none are configured */
+static const char* default_log_id_fields[] = { "request_id", "trace_id" };
+static const char* default_network_id_fields[] = { "http.headers.x-request-id", "trace_id" };
+
+/*
+ * Events buffered under one ID
+ */
+typedef struct id_entry_s {
+  uint64_t hash;
+  char* id;
+  size_t id_length;
+  uint64_t last_seen_ns;         /* Newest event time buffered */
+
+  nblex_event_buffer_entry* log_events;      /* Newest first */
+  nblex_event_buffer_entry* network_events;
+  size_t log_count;
+  size_t network_count;
+
+  struct id_entry_s* older;      /* Expiry order, by last use */
+  struct id_entry_s* newer;
+} id_entry_t;
+
+/*
+ * ID index: entries by ID hash, plus a use-ordered list for expiry.
+ * Every indexed ID is in the Bloom filter; it is rebuilt from the live
+ * IDs once a window so expired ones stop matching.
+ */
+struct nblex_id_index_s {
+  nblex_index_t entries;
+
+  id_entry_t* oldest;
+  id_entry_t* newest;
+  size_t events_count;
+
+  bloom_filter_t* bloom;
+  uint64_t bloom_built_ns;
+
+  nblex_pool_t* buffered;        /* The world's buffer entry pool */
+};
+
+/*
+ * Add a field carrying the correlation ID of log or network events
+ */
+int nblex_correlation_add_id_field(nblex_correlation* corr,
+                                   nblex_event_type type,
+                                   const char* field) {
+  if (!corr || !field || !*field) {
+    return -1;
+  }
+
+  char*** fields;
+  size_t* count;
+  if (type == NBLEX_EVENT_LOG) {
+    fields = &corr->log_id_fields;
+    count = &corr->log_id_fields_count;
+  } else if (type == NBLEX_EVENT_NETWORK) {
+    fields = &corr->network_id_fields;
+    count = &corr->network_id_fields_count;
+  } else {
+    return -1;
+  }
+
+  char** grown = nblex_realloc(*fields, (*count + 1) * sizeof(char*));
+  if (!grown) {
+    return -1;
+  }
+  *fields = grown;
+  grown[*count] = nblex_strdup(field);
+  if (!grown[*count]) {
+    return -1;
+  }
+  (*count)++;
+  return 0;
+}
+
+/*
+ * Field value by flat key ("http.headers.x-request-id") or dot path
+ */
+json_t* nblex_correlation_field_value(json_t* data, const char* path) {
+  json_t* value = json_object_get(data, path);
+  if (value) {
+    return value;
+  }
+
+  const char* dot = strchr(path, '.');
+  while (dot && data) {
+    char prefix[128];
+    size_t length = (size_t)(dot - path);
+    if (length >= sizeof(prefix)) {
+      return NULL;
+    }
+    memcpy(prefix, path, length);
+    prefix[length] = '\0';
+    data = json_object_get(data, prefix);
+    if (!json_is_object(data)) {
+      return NULL;
+    }
+    path = dot + 1;
+    value = json_object_get(data, path);
+    if (value) {
+      return value;
+    }
+    dot = strchr(path, '.');
+  }
+  return NULL;
+}
+
+/*
+ * The event's ID: the first configured field it carries as a non-empty
+ * string or an integer. NULL if it has none.
+ */
+static const char* event_id(nblex_correlation* corr, nblex_event* event,
+                            char* number, size_t number_size, size_t* length) {
+  if (!json_is_object(event->data)) {
+    return NULL;
+  }
+
+  const char* const* fields;
+  size_t count;
+  if (event->type == NBLEX_EVENT_LOG) {
+    fields = (const char* const*)corr->log_id_fields;
+    count = corr->log_id_fields_count;
+    if (count == 0) {
+      fields = default_log_id_fields;
+      count = sizeof(default_log_id_fields) / sizeof(default_log_id_fields[0]);
+    }
+  } else {
+    fields = (const char* const*)corr->network_id_fields;
+    count = corr->network_id_fields_count;
+    if (count == 0) {
+      fields = default_network_id_fields;
+      count = sizeof(default_network_id_fields) / sizeof(default_network_id_fields[0]);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    json_t* value = nblex_correlation_field_value(event->data, fields[i]);
+    if (json_is_string(value) && json_string_length(value) > 0) {
+      *length = json_string_length(value);
+      return json_string_value(value);
+    }
+    if (json_is_integer(value)) {
+      snprintf(number, number_size, "%lld", (long long)json_integer_value(value));
+      *length = strlen(number);
+      return number;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Create the index and its Bloom filter
+ */
+static nblex_id_index* id_index_new(nblex_world* world) {
+  nblex_pool_t* buffered = nblex_world_entry_pool(world);
+  nblex_id_index* index = buffered ? nblex_calloc(1, sizeof(nblex_id_index)) : NULL;
+  if (!index) {
+    return NULL;
+  }
+  index->bloom = nblex_bloom_filter_new(ID_BLOOM_BITS_LOG2, ID_BLOOM_HASHES);
+  if (!index->bloom) {
+    nblex_free(index);
+    return NULL;
+  }
+  index->bloom_built_ns = nblex_world_clock(world);
+  index->buffered = buffered;
+  return index;
+}
+
+/*
+ * Look up an ID
+ */
+static id_entry_t* id_index_find(const nblex_id_index* index, uint64_t hash,
+                                 const char* id, size_t id_length) {
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket;
+  while ((bucket = nblex_index_next(&index->entries, hash, &pos)) != NULL) {
+    id_entry_t* entry = (id_entry_t*)bucket->value;
+    if (entry->id_length == id_length && memcmp(entry->id, id, id_length) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Unlink an entry from the expiry order
+ */
+static void id_order_unlink(nblex_id_index* index, id_entry_t* entry) {
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    index->oldest = entry->newer;
+  }
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    index->newest = entry->older;
+  }
+  entry->older = entry->newer = NULL;
+}
+
+/*
+ * Make an entry the most recently used
+ */
+static void id_order_touch(nblex_id_index* index, id_entry_t* entry) {
+  if (index->newest == entry) {
+    return;
+  }
+  if (entry->older || entry->newer || index->oldest == entry) {
+    id_order_unlink(index, entry);
+  }
+  entry->older = index->newest;
+  if (index->newest) {
+    index->newest->newer = entry;
+  } else {
+    index->oldest = entry;
+  }
+  index->newest = entry;
+}
+
+/*
+ * Free a list of buffered events, crediting the buffered bytes
+ */
+static void free_id_events(nblex_correlation* corr, nblex_event_buffer_entry* entry) {
+  while (entry) {
+    nblex_event_buffer_entry* next = entry->next;
+    corr->buffered_bytes -= entry->size;
+    nblex_event_free(entry->event);
+    nblex_pool_free(corr->id_index->buffered, entry);
+    entry = next;
+  }
+}
+
+/*
+ * Remove an ID and free its events
+ */
+static void id_entry_drop(nblex_correlation* corr, id_entry_t* entry) {
+  nblex_id_index* index = corr->id_index;
+  nblex_index_remove(&index->entries, entry->hash, (uintptr_t)entry);
+  id_order_unlink(index, entry);
+  index->events_count -= entry->log_count + entry->network_count;
+  free_id_events(corr, entry->log_events);
+  free_id_events(corr, entry->network_events);
+  nblex_free(entry->id);
+  nblex_free(entry);
+}
+
+/*
+ * Create correlation event for an ID match
+ */
+static nblex_event* create_id_correlation_event(nblex_correlation* corr,
+                                                const id_entry_t* entry,
+                                                nblex_event* log_event,
+                                                nblex_event* network_event) {
+  nblex_event* corr_event = nblex_world_event_new(corr->world, NBLEX_EVENT_CORRELATION, NULL);
+  if (!corr_event) {
+    return NULL;
+  }
+  corr_event->timestamp_ns = log_event->timestamp_ns;
+
+  json_t* corr_data = json_object();
+  if (!corr_data) {
+    nblex_event_free(corr_event);
+    return NULL;
+  }
+
+  json_object_set_new(corr_data, "correlation_type", json_string("id_based"));
+  json_object_set_new(corr_data, "id", json_stringn(entry->id, entry->id_length));
+  json_object_set_new(corr_data, "window_ms",
+                      json_integer(corr->window_ns / 1000000ULL));
+  if (log_event->data) {
+    json_object_set(corr_data, "log", log_event->data);
+  }
+  if (network_event->data) {
+    json_object_set(corr_data, "network", network_event->data);
+  }
+
+  int64_t time_diff_ns = (int64_t)log_event->timestamp_ns -
+                         (int64_t)network_event->timestamp_ns;
+  json_object_set_new(corr_data, "time_diff_ms", json_real(time_diff_ns / 1000000.0));
+
+  corr_event->data = corr_data;
+  return corr_event;
+}
+
+/*
+ * Emit one correlation listing the events on the other side of an ID
+ * within the window of the new event, closest first
+ */
+static void id_correlation_match_coalesced(nblex_correlation* corr, id_entry_t* entry,
+                                           nblex_event* new_event) {
+  bool is_log = new_event->type == NBLEX_EVENT_LOG;
+  nblex_event* candidates[ID_MAX_EVENTS];
+  uint64_t distances[ID_MAX_EVENTS];
+  size_t count = 0;
+
+  nblex_corr_match_stats stats;
+  memset(&stats, 0, sizeof(stats));
+  for (nblex_event_buffer_entry* other = is_log ? entry->network_events : entry->log_events;
+       other && count < ID_MAX_EVENTS; other = other->next) {
+    int64_t time_diff = (int64_t)new_event->timestamp_ns -
+                        (int64_t)other->event->timestamp_ns;
+    if (llabs(time_diff) > (int64_t)corr->window_ns) {
+      continue;
+    }
+
+    /* Insertion sort by distance; lists hold at most ID_MAX_EVENTS */
+    size_t pos = count++;
+    uint64_t distance = (uint64_t)llabs(time_diff);
+    while (pos > 0 && distances[pos - 1] > distance) {
+      candidates[pos] = candidates[pos - 1];
+      distances[pos] = distances[pos - 1];
+      pos--;
+    }
+    candidates[pos] = other->event;
+    distances[pos] = distance;
+
+    int64_t pair_diff = is_log ? time_diff : -time_diff;
+    if (count == 1 || pair_diff < stats.min_diff_ns) {
+      stats.min_diff_ns = pair_diff;
+    }
+    if (count == 1 || pair_diff > stats.max_diff_ns) {
+      stats.max_diff_ns = pair_diff;
+    }
+    if (is_log) {
+      stats.bytes += other->bytes;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  stats.count = count;
+  if (!is_log) {
+    stats.bytes = nblex_network_event_bytes(new_event);
+  }
+
+  json_t* corr_data = json_object();
+  json_t* matches = json_array();
+  if (corr_data) {
+    json_object_set_new(corr_data, "correlation_type", json_string("id_based"));
+    json_object_set_new(corr_data, "id", json_stringn(entry->id, entry->id_length));
+  }
+  for (size_t i = 0; matches && i < count && i < corr->max_matches; i++) {
+    json_array_append_new(matches, nblex_correlation_match_json(new_event, candidates[i]));
+  }
+  nblex_correlation_emit_coalesced(corr, corr_data, new_event, matches, &stats);
+}
+
+/*
+ * Emit a correlation for each event on the other side of an ID within
+ * the window of the new event
+ */
+static void id_correlation_match(nblex_correlation* corr, id_entry_t* entry,
+                                 nblex_event* new_event) {
+  if (corr->coalesce) {
+    id_correlation_match_coalesced(corr, entry, new_event);
+    return;
+  }
+
+  bool is_log = new_event->type == NBLEX_EVENT_LOG;
+  for (nblex_event_buffer_entry* other = is_log ? entry->network_events : entry->log_events;
+       other; other = other->next) {
+    int64_t time_diff = (int64_t)new_event->timestamp_ns -
+                        (int64_t)other->event->timestamp_ns;
+    if (llabs(time_diff) > (int64_t)corr->window_ns) {
+      continue;
+    }
+
+    nblex_event* corr_event = is_log ?
+      create_id_correlation_event(corr, entry, new_event, other->event) :
+      create_id_correlation_event(corr, entry, other->event, new_event);
+    if (corr_event) {
+      corr->correlations_found++;
+      if (corr->world) {
+        corr->world->events_correlated++;
+        nblex_event_emit(corr->world, corr_event);
+      } else {
+        nblex_event_free(corr_event);
+      }
+    }
+  }
+}
+
+/*
+ * Buffer an event under its ID, keeping the newest ID_MAX_EVENTS of
+ * its side
+ */
+static int id_correlation_buffer(nblex_correlation* corr, id_entry_t* entry,
+                                 nblex_event* event) {
+  nblex_id_index* index = corr->id_index;
+  size_t size = nblex_event_buffered_size(event);
+  size_t limit = corr->world ? corr->world->buffer_limit : 0;
+  if (index->events_count >= NBLEX_CORR_MAX_BUFFERED ||
+      (limit && corr->buffered_bytes + size > limit)) {
+    corr->buffer_dropped++;
+    return -1;
+  }
+
+  bool is_log = event->type == NBLEX_EVENT_LOG;
+  nblex_event_buffer_entry** head = is_log ? &entry->log_events : &entry->network_events;
+  size_t* count = is_log ? &entry->log_count : &entry->network_count;
+
+  nblex_event_buffer_entry* buffered = nblex_pool_alloc(index->buffered);
+  if (!buffered) {
+    return -1;
+  }
+  nblex_event* shared = nblex_event_retain(event);
+  buffered->event = shared;
+  buffered->size = size;
+  buffered->bytes = nblex_network_event_bytes(shared);
+  buffered->next = *head;
+  *head = buffered;
+  (*count)++;
+  index->events_count++;
+  corr->buffered_bytes += size;
+
+  if (*count > ID_MAX_EVENTS) {
+    nblex_event_buffer_entry** tail = head;
+    while ((*tail)->next) {
+      tail = &(*tail)->next;
+    }
+    free_id_events(corr, *tail);
+    *tail = NULL;
+    (*count)--;
+    index->events_count--;
+    corr->buffer_dropped++;
+  }
+
+  if (event->timestamp_ns > entry->last_seen_ns) {
+    entry->last_seen_ns = event->timestamp_ns;
+  }
+  id_order_touch(index, entry);
+  nblex_bloom_filter_add_hash(index->bloom, entry->hash);
+  return 0;
+}
+
+/*
+ * Process an event through ID-based correlation
+ */
+void nblex_id_correlation_process_event(nblex_correlation* corr, nblex_event* event) {
+  if (!corr || !event ||
+      (event->type != NBLEX_EVENT_LOG && event->type != NBLEX_EVENT_NETWORK)) {
+    return;
+  }
+
+  char number[32];
+  size_t id_length = 0;
+  const char* id = event_id(corr, event, number, sizeof(number), &id_length);
+  if (!id) {
+    return;
+  }
+
+  if (!corr->id_index) {
+    corr->id_index = id_index_new(corr->world);
+    if (!corr->id_index) {
+      return;
+    }
+  }
+  nblex_id_index* index = corr->id_index;
+
+  /* A clear Bloom bit proves the ID is not indexed */
+  uint64_t hash = nblex_hash64(id, id_length, 0);
+  id_entry_t* entry = NULL;
+  if (nblex_bloom_filter_may_contain(index->bloom, hash)) {
+    entry = id_index_find(index, hash, id, id_length);
+  } else {
+    corr->id_bloom_rejects++;
+  }
+
+  if (entry) {
+    id_correlation_match(corr, entry, event);
+  } else {
+    entry = nblex_calloc(1, sizeof(id_entry_t));
+    if (!entry) {
+      return;
+    }
+    entry->id = nblex_malloc(id_length + 1);
+    if (!entry->id) {
+      nblex_free(entry);
+      return;
+    }
+    memcpy(entry->id, id, id_length);
+    entry->id[id_length] = '\0';
+    entry->id_length = id_length;
+    entry->hash = hash;
+    if (nblex_index_insert(&index->entries, hash, (uintptr_t)entry) != 0) {
+      nblex_free(entry->id);
+      nblex_free(entry);
+      return;
+    }
+  }
+
+  if (id_correlation_buffer(corr, entry, event) != 0 &&
+      !entry->log_events && !entry->network_events) {
+    /* Nothing buffered under a new ID: do not keep it */
+    nblex_index_remove(&index->entries, entry->hash, (uintptr_t)entry);
+    nblex_free(entry->id);
+    nblex_free(entry);
+  }
+}
+
+/*
+ * Drop IDs unused for the window, oldest first, and rebuild the Bloom
+ * filter once a window
+ */
+void nblex_id_correlation_expire(nblex_correlation* corr, uint64_t now_ns) {
+  if (!corr || !corr->id_index) {
+    return;
+  }
+  nblex_id_index* index = corr->id_index;
+  uint64_t cutoff = now_ns > corr->window_ns ? now_ns - corr->window_ns : 0;
+
+  /* Use order follows event time closely; an ID behind a newer one
+   * waits for a later pass */
+  while (index->oldest && index->oldest->last_seen_ns < cutoff) {
+    id_entry_drop(corr, index->oldest);
+  }
+
+  if (now_ns >= index->bloom_built_ns + corr->window_ns) {
+    nblex_bloom_filter_clear(index->bloom);
+    for (id_entry_t* entry = index->oldest; entry; entry = entry->newer) {
+      nblex_bloom_filter_add_hash(index->bloom, entry->hash);
+    }
+    index->bloom_built_ns = now_ns;
+  }
+}
+
+/*
+ * Drop the least recently used IDs until `bytes` of their events are
+ * freed
+ */
+size_t nblex_id_correlation_shrink(nblex_correlation* corr, size_t bytes) {
+  if (!corr || !corr->id_index) {
+    return 0;
+  }
+
+  nblex_id_index* index = corr->id_index;
+  size_t before = corr->buffered_bytes;
+  while (index->oldest && before - corr->buffered_bytes < bytes) {
+    corr->buffer_shrunk += index->oldest->log_count + index->oldest->network_count;
+    id_entry_drop(corr, index->oldest);
+  }
+  return before - corr->buffered_bytes;
+}
+
+/*
+ * Free the ID index and the configured ID fields
+ */
+void nblex_id_correlation_free(nblex_correlation* corr) {
+  if (!corr) {
+    return;
+  }
+
+  nblex_id_index* index = corr->id_index;
+  if (index) {
+    while (index->oldest) {
+      id_entry_drop(corr, index->oldest);
+    }
+    nblex_bloom_filter_free(index->bloom);
+    nblex_index_free(&index->entries);
+    nblex_free(index);
+    corr->id_index = NULL;
+  }
+
+  for (size_t i = 0; i < corr->log_id_fields_count; i++) {
+    nblex_free(corr->log_id_fields[i]);
+  }
+  nblex_free(corr->log_id_fields);
+  for (size_t i = 0; i < corr->network_id_fields_count; i++) {
+    nblex_free(corr->network_id_fields[i]);
+  }
+  nblex_free(corr->network_id_fields);
+  corr->log_id_fields = corr->network_id_fields = NULL;
+  corr->log_id_fields_count = corr->network_id_fields_count = 0;
+}
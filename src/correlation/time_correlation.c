@@ -11,12 +11,15 @@
 #include <string.h>
 
 #define CLEANUP_INTERVAL_MS 1000  /* Clean up old events every second */
-#define MAX_BUFFER_SIZE 10000     /* Maximum events to buffer */
+#define BUFFERED_FIELD_OVERHEAD 48 /* Bytes per JSON field beyond its strings */
+#define RING_INITIAL_CAPACITY 64  /* Entries in a buffer's first ring */
+#define DEFAULT_MAX_MATCHES 10    /* Matches a coalesced correlation lists */
 
 /* Forward declarations */
 static void cleanup_timer_cb(uv_timer_t* handle);
 static void cleanup_timer_close_cb(uv_handle_t* handle);
 static void correlation_check_event(nblex_correlation* corr, nblex_event* new_event);
+static void free_ring(nblex_event_ring* ring);
 
 /*
  * Create a new correlation engine
@@ -34,10 +37,6 @@ nblex_correlation* nblex_correlation_new(nblex_world* world) {
   corr->world = world;
   corr->type = NBLEX_CORR_TIME_BASED;
   corr->window_ns = 100 * 1000000ULL;  /* Default 100ms in nanoseconds */
-  corr->log_events = NULL;
-  corr->network_events = NULL;
-  corr->log_events_count = 0;
-  corr->network_events_count = 0;
   corr->correlations_found = 0;
   corr->timer_initialized = 0;  /* Timer not initialized yet */
 
@@ -60,6 +59,22 @@ int nblex_correlation_add_strategy(nblex_correlation* corr,
   return 0;
 }
 
+/*
+ * Emit one correlation per triggering event instead of one per pair
+ */
+int nblex_correlation_set_coalesce(nblex_correlation* corr,
+                                   bool enabled,
+                                   size_t max_matches) {
+  if (!corr) {
+    return -1;
+  }
+
+  corr->coalesce = enabled;
+  corr->max_matches = max_matches ? max_matches : DEFAULT_MAX_MATCHES;
+
+  return 0;
+}
+
 /*
  * Start correlation engine
  */
@@ -110,79 +125,151 @@ void nblex_correlation_free(nblex_correlation* corr) {
     return;
   }
 
-  /* If timer wasn't initialized, free immediately */
-  /* Free buffered log events */
-  nblex_event_buffer_entry* entry = corr->log_events;
-  while (entry) {
-    nblex_event_buffer_entry* next = entry->next;
-    nblex_event_free(entry->event);
-    nblex_free(entry);
-    entry = next;
+  /* If timer wasn't initialized, free immediately, with buffered events */
+  free_ring(&corr->log_events);
+  free_ring(&corr->network_events);
+  nblex_id_correlation_free(corr);
+  nblex_connection_correlation_free(corr);
+
+  nblex_free(corr);
+}
+
+/*
+ * Estimate the bytes a buffered event holds: the entry, the event and
+ * its top-level JSON fields. Nested values are counted flat.
+ */
+size_t nblex_event_buffered_size(const nblex_event* event) {
+  size_t size = sizeof(nblex_event_buffer_entry) + sizeof(nblex_event);
+  if (!event || !json_is_object(event->data)) {
+    return size;
   }
 
-  /* Free buffered network events */
-  entry = corr->network_events;
-  while (entry) {
-    nblex_event_buffer_entry* next = entry->next;
-    nblex_event_free(entry->event);
-    nblex_free(entry);
-    entry = next;
+  const char* key;
+  json_t* value;
+  json_object_foreach(event->data, key, value) {
+    size += BUFFERED_FIELD_OVERHEAD + strlen(key);
+    if (json_is_string(value)) {
+      size += json_string_length(value);
+    }
   }
+  return size;
+}
 
-  nblex_free(corr);
+/*
+ * Entry at a position counted from the oldest
+ */
+static nblex_event_buffer_entry* ring_at(const nblex_event_ring* ring, size_t index) {
+  return &ring->entries[(ring->head + index) & (ring->capacity - 1)];
 }
 
 /*
- * Add event to buffer
+ * Position of the first entry at or after a timestamp (binary search)
  */
-static int add_to_buffer(nblex_event_buffer_entry** buffer_head,
-                        size_t* count,
-                        nblex_event* event) {
-  /* Check buffer size limit */
-  if (*count >= MAX_BUFFER_SIZE) {
+static size_t ring_lower_bound(const nblex_event_ring* ring, uint64_t timestamp_ns) {
+  size_t low = 0;
+  size_t high = ring->count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (ring_at(ring, mid)->event->timestamp_ns < timestamp_ns) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+/*
+ * Double a ring's capacity, moving the entries to start at zero
+ */
+static int ring_grow(nblex_event_ring* ring) {
+  size_t capacity = ring->capacity ? ring->capacity * 2 : RING_INITIAL_CAPACITY;
+  nblex_event_buffer_entry* entries = nblex_malloc(capacity * sizeof(nblex_event_buffer_entry));
+  if (!entries) {
     return -1;
   }
 
-  /* Create buffer entry */
-  nblex_event_buffer_entry* entry = nblex_malloc(sizeof(nblex_event_buffer_entry));
-  if (!entry) {
+  for (size_t i = 0; i < ring->count; i++) {
+    entries[i] = *ring_at(ring, i);
+  }
+  nblex_free(ring->entries);
+  ring->entries = entries;
+  ring->capacity = capacity;
+  ring->head = 0;
+  return 0;
+}
+
+/*
+ * Free a ring and its buffered events
+ */
+static void free_ring(nblex_event_ring* ring) {
+  for (size_t i = 0; i < ring->count; i++) {
+    nblex_event_free(ring_at(ring, i)->event);
+  }
+  nblex_free(ring->entries);
+  memset(ring, 0, sizeof(*ring));
+}
+
+/*
+ * Add event to buffer. Events arrive roughly in time order, so one is
+ * usually appended; a late one is shifted back into place.
+ */
+static int add_to_buffer(nblex_correlation* corr,
+                        nblex_event_ring* ring,
+                        nblex_event* event) {
+  /* Check buffer size limits */
+  size_t size = nblex_event_buffered_size(event);
+  size_t limit = corr->world ? corr->world->buffer_limit : 0;
+  if (ring->count >= NBLEX_CORR_MAX_BUFFERED || (limit && corr->buffered_bytes + size > limit)) {
+    corr->buffer_dropped++;
     return -1;
   }
 
-  /* Duplicate event using clone helper to properly manage JSON refs */
-  nblex_event* event_copy = nblex_event_clone(event);
-  if (!event_copy) {
-    nblex_free(entry);
+  if (ring->count == ring->capacity && ring_grow(ring) != 0) {
     return -1;
   }
-  entry->event = event_copy;
-  entry->next = *buffer_head;
-  *buffer_head = entry;
-  (*count)++;
+
+  /* Share the event rather than copy it */
+  nblex_event* shared = nblex_event_retain(event);
+
+  /* Keep equal timestamps in arrival order */
+  size_t index = ring->count;
+  while (index > 0 &&
+         ring_at(ring, index - 1)->event->timestamp_ns > shared->timestamp_ns) {
+    *ring_at(ring, index) = *ring_at(ring, index - 1);
+    index--;
+  }
+
+  nblex_event_buffer_entry* entry = ring_at(ring, index);
+  entry->event = shared;
+  entry->size = size;
+  entry->bytes = nblex_network_event_bytes(shared);
+  entry->next = NULL;
+  ring->count++;
+  corr->buffered_bytes += size;
 
   return 0;
 }
 
 /*
- * Remove old events from buffer
+ * Release the oldest event of a buffer
  */
-static void cleanup_old_events(nblex_event_buffer_entry** buffer_head,
-                               size_t* count,
-                               uint64_t cutoff_time) {
-  nblex_event_buffer_entry** entry_ptr = buffer_head;
-
-  while (*entry_ptr) {
-    nblex_event_buffer_entry* entry = *entry_ptr;
+static void ring_pop_oldest(nblex_correlation* corr, nblex_event_ring* ring) {
+  nblex_event_buffer_entry* entry = ring_at(ring, 0);
+  corr->buffered_bytes -= entry->size;
+  nblex_event_free(entry->event);
+  ring->head = (ring->head + 1) & (ring->capacity - 1);
+  ring->count--;
+}
 
-    if (entry->event->timestamp_ns < cutoff_time) {
-      /* Remove this entry */
-      *entry_ptr = entry->next;
-      nblex_event_free(entry->event);
-      nblex_free(entry);
-      (*count)--;
-    } else {
-      entry_ptr = &entry->next;
-    }
+/*
+ * Remove old events from buffer: the oldest are at the head
+ */
+static void cleanup_old_events(nblex_correlation* corr,
+                               nblex_event_ring* ring,
+                               uint64_t cutoff_time) {
+  while (ring->count > 0 && ring_at(ring, 0)->event->timestamp_ns < cutoff_time) {
+    ring_pop_oldest(corr, ring);
   }
 }
 
@@ -192,19 +279,16 @@ static void cleanup_old_events(nblex_event_buffer_entry** buffer_head,
 static nblex_event* create_correlation_event(nblex_correlation* corr,
                                              nblex_event* log_event,
                                              nblex_event* network_event) {
-  nblex_event* corr_event = nblex_malloc(sizeof(nblex_event));
+  nblex_event* corr_event = nblex_world_event_new(corr->world, NBLEX_EVENT_CORRELATION, NULL);
   if (!corr_event) {
     return NULL;
   }
-
-  corr_event->type = NBLEX_EVENT_CORRELATION;
   corr_event->timestamp_ns = log_event->timestamp_ns;
-  corr_event->input = NULL;
 
   /* Create JSON object with both events */
   json_t* corr_data = json_object();
   if (!corr_data) {
-    nblex_free(corr_event);
+    nblex_event_free(corr_event);
     return NULL;
   }
 
@@ -233,6 +317,132 @@ static nblex_event* create_correlation_event(nblex_correlation* corr,
   return corr_event;
 }
 
+/*
+ * Bytes a network event's length field gives, 0 if none
+ */
+uint64_t nblex_network_event_bytes(const nblex_event* event) {
+  if (event->type != NBLEX_EVENT_NETWORK) {
+    return 0;
+  }
+  json_t* length = json_object_get(event->data, "length");
+  if (json_is_integer(length) && json_integer_value(length) > 0) {
+    return (uint64_t)json_integer_value(length);
+  }
+  return 0;
+}
+
+/*
+ * One listed match of a coalesced correlation: the matched event's data
+ * under its type and the pair's time difference
+ */
+json_t* nblex_correlation_match_json(const nblex_event* trigger, const nblex_event* match) {
+  json_t* entry = json_object();
+  if (!entry) {
+    return NULL;
+  }
+
+  int64_t time_diff_ns = trigger->type == NBLEX_EVENT_LOG ?
+    (int64_t)trigger->timestamp_ns - (int64_t)match->timestamp_ns :
+    (int64_t)match->timestamp_ns - (int64_t)trigger->timestamp_ns;
+  json_object_set_new(entry, "time_diff_ms", json_real(time_diff_ns / 1000000.0));
+  if (match->data) {
+    json_object_set(entry, match->type == NBLEX_EVENT_LOG ? "log" : "network", match->data);
+  }
+  return entry;
+}
+
+/*
+ * Complete and emit a coalesced correlation event
+ */
+void nblex_correlation_emit_coalesced(nblex_correlation* corr, json_t* corr_data,
+                                      nblex_event* trigger, json_t* matches,
+                                      const nblex_corr_match_stats* stats) {
+  size_t listed = json_array_size(matches);
+  nblex_event* corr_event = nblex_world_event_new(corr->world, NBLEX_EVENT_CORRELATION, NULL);
+  if (!corr_event || !corr_data || !matches) {
+    nblex_event_free(corr_event);
+    json_decref(corr_data);
+    json_decref(matches);
+    return;
+  }
+  corr_event->timestamp_ns = trigger->timestamp_ns;
+
+  json_object_set_new(corr_data, "window_ms",
+                      json_integer(corr->window_ns / 1000000ULL));
+  if (trigger->data) {
+    json_object_set(corr_data, trigger->type == NBLEX_EVENT_LOG ? "log" : "network",
+                    trigger->data);
+  }
+  json_object_set_new(corr_data, "matches", matches);
+  json_object_set_new(corr_data, "match_count", json_integer((json_int_t)stats->count));
+  json_object_set_new(corr_data, "matches_dropped",
+                      json_integer((json_int_t)(stats->count - listed)));
+  json_object_set_new(corr_data, "min_time_diff_ms", json_real(stats->min_diff_ns / 1000000.0));
+  json_object_set_new(corr_data, "max_time_diff_ms", json_real(stats->max_diff_ns / 1000000.0));
+  json_object_set_new(corr_data, "bytes", json_integer((json_int_t)stats->bytes));
+  corr_event->data = corr_data;
+
+  corr->correlations_found += stats->count;
+  corr->pairs_dropped += stats->count - listed;
+  if (corr->world) {
+    corr->world->events_correlated++;
+    nblex_event_emit(corr->world, corr_event);
+  } else {
+    nblex_event_free(corr_event);
+  }
+}
+
+/*
+ * Emit one correlation for the run [first, last) of a buffer matching a
+ * new event. The run is sorted, so the closest matches are found by
+ * walking outwards from the new event's time.
+ */
+static void correlation_emit_coalesced_run(nblex_correlation* corr, nblex_event* new_event,
+                                           nblex_event_ring* ring, size_t first, size_t last) {
+  nblex_corr_match_stats stats;
+  stats.count = last - first;
+  int64_t oldest = (int64_t)ring_at(ring, first)->event->timestamp_ns;
+  int64_t newest = (int64_t)ring_at(ring, last - 1)->event->timestamp_ns;
+  int64_t now = (int64_t)new_event->timestamp_ns;
+  if (new_event->type == NBLEX_EVENT_LOG) {
+    stats.min_diff_ns = now - newest;
+    stats.max_diff_ns = now - oldest;
+    stats.bytes = 0;
+    for (size_t i = first; i < last; i++) {
+      stats.bytes += ring_at(ring, i)->bytes;
+    }
+  } else {
+    stats.min_diff_ns = oldest - now;
+    stats.max_diff_ns = newest - now;
+    stats.bytes = nblex_network_event_bytes(new_event);
+  }
+
+  json_t* corr_data = json_object();
+  json_t* matches = json_array();
+  if (corr_data) {
+    json_object_set_new(corr_data, "correlation_type", json_string("time_based"));
+  }
+
+  /* Closest first: take the nearer of the next older and newer match */
+  size_t newer = ring_lower_bound(ring, new_event->timestamp_ns);
+  size_t older = newer;
+  while (matches && json_array_size(matches) < corr->max_matches &&
+         (older > first || newer < last)) {
+    nblex_event* match;
+    if (older > first &&
+        (newer == last ||
+         new_event->timestamp_ns - ring_at(ring, older - 1)->event->timestamp_ns <=
+         ring_at(ring, newer)->event->timestamp_ns - new_event->timestamp_ns)) {
+      match = ring_at(ring, --older)->event;
+    } else {
+      match = ring_at(ring, newer++)->event;
+    }
+    json_array_append_new(matches, nblex_correlation_match_json(new_event, match));
+  }
+
+  nblex_correlation_emit_coalesced(corr, corr_data, new_event, matches, &stats);
+}
+
 /*
  * Check for correlations with new event
  */
@@ -242,50 +452,57 @@ static void correlation_check_event(nblex_correlation* corr, nblex_event* new_ev
   }
 
   /* Determine which buffer to check against */
-  nblex_event_buffer_entry* check_buffer = NULL;
+  nblex_event_ring* check_buffer = NULL;
   if (new_event->type == NBLEX_EVENT_LOG) {
-    check_buffer = corr->network_events;
+    check_buffer = &corr->network_events;
   } else if (new_event->type == NBLEX_EVENT_NETWORK) {
-    check_buffer = corr->log_events;
+    check_buffer = &corr->log_events;
   } else {
     return;  /* Don't correlate other event types */
   }
 
-  /* Check for matches within time window */
-  nblex_event_buffer_entry* entry = check_buffer;
-  while (entry) {
-    nblex_event* buffered_event = entry->event;
+  /* Matches within the window (±) are a run of the sorted buffer */
+  uint64_t start = new_event->timestamp_ns > corr->window_ns ?
+                   new_event->timestamp_ns - corr->window_ns : 0;
+  uint64_t end = new_event->timestamp_ns + corr->window_ns;
 
-    /* Calculate time difference */
-    int64_t time_diff = (int64_t)new_event->timestamp_ns -
-                       (int64_t)buffered_event->timestamp_ns;
+  size_t first = ring_lower_bound(check_buffer, start);
+  if (corr->coalesce) {
+    size_t last = ring_lower_bound(check_buffer, end + 1);
+    if (last > first) {
+      correlation_emit_coalesced_run(corr, new_event, check_buffer, first, last);
+    }
+    return;
+  }
 
-    /* Check if within window (±) */
-    if (llabs(time_diff) <= (int64_t)corr->window_ns) {
-      /* Found a correlation! */
-      nblex_event* corr_event;
+  /* Index, not pointer: the buffer may change while a result is emitted */
+  for (size_t i = first; i < check_buffer->count; i++) {
+    nblex_event* buffered_event = ring_at(check_buffer, i)->event;
+    if (buffered_event->timestamp_ns > end) {
+      break;
+    }
 
-      if (new_event->type == NBLEX_EVENT_LOG) {
-        corr_event = create_correlation_event(corr, new_event, buffered_event);
-      } else {
-        corr_event = create_correlation_event(corr, buffered_event, new_event);
-      }
+    /* Found a correlation! */
+    nblex_event* corr_event;
 
-      if (corr_event) {
-        corr->correlations_found++;
-        if (corr->world) {
-          corr->world->events_correlated++;
-
-          /* Emit correlation event - this will free it */
-          nblex_event_emit(corr->world, corr_event);
-        } else {
-          /* World is NULL, free the event ourselves */
-          nblex_event_free(corr_event);
-        }
-      }
+    if (new_event->type == NBLEX_EVENT_LOG) {
+      corr_event = create_correlation_event(corr, new_event, buffered_event);
+    } else {
+      corr_event = create_correlation_event(corr, buffered_event, new_event);
     }
 
-    entry = entry->next;
+    if (corr_event) {
+      corr->correlations_found++;
+      if (corr->world) {
+        corr->world->events_correlated++;
+
+        /* Emit correlation event - this will free it */
+        nblex_event_emit(corr->world, corr_event);
+      } else {
+        /* World is NULL, free the event ourselves */
+        nblex_event_free(corr_event);
+      }
+    }
   }
 }
 
@@ -297,15 +514,23 @@ void nblex_correlation_process_event(nblex_correlation* corr, nblex_event* event
     return;
   }
 
-  /* Check for correlations with existing events */
-  correlation_check_event(corr, event);
-
-  /* Add event to appropriate buffer */
-  if (event->type == NBLEX_EVENT_LOG) {
-    add_to_buffer(&corr->log_events, &corr->log_events_count, event);
-  } else if (event->type == NBLEX_EVENT_NETWORK) {
-    add_to_buffer(&corr->network_events, &corr->network_events_count, event);
+  nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_CORRELATION);
+  if (corr->type == NBLEX_CORR_ID_BASED) {
+    nblex_id_correlation_process_event(corr, event);
+  } else if (corr->type == NBLEX_CORR_CONNECTION) {
+    nblex_connection_correlation_process_event(corr, event);
+  } else {
+    /* Check for correlations with existing events */
+    correlation_check_event(corr, event);
+
+    /* Add event to appropriate buffer */
+    if (event->type == NBLEX_EVENT_LOG) {
+      add_to_buffer(corr, &corr->log_events, event);
+    } else if (event->type == NBLEX_EVENT_NETWORK) {
+      add_to_buffer(corr, &corr->network_events, event);
+    }
   }
+  nblex_mem_tag_leave(previous_tag);
 }
 
 /*
@@ -319,42 +544,82 @@ static void cleanup_timer_close_cb(uv_handle_t* handle) {
     return;
   }
 
-  /* Free buffered log events */
-  nblex_event_buffer_entry* entry = corr->log_events;
-  while (entry) {
-    nblex_event_buffer_entry* next = entry->next;
-    nblex_event_free(entry->event);
-    nblex_free(entry);
-    entry = next;
-  }
-
-  /* Free buffered network events */
-  entry = corr->network_events;
-  while (entry) {
-    nblex_event_buffer_entry* next = entry->next;
-    nblex_event_free(entry->event);
-    nblex_free(entry);
-    entry = next;
-  }
+  /* Free buffered log and network events */
+  free_ring(&corr->log_events);
+  free_ring(&corr->network_events);
+  nblex_id_correlation_free(corr);
+  nblex_connection_correlation_free(corr);
 
   /* Now safe to free the correlation struct */
   nblex_free(corr);
 }
 
 /*
- * Periodic cleanup timer callback
+ * Release buffered events too old to correlate
  */
-static void cleanup_timer_cb(uv_timer_t* handle) {
-  nblex_correlation* corr = (nblex_correlation*)handle->data;
+void nblex_correlation_expire(nblex_correlation* corr) {
+  if (corr) {
+    /* In event time mode the current time is the watermark */
+    nblex_correlation_expire_at(corr, nblex_world_clock(corr->world));
+  }
+}
+
+/*
+ * Release buffered events too old to correlate at time `now`
+ */
+void nblex_correlation_expire_at(nblex_correlation* corr, uint64_t now) {
   if (!corr) {
     return;
   }
 
   /* Calculate cutoff time (current time - 2 * window) */
-  uint64_t now = nblex_timestamp_now();
-  uint64_t cutoff = now - (corr->window_ns * 2);
+  uint64_t cutoff = now > corr->window_ns * 2 ? now - (corr->window_ns * 2) : 0;
 
   /* Clean up old events from both buffers */
-  cleanup_old_events(&corr->log_events, &corr->log_events_count, cutoff);
-  cleanup_old_events(&corr->network_events, &corr->network_events_count, cutoff);
+  cleanup_old_events(corr, &corr->log_events, cutoff);
+  cleanup_old_events(corr, &corr->network_events, cutoff);
+
+  /* IDs expire after one unused window, flows after their idle timeout */
+  nblex_id_correlation_expire(corr, now);
+  nblex_connection_correlation_expire(corr, now);
+}
+
+/*
+ * Release the oldest buffered events, of either buffer, to free memory
+ */
+size_t nblex_correlation_shrink(nblex_correlation* corr, size_t bytes) {
+  if (!corr) {
+    return 0;
+  }
+
+  size_t before = corr->buffered_bytes;
+  while (before - corr->buffered_bytes < bytes) {
+    nblex_event_ring* logs = &corr->log_events;
+    nblex_event_ring* network = &corr->network_events;
+    nblex_event_ring* ring;
+    if (logs->count == 0 || network->count == 0) {
+      ring = logs->count ? logs : network;
+    } else {
+      ring = ring_at(logs, 0)->event->timestamp_ns <= ring_at(network, 0)->event->timestamp_ns ?
+             logs : network;
+    }
+    if (ring->count == 0) {
+      break;
+    }
+    ring_pop_oldest(corr, ring);
+    corr->buffer_shrunk++;
+  }
+
+  size_t freed = before - corr->buffered_bytes;
+  if (freed < bytes) {
+    freed += nblex_id_correlation_shrink(corr, bytes - freed);
+  }
+  return freed;
+}
+
+/*
+ * Periodic cleanup timer callback
+ */
+static void cleanup_timer_cb(uv_timer_t* handle) {
+  nblex_correlation_expire((nblex_correlation*)handle->data);
 }
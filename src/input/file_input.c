@@ -133,8 +133,13 @@ static int file_input_start(nblex_input* input) {
   /* Set line buffering so new data is immediately available */
   setvbuf(data->file, NULL, _IOLBF, 0);
 
-  /* Seek to end for tailing */
-  fseek(data->file, 0, SEEK_END);
+  /* Resume where a checkpoint left off, else seek to end for tailing */
+  long offset;
+  if (nblex_checkpoint_file_offset(input, data->file, &offset) == 0) {
+    fseek(data->file, offset, SEEK_SET);
+  } else {
+    fseek(data->file, 0, SEEK_END);
+  }
 
   /* Try to use uv_fs_event for efficient file watching */
   int ret = uv_fs_event_init(input->world->loop, &data->fs_event);
@@ -173,10 +178,10 @@ static int file_input_stop(nblex_input* input) {
     if (data->use_fs_event) {
       uv_fs_event_stop(&data->fs_event);
       uv_close((uv_handle_t*)&data->fs_event, NULL);
-    } else {
-      uv_timer_stop(&data->poll_timer);
-      uv_close((uv_handle_t*)&data->poll_timer, NULL);
     }
+    /* The poll timer runs alongside fs_event too */
+    uv_timer_stop(&data->poll_timer);
+    uv_close((uv_handle_t*)&data->poll_timer, NULL);
     data->watching = false;
   }
 
@@ -247,6 +252,7 @@ static void file_read_new_data(nblex_input* input) {
   }
 
   /* Read lines from file */
+  nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_INPUT);
   char buffer[4096];
   while (fgets(buffer, sizeof(buffer), data->file) != NULL) {
     size_t len = strlen(buffer);
@@ -269,6 +275,7 @@ static void file_read_new_data(nblex_input* input) {
     }
 
     /* Parse line based on format */
+    nblex_mem_tag_enter(NBLEX_MEM_TAG_PARSER);
     if (input->format == NBLEX_FORMAT_JSON) {
       event->data = nblex_parse_json_line(buffer);
       /* If JSON parsing fails, fall back to creating a simple message object */
@@ -299,6 +306,7 @@ static void file_read_new_data(nblex_input* input) {
       event->data = json_object();
       json_object_set_new(event->data, "message", json_string(buffer));
     }
+    nblex_mem_tag_enter(NBLEX_MEM_TAG_INPUT);
 
     if (!event->data) {
       nblex_event_free(event);
@@ -308,6 +316,7 @@ static void file_read_new_data(nblex_input* input) {
     /* Emit event */
     nblex_event_emit(input->world, event);
   }
+  nblex_mem_tag_leave(previous_tag);
 }
 
 /* File system event callback - triggered when file changes */
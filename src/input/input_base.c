@@ -103,6 +103,15 @@ int nblex_input_set_format(nblex_input* input, nblex_log_format format) {
   return 0;
 }
 
+int nblex_input_set_priority(nblex_input* input, int priority) {
+  if (!input) {
+    return -1;
+  }
+
+  input->priority = priority;
+  return 0;
+}
+
 int nblex_input_set_filter(nblex_input* input, const char* filter_expr) {
   if (!input) {
     return -1;
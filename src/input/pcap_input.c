@@ -27,8 +27,8 @@ static const nblex_input_vtable pcap_input_vtable;
 static void packet_handler(u_char* user, const struct pcap_pkthdr* header, const u_char* packet);
 
 /* Protocol dissector functions */
-static void dissect_tcp(const u_char* packet, json_t* event);
-static void dissect_udp(const u_char* packet, json_t* event);
+static void dissect_tcp(const u_char* packet, json_t* event, nblex_flow_key* flow);
+static void dissect_udp(const u_char* packet, json_t* event, nblex_flow_key* flow);
 static void dissect_icmp(const u_char* packet, json_t* event);
 
 /* Poll callback for non-blocking pcap reads */
@@ -43,7 +43,9 @@ static void on_pcap_readable(uv_poll_t* handle, int status, int events) {
 
     if (events & UV_READABLE) {
         /* Process up to 10 packets at a time to avoid blocking */
+        nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_INPUT);
         int count = pcap_dispatch(data->pcap_handle, 10, packet_handler, (u_char*)input);
+        nblex_mem_tag_leave(previous_tag);
 
         if (count < 0) {
             fprintf(stderr, "Error in pcap_dispatch: %s\n", pcap_geterr(data->pcap_handle));
@@ -73,6 +75,12 @@ static void packet_handler(u_char* user, const struct pcap_pkthdr* header, const
         return;
     }
 
+    /* In event time mode the capture time, not arrival, orders the packet */
+    if (world->event_time.enabled) {
+        event->timestamp_ns = (uint64_t)header->ts.tv_sec * 1000000000ULL +
+                              (uint64_t)header->ts.tv_usec * 1000ULL;
+    }
+
     /* Basic packet info */
     json_object_set_new(json_data, "timestamp", json_real(header->ts.tv_sec + header->ts.tv_usec / 1000000.0));
     json_object_set_new(json_data, "length", json_integer(header->len));
@@ -116,6 +124,12 @@ static void packet_handler(u_char* user, const struct pcap_pkthdr* header, const
             json_object_set_new(json_data, "ip_ttl", json_integer(ip->ip_ttl));
             json_object_set_new(json_data, "ip_length", json_integer(ntohs(ip->ip_len)));
 
+            /* Addresses of the flow, completed by the TCP or UDP dissector */
+            nblex_flow_key flow;
+            memset(&flow, 0, sizeof(flow));
+            nblex_flow_map_ipv4(flow.addr[0], &ip->ip_src);
+            nblex_flow_map_ipv4(flow.addr[1], &ip->ip_dst);
+
             /* Skip IP header */
             int ip_header_len = ip->ip_hl * 4;
             packet += ip_header_len;
@@ -125,12 +139,14 @@ static void packet_handler(u_char* user, const struct pcap_pkthdr* header, const
             switch (ip->ip_p) {
                 case IPPROTO_TCP:
                     if (remaining >= sizeof(struct tcphdr)) {
-                        dissect_tcp(packet, json_data);
+                        dissect_tcp(packet, json_data, &flow);
+                        event->flow = flow;
                     }
                     break;
                 case IPPROTO_UDP:
                     if (remaining >= sizeof(struct udphdr)) {
-                        dissect_udp(packet, json_data);
+                        dissect_udp(packet, json_data, &flow);
+                        event->flow = flow;
                     }
                     break;
                 case IPPROTO_ICMP:
@@ -145,17 +161,19 @@ static void packet_handler(u_char* user, const struct pcap_pkthdr* header, const
     /* Set event data */
     event->data = json_data;
 
-    /* Emit event */
+    /* Emit event; emitting takes over our reference */
     nblex_event_emit(world, event);
-
-    /* Clean up */
-    nblex_event_free(event);
 }
 
-/* TCP dissector */
-static void dissect_tcp(const u_char* packet, json_t* event) {
+/* TCP dissector; completes the flow key from the ports */
+static void dissect_tcp(const u_char* packet, json_t* event, nblex_flow_key* flow) {
     struct tcphdr* tcp = (struct tcphdr*)packet;
 
+    flow->protocol = IPPROTO_TCP;
+    flow->port[0] = ntohs(tcp->th_sport);
+    flow->port[1] = ntohs(tcp->th_dport);
+    nblex_flow_key_normalize(flow);
+
     json_object_set_new(event, "protocol", json_string("tcp"));
     json_object_set_new(event, "tcp_src_port", json_integer(ntohs(tcp->th_sport)));
     json_object_set_new(event, "tcp_dst_port", json_integer(ntohs(tcp->th_dport)));
@@ -177,10 +195,15 @@ static void dissect_tcp(const u_char* packet, json_t* event) {
     json_object_set_new(event, "tcp_urgent", json_integer(ntohs(tcp->th_urp)));
 }
 
-/* UDP dissector */
-static void dissect_udp(const u_char* packet, json_t* event) {
+/* UDP dissector; completes the flow key from the ports */
+static void dissect_udp(const u_char* packet, json_t* event, nblex_flow_key* flow) {
     struct udphdr* udp = (struct udphdr*)packet;
 
+    flow->protocol = IPPROTO_UDP;
+    flow->port[0] = ntohs(udp->uh_sport);
+    flow->port[1] = ntohs(udp->uh_dport);
+    nblex_flow_key_normalize(flow);
+
     json_object_set_new(event, "protocol", json_string("udp"));
     json_object_set_new(event, "udp_src_port", json_integer(ntohs(udp->uh_sport)));
     json_object_set_new(event, "udp_dst_port", json_integer(ntohs(udp->uh_dport)));
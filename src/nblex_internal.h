@@ -54,6 +54,7 @@
 #include <sys/_types/_u_int.h>
 #endif
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -95,6 +96,47 @@ typedef unsigned int u_int;
 typedef struct nblex_input_vtable_s nblex_input_vtable;
 typedef struct filter_s filter_t;
 typedef struct filter_node filter_node_t;
+typedef struct filter_dag_s filter_dag_t;
+typedef struct nql_registry_s nql_registry_t;
+typedef struct nblex_scheduler_s nblex_scheduler_t;
+typedef struct nblex_checkpoint_s nblex_checkpoint_t;
+typedef struct nblex_worker_pool_s nblex_worker_pool_t;
+typedef struct nblex_pool_s nblex_pool_t;
+
+/*
+ * Event time settings and state of a world
+ */
+typedef struct {
+  bool enabled;
+  char* field;                  /* Log event timestamp field */
+  uint64_t max_delay_ns;
+  nblex_late_policy late_policy;
+  uint64_t allowed_lateness_ns;
+
+  /* Lowest input watermark; never decreases */
+  uint64_t watermark_ns;
+
+  /* Window and expiry deadlines, fired as the watermark advances */
+  nblex_scheduler_t* scheduler;
+
+  /* Statistics */
+  uint64_t missing_timestamps;  /* Log events stamped from their input instead */
+  uint64_t untimed_skipped;     /* Of those, skipped before any time was known */
+  uint64_t late_dropped;
+  uint64_t late_side_output;
+  uint64_t late_updates;
+} nblex_event_time_t;
+
+/*
+ * Memory account charged by the nblex_malloc() wrappers
+ */
+typedef struct nblex_mem_account_s nblex_mem_account_t;
+struct nblex_mem_account_s {
+  nblex_mem_account_t* parent;  /* Also charged, e.g. a world-wide budget */
+  atomic_size_t used;           /* Also charged from worker threads */
+  atomic_size_t peak;
+  size_t limit;                 /* 0 for no limit */
+};
 
 /*
  * World structure - main context
@@ -116,9 +158,70 @@ struct nblex_world_s {
   nblex_event_handler event_handler;
   void* event_handler_data;
 
+  /* Batch handler and the input events queued for it: up to batch_size,
+   * the oldest event time among them, whether the handler is running,
+   * and the check handle that hands them over after each loop
+   * iteration (initialized by nblex_world_start) */
+  nblex_batch_handler batch_handler;
+  void* batch_handler_data;
+  size_t batch_size;
+  nblex_event** batch;
+  size_t batch_count;
+  uint64_t batch_min_ns;
+  bool batch_flushing;
+  bool batch_check_init;
+  uv_check_t batch_check;
+
   /* Correlation engine */
   nblex_correlation* correlation;
 
+  /* Prepared nQL queries bound to this world, indexed by query ID */
+  nql_registry_t* queries;
+
+  /* Filters of those queries, sharing common predicates */
+  filter_dag_t* filter_dag;
+
+  /* Window and expiry deadlines of all queries, created on first use */
+  nblex_scheduler_t* scheduler;
+
+  /* Event time mode; processing (arrival) time unless enabled */
+  nblex_event_time_t event_time;
+
+  /* Executor state of all queries; each query's account charges this.
+   * Its limit is the world-wide budget, 0 for none. */
+  nblex_mem_account_t memory;
+
+  /* Budget and eviction policy given to each query as it is prepared */
+  size_t query_memory_limit;
+  nblex_evict_policy query_evict_policy;
+
+  /* Limit on bytes held by correlation buffers, 0 for none */
+  size_t buffer_limit;
+
+  /* How far the world has degraded to stay within its memory limit
+   * (NBLEX_DEGRADE_*), since when, whether the buffers have reached the
+   * limit again since then, and the events dropped for it by admission */
+  int degrade_level;
+  uint64_t degrade_since_ns;
+  bool degrade_pressed;
+  uint64_t network_seen;        /* Network events offered while sampling */
+  uint64_t network_sampled;
+  uint64_t input_shed;
+
+  /* Snapshots of query state and input positions, NULL unless enabled */
+  nblex_checkpoint_t* checkpoint;
+
+  /* Threads that update aggregation buckets of a batch in parallel;
+   * 1 or fewer runs everything on the loop thread. The pool is created
+   * on first use. */
+  size_t worker_threads;
+  nblex_worker_pool_t* workers;
+
+  /* Pools of event structs and correlation buffer entries, created on
+   * first use */
+  nblex_pool_t* event_pool;
+  nblex_pool_t* entry_pool;
+
   /* Statistics */
   uint64_t events_processed;
   uint64_t events_correlated;
@@ -140,6 +243,14 @@ struct nblex_input_s {
 
   /* Filter for this input */
   filter_t* filter;
+
+  /* Newest event time seen in event time mode, 0 if none */
+  uint64_t event_time_max_ns;
+  /* No more events will come: it no longer holds the watermark back */
+  bool event_time_done;
+
+  /* Lower priorities are shed first under memory pressure */
+  int priority;
 };
 
 /*
@@ -158,6 +269,17 @@ struct nblex_input_vtable_s {
   void (*free)(nblex_input* input);
 };
 
+/*
+ * Connection of a network event: its 5-tuple with the lower (address,
+ * port) endpoint first, so both directions share one key. IPv4
+ * addresses are stored IPv4-mapped. All zero when there is none.
+ */
+typedef struct {
+  uint8_t addr[2][16];
+  uint16_t port[2];
+  uint8_t protocol;       /* IPPROTO_TCP or IPPROTO_UDP */
+} nblex_flow_key;
+
 /*
  * Event structure
  */
@@ -170,6 +292,14 @@ struct nblex_event_s {
 
   /* Event data (JSON object) */
   json_t* data;
+
+  /* Set by packet inputs for TCP and UDP packets */
+  nblex_flow_key flow;
+
+  /* References held: the creator's, plus one per retain. Events are
+   * retained and released on their world's loop thread only. */
+  uint32_t refcount;
+  nblex_pool_t* pool;       /* Owner of the struct, NULL if malloc'd */
 };
 
 /*
@@ -183,6 +313,7 @@ struct nblex_input_config_s {
     char* interface;      /* for network inputs */
     char* filter;         /* pcap filter */
     char* format;         /* log format */
+    int priority;         /* shedding priority */
 };
 
 /*
@@ -237,9 +368,32 @@ typedef struct {
  */
 typedef struct nblex_event_buffer_entry_s {
   nblex_event* event;
+  size_t size;         /* Bytes counted against the buffer limit */
+  uint64_t bytes;      /* A network event's length, for coalesced output */
   struct nblex_event_buffer_entry_s* next;
 } nblex_event_buffer_entry;
 
+/*
+ * Correlation event ring: a growable circular array of buffer entries
+ * kept sorted by timestamp, oldest at head. Entries' next links are
+ * unused.
+ */
+typedef struct {
+  nblex_event_buffer_entry* entries;
+  size_t capacity;     /* Power of two, 0 until the first event */
+  size_t head;
+  size_t count;
+} nblex_event_ring;
+
+/* Events a correlation buffer holds at most */
+#define NBLEX_CORR_MAX_BUFFERED 10000
+
+/* Index of buffered events by correlation ID (id_correlation.c) */
+typedef struct nblex_id_index_s nblex_id_index;
+
+/* Table of live connections (connection_correlation.c) */
+typedef struct nblex_flow_table_s nblex_flow_table;
+
 /*
  * Correlation structure
  */
@@ -251,17 +405,48 @@ struct nblex_correlation_s {
   uint64_t window_ns;  /* Time window in nanoseconds */
 
   /* Event buffers for time-based correlation */
-  nblex_event_buffer_entry* log_events;
-  nblex_event_buffer_entry* network_events;
-  size_t log_events_count;
-  size_t network_events_count;
+  nblex_event_ring log_events;
+  nblex_event_ring network_events;
+
+  /* ID-based correlation: fields carrying a log or network event's ID,
+   * tried in order, and the index of events buffered by ID (created on
+   * first use). The window is how long an unused ID stays indexed. */
+  char** log_id_fields;
+  size_t log_id_fields_count;
+  char** network_id_fields;
+  size_t network_id_fields_count;
+  nblex_id_index* id_index;
+
+  /* Connection-based correlation: log fields naming the peer endpoint
+   * (NULL for the defaults), and the table of flows seen on the wire
+   * (created on first use), expired when idle and capped in size */
+  char* peer_ip_field;
+  char* peer_port_field;
+  uint64_t flow_idle_ns;
+  size_t max_flows;
+  nblex_flow_table* flow_table;
+
+  /* Coalesced output: one correlation event per triggering event,
+   * listing its max_matches closest matches and a summary of them all,
+   * instead of one event per matching pair */
+  bool coalesce;
+  size_t max_matches;
 
   /* Timer for periodic cleanup */
   uv_timer_t cleanup_timer;
   int timer_initialized;  /* Track if timer was initialized */
 
+  /* Estimated bytes held by both buffers */
+  size_t buffered_bytes;
+
   /* Statistics */
   uint64_t correlations_found;
+  uint64_t buffer_dropped;   /* Events not buffered: over a buffer limit */
+  uint64_t buffer_shrunk;    /* Events released early: over the memory limit */
+  uint64_t id_bloom_rejects; /* ID lookups the Bloom filter answered */
+  uint64_t flows_expired;    /* Flows dropped after going idle */
+  uint64_t flows_evicted;    /* Flows dropped for a new one at max_flows */
+  uint64_t pairs_dropped;    /* Coalesced matches beyond max_matches, not listed */
 };
 
 /*
@@ -275,24 +460,275 @@ void* nblex_realloc(void* ptr, size_t size);
 void nblex_free(void* ptr);
 char* nblex_strdup(const char* s);
 
+/* Allocation counters of the wrappers above (realloc counts as an allocation) */
+typedef struct {
+  uint64_t allocations;
+  uint64_t frees;
+} nblex_memory_stats_t;
+void nblex_memory_get_stats(nblex_memory_stats_t* stats);
+
+/* Memory accounts: while an account is entered on a thread, the wrappers
+ * above charge it and its parents with the usable size of each block
+ * they allocate, and credit them for each block they free. Memory must
+ * be freed under the account it was charged to, or not charged at all.
+ * Several threads may charge one account at once.
+ */
+void nblex_mem_account_init(nblex_mem_account_t* account, nblex_mem_account_t* parent);
+/* Enter an account (NULL to suspend charging); returns the previous one */
+nblex_mem_account_t* nblex_mem_account_enter(nblex_mem_account_t* account);
+void nblex_mem_account_leave(nblex_mem_account_t* previous);
+/* Is the account or any parent over its limit? */
+bool nblex_mem_account_over_limit(const nblex_mem_account_t* account);
+
+/* Fixed-size object pools: O(1) alloc and free of objects carved from
+ * shared chunks. A pool is used by one thread at a time; worker threads
+ * do not allocate pooled objects. A charged pool charges and credits the
+ * current memory account by object, like the wrappers above. Building
+ * with NBLEX_POOL_DEBUG poisons freed objects and aborts on a write
+ * after free.
+ */
+nblex_pool_t* nblex_pool_new(size_t object_size, bool charged);
+void* nblex_pool_alloc(nblex_pool_t* pool);
+void* nblex_pool_calloc(nblex_pool_t* pool);
+void nblex_pool_free(nblex_pool_t* pool, void* ptr);
+/* Free the pool now, or when its last object is freed */
+void nblex_pool_detach(nblex_pool_t* pool);
+typedef struct {
+  size_t object_size;   /* Rounded up for alignment */
+  size_t live;          /* Objects allocated and not freed */
+  size_t capacity;      /* Objects in the chunks so far */
+  size_t bytes;         /* Held in chunks */
+} nblex_pool_stats_t;
+void nblex_pool_get_stats(const nblex_pool_t* pool, nblex_pool_stats_t* stats);
+
+/* JSON memory. Once nblex_json_allocator_init() has installed nblex's
+ * allocator (as a world memory limit does), jansson allocates through
+ * nblex, each block counted against the subsystem tag current on its
+ * thread when allocated, wherever it is freed. Small blocks are recycled
+ * through per-thread size-class caches.
+ */
+typedef enum {
+  NBLEX_MEM_TAG_OTHER = 0,      /* Application code and setup */
+  NBLEX_MEM_TAG_INPUT,
+  NBLEX_MEM_TAG_PARSER,
+  NBLEX_MEM_TAG_CORRELATION,
+  NBLEX_MEM_TAG_EXECUTOR,
+  NBLEX_MEM_TAG_OUTPUT,
+  NBLEX_MEM_TAG_COUNT
+} nblex_mem_tag;
+/* Set this thread's tag; returns the previous one */
+nblex_mem_tag nblex_mem_tag_enter(nblex_mem_tag tag);
+void nblex_mem_tag_leave(nblex_mem_tag previous);
+const char* nblex_mem_tag_name(nblex_mem_tag tag);
+typedef struct {
+  size_t live_bytes;        /* Allocated and not yet freed */
+  uint64_t allocations;     /* Since start, for allocation rates */
+  uint64_t frees;
+} nblex_mem_tag_stats_t;
+void nblex_memory_get_tag_stats(nblex_mem_tag tag, nblex_mem_tag_stats_t* stats);
+/* Live JSON bytes of all tags, 0 without the allocator; cheap enough to
+ * read per event */
+size_t nblex_json_live_bytes(void);
+/* Serialize like json_dumps(), into memory from malloc(), whichever
+ * allocator jansson uses */
+char* nblex_json_dumps(const json_t* json, size_t flags);
+
+/* Worker pool: a fixed set of threads that run one function together.
+ * nblex_worker_pool_run() calls fn(arg, i) once for each i below the
+ * pool size, index 0 on the calling thread, and returns when all have
+ * returned. Only one thread may run the pool at a time.
+ */
+typedef void (*nblex_worker_fn)(void* arg, size_t worker);
+nblex_worker_pool_t* nblex_worker_pool_new(size_t threads);
+void nblex_worker_pool_free(nblex_worker_pool_t* pool);
+size_t nblex_worker_pool_size(const nblex_worker_pool_t* pool);
+void nblex_worker_pool_run(nblex_worker_pool_t* pool, nblex_worker_fn fn, void* arg);
+/* The world's pool, created on first use; NULL if it has one thread or
+ * the threads cannot be started */
+nblex_worker_pool_t* nblex_world_workers(nblex_world* world);
+
 /* Events */
 nblex_event* nblex_event_new(nblex_event_type type, nblex_input* input);
+/* A new event from a world's pool; NULL world allocates it alone */
+nblex_event* nblex_world_event_new(nblex_world* world, nblex_event_type type,
+                                   nblex_input* input);
+/* Release the caller's reference (nblex_event_release) */
 void nblex_event_free(nblex_event* event);
-/* Shutdown exec contexts referencing a world: stop and close their timers so
- * the world's loop can be safely drained and closed. Implemented in
- * src/core/nql_executor.c and invoked by nblex_world_free().
- */
-/* Important: exec contexts do NOT retain pointers to parsed nql_query_t
- * instances. Callers may free parsed queries after `nql_execute()` returns.
- * The executor stores only lightweight information (for example the
- * query type and an optional cached query string) in the internal contexts.
- */
-void nblex_exec_contexts_shutdown_world(nblex_world* world);
+/* Emit an event, taking over the caller's reference */
 void nblex_event_emit(nblex_world* world, nblex_event* event);
+/* Queue an input event for the batch handler, retaining it; handed over
+ * alone if there is no batch size or the handler is already running */
+void nblex_world_batch_event(nblex_world* world, nblex_event* event);
+/* Hand the queued events to the batch handler and release them */
+void nblex_world_flush_batch(nblex_world* world);
 /* Clone an event: deep copy the event struct, incref JSON data if present.
- * The returned event must be freed with nblex_event_free().
+ * The returned event must be freed with nblex_event_free(). Buffers that
+ * only read an event retain it instead.
  */
 nblex_event* nblex_event_clone(nblex_event* src);
+/* Degradation steps of a world over its memory limit, in order */
+#define NBLEX_DEGRADE_NONE 0
+#define NBLEX_DEGRADE_SHRINK 1      /* Release the oldest buffered events */
+#define NBLEX_DEGRADE_SAMPLE 2      /* Also admit 1 in NBLEX_NETWORK_SAMPLE network events */
+#define NBLEX_DEGRADE_SHED 3        /* Also drop inputs below the highest priority */
+#define NBLEX_NETWORK_SAMPLE 8
+/* How long a step is given before the world steps up or down */
+#define NBLEX_DEGRADE_INTERVAL_NS 1000000000ULL
+/* Should an input's new event be admitted, given the memory limit? */
+bool nblex_world_admit(nblex_world* world, nblex_input* input, nblex_event_type type);
+/* A world's pool of nblex_event_buffer_entry, created on first use;
+ * NULL if it cannot be created */
+nblex_pool_t* nblex_world_entry_pool(nblex_world* world);
+
+/* Hashing (non-cryptographic) */
+uint64_t nblex_hash64(const void* data, size_t len, uint64_t seed);
+uint64_t nblex_hash64_string(const char* s);
+uint64_t nblex_hash64_combine(uint64_t h, uint64_t value);
+/* Hash a JSON value by type and content; integral numbers hash alike
+ * whether stored as integer or real.
+ */
+uint64_t nblex_hash64_json(const json_t* value);
+
+/* Hash index: open addressing with linear probing, kept at most 3/4
+ * full, with backward-shift deletion. Each bucket holds a hash and a
+ * caller value, a pointer or an ID + 1 (0 marks an empty bucket); the
+ * caller holds the keys and compares them for the buckets whose hash
+ * matches. A zeroed index is empty and allocates on first insert.
+ */
+typedef struct {
+  uint64_t hash;
+  uintptr_t value;
+} nblex_index_bucket_t;
+typedef struct {
+  nblex_index_bucket_t* buckets;
+  size_t capacity;              /* Power of two, 0 until first insert */
+  size_t count;
+} nblex_index_t;
+/* Add a value; the same hash and value must not be added twice */
+int nblex_index_insert(nblex_index_t* index, uint64_t hash, uintptr_t value);
+/* Remove a value added under a hash; false if it is not there */
+bool nblex_index_remove(nblex_index_t* index, uint64_t hash, uintptr_t value);
+void nblex_index_free(nblex_index_t* index);
+/* Next bucket under a hash, NULL after the last. `*pos` starts as the
+ * hash. Its value may be replaced by another non-zero value.
+ */
+static inline nblex_index_bucket_t* nblex_index_next(const nblex_index_t* index, uint64_t hash,
+                                                     size_t* pos) {
+  if (index->count == 0) {
+    return NULL;
+  }
+  size_t mask = index->capacity - 1;
+  nblex_index_bucket_t* bucket;
+  while ((bucket = &index->buckets[*pos & mask])->value != 0) {
+    *pos = (*pos & mask) + 1;
+    if (bucket->hash == hash) {
+      return bucket;
+    }
+  }
+  return NULL;
+}
+
+/* Quantile sketch (mergeable, relative-error; accuracy 0 keeps all values).
+ * Magnitudes more than NBLEX_QUANTILE_SKETCH_RANGE below the largest seen
+ * lose the accuracy bound.
+ */
+#define NBLEX_QUANTILE_SKETCH_RANGE 1e12
+typedef struct quantile_sketch_s quantile_sketch_t;
+quantile_sketch_t* nblex_quantile_sketch_new(double relative_accuracy);
+void nblex_quantile_sketch_free(quantile_sketch_t* sketch);
+int nblex_quantile_sketch_add(quantile_sketch_t* sketch, double value);
+int nblex_quantile_sketch_merge(quantile_sketch_t* dst, const quantile_sketch_t* src);
+double nblex_quantile_sketch_quantile(quantile_sketch_t* sketch, double q);
+uint64_t nblex_quantile_sketch_count(const quantile_sketch_t* sketch);
+double nblex_quantile_sketch_relative_accuracy(const quantile_sketch_t* sketch);
+size_t nblex_quantile_sketch_bin_count(const quantile_sketch_t* sketch);
+size_t nblex_quantile_sketch_max_bins(const quantile_sketch_t* sketch);
+
+/* HyperLogLog distinct counter (exact below the threshold, mergeable) */
+#define NBLEX_HLL_DEFAULT_PRECISION 14
+#define NBLEX_HLL_MIN_PRECISION 4
+#define NBLEX_HLL_MAX_PRECISION 18
+#define NBLEX_HLL_EXACT_THRESHOLD 128
+typedef struct hll_s hll_t;
+hll_t* nblex_hll_new(int precision);
+void nblex_hll_free(hll_t* hll);
+int nblex_hll_add_hash(hll_t* hll, uint64_t hash);
+int nblex_hll_merge(hll_t* dst, const hll_t* src);
+uint64_t nblex_hll_estimate(const hll_t* hll);
+bool nblex_hll_is_exact(const hll_t* hll);
+size_t nblex_hll_memory_usage(const hll_t* hll);
+
+/* Bloom filter over 64-bit hashes (no false negatives) */
+#define NBLEX_BLOOM_MIN_BITS_LOG2 6
+#define NBLEX_BLOOM_MAX_BITS_LOG2 32
+typedef struct bloom_filter_s bloom_filter_t;
+bloom_filter_t* nblex_bloom_filter_new(size_t bits_log2, int hashes);
+void nblex_bloom_filter_free(bloom_filter_t* bloom);
+void nblex_bloom_filter_add_hash(bloom_filter_t* bloom, uint64_t hash);
+bool nblex_bloom_filter_may_contain(const bloom_filter_t* bloom, uint64_t hash);
+void nblex_bloom_filter_clear(bloom_filter_t* bloom);
+size_t nblex_bloom_filter_memory_usage(const bloom_filter_t* bloom);
+
+/* Checkpoint encoding: fixed-width little-endian fields appended to a
+ * growable buffer and read back with bounds checks. Both sides fail
+ * sticky: once `failed` is set further puts are ignored and gets return
+ * zero, so callers check once at the end.
+ */
+typedef struct {
+  uint8_t* data;
+  size_t size;
+  size_t capacity;
+  bool failed;
+} nblex_ckpt_writer_t;
+typedef struct {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+  bool failed;
+} nblex_ckpt_reader_t;
+void nblex_ckpt_put_u8(nblex_ckpt_writer_t* writer, uint8_t value);
+void nblex_ckpt_put_u32(nblex_ckpt_writer_t* writer, uint32_t value);
+void nblex_ckpt_put_u64(nblex_ckpt_writer_t* writer, uint64_t value);
+void nblex_ckpt_put_double(nblex_ckpt_writer_t* writer, double value);
+void nblex_ckpt_put_bytes(nblex_ckpt_writer_t* writer, const void* data, size_t length);
+/* Length-prefixed; NULL is written as an empty string */
+void nblex_ckpt_put_string(nblex_ckpt_writer_t* writer, const char* s, size_t length);
+/* Overwrite a u32 put earlier at `offset`, e.g. a length known later */
+void nblex_ckpt_patch_u32(nblex_ckpt_writer_t* writer, size_t offset, uint32_t value);
+uint8_t nblex_ckpt_get_u8(nblex_ckpt_reader_t* reader);
+uint32_t nblex_ckpt_get_u32(nblex_ckpt_reader_t* reader);
+uint64_t nblex_ckpt_get_u64(nblex_ckpt_reader_t* reader);
+double nblex_ckpt_get_double(nblex_ckpt_reader_t* reader);
+const void* nblex_ckpt_get_bytes(nblex_ckpt_reader_t* reader, size_t length);
+/* Points into the reader's data, not NUL-terminated; NULL on failure */
+const char* nblex_ckpt_get_string(nblex_ckpt_reader_t* reader, size_t* length_out);
+/* Bytes left to read, or 0 after a failure */
+size_t nblex_ckpt_remaining(const nblex_ckpt_reader_t* reader);
+
+/* Sketch state in checkpoints; restoring yields an equivalent sketch */
+int nblex_quantile_sketch_write(const quantile_sketch_t* sketch, nblex_ckpt_writer_t* writer);
+quantile_sketch_t* nblex_quantile_sketch_read(nblex_ckpt_reader_t* reader);
+int nblex_hll_write(const hll_t* hll, nblex_ckpt_writer_t* writer);
+hll_t* nblex_hll_read(nblex_ckpt_reader_t* reader);
+
+/* Checkpoints of a world: query state, event-time watermarks and input
+ * read positions, written atomically to a file and restored before the
+ * world starts. Implemented in src/core/checkpoint.c.
+ */
+/* Restore (if not done yet) and start periodic checkpoints; called by
+ * nblex_world_start() before inputs start */
+int nblex_checkpoint_start(nblex_world* world);
+/* Write a final checkpoint and stop the timer; called by nblex_world_stop()
+ * while inputs still hold their positions. `watermark_ns` is the event
+ * time watermark to record, which the end of input may have overtaken */
+void nblex_checkpoint_stop(nblex_world* world, uint64_t watermark_ns);
+/* Close the timer; memory is released by its close callback */
+void nblex_checkpoint_free(nblex_checkpoint_t* checkpoint);
+/* Position to resume a file input at, if the restored checkpoint has one
+ * for the same file and the file still extends past it. Returns 0 and
+ * sets *offset_out, or -1 to read from the end as usual.
+ */
+int nblex_checkpoint_file_offset(nblex_input* input, FILE* file, long* offset_out);
 
 /* Timestamp */
 static inline uint64_t nblex_timestamp_now(void) {
@@ -332,6 +768,46 @@ json_t* nblex_regex_parser_parse(regex_parser_t* parser, const char* line);
 /* Correlation */
 int nblex_correlation_start(nblex_correlation* corr);
 void nblex_correlation_process_event(nblex_correlation* corr, nblex_event* event);
+/* Release buffered events too old to correlate (the cleanup timer's work) */
+void nblex_correlation_expire(nblex_correlation* corr);
+void nblex_correlation_expire_at(nblex_correlation* corr, uint64_t now);
+/* Release the oldest buffered events until `bytes` are freed or none
+ * are left; returns the bytes freed */
+size_t nblex_correlation_shrink(nblex_correlation* corr, size_t bytes);
+/* Bytes a buffered event is counted as holding */
+size_t nblex_event_buffered_size(const nblex_event* event);
+/* ID-based strategy, dispatched to by the functions above */
+void nblex_id_correlation_process_event(nblex_correlation* corr, nblex_event* event);
+void nblex_id_correlation_expire(nblex_correlation* corr, uint64_t now_ns);
+size_t nblex_id_correlation_shrink(nblex_correlation* corr, size_t bytes);
+void nblex_id_correlation_free(nblex_correlation* corr);
+/* Summary of all the pairs a triggering event matched */
+typedef struct {
+  size_t count;
+  int64_t min_diff_ns;       /* Log minus network time */
+  int64_t max_diff_ns;
+  uint64_t bytes;            /* Of the network events involved */
+} nblex_corr_match_stats;
+/* One listed match of a coalesced correlation */
+json_t* nblex_correlation_match_json(const nblex_event* trigger, const nblex_event* match);
+/* Complete and emit a coalesced correlation: corr_data (stolen) already
+ * holds the strategy's own fields, matches (stolen) the listed ones */
+void nblex_correlation_emit_coalesced(nblex_correlation* corr, json_t* corr_data,
+                                      nblex_event* trigger, json_t* matches,
+                                      const nblex_corr_match_stats* stats);
+/* Bytes a network event's length field gives, 0 if none */
+uint64_t nblex_network_event_bytes(const nblex_event* event);
+/* Connection-based strategy, likewise */
+void nblex_connection_correlation_process_event(nblex_correlation* corr, nblex_event* event);
+void nblex_connection_correlation_expire(nblex_correlation* corr, uint64_t now_ns);
+void nblex_connection_correlation_free(nblex_correlation* corr);
+/* Field value by flat key ("http.headers.x-request-id") or dot path */
+json_t* nblex_correlation_field_value(json_t* data, const char* path);
+/* Store an IPv4 address (network order) IPv4-mapped */
+void nblex_flow_map_ipv4(uint8_t addr[16], const struct in_addr* ipv4);
+/* Order a flow key's endpoints once its source (0) and destination (1)
+ * are filled in */
+void nblex_flow_key_normalize(nblex_flow_key* key);
 
 /* JSON output */
 char* nblex_event_to_json_string(nblex_event* event);
@@ -342,6 +818,38 @@ void nblex_filter_free(filter_t* filter);
 int nblex_filter_matches(const filter_t* filter, const nblex_event* event);
 filter_node_t* parse_filter_full(const char* expr);
 char* nblex_filter_to_bpf(const filter_t* filter);
+/* The filter as an expression, fully parenthesised; free() the result */
+char* nblex_filter_to_string(const filter_t* filter);
+
+/* Batch execution: events are handed over NBLEX_BATCH_SIZE at a time and
+ * stages narrow a selection vector of ascending indices into the batch.
+ */
+#define NBLEX_BATCH_SIZE 256
+/* Keep the entries of sel[0..count) whose events match; count is at most
+ * NBLEX_BATCH_SIZE. Returns how many were kept, in order.
+ */
+size_t nblex_filter_select(const filter_t* filter, nblex_event* const* events,
+                           uint16_t* sel, size_t count);
+
+/* Shared predicate DAG: filters added to one DAG share identical
+ * predicates and subexpressions. Between begin and end, matching any of
+ * its filters against that event evaluates each shared node at most
+ * once; outside, filters are evaluated on their own. Scopes nest.
+ */
+typedef struct {
+  const nblex_event* event;
+  uint64_t generation;
+} filter_dag_scope_t;
+filter_dag_t* nblex_filter_dag_new(void);
+void nblex_filter_dag_free(filter_dag_t* dag);
+int nblex_filter_dag_add(filter_dag_t* dag, filter_t* filter);
+/* Take a filter out of its DAG, if any; nblex_filter_free() does this */
+void nblex_filter_dag_remove(filter_t* filter);
+void nblex_filter_dag_begin(filter_dag_t* dag, const nblex_event* event, filter_dag_scope_t* saved);
+void nblex_filter_dag_end(filter_dag_t* dag, const filter_dag_scope_t* saved);
+/* Distinct nodes, and predicate evaluations made so far */
+size_t nblex_filter_dag_size(const filter_dag_t* dag);
+uint64_t nblex_filter_dag_evaluations(const filter_dag_t* dag);
 
 /* nQL parser */
 typedef struct nql_query_s nql_query_t;
@@ -350,7 +858,187 @@ nql_query_t* nql_parse_ex(const char* query_str, char** error_out);
 void nql_free(nql_query_t* query);
 
 /* nQL executor */
+/* A prepared query owns its parsed AST, compiled filters and executor
+ * state (aggregation buckets, correlation buffers, deadlines). Prepare once
+ * and execute per event to avoid re-parsing the query string.
+ */
+typedef struct nql_prepared_s nql_prepared_t;
+nql_prepared_t* nql_prepare(const char* query_str, nblex_world* world);
+nql_prepared_t* nql_prepare_ex(const char* query_str, nblex_world* world, char** error_out);
+int nql_execute_prepared(nql_prepared_t* prepared, nblex_event* event);
+/* Execute a prepared query on `count` events (NULL entries are skipped),
+ * running each stage over up to NBLEX_BATCH_SIZE of them before the
+ * next. Stores the indices of matching events in ascending order in
+ * `matched_out`, if given, and returns how many matched.
+ */
+size_t nql_execute_prepared_batch(nql_prepared_t* prepared, nblex_event** events,
+                                  size_t count, uint32_t* matched_out);
+void nql_prepared_free(nql_prepared_t* prepared);
+/* Query ID of a prepared query within its world's registry, -1 if none */
+int nql_prepared_id(const nql_prepared_t* prepared);
+/* Parsed AST of a prepared query, owned by it */
+const nql_query_t* nql_prepared_query(const nql_prepared_t* prepared);
+/* Memory budget of a prepared query's executor state, also charged to
+ * its world's budget. Over either, the least recently updated
+ * aggregation buckets are evicted: emitted early with "evicted": true,
+ * or folded into a group whose fields all read "__other__".
+ */
+typedef enum {
+  NQL_EVICT_EMIT = NBLEX_EVICT_EMIT,
+  NQL_EVICT_FOLD = NBLEX_EVICT_FOLD
+} nql_evict_policy_t;
+typedef struct {
+  size_t used;
+  size_t peak;
+  size_t limit;          /* 0 for none */
+  uint64_t evicted;      /* Buckets emitted early */
+  uint64_t folded;       /* Buckets merged into the "__other__" group */
+  uint64_t dropped;      /* Buckets discarded when folding failed */
+} nql_memory_stats_t;
+int nql_prepared_set_memory_limit(nql_prepared_t* prepared, size_t limit_bytes,
+                                  nql_evict_policy_t policy);
+int nql_prepared_get_memory_stats(const nql_prepared_t* prepared, nql_memory_stats_t* stats);
+/* Queries prefixed with "explain" are described, not run; with "explain
+ * analyze" they run and count per stage. nql_explain() returns the plan,
+ * with any counters, as text to free with nblex_free().
+ */
+typedef struct {
+  uint64_t events_in;
+  uint64_t events_out;   /* Events passed on to the next stage */
+  uint64_t time_ns;      /* Including emitting the stage's results */
+  uint64_t allocations;  /* Process-wide allocations while it ran */
+} nql_stage_stats_t;
+char* nql_explain(const nql_prepared_t* prepared);
+int nql_prepared_get_stage_stats(const nql_prepared_t* prepared, size_t stage,
+                                 nql_stage_stats_t* stats);
 int nql_execute(const char* query_str, nblex_event* event, nblex_world* world);
+/* World-owned standing queries, addressed by integer query ID */
+int nql_register(nblex_world* world, const char* query_str, char** error_out);
+int nql_execute_id(nblex_world* world, int query_id, nblex_event* event);
+/* Execute every query bound to a world against one event, evaluating
+ * each predicate they share once. Calls `matched` for each query that
+ * matches and returns how many did.
+ */
+typedef void (*nql_match_cb)(int query_id, nblex_event* event, void* user_data);
+int nql_execute_all(nblex_world* world, nblex_event* event, nql_match_cb matched, void* user_data);
+/* Execute every query bound to a world against a batch of events with
+ * nql_execute_prepared_batch(), NBLEX_BATCH_SIZE events at a time: each
+ * query in turn over those events. Shared predicates are not evaluated
+ * once across queries. Returns the number of matches.
+ */
+size_t nql_execute_all_batch(nblex_world* world, nblex_event** events, size_t count,
+                             nql_match_cb matched, void* user_data);
+int nql_unregister(nblex_world* world, int query_id);
+/* Cancel deadlines of every query bound to a world and free the world-owned
+ * ones; caller-owned handles are detached and must still be freed with
+ * nql_prepared_free(). Invoked by nblex_world_free().
+ */
+void nql_world_shutdown(nblex_world* world);
+/* Write the state of every query bound to a world, keyed by query
+ * string; restore it into queries of the same string that have not run
+ * yet. Restored windows and buffers get fresh deadlines, so those whose
+ * time has passed close or expire on the next scheduler run. Records
+ * without such a query are skipped.
+ */
+int nql_world_checkpoint(nblex_world* world, nblex_ckpt_writer_t* writer);
+int nql_world_restore(nblex_world* world, nblex_ckpt_reader_t* reader);
+
+/* nQL query registry: slot array indexed by query ID with an optional
+ * string index. Implemented in src/core/nql_registry.c.
+ */
+nql_registry_t* nql_registry_new(void);
+void nql_registry_free(nql_registry_t* registry);
+int nql_registry_add(nql_registry_t* registry, nql_prepared_t* prepared, const char* key);
+void nql_registry_remove(nql_registry_t* registry, int id);
+nql_prepared_t* nql_registry_get(const nql_registry_t* registry, int id);
+nql_prepared_t* nql_registry_find(const nql_registry_t* registry, const char* key);
+size_t nql_registry_count(const nql_registry_t* registry);
+/* Upper bound (exclusive) of assigned query IDs, for iteration */
+size_t nql_registry_capacity(const nql_registry_t* registry);
+
+/* nQL group-key interner: each distinct tuple of strings is stored once
+ * in a per-query arena under a stable, reference-counted ID. Interning
+ * a known tuple does not allocate. Implemented in src/core/nql_interner.c.
+ */
+typedef struct nql_interner_s nql_interner_t;
+typedef struct {
+  const char* data;       /* Need not be NUL-terminated */
+  size_t length;
+} nql_key_part_t;
+nql_interner_t* nql_interner_new(size_t parts_count);
+void nql_interner_free(nql_interner_t* interner);
+/* Find or add a tuple and take a reference to it; returns its ID or -1 */
+int nql_interner_intern(nql_interner_t* interner, const nql_key_part_t* parts);
+void nql_interner_retain(nql_interner_t* interner, int id);
+void nql_interner_release(nql_interner_t* interner, int id);
+uint64_t nql_interner_hash(const nql_interner_t* interner, int id);
+uint64_t nql_interner_hash_parts(const nql_key_part_t* parts, size_t parts_count);
+/* NUL-terminated part of a live tuple; valid until the next intern call */
+const char* nql_interner_part(const nql_interner_t* interner, int id, size_t part);
+size_t nql_interner_count(const nql_interner_t* interner);
+size_t nql_interner_arena_size(const nql_interner_t* interner);
+
+/* Deadline scheduler: a per-world min-heap of deadlines driven by one
+ * libuv timer, armed for the earliest. Deadlines are embedded in their
+ * owner (a window bucket, a correlation buffer) and fire once; the
+ * callback may reschedule. Equal deadlines fire in scheduling order.
+ * Implemented in src/core/scheduler.c.
+ */
+typedef struct nblex_deadline_s nblex_deadline_t;
+typedef void (*nblex_deadline_cb)(nblex_deadline_t* deadline, uint64_t now_ns);
+struct nblex_deadline_s {
+  uint64_t when_ns;
+  uint64_t seq;                   /* Tie-break for equal deadlines */
+  nblex_deadline_cb cb;
+  void* data;
+  nblex_scheduler_t* scheduler;   /* NULL while not scheduled */
+  size_t heap_index;
+};
+void nblex_deadline_init(nblex_deadline_t* deadline, nblex_deadline_cb cb, void* data);
+/* Schedule, or move if already scheduled; returns 0 or -1 */
+int nblex_deadline_schedule(nblex_scheduler_t* scheduler, nblex_deadline_t* deadline,
+                            uint64_t when_ns);
+void nblex_deadline_cancel(nblex_deadline_t* deadline);
+bool nblex_deadline_pending(const nblex_deadline_t* deadline);
+/* With a NULL loop the scheduler has no timer and deadlines fire only
+ * from nblex_scheduler_run(), e.g. as an event-time watermark advances.
+ */
+nblex_scheduler_t* nblex_scheduler_new(uv_loop_t* loop);
+/* Unschedule everything and close the timer; memory is released by the
+ * close callback when the loop next runs (at once if there is no timer).
+ */
+void nblex_scheduler_free(nblex_scheduler_t* scheduler);
+/* Fire every deadline due at now_ns; returns how many fired */
+size_t nblex_scheduler_run(nblex_scheduler_t* scheduler, uint64_t now_ns);
+size_t nblex_scheduler_pending(const nblex_scheduler_t* scheduler);
+/* The world's scheduler, created on first use */
+nblex_scheduler_t* nblex_world_scheduler(nblex_world* world);
+
+/* Event time: source events are stamped from a field or the capture
+ * time, per-input watermarks advance with them and deadlines on the
+ * world's event-time scheduler fire as the lowest watermark passes them.
+ * Implemented in src/core/event_time.c.
+ */
+/* Parse an event time: epoch seconds, milliseconds, microseconds or
+ * nanoseconds (by magnitude), ISO 8601 or nginx time_local strings.
+ * Returns 0 and sets *ns_out, or -1.
+ */
+int nblex_event_time_parse(const json_t* value, uint64_t* ns_out);
+/* Stamp a source event and advance its input's watermark; called by
+ * nblex_event_emit() before the event is handled. Returns false if the
+ * event has no time and none is known yet, so it is not handled.
+ */
+bool nblex_event_time_observe(nblex_world* world, nblex_event* event);
+/* An input has ended (NULL: all of them, at world stop): its watermark
+ * goes to the end of time, and once no input is left, every window
+ * closes */
+void nblex_event_time_input_done(nblex_world* world, nblex_input* input);
+/* Raise the world watermark (never lowers it) and fire what is due */
+void nblex_world_advance_watermark(nblex_world* world, uint64_t watermark_ns);
+/* Scheduler for window deadlines: the event-time one when enabled */
+nblex_scheduler_t* nblex_world_window_scheduler(nblex_world* world);
+/* Current time for windows: the watermark in event time mode */
+uint64_t nblex_world_clock(nblex_world* world);
 
 /* Configuration */
 typedef struct nblex_config_s nblex_config_t;
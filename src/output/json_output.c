@@ -31,8 +31,10 @@ char* nblex_event_to_json_string(nblex_event* event) {
     return NULL;
   }
 
+  nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_OUTPUT);
   json_t* root = json_object();
   if (!root) {
+    nblex_mem_tag_leave(previous_tag);
     return NULL;
   }
 
@@ -76,10 +78,11 @@ char* nblex_event_to_json_string(nblex_event* event) {
     json_object_set_new(root, "data", event->data);
   }
 
-  /* Serialize to string */
-  char* json_str = json_dumps(root, JSON_COMPACT);
+  /* Serialize to a string the caller frees with free() */
+  char* json_str = nblex_json_dumps(root, JSON_COMPACT);
 
   json_decref(root);
+  nblex_mem_tag_leave(previous_tag);
 
   return json_str;
 }
@@ -139,6 +139,24 @@ int nblex_metrics_output_flush(metrics_output_t* output) {
         fprintf(output->file, "# TYPE nblex_correlations_found counter\n");
         fprintf(output->file, "nblex_correlations_found %llu\n", (unsigned long long)output->correlations_found);
 
+        /* JSON memory by the subsystem that allocated it */
+        nblex_mem_tag_stats_t tag_stats[NBLEX_MEM_TAG_COUNT];
+        for (int i = 0; i < NBLEX_MEM_TAG_COUNT; i++) {
+            nblex_memory_get_tag_stats((nblex_mem_tag)i, &tag_stats[i]);
+        }
+        fprintf(output->file, "# HELP nblex_json_live_bytes JSON bytes allocated and not yet freed\n");
+        fprintf(output->file, "# TYPE nblex_json_live_bytes gauge\n");
+        for (int i = 0; i < NBLEX_MEM_TAG_COUNT; i++) {
+            fprintf(output->file, "nblex_json_live_bytes{subsystem=\"%s\"} %zu\n",
+                   nblex_mem_tag_name((nblex_mem_tag)i), tag_stats[i].live_bytes);
+        }
+        fprintf(output->file, "# HELP nblex_json_allocations_total JSON allocations\n");
+        fprintf(output->file, "# TYPE nblex_json_allocations_total counter\n");
+        for (int i = 0; i < NBLEX_MEM_TAG_COUNT; i++) {
+            fprintf(output->file, "nblex_json_allocations_total{subsystem=\"%s\"} %llu\n",
+                   nblex_mem_tag_name((nblex_mem_tag)i), (unsigned long long)tag_stats[i].allocations);
+        }
+
         /* Export aggregation metrics */
         if (output->aggregation_metrics) {
             fprintf(output->file, "# HELP nblex_aggregation Aggregation metrics from nQL queries\n");
@@ -318,7 +336,9 @@ int nblex_metrics_output_write(metrics_output_t* output, nblex_event* event) {
                             
                             /* Copy group labels if present */
                             if (group && json_is_object(group)) {
+                                nblex_mem_tag previous_tag = nblex_mem_tag_enter(NBLEX_MEM_TAG_OUTPUT);
                                 new_metric->labels = json_deep_copy(group);
+                                nblex_mem_tag_leave(previous_tag);
                                 if (!new_metric->labels) {
                                     free(new_metric->metric_name);
                                     free(new_metric);
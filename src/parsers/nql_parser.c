@@ -374,6 +374,30 @@ static int parse_agg_function(nql_parser_t* parser, nql_aggregate_t* aggregate)
       goto error;
     }
     parser->pos = endptr;
+    if (func.percentile < 0.0 || func.percentile > 100.0) {
+      parser_set_error(parser, "percentile value must be between 0 and 100");
+      goto error;
+    }
+
+    /* Optional accuracy: a relative error bound, or 'exact' */
+    func.accuracy = NQL_PERCENTILE_DEFAULT_ACCURACY;
+    if (consume_char(parser, ',')) {
+      if (match_keyword(parser, "exact")) {
+        func.accuracy = 0.0;
+      } else {
+        skip_whitespace(parser);
+        func.accuracy = strtod(parser->pos, &endptr);
+        if (endptr == parser->pos) {
+          parser_set_error(parser, "expected accuracy or 'exact' in percentile()");
+          goto error;
+        }
+        parser->pos = endptr;
+        if (!(func.accuracy > 0.0 && func.accuracy < 1.0)) {
+          parser_set_error(parser, "percentile accuracy must be between 0 and 1");
+          goto error;
+        }
+      }
+    }
 
     skip_whitespace(parser);
     if (!consume_char(parser, ')')) {
@@ -458,14 +482,25 @@ static nql_query_t* parse_correlate(nql_parser_t* parser) {
     return NULL;
   }
 
-  const char* right_keywords[] = {"within", "|"};
+  const char* right_keywords[] = {"on", "within", "|"};
   query->data.correlate->right_filter =
-      parse_filter_expr(parser, right_keywords, 2, true);
+      parse_filter_expr(parser, right_keywords, 3, true);
   if (!query->data.correlate->right_filter) {
     nql_free(query);
     return NULL;
   }
 
+  if (match_keyword(parser, "on")) {
+    query->data.correlate->on_field = parse_identifier(parser);
+    if (!query->data.correlate->on_field) {
+      if (!parser->error_msg) {
+        parser_set_error(parser, "expected field name after 'on'");
+      }
+      nql_free(query);
+      return NULL;
+    }
+  }
+
   if (match_keyword(parser, "within")) {
     uint64_t within = parse_duration(parser);
     if (parser->error_msg) {
@@ -628,6 +663,144 @@ static nql_query_t* parse_aggregate(nql_parser_t* parser) {
   return query;
 }
 
+/* Helper: Parse the number in top(N) or limit N */
+static bool parse_limit(nql_parser_t* parser, uint64_t* limit_out) {
+  skip_whitespace(parser);
+  if (!isdigit((unsigned char)*parser->pos)) {
+    return false;
+  }
+  char* endptr = NULL;
+  unsigned long long value = strtoull(parser->pos, &endptr, 10);
+  parser->pos = endptr;
+  if (value == 0) {
+    parser_set_error(parser, "limit must be at least 1");
+    return false;
+  }
+  *limit_out = value;
+  return true;
+}
+
+/* Helper: Parse the ranking function after 'by' into a top stage */
+static int parse_order_func(nql_parser_t* parser, nql_top_t* top) {
+  nql_aggregate_t funcs = {0};
+  if (parse_agg_function(parser, &funcs) != 0) {
+    return -1;
+  }
+  top->ordered = true;
+  top->order_func = funcs.funcs[0];
+  free(funcs.funcs);
+  return 0;
+}
+
+static nql_query_t* parse_top(nql_parser_t* parser) {
+  const char* saved = parser->pos;
+  nql_top_t top = {0};
+  top.func_index = -1;
+
+  /* Only commit once the clause shape is certain, so that fields
+   * named top, order or limit still parse as filters */
+  if (match_keyword(parser, "top") && consume_char(parser, '(')) {
+    if (!parse_limit(parser, &top.limit)) {
+      parser_set_error(parser, "expected count in top()");
+      return NULL;
+    }
+    if (!consume_char(parser, ')')) {
+      parser_set_error(parser, "expected ')' after top count");
+      return NULL;
+    }
+    if (!match_keyword(parser, "by")) {
+      parser_set_error(parser, "expected 'by' after top()");
+      return NULL;
+    }
+    if (parse_order_func(parser, &top) != 0) {
+      return NULL;
+    }
+    top.descending = true;
+  } else {
+    parser->pos = saved;
+    if (match_keyword(parser, "order") && match_keyword(parser, "by")) {
+      if (parse_order_func(parser, &top) != 0) {
+        return NULL;
+      }
+      if (match_keyword(parser, "desc")) {
+        top.descending = true;
+      } else {
+        match_keyword(parser, "asc");
+      }
+      if (match_keyword(parser, "limit") && !parse_limit(parser, &top.limit)) {
+        parser_set_error(parser, "expected count after limit");
+        free(top.order_func.field);
+        return NULL;
+      }
+    } else {
+      parser->pos = saved;
+      if (!match_keyword(parser, "limit") || !parse_limit(parser, &top.limit)) {
+        return NULL;
+      }
+    }
+  }
+
+  nql_query_t* query = allocate_query(NQL_QUERY_TOP);
+  if (query) {
+    query->data.top = malloc(sizeof(nql_top_t));
+  }
+  if (!query || !query->data.top) {
+    free(query);
+    free(top.order_func.field);
+    parser_set_error(parser, "out of memory");
+    return NULL;
+  }
+  *query->data.top = top;
+  return query;
+}
+
+/* Helper: Same aggregation function and arguments, ignoring accuracy */
+static bool agg_func_equal(const nql_agg_func_t* a, const nql_agg_func_t* b) {
+  if (a->type != b->type) {
+    return false;
+  }
+  if ((a->field == NULL) != (b->field == NULL) ||
+      (a->field && strcmp(a->field, b->field) != 0)) {
+    return false;
+  }
+  return a->type != NQL_AGG_PERCENTILE || a->percentile == b->percentile;
+}
+
+/* Helper: A top stage ranks the closed windows of the aggregate stage
+ * before it, by one of that stage's functions. Resolve that function.
+ */
+static int check_top_stages(nql_parser_t* parser, nql_pipeline_t* pipeline) {
+  for (size_t i = 0; i < pipeline->count; i++) {
+    if (pipeline->stages[i]->type != NQL_QUERY_TOP) {
+      continue;
+    }
+    nql_top_t* top = pipeline->stages[i]->data.top;
+    nql_query_t* prev = i > 0 ? pipeline->stages[i - 1] : NULL;
+    if (!prev || prev->type != NQL_QUERY_AGGREGATE ||
+        (prev->data.aggregate->window.type != NQL_WINDOW_TUMBLING &&
+         prev->data.aggregate->window.type != NQL_WINDOW_SLIDING)) {
+      parser_set_error(parser, "top, order by and limit must follow a tumbling or "
+                       "sliding window aggregate");
+      return -1;
+    }
+    if (!top->ordered) {
+      continue;
+    }
+    nql_aggregate_t* aggregate = prev->data.aggregate;
+    for (size_t f = 0; f < aggregate->funcs_count; f++) {
+      if (agg_func_equal(&aggregate->funcs[f], &top->order_func)) {
+        top->func_index = (int)f;
+        break;
+      }
+    }
+    if (top->func_index < 0) {
+      parser_set_error(parser, "order by function is not computed by the aggregate stage");
+      return -1;
+    }
+  }
+  return 0;
+}
+
 static nql_query_t* parse_show(nql_parser_t* parser) {
   const char* saved = parser->pos;
   if (!match_keyword(parser, "show")) {
@@ -773,6 +946,12 @@ static nql_query_t* parse_single_query(nql_parser_t* parser) {
   }
   parser->pos = saved;
 
+  query = parse_top(parser);
+  if (query || parser->error_msg) {
+    return query;
+  }
+  parser->pos = saved;
+
   query = parse_show(parser);
   if (query || parser->error_msg) {
     return query;
@@ -827,6 +1006,14 @@ static nql_query_t* parse_pipeline(nql_parser_t* parser) {
     }
   }
 
+  if (check_top_stages(parser, &pipeline) != 0) {
+    for (size_t i = 0; i < pipeline.count; i++) {
+      nql_free(pipeline.stages[i]);
+    }
+    free(pipeline.stages);
+    return NULL;
+  }
+
   if (pipeline.count == 1) {
     free(pipeline.stages);
     return first;
@@ -852,7 +1039,22 @@ static nql_query_t* parse_entry(nql_parser_t* parser) {
     parser_set_error(parser, "empty query");
     return NULL;
   }
-  return parse_pipeline(parser);
+
+  nql_explain_t explain = NQL_EXPLAIN_NONE;
+  if (match_keyword(parser, "explain")) {
+    explain = match_keyword(parser, "analyze") ? NQL_EXPLAIN_ANALYZE : NQL_EXPLAIN_PLAN;
+    skip_whitespace(parser);
+    if (!*parser->pos) {
+      parser_set_error(parser, "expected query after explain");
+      return NULL;
+    }
+  }
+
+  nql_query_t* query = parse_pipeline(parser);
+  if (query) {
+    query->explain = explain;
+  }
+  return query;
 }
 
 static void free_aggregate(nql_aggregate_t* aggregate) {
@@ -888,6 +1090,7 @@ static void free_correlate(nql_correlate_t* correlate) {
   if (correlate->right_filter) {
     nblex_filter_free(correlate->right_filter);
   }
+  free(correlate->on_field);
   free(correlate);
 }
 
@@ -908,6 +1111,15 @@ static void free_show(nql_show_t* show) {
   free(show);
 }
 
+static void free_top(nql_top_t* top) {
+  if (!top) {
+    return;
+  }
+
+  free(top->order_func.field);
+  free(top);
+}
+
 void nql_free(nql_query_t* query) {
   if (!query) {
     return;
@@ -936,6 +1148,9 @@ void nql_free(nql_query_t* query) {
         free(query->data.pipeline.stages);
       }
       break;
+    case NQL_QUERY_TOP:
+      free_top(query->data.top);
+      break;
   }
 
   free(query);
@@ -21,7 +21,8 @@ typedef enum {
   NQL_QUERY_CORRELATE,
   NQL_QUERY_AGGREGATE,
   NQL_QUERY_SHOW,
-  NQL_QUERY_PIPELINE
+  NQL_QUERY_PIPELINE,
+  NQL_QUERY_TOP
 } nql_query_type_t;
 
 typedef enum {
@@ -41,10 +42,22 @@ typedef enum {
   NQL_WINDOW_SESSION
 } nql_window_type_t;
 
+/* explain <query> describes the plan; explain analyze also collects
+ * per-stage counters as the query runs */
+typedef enum {
+  NQL_EXPLAIN_NONE,
+  NQL_EXPLAIN_PLAN,
+  NQL_EXPLAIN_ANALYZE
+} nql_explain_t;
+
+/* Default relative error bound of percentile() results */
+#define NQL_PERCENTILE_DEFAULT_ACCURACY 0.01
+
 typedef struct {
   nql_agg_func_type_t type;
   char* field;       /* NULL for count() */
   double percentile; /* Only used for percentile() */
+  double accuracy;   /* percentile() relative error bound, 0 for exact */
 } nql_agg_func_t;
 
 typedef struct {
@@ -66,6 +79,7 @@ typedef struct {
 typedef struct {
   filter_t* left_filter;
   filter_t* right_filter;
+  char* on_field;       /* Join key both sides must share, or NULL */
   uint64_t within_ms;
 } nql_correlate_t;
 
@@ -76,6 +90,16 @@ typedef struct {
   filter_t* where_filter;
 } nql_show_t;
 
+/* top(N) by f(x) / order by f(x) [asc|desc] [limit N] / limit N: ranks
+ * the results of the windowed aggregate stage before it, per window */
+typedef struct {
+  bool ordered;               /* Has an order by function */
+  nql_agg_func_t order_func;  /* Metric to rank by, when ordered */
+  int func_index;             /* order_func's index in the aggregate stage */
+  bool descending;
+  uint64_t limit;             /* 0 for no limit */
+} nql_top_t;
+
 typedef struct nql_query_s nql_query_t;
 
 typedef struct {
@@ -85,12 +109,14 @@ typedef struct {
 
 struct nql_query_s {
   nql_query_type_t type;
+  nql_explain_t explain;  /* Set on the top-level query only */
   union {
     filter_t* filter;
     nql_correlate_t* correlate;
     nql_aggregate_t* aggregate;
     nql_show_t* show;
     nql_pipeline_t pipeline;
+    nql_top_t* top;
   } data;
 };
 
@@ -0,0 +1,101 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bloom_filter.c - Bloom filter over 64-bit hashes
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Bloom filter structure
+ *
+ * A bit array of 2^bits_log2 bits. Each item sets `hashes` bits chosen
+ * by double hashing from its 64-bit hash, so a clear bit proves the
+ * item was never added. With n items in m bits the false positive rate
+ * is about (1 - e^(-k n / m))^k.
+ */
+struct bloom_filter_s {
+  uint64_t* words;
+  size_t bits_mask;         /* 2^bits_log2 - 1 */
+  size_t words_count;
+  int hashes;
+};
+
+bloom_filter_t* nblex_bloom_filter_new(size_t bits_log2, int hashes) {
+  if (bits_log2 < NBLEX_BLOOM_MIN_BITS_LOG2 || bits_log2 > NBLEX_BLOOM_MAX_BITS_LOG2 ||
+      hashes < 1) {
+    return NULL;
+  }
+
+  bloom_filter_t* bloom = nblex_calloc(1, sizeof(bloom_filter_t));
+  if (!bloom) {
+    return NULL;
+  }
+
+  bloom->words_count = ((size_t)1 << bits_log2) / 64;
+  bloom->words = nblex_calloc(bloom->words_count, sizeof(uint64_t));
+  if (!bloom->words) {
+    nblex_free(bloom);
+    return NULL;
+  }
+  bloom->bits_mask = ((size_t)1 << bits_log2) - 1;
+  bloom->hashes = hashes;
+  return bloom;
+}
+
+void nblex_bloom_filter_free(bloom_filter_t* bloom) {
+  if (!bloom) {
+    return;
+  }
+  nblex_free(bloom->words);
+  nblex_free(bloom);
+}
+
+/* Helper: Second hash for double hashing; odd so probes never repeat
+ * early in a power-of-two table */
+static uint64_t bloom_step(uint64_t hash) {
+  return nblex_hash64_combine(hash, 0x424c4f4fULL) | 1;
+}
+
+void nblex_bloom_filter_add_hash(bloom_filter_t* bloom, uint64_t hash) {
+  if (!bloom) {
+    return;
+  }
+  uint64_t step = bloom_step(hash);
+  for (int i = 0; i < bloom->hashes; i++) {
+    size_t bit = (size_t)(hash + (uint64_t)i * step) & bloom->bits_mask;
+    bloom->words[bit / 64] |= 1ULL << (bit % 64);
+  }
+}
+
+bool nblex_bloom_filter_may_contain(const bloom_filter_t* bloom, uint64_t hash) {
+  if (!bloom) {
+    return false;
+  }
+  uint64_t step = bloom_step(hash);
+  for (int i = 0; i < bloom->hashes; i++) {
+    size_t bit = (size_t)(hash + (uint64_t)i * step) & bloom->bits_mask;
+    if (!(bloom->words[bit / 64] & (1ULL << (bit % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void nblex_bloom_filter_clear(bloom_filter_t* bloom) {
+  if (!bloom) {
+    return;
+  }
+  memset(bloom->words, 0, bloom->words_count * sizeof(uint64_t));
+}
+
+size_t nblex_bloom_filter_memory_usage(const bloom_filter_t* bloom) {
+  if (!bloom) {
+    return 0;
+  }
+  return sizeof(bloom_filter_t) + bloom->words_count * sizeof(uint64_t);
+}
@@ -0,0 +1,180 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * hash.c - Non-cryptographic hashing utilities and a hash index
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 64-bit hash based on MurmurHash64A (public domain, Austin Appleby).
+ * Used for hash table indexing and sketches; not suitable for untrusted
+ * input where collision attacks matter.
+ */
+uint64_t nblex_hash64(const void* data, size_t len, uint64_t seed) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char* p = (const unsigned char*)data;
+  const unsigned char* end = p + (len & ~(size_t)7);
+  uint64_t h = seed ^ (len * m);
+
+  while (p != end) {
+    uint64_t k;
+    memcpy(&k, p, sizeof(k));
+    p += 8;
+
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+
+    h ^= k;
+    h *= m;
+  }
+
+  switch (len & 7) {
+  case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+  case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+  case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+  case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+  case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+  case 2: h ^= (uint64_t)p[1] << 8;  /* fall through */
+  case 1: h ^= (uint64_t)p[0];
+          h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+uint64_t nblex_hash64_string(const char* s) {
+  return s ? nblex_hash64(s, strlen(s), 0) : 0;
+}
+
+uint64_t nblex_hash64_combine(uint64_t h, uint64_t value) {
+  /* Mix in the value, then finalize (MurmurHash3 fmix64) */
+  h ^= value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* Type seeds keep values of different JSON types apart */
+#define HASH_SEED_STRING  0x5354524eULL
+#define HASH_SEED_NUMBER  0x4e554d42ULL
+#define HASH_SEED_OTHER   0x4f544852ULL
+
+uint64_t nblex_hash64_json(const json_t* value) {
+  if (!value) {
+    return 0;
+  }
+
+  switch (json_typeof(value)) {
+  case JSON_STRING:
+    return nblex_hash64(json_string_value(value), json_string_length(value),
+                        HASH_SEED_STRING);
+
+  case JSON_INTEGER:
+  case JSON_REAL: {
+    /* Integral numbers hash alike whether stored as integer or real */
+    double d = json_number_value(value);
+    if (json_is_integer(value) ||
+        (d == floor(d) && d >= -9223372036854775808.0 && d < 9223372036854775808.0)) {
+      int64_t i = json_is_integer(value) ? (int64_t)json_integer_value(value) : (int64_t)d;
+      return nblex_hash64(&i, sizeof(i), HASH_SEED_NUMBER);
+    }
+    return nblex_hash64(&d, sizeof(d), HASH_SEED_NUMBER);
+  }
+
+  case JSON_TRUE:
+    return nblex_hash64("true", 4, HASH_SEED_OTHER);
+  case JSON_FALSE:
+    return nblex_hash64("false", 5, HASH_SEED_OTHER);
+  case JSON_NULL:
+    return nblex_hash64("null", 4, HASH_SEED_OTHER);
+
+  default: {
+    /* Objects and arrays: hash their canonical serialization */
+    char* dump = nblex_json_dumps(value, JSON_COMPACT | JSON_SORT_KEYS);
+    uint64_t h = dump ? nblex_hash64(dump, strlen(dump), HASH_SEED_OTHER) : 0;
+    free(dump);
+    return h;
+  }
+  }
+}
+
+#define INDEX_INITIAL_CAPACITY 16
+
+/* Helper: Put a value in the first empty bucket of its probe chain */
+static void index_place(nblex_index_bucket_t* buckets, size_t capacity,
+                        uint64_t hash, uintptr_t value) {
+  size_t mask = capacity - 1;
+  size_t pos = (size_t)hash & mask;
+  while (buckets[pos].value != 0) {
+    pos = (pos + 1) & mask;
+  }
+  buckets[pos].hash = hash;
+  buckets[pos].value = value;
+}
+
+int nblex_index_insert(nblex_index_t* index, uint64_t hash, uintptr_t value) {
+  if ((index->count + 1) * 4 > index->capacity * 3) {
+    size_t capacity = index->capacity ? index->capacity * 2 : INDEX_INITIAL_CAPACITY;
+    nblex_index_bucket_t* buckets = nblex_calloc(capacity, sizeof(nblex_index_bucket_t));
+    if (!buckets) {
+      return -1;
+    }
+    for (size_t i = 0; i < index->capacity; i++) {
+      if (index->buckets[i].value != 0) {
+        index_place(buckets, capacity, index->buckets[i].hash, index->buckets[i].value);
+      }
+    }
+    nblex_free(index->buckets);
+    index->buckets = buckets;
+    index->capacity = capacity;
+  }
+
+  index_place(index->buckets, index->capacity, hash, value);
+  index->count++;
+  return 0;
+}
+
+bool nblex_index_remove(nblex_index_t* index, uint64_t hash, uintptr_t value) {
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket;
+  do {
+    bucket = nblex_index_next(index, hash, &pos);
+  } while (bucket && bucket->value != value);
+  if (!bucket) {
+    return false;
+  }
+
+  /* Shift following entries back so probe chains stay unbroken */
+  size_t mask = index->capacity - 1;
+  size_t hole = (size_t)(bucket - index->buckets);
+  size_t next = (hole + 1) & mask;
+  while (index->buckets[next].value != 0) {
+    size_t home = (size_t)index->buckets[next].hash & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      index->buckets[hole] = index->buckets[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  index->buckets[hole].value = 0;
+  index->count--;
+  return true;
+}
+
+void nblex_index_free(nblex_index_t* index) {
+  nblex_free(index->buckets);
+  memset(index, 0, sizeof(*index));
+}
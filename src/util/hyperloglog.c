@@ -0,0 +1,452 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * hyperloglog.c - Mergeable approximate distinct counter
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXACT_CAPACITY (2 * NBLEX_HLL_EXACT_THRESHOLD)
+#define SPARSE_INITIAL_CAPACITY 64
+
+typedef enum {
+  HLL_EXACT,
+  HLL_SPARSE,
+  HLL_DENSE
+} hll_mode_t;
+
+/*
+ * HyperLogLog structure
+ *
+ * Small cardinalities are counted exactly in an open-addressing set of
+ * 64-bit hashes. Past NBLEX_HLL_EXACT_THRESHOLD the sketch switches to
+ * HyperLogLog registers: first sparse (a hash table of non-zero
+ * registers, each entry packing register index and value), then dense
+ * (one byte per register) once the sparse table would use as much
+ * memory. The standard error is about 1.04 / sqrt(2^precision).
+ */
+struct hll_s {
+  hll_mode_t mode;
+  int precision;
+  size_t registers_count;   /* m = 2^precision */
+
+  uint64_t* exact;          /* Exact mode: hashes, 0 marks an empty slot */
+  size_t exact_count;
+
+  uint32_t* sparse;         /* Sparse mode: (index << 8) | value, 0 empty */
+  size_t sparse_capacity;   /* Power of two */
+  size_t sparse_count;
+
+  uint8_t* registers;       /* Dense mode */
+};
+
+hll_t* nblex_hll_new(int precision) {
+  if (precision < NBLEX_HLL_MIN_PRECISION || precision > NBLEX_HLL_MAX_PRECISION) {
+    return NULL;
+  }
+
+  hll_t* hll = nblex_calloc(1, sizeof(hll_t));
+  if (!hll) {
+    return NULL;
+  }
+
+  hll->exact = nblex_calloc(EXACT_CAPACITY, sizeof(uint64_t));
+  if (!hll->exact) {
+    nblex_free(hll);
+    return NULL;
+  }
+
+  hll->mode = HLL_EXACT;
+  hll->precision = precision;
+  hll->registers_count = (size_t)1 << precision;
+  return hll;
+}
+
+void nblex_hll_free(hll_t* hll) {
+  if (!hll) {
+    return;
+  }
+  nblex_free(hll->exact);
+  nblex_free(hll->sparse);
+  nblex_free(hll->registers);
+  nblex_free(hll);
+}
+
+/* Helper: Register index and value (leading zeros + 1) of a hash */
+static void hll_split_hash(const hll_t* hll, uint64_t hash,
+                           uint32_t* index, uint8_t* value) {
+  int q = 64 - hll->precision;
+  *index = (uint32_t)(hash >> q);
+  uint64_t w = hash << hll->precision;
+  uint8_t rho = 1;
+  while (rho <= q && !(w & 0x8000000000000000ULL)) {
+    w <<= 1;
+    rho++;
+  }
+  *value = rho;
+}
+
+/* Helper: Slot of a register index in a sparse table */
+static size_t sparse_slot(uint32_t index, size_t capacity) {
+  return (size_t)((index * 0x9E3779B1U) >> 7) & (capacity - 1);
+}
+
+/* Helper: Set a sparse register to at least value (table has room) */
+static void sparse_update(uint32_t* table, size_t capacity, size_t* count,
+                          uint32_t index, uint8_t value) {
+  size_t mask = capacity - 1;
+  size_t pos = sparse_slot(index, capacity);
+  while (table[pos] != 0) {
+    if ((table[pos] >> 8) == index) {
+      if ((table[pos] & 0xff) < value) {
+        table[pos] = (index << 8) | value;
+      }
+      return;
+    }
+    pos = (pos + 1) & mask;
+  }
+  table[pos] = (index << 8) | value;
+  (*count)++;
+}
+
+/* Helper: Switch to dense registers */
+static int hll_to_dense(hll_t* hll) {
+  uint8_t* registers = nblex_calloc(hll->registers_count, sizeof(uint8_t));
+  if (!registers) {
+    return -1;
+  }
+
+  for (size_t i = 0; i < hll->sparse_capacity; i++) {
+    uint32_t entry = hll->sparse[i];
+    if (entry != 0) {
+      registers[entry >> 8] = (uint8_t)(entry & 0xff);
+    }
+  }
+
+  nblex_free(hll->sparse);
+  hll->sparse = NULL;
+  hll->sparse_capacity = 0;
+  hll->sparse_count = 0;
+  hll->registers = registers;
+  hll->mode = HLL_DENSE;
+  return 0;
+}
+
+/* Helper: Grow the sparse table, or go dense when it would not save memory */
+static int sparse_reserve(hll_t* hll) {
+  if (hll->sparse && (hll->sparse_count + 1) * 2 <= hll->sparse_capacity) {
+    return 0;
+  }
+
+  size_t capacity = hll->sparse_capacity ? hll->sparse_capacity * 2 : SPARSE_INITIAL_CAPACITY;
+  if (capacity * sizeof(uint32_t) > hll->registers_count) {
+    return hll_to_dense(hll);
+  }
+
+  uint32_t* table = nblex_calloc(capacity, sizeof(uint32_t));
+  if (!table) {
+    return -1;
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < hll->sparse_capacity; i++) {
+    uint32_t entry = hll->sparse[i];
+    if (entry != 0) {
+      sparse_update(table, capacity, &count, entry >> 8, (uint8_t)(entry & 0xff));
+    }
+  }
+
+  nblex_free(hll->sparse);
+  hll->sparse = table;
+  hll->sparse_capacity = capacity;
+  hll->sparse_count = count;
+  return 0;
+}
+
+/* Helper: Raise one register in sparse or dense mode */
+static int hll_update_register(hll_t* hll, uint32_t index, uint8_t value) {
+  if (hll->mode == HLL_SPARSE) {
+    if (sparse_reserve(hll) != 0) {
+      return -1;
+    }
+  }
+
+  if (hll->mode == HLL_DENSE) {
+    if (hll->registers[index] < value) {
+      hll->registers[index] = value;
+    }
+    return 0;
+  }
+
+  sparse_update(hll->sparse, hll->sparse_capacity, &hll->sparse_count, index, value);
+  return 0;
+}
+
+/* Helper: Move the exact set into registers */
+static int hll_exact_to_registers(hll_t* hll) {
+  hll->mode = HLL_SPARSE;
+  for (size_t i = 0; i < EXACT_CAPACITY; i++) {
+    if (hll->exact[i] != 0) {
+      uint32_t index;
+      uint8_t value;
+      hll_split_hash(hll, hll->exact[i], &index, &value);
+      if (hll_update_register(hll, index, value) != 0) {
+        return -1;
+      }
+    }
+  }
+  nblex_free(hll->exact);
+  hll->exact = NULL;
+  hll->exact_count = 0;
+  return 0;
+}
+
+int nblex_hll_add_hash(hll_t* hll, uint64_t hash) {
+  if (!hll) {
+    return -1;
+  }
+
+  if (hll->mode == HLL_EXACT) {
+    uint64_t key = hash ? hash : 1;
+    size_t mask = EXACT_CAPACITY - 1;
+    size_t pos = (size_t)key & mask;
+    while (hll->exact[pos] != 0) {
+      if (hll->exact[pos] == key) {
+        return 0;
+      }
+      pos = (pos + 1) & mask;
+    }
+    if (hll->exact_count < NBLEX_HLL_EXACT_THRESHOLD) {
+      hll->exact[pos] = key;
+      hll->exact_count++;
+      return 0;
+    }
+    if (hll_exact_to_registers(hll) != 0) {
+      return -1;
+    }
+  }
+
+  uint32_t index;
+  uint8_t value;
+  hll_split_hash(hll, hash, &index, &value);
+  return hll_update_register(hll, index, value);
+}
+
+int nblex_hll_merge(hll_t* dst, const hll_t* src) {
+  if (!dst || !src || dst->precision != src->precision) {
+    return -1;
+  }
+
+  switch (src->mode) {
+  case HLL_EXACT:
+    for (size_t i = 0; i < EXACT_CAPACITY; i++) {
+      if (src->exact[i] != 0 && nblex_hll_add_hash(dst, src->exact[i]) != 0) {
+        return -1;
+      }
+    }
+    return 0;
+
+  case HLL_SPARSE:
+    if (dst->mode == HLL_EXACT && hll_exact_to_registers(dst) != 0) {
+      return -1;
+    }
+    for (size_t i = 0; i < src->sparse_capacity; i++) {
+      uint32_t entry = src->sparse[i];
+      if (entry != 0 &&
+          hll_update_register(dst, entry >> 8, (uint8_t)(entry & 0xff)) != 0) {
+        return -1;
+      }
+    }
+    return 0;
+
+  case HLL_DENSE:
+    if (dst->mode == HLL_EXACT && hll_exact_to_registers(dst) != 0) {
+      return -1;
+    }
+    if (dst->mode == HLL_SPARSE && hll_to_dense(dst) != 0) {
+      return -1;
+    }
+    for (size_t i = 0; i < dst->registers_count; i++) {
+      if (dst->registers[i] < src->registers[i]) {
+        dst->registers[i] = src->registers[i];
+      }
+    }
+    return 0;
+  }
+
+  return -1;
+}
+
+/* Helper: sigma() of Ertl's improved estimator */
+static double hll_sigma(double x) {
+  if (x == 1.0) {
+    return INFINITY;
+  }
+  double y = 1.0;
+  double z = x;
+  double z_prev;
+  do {
+    x *= x;
+    z_prev = z;
+    z += x * y;
+    y += y;
+  } while (z != z_prev);
+  return z;
+}
+
+/* Helper: tau() of Ertl's improved estimator */
+static double hll_tau(double x) {
+  if (x == 0.0 || x == 1.0) {
+    return 0.0;
+  }
+  double y = 1.0;
+  double z = 1.0 - x;
+  double z_prev;
+  do {
+    x = sqrt(x);
+    z_prev = z;
+    y *= 0.5;
+    z -= (1.0 - x) * (1.0 - x) * y;
+  } while (z != z_prev);
+  return z / 3.0;
+}
+
+uint64_t nblex_hll_estimate(const hll_t* hll) {
+  if (!hll) {
+    return 0;
+  }
+  if (hll->mode == HLL_EXACT) {
+    return hll->exact_count;
+  }
+
+  /* Histogram of register values; zero registers are implicit in sparse mode */
+  int q = 64 - hll->precision;
+  uint64_t histogram[66] = {0};
+  double m = (double)hll->registers_count;
+
+  if (hll->mode == HLL_SPARSE) {
+    for (size_t i = 0; i < hll->sparse_capacity; i++) {
+      if (hll->sparse[i] != 0) {
+        histogram[hll->sparse[i] & 0xff]++;
+      }
+    }
+    histogram[0] = hll->registers_count - hll->sparse_count;
+  } else {
+    for (size_t i = 0; i < hll->registers_count; i++) {
+      histogram[hll->registers[i]]++;
+    }
+  }
+
+  /* Ertl, "New cardinality estimation algorithms for HyperLogLog
+   * sketches" (2017): unbiased over the whole range without empirical
+   * bias tables.
+   */
+  double z = m * hll_tau((m - (double)histogram[q + 1]) / m);
+  for (int k = q; k >= 1; k--) {
+    z += (double)histogram[k];
+    z *= 0.5;
+  }
+  z += m * hll_sigma((double)histogram[0] / m);
+
+  return (uint64_t)llround(m * m / (2.0 * log(2.0) * z));
+}
+
+bool nblex_hll_is_exact(const hll_t* hll) {
+  return hll && hll->mode == HLL_EXACT;
+}
+
+size_t nblex_hll_memory_usage(const hll_t* hll) {
+  if (!hll) {
+    return 0;
+  }
+  switch (hll->mode) {
+  case HLL_EXACT:
+    return sizeof(hll_t) + EXACT_CAPACITY * sizeof(uint64_t);
+  case HLL_SPARSE:
+    return sizeof(hll_t) + hll->sparse_capacity * sizeof(uint32_t);
+  case HLL_DENSE:
+    return sizeof(hll_t) + hll->registers_count;
+  }
+  return sizeof(hll_t);
+}
+
+int nblex_hll_write(const hll_t* hll, nblex_ckpt_writer_t* writer) {
+  if (!hll || !writer) {
+    return -1;
+  }
+
+  nblex_ckpt_put_u8(writer, (uint8_t)hll->precision);
+  nblex_ckpt_put_u8(writer, (uint8_t)hll->mode);
+  switch (hll->mode) {
+  case HLL_EXACT:
+    nblex_ckpt_put_u32(writer, (uint32_t)hll->exact_count);
+    for (size_t i = 0; i < EXACT_CAPACITY; i++) {
+      if (hll->exact[i] != 0) {
+        nblex_ckpt_put_u64(writer, hll->exact[i]);
+      }
+    }
+    break;
+  case HLL_SPARSE:
+    nblex_ckpt_put_u32(writer, (uint32_t)hll->sparse_count);
+    for (size_t i = 0; i < hll->sparse_capacity; i++) {
+      if (hll->sparse[i] != 0) {
+        nblex_ckpt_put_u32(writer, hll->sparse[i]);
+      }
+    }
+    break;
+  case HLL_DENSE:
+    nblex_ckpt_put_bytes(writer, hll->registers, hll->registers_count);
+    break;
+  }
+  return writer->failed ? -1 : 0;
+}
+
+hll_t* nblex_hll_read(nblex_ckpt_reader_t* reader) {
+  if (!reader) {
+    return NULL;
+  }
+
+  int precision = nblex_ckpt_get_u8(reader);
+  uint8_t mode = nblex_ckpt_get_u8(reader);
+  if (reader->failed) {
+    return NULL;
+  }
+  hll_t* hll = nblex_hll_new(precision);
+  if (!hll) {
+    return NULL;
+  }
+
+  int rc = -1;
+  if (mode == HLL_EXACT) {
+    uint32_t count = nblex_ckpt_get_u32(reader);
+    rc = count <= NBLEX_HLL_EXACT_THRESHOLD ? 0 : -1;
+    for (uint32_t i = 0; rc == 0 && i < count; i++) {
+      rc = nblex_hll_add_hash(hll, nblex_ckpt_get_u64(reader));
+    }
+  } else if (mode == HLL_SPARSE) {
+    uint32_t count = nblex_ckpt_get_u32(reader);
+    rc = count <= hll->registers_count ? hll_exact_to_registers(hll) : -1;
+    for (uint32_t i = 0; rc == 0 && i < count; i++) {
+      uint32_t entry = nblex_ckpt_get_u32(reader);
+      rc = (entry >> 8) < hll->registers_count ?
+           hll_update_register(hll, entry >> 8, (uint8_t)(entry & 0xff)) : -1;
+    }
+  } else if (mode == HLL_DENSE) {
+    const uint8_t* registers = nblex_ckpt_get_bytes(reader, hll->registers_count);
+    rc = registers && hll_exact_to_registers(hll) == 0 && hll_to_dense(hll) == 0 ? 0 : -1;
+    if (rc == 0) {
+      memcpy(hll->registers, registers, hll->registers_count);
+    }
+  }
+
+  if (rc != 0 || reader->failed) {
+    nblex_hll_free(hll);
+    return NULL;
+  }
+  return hll;
+}
@@ -8,24 +8,91 @@
 
 /* Feature test macros - let nblex_internal.h handle platform-specific setup */
 #include "../nblex_internal.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define usable_size(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define usable_size(ptr) malloc_usable_size(ptr)
+#endif
 
-/* Memory allocation wrappers for future instrumentation */
+/* Memory allocation wrappers, counting calls so allocation behaviour of
+ * hot paths can be measured. Counters are process-wide and relaxed:
+ * they are statistics, not synchronization.
+ */
+
+static atomic_uint_fast64_t allocations_count;
+static atomic_uint_fast64_t frees_count;
+
+/* Account charged by the wrappers on this thread, if any */
+static _Thread_local nblex_mem_account_t* current_account;
+
+/* Helper: Charge an account and its parents for `bytes`. Worker threads
+ * charge the same accounts as the loop thread, so updates are atomic. */
+static void account_charge(nblex_mem_account_t* account, size_t bytes) {
+  for (; account; account = account->parent) {
+    size_t used = atomic_fetch_add_explicit(&account->used, bytes, memory_order_relaxed) + bytes;
+    size_t peak = atomic_load_explicit(&account->peak, memory_order_relaxed);
+    while (used > peak &&
+           !atomic_compare_exchange_weak_explicit(&account->peak, &peak, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+  }
+}
+
+/* Helper: Credit an account and its parents for `bytes`. A block freed
+ * in a different scope than it was charged to cannot take an account
+ * below zero. */
+static void account_credit(nblex_mem_account_t* account, size_t bytes) {
+  for (; account; account = account->parent) {
+    size_t used = atomic_load_explicit(&account->used, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&account->used, &used,
+                                                  used > bytes ? used - bytes : 0,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+  }
+}
+
+/* Helper: Count one allocation that succeeded */
+static void* count_allocation(void* ptr) {
+  if (ptr) {
+    atomic_fetch_add_explicit(&allocations_count, 1, memory_order_relaxed);
+    if (current_account) {
+      account_charge(current_account, usable_size(ptr));
+    }
+  }
+  return ptr;
+}
 
 void* nblex_malloc(size_t size) {
-  return malloc(size);
+  return count_allocation(malloc(size));
 }
 
 void* nblex_calloc(size_t nmemb, size_t size) {
-  return calloc(nmemb, size);
+  return count_allocation(calloc(nmemb, size));
 }
 
 void* nblex_realloc(void* ptr, size_t size) {
-  return realloc(ptr, size);
+  size_t old_size = ptr && current_account ? usable_size(ptr) : 0;
+  void* result = realloc(ptr, size);
+  if (result && old_size) {
+    account_credit(current_account, old_size);
+  }
+  return count_allocation(result);
 }
 
 void nblex_free(void* ptr) {
+  if (ptr) {
+    atomic_fetch_add_explicit(&frees_count, 1, memory_order_relaxed);
+    if (current_account) {
+      account_credit(current_account, usable_size(ptr));
+    }
+  }
   free(ptr);
 }
 
@@ -33,5 +100,525 @@ char* nblex_strdup(const char* s) {
   if (!s) {
     return NULL;
   }
-  return strdup(s);
+  return count_allocation(strdup(s));
+}
+
+void nblex_memory_get_stats(nblex_memory_stats_t* stats) {
+  if (!stats) {
+    return;
+  }
+  stats->allocations = atomic_load_explicit(&allocations_count, memory_order_relaxed);
+  stats->frees = atomic_load_explicit(&frees_count, memory_order_relaxed);
+}
+
+void nblex_mem_account_init(nblex_mem_account_t* account, nblex_mem_account_t* parent) {
+  if (!account) {
+    return;
+  }
+  account->parent = parent;
+  atomic_init(&account->used, 0);
+  atomic_init(&account->peak, 0);
+  account->limit = 0;
+}
+
+nblex_mem_account_t* nblex_mem_account_enter(nblex_mem_account_t* account) {
+  nblex_mem_account_t* previous = current_account;
+  current_account = account;
+  return previous;
+}
+
+void nblex_mem_account_leave(nblex_mem_account_t* previous) {
+  current_account = previous;
+}
+
+bool nblex_mem_account_over_limit(const nblex_mem_account_t* account) {
+  for (; account; account = account->parent) {
+    if (account->limit &&
+        atomic_load_explicit(&account->used, memory_order_relaxed) > account->limit) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Fixed-size object pools. Objects are carved from chunks in order and
+ * reused through a free list threaded through the free objects, so
+ * taking and returning one is O(1) and a pool's objects sit together.
+ * Chunks are only freed with the pool.
+ *
+ * With NBLEX_POOL_DEBUG, freed objects are filled with POOL_POISON and
+ * checked when taken again, catching writes after free and (as far as
+ * the pattern allows) double frees; allocated ones are filled with
+ * POOL_FRESH to show up reads of fields never set. Under
+ * AddressSanitizer free objects are poisoned for it too.
+ */
+
+#if defined(__SANITIZE_ADDRESS__)
+#define POOL_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define POOL_ASAN 1
+#endif
+#endif
+
+#ifdef POOL_ASAN
+#include <sanitizer/asan_interface.h>
+#define pool_asan_poison(ptr, size) ASAN_POISON_MEMORY_REGION(ptr, size)
+#define pool_asan_unpoison(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+#else
+#define pool_asan_poison(ptr, size) ((void)(ptr), (void)(size))
+#define pool_asan_unpoison(ptr, size) ((void)(ptr), (void)(size))
+#endif
+
+#define POOL_CHUNK_BYTES 16384  /* Chunk size, unless one object is bigger */
+#define POOL_POISON 0xdb  /* Fills free objects in debug builds */
+#define POOL_FRESH 0xcd   /* Fills allocated objects in debug builds */
+
+typedef struct pool_chunk_s {
+  struct pool_chunk_s* next;
+  max_align_t objects[];
+} pool_chunk_t;
+
+/* A free object; the rest of it is poison in debug builds */
+typedef struct pool_free_s {
+  struct pool_free_s* next;
+} pool_free_t;
+
+struct nblex_pool_s {
+  size_t object_size;     /* Rounded up to keep objects aligned */
+  size_t chunk_objects;
+  bool charged;           /* Charge the current memory account */
+
+  pool_chunk_t* chunks;
+  char* carve;            /* Next never used object of the newest chunk */
+  char* carve_end;
+  pool_free_t* free_list;
+
+  size_t chunks_count;
+  size_t live;            /* Objects taken and not yet returned */
+  bool detached;          /* Destroy when live reaches 0 */
+};
+
+nblex_pool_t* nblex_pool_new(size_t object_size, bool charged) {
+  nblex_pool_t* pool = calloc(1, sizeof(nblex_pool_t));
+  if (!pool) {
+    return NULL;
+  }
+  size_t align = _Alignof(max_align_t);
+  if (object_size < sizeof(pool_free_t)) {
+    object_size = sizeof(pool_free_t);
+  }
+  pool->object_size = (object_size + align - 1) / align * align;
+  pool->chunk_objects = (POOL_CHUNK_BYTES - sizeof(pool_chunk_t)) / pool->object_size;
+  if (pool->chunk_objects == 0) {
+    pool->chunk_objects = 1;
+  }
+  pool->charged = charged;
+  return pool;
+}
+
+/* Helper: Free a pool and its chunks */
+static void pool_destroy(nblex_pool_t* pool) {
+  while (pool->chunks) {
+    pool_chunk_t* next = pool->chunks->next;
+    free(pool->chunks);
+    pool->chunks = next;
+  }
+  free(pool);
+}
+
+void nblex_pool_detach(nblex_pool_t* pool) {
+  if (!pool) {
+    return;
+  }
+  pool->detached = true;
+  if (pool->live == 0) {
+    pool_destroy(pool);
+  }
+}
+
+#ifdef NBLEX_POOL_DEBUG
+/* Helper: Is everything after the free list link still poison? */
+static bool pool_object_poisoned(const nblex_pool_t* pool, const void* ptr) {
+  const unsigned char* bytes = (const unsigned char*)ptr;
+  for (size_t i = sizeof(pool_free_t); i < pool->object_size; i++) {
+    if (bytes[i] != POOL_POISON) {
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+void* nblex_pool_alloc(nblex_pool_t* pool) {
+  void* ptr;
+  if (pool->free_list) {
+    pool_free_t* object = pool->free_list;
+    pool_asan_unpoison(object, pool->object_size);
+    pool->free_list = object->next;
+#ifdef NBLEX_POOL_DEBUG
+    if (!pool_object_poisoned(pool, object)) {
+      fprintf(stderr, "nblex: pool object %p written after free\n", (void*)object);
+      abort();
+    }
+#endif
+    ptr = object;
+  } else {
+    if (pool->carve == pool->carve_end) {
+      pool_chunk_t* chunk = malloc(sizeof(pool_chunk_t) +
+                                   pool->chunk_objects * pool->object_size);
+      if (!chunk) {
+        return NULL;
+      }
+      chunk->next = pool->chunks;
+      pool->chunks = chunk;
+      pool->chunks_count++;
+      pool->carve = (char*)chunk->objects;
+      pool->carve_end = pool->carve + pool->chunk_objects * pool->object_size;
+    }
+    ptr = pool->carve;
+    pool->carve += pool->object_size;
+  }
+#ifdef NBLEX_POOL_DEBUG
+  memset(ptr, POOL_FRESH, pool->object_size);
+#endif
+
+  pool->live++;
+  if (pool->charged && current_account) {
+    account_charge(current_account, pool->object_size);
+  }
+  return ptr;
+}
+
+void* nblex_pool_calloc(nblex_pool_t* pool) {
+  void* ptr = nblex_pool_alloc(pool);
+  if (ptr) {
+    memset(ptr, 0, pool->object_size);
+  }
+  return ptr;
+}
+
+void nblex_pool_free(nblex_pool_t* pool, void* ptr) {
+  if (!ptr) {
+    return;
+  }
+#ifdef NBLEX_POOL_DEBUG
+  if (pool_object_poisoned(pool, ptr)) {
+    fprintf(stderr, "nblex: pool object %p freed twice\n", ptr);
+    abort();
+  }
+  memset(ptr, POOL_POISON, pool->object_size);
+#endif
+  if (pool->charged && current_account) {
+    account_credit(current_account, pool->object_size);
+  }
+
+  pool_free_t* object = (pool_free_t*)ptr;
+  object->next = pool->free_list;
+  pool->free_list = object;
+  pool_asan_poison(object, pool->object_size);
+
+  if (--pool->live == 0 && pool->detached) {
+    pool_destroy(pool);
+  }
+}
+
+void nblex_pool_get_stats(const nblex_pool_t* pool, nblex_pool_stats_t* stats) {
+  if (!stats) {
+    return;
+  }
+  memset(stats, 0, sizeof(*stats));
+  if (!pool) {
+    return;
+  }
+  stats->object_size = pool->object_size;
+  stats->live = pool->live;
+  stats->capacity = pool->chunks_count * pool->chunk_objects;
+  stats->bytes = pool->chunks_count * (sizeof(pool_chunk_t) +
+                                       pool->chunk_objects * pool->object_size);
+}
+
+/* JSON allocator. nblex_json_allocator_init() points jansson at
+ * json_block_alloc() and json_block_free(); jansson has one allocator
+ * per process, so it is installed only over the default one. Blocks
+ * are plain malloc() blocks with a trailer in their last bytes
+ * recording the size class and the tag the block was charged to; it is
+ * credited to that tag when freed, as event data built by one subsystem
+ * is often released by another. The trailer's magic is keyed to the
+ * block's address, so blocks jansson allocated before the allocator was
+ * installed are told apart and freed uncounted, and a block freed with
+ * free() is merely left counted.
+ *
+ * Blocks up to JSON_CLASS_MAX bytes are rounded up to a size class and
+ * reused through free lists of the thread that frees them, up to
+ * JSON_CACHE_MAX per class. Bigger blocks go straight to malloc().
+ *
+ * Everything a thread needs is in one thread-local struct, including
+ * its counts, which are added to the shared counters every
+ * JSON_FLUSH_OPS blocks, for any block too big to cache, and when the
+ * thread reads the statistics or exits (also freeing its lists).
+ */
+
+#define JSON_MAGIC 0x6a736f6e626c6b73ULL
+#define JSON_CLASS_MAX 256
+#define JSON_CACHE_MAX 512
+#define JSON_CLASS_NONE 0xff
+#define JSON_FLUSH_OPS 64
+
+static const uint16_t json_class_sizes[] = { 16, 32, 48, 64, 80, 96, 128, 160, 192, 256 };
+#define JSON_CLASSES (sizeof(json_class_sizes) / sizeof(json_class_sizes[0]))
+
+/* Size class of a block by its size in 16 byte units, rounded up */
+static const uint8_t json_class_of[JSON_CLASS_MAX / 16 + 1] = {
+  0, 0, 1, 2, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9, 9
+};
+
+typedef struct {
+  uint64_t magic;               /* JSON_MAGIC ^ block address */
+  size_t size;                  /* Bytes charged to the tag */
+  uint8_t tag;
+  uint8_t size_class;           /* JSON_CLASS_NONE if bigger than any */
+} json_trailer_t;
+
+/* Helper: Where a block's trailer is; copied in and out with memcpy()
+ * as blocks bigger than any class may leave it unaligned */
+static char* json_trailer_at(void* block) {
+  return (char*)block + usable_size(block) - sizeof(json_trailer_t);
+}
+
+/* Helper: Give a block back to malloc(); memory it hands out again must
+ * not pass for a block */
+static void json_block_release(void* block) {
+  uint64_t magic = 0;
+  memcpy(json_trailer_at(block), &magic, sizeof(magic));
+  free(block);
+}
+
+typedef struct json_cached_s {
+  struct json_cached_s* next;
+} json_cached_t;
+
+/* Counts of one tag */
+typedef struct {
+  int64_t live_bytes;
+  uint64_t allocations;
+  uint64_t frees;
+} json_counts_t;
+
+typedef struct {
+  nblex_mem_tag tag;            /* Current tag of the thread */
+  json_cached_t* lists[JSON_CLASSES];
+  uint16_t counts[JSON_CLASSES];
+  bool registered;              /* For json_thread_exit() */
+  uint32_t pending_ops;
+  json_counts_t pending[NBLEX_MEM_TAG_COUNT];
+} json_thread_t;
+
+static const char* const mem_tag_names[NBLEX_MEM_TAG_COUNT] = {
+  "other", "input", "parser", "correlation", "executor", "output"
+};
+
+static struct {
+  atomic_int_fast64_t live_bytes;
+  atomic_uint_fast64_t allocations;
+  atomic_uint_fast64_t frees;
+} json_counters[NBLEX_MEM_TAG_COUNT];
+
+/* Initial exec: a small struct, and jansson calls in for every block */
+static _Thread_local json_thread_t json_thread __attribute__((tls_model("initial-exec")));
+static pthread_key_t json_thread_key;
+static bool json_thread_key_ok;
+
+/* Helper: Add a thread's counts to the shared counters */
+static void json_thread_flush(json_thread_t* thread) {
+  for (size_t i = 0; i < NBLEX_MEM_TAG_COUNT; i++) {
+    json_counts_t* pending = &thread->pending[i];
+    if (pending->allocations || pending->frees) {
+      atomic_fetch_add_explicit(&json_counters[i].live_bytes, pending->live_bytes,
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&json_counters[i].allocations, pending->allocations,
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&json_counters[i].frees, pending->frees,
+                                memory_order_relaxed);
+      memset(pending, 0, sizeof(*pending));
+    }
+  }
+  thread->pending_ops = 0;
+}
+
+/* Helper: Flush a thread's counts and free its lists; it is exiting */
+static void json_thread_exit(void* data) {
+  json_thread_t* thread = (json_thread_t*)data;
+  json_thread_flush(thread);
+  for (size_t i = 0; i < JSON_CLASSES; i++) {
+    while (thread->lists[i]) {
+      json_cached_t* next = thread->lists[i]->next;
+      json_block_release(thread->lists[i]);
+      thread->lists[i] = next;
+    }
+    thread->counts[i] = 0;
+  }
+  thread->registered = false;
+}
+
+/* Helper: Count one block allocated or freed; returns false if the
+ * thread cannot be registered to flush at exit */
+static bool json_thread_count(json_thread_t* thread, json_counts_t* pending,
+                              int64_t bytes, bool flush) {
+  pending->live_bytes += bytes;
+  if (bytes > 0) {
+    pending->allocations++;
+  } else {
+    pending->frees++;
+  }
+  if (!thread->registered) {
+    thread->registered = json_thread_key_ok &&
+                         pthread_setspecific(json_thread_key, thread) == 0;
+    flush = flush || !thread->registered;
+  }
+  if (flush || ++thread->pending_ops >= JSON_FLUSH_OPS) {
+    json_thread_flush(thread);
+  }
+  return thread->registered;
+}
+
+static void* json_block_alloc(size_t size) {
+  json_thread_t* thread = &json_thread;
+  uint8_t size_class = JSON_CLASS_NONE;
+  void* block = NULL;
+  if (size <= JSON_CLASS_MAX) {
+    size_class = json_class_of[(size + 15) / 16];
+    size = json_class_sizes[size_class];
+    json_cached_t* cached = thread->lists[size_class];
+    if (cached) {
+      thread->lists[size_class] = cached->next;
+      thread->counts[size_class]--;
+      block = cached;
+    }
+  }
+  if (!block) {
+    block = malloc(size + sizeof(json_trailer_t));
+    if (!block) {
+      return NULL;
+    }
+  }
+
+  json_trailer_t trailer = {
+    JSON_MAGIC ^ (uintptr_t)block, size, (uint8_t)thread->tag, size_class
+  };
+  memcpy(json_trailer_at(block), &trailer, sizeof(trailer));
+  json_thread_count(thread, &thread->pending[thread->tag], (int64_t)size,
+                    size_class == JSON_CLASS_NONE);
+  return block;
+}
+
+static void json_block_free(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  json_thread_t* thread = &json_thread;
+  json_trailer_t trailer;
+  if (usable_size(ptr) < sizeof(trailer)) {
+    free(ptr);
+    return;
+  }
+  memcpy(&trailer, json_trailer_at(ptr), sizeof(trailer));
+  if (trailer.magic != (JSON_MAGIC ^ (uintptr_t)ptr)) {
+    free(ptr);
+    return;
+  }
+
+  uint8_t size_class = trailer.size_class;
+  bool cached = json_thread_count(thread, &thread->pending[trailer.tag],
+                                  -(int64_t)trailer.size, size_class == JSON_CLASS_NONE);
+  if (!cached || size_class == JSON_CLASS_NONE ||
+      thread->counts[size_class] >= JSON_CACHE_MAX) {
+    json_block_release(ptr);
+    return;
+  }
+  json_cached_t* block = (json_cached_t*)ptr;
+  block->next = thread->lists[size_class];
+  thread->lists[size_class] = block;
+  thread->counts[size_class]++;
+}
+
+static pthread_once_t json_alloc_once = PTHREAD_ONCE_INIT;
+static bool json_alloc_installed;
+
+/* Helper: Install the allocator unless another one already is */
+static void json_alloc_install(void) {
+  json_malloc_t current_malloc;
+  json_free_t current_free;
+  json_get_alloc_funcs(&current_malloc, &current_free);
+  if (current_malloc != malloc || current_free != free) {
+    return;
+  }
+  json_thread_key_ok = pthread_key_create(&json_thread_key, json_thread_exit) == 0;
+  json_set_alloc_funcs(json_block_alloc, json_block_free);
+  json_alloc_installed = true;
+}
+
+int nblex_json_allocator_init(void) {
+  pthread_once(&json_alloc_once, json_alloc_install);
+  return json_alloc_installed ? 0 : -1;
+}
+
+nblex_mem_tag nblex_mem_tag_enter(nblex_mem_tag tag) {
+  nblex_mem_tag previous = json_thread.tag;
+  json_thread.tag = tag < NBLEX_MEM_TAG_COUNT ? tag : NBLEX_MEM_TAG_OTHER;
+  return previous;
+}
+
+void nblex_mem_tag_leave(nblex_mem_tag previous) {
+  json_thread.tag = previous;
+}
+
+const char* nblex_mem_tag_name(nblex_mem_tag tag) {
+  return tag < NBLEX_MEM_TAG_COUNT ? mem_tag_names[tag] : "unknown";
+}
+
+void nblex_memory_get_tag_stats(nblex_mem_tag tag, nblex_mem_tag_stats_t* stats) {
+  if (!stats) {
+    return;
+  }
+  memset(stats, 0, sizeof(*stats));
+  if (tag >= NBLEX_MEM_TAG_COUNT) {
+    return;
+  }
+  /* Counts of other threads may lag by up to JSON_FLUSH_OPS blocks */
+  json_thread_flush(&json_thread);
+  int64_t live = atomic_load_explicit(&json_counters[tag].live_bytes, memory_order_relaxed);
+  stats->live_bytes = live > 0 ? (size_t)live : 0;
+  stats->allocations = atomic_load_explicit(&json_counters[tag].allocations, memory_order_relaxed);
+  stats->frees = atomic_load_explicit(&json_counters[tag].frees, memory_order_relaxed);
+}
+
+size_t nblex_json_live_bytes(void) {
+  /* Unflushed counts lag by up to JSON_FLUSH_OPS small blocks a thread */
+  int64_t live = 0;
+  for (size_t i = 0; i < NBLEX_MEM_TAG_COUNT; i++) {
+    live += atomic_load_explicit(&json_counters[i].live_bytes, memory_order_relaxed);
+  }
+  return live > 0 ? (size_t)live : 0;
+}
+
+char* nblex_json_dumps(const json_t* json, size_t flags) {
+  /* Most events fit the stack buffer and are serialized once */
+  char buffer[4096];
+  size_t size = json ? json_dumpb(json, buffer, sizeof(buffer), flags) : 0;
+  if (size == 0) {
+    return NULL;
+  }
+  char* result = malloc(size + 1);
+  if (!result) {
+    return NULL;
+  }
+  if (size <= sizeof(buffer)) {
+    memcpy(result, buffer, size);
+  } else if (json_dumpb(json, result, size, flags) != size) {
+    free(result);
+    return NULL;
+  }
+  result[size] = '\0';
+  return result;
 }
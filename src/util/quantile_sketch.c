@@ -0,0 +1,495 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * quantile_sketch.c - Mergeable relative-error quantile sketch
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STORE_INITIAL_BINS 64
+#define EXACT_INITIAL_CAPACITY 64
+
+/*
+ * Dense store of bin counts for keys in [offset, offset + capacity).
+ * Used keys are tracked separately so the array can carry slack on
+ * either side. When the used range would exceed the bin limit the
+ * lowest keys are folded into the lowest kept bin.
+ */
+typedef struct {
+  uint64_t* counts;
+  int32_t offset;           /* Key of counts[0] */
+  size_t capacity;
+  int32_t min_key;          /* Used key range, valid when total > 0 */
+  int32_t max_key;
+  uint64_t total;
+} sketch_store_t;
+
+/*
+ * Sketch structure
+ *
+ * In sketch mode a value x maps to bin key ceil(log_gamma(|x|)) with
+ * gamma = (1 + a) / (1 - a); every value in a bin is within relative
+ * error a of the bin's representative value, so any quantile is
+ * reported within a of the true value at that rank. Each store keeps
+ * enough bins to span NBLEX_QUANTILE_SKETCH_RANGE, which fixes its
+ * memory for a given accuracy. Positive and negative values use
+ * separate stores; values too small to index are counted as zero. In
+ * exact mode all values are kept.
+ */
+struct quantile_sketch_s {
+  bool exact;
+  double relative_accuracy;
+  double gamma;
+  double log_gamma;
+  double min_indexable;
+  size_t max_bins;
+
+  sketch_store_t positive;
+  sketch_store_t negative;
+  uint64_t zero_count;
+
+  double* values;           /* Exact mode only */
+  size_t values_count;
+  size_t values_capacity;
+
+  uint64_t count;
+  double min;
+  double max;
+};
+
+quantile_sketch_t* nblex_quantile_sketch_new(double relative_accuracy) {
+  if (relative_accuracy < 0.0 || relative_accuracy >= 1.0) {
+    return NULL;
+  }
+
+  quantile_sketch_t* sketch = nblex_calloc(1, sizeof(quantile_sketch_t));
+  if (!sketch) {
+    return NULL;
+  }
+
+  sketch->min = INFINITY;
+  sketch->max = -INFINITY;
+
+  if (relative_accuracy == 0.0) {
+    sketch->exact = true;
+    return sketch;
+  }
+
+  sketch->relative_accuracy = relative_accuracy;
+  sketch->gamma = (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+  sketch->log_gamma = log(sketch->gamma);
+  sketch->min_indexable = DBL_MIN * sketch->gamma;
+  sketch->max_bins = (size_t)ceil(log(NBLEX_QUANTILE_SKETCH_RANGE) / sketch->log_gamma);
+  return sketch;
+}
+
+void nblex_quantile_sketch_free(quantile_sketch_t* sketch) {
+  if (!sketch) {
+    return;
+  }
+  nblex_free(sketch->positive.counts);
+  nblex_free(sketch->negative.counts);
+  nblex_free(sketch->values);
+  nblex_free(sketch);
+}
+
+/* Helper: Rebuild a store so its used range covers [lo, hi] */
+static int store_rebuild(sketch_store_t* store, size_t max_bins, int32_t lo, int32_t hi) {
+  if ((int64_t)hi - lo + 1 > (int64_t)max_bins) {
+    lo = (int32_t)((int64_t)hi - (int64_t)max_bins + 1);
+  }
+  size_t span = (size_t)((int64_t)hi - lo + 1);
+
+  size_t capacity = store->capacity ? store->capacity : STORE_INITIAL_BINS;
+  while (capacity < span + span / 2 && capacity < max_bins) {
+    capacity *= 2;
+  }
+  if (capacity > max_bins) {
+    capacity = max_bins;
+  }
+
+  uint64_t* counts = nblex_calloc(capacity, sizeof(uint64_t));
+  if (!counts) {
+    return -1;
+  }
+
+  /* Centre the used range so the store can grow either way cheaply */
+  int32_t offset = (int32_t)((int64_t)lo - (int64_t)(capacity - span) / 2);
+
+  if (store->total > 0) {
+    for (int32_t key = store->min_key; key <= store->max_key; key++) {
+      uint64_t n = store->counts[key - store->offset];
+      if (n > 0) {
+        int32_t dst = key < lo ? lo : key;
+        counts[dst - offset] += n;
+      }
+    }
+    if (store->min_key < lo) {
+      store->min_key = lo;
+    }
+  }
+
+  nblex_free(store->counts);
+  store->counts = counts;
+  store->offset = offset;
+  store->capacity = capacity;
+  return 0;
+}
+
+/* Helper: Add n occurrences of a key to a store */
+static int store_add(sketch_store_t* store, size_t max_bins, int32_t key, uint64_t n) {
+  if (store->total == 0) {
+    if (!store->counts || key < store->offset ||
+        (int64_t)key >= (int64_t)store->offset + (int64_t)store->capacity) {
+      if (store_rebuild(store, max_bins, key, key) != 0) {
+        return -1;
+      }
+    }
+    store->min_key = key;
+    store->max_key = key;
+  } else {
+    int32_t lo = key < store->min_key ? key : store->min_key;
+    int32_t hi = key > store->max_key ? key : store->max_key;
+    if (lo < store->offset ||
+        (int64_t)hi >= (int64_t)store->offset + (int64_t)store->capacity) {
+      if (store_rebuild(store, max_bins, lo, hi) != 0) {
+        return -1;
+      }
+      /* Keys below the kept range fold into its lowest bin */
+      int32_t kept_lo = (int32_t)((int64_t)hi - (int64_t)max_bins + 1);
+      if (lo < kept_lo) {
+        lo = kept_lo;
+        if (key < lo) {
+          key = lo;
+        }
+      }
+    }
+    store->min_key = lo;
+    store->max_key = hi;
+  }
+
+  store->counts[key - store->offset] += n;
+  store->total += n;
+  return 0;
+}
+
+/* Helper: Bin key for a positive, indexable magnitude */
+static int32_t sketch_key(const quantile_sketch_t* sketch, double magnitude) {
+  return (int32_t)ceil(log(magnitude) / sketch->log_gamma);
+}
+
+/* Helper: Representative value of a bin key (midpoint in relative terms) */
+static double sketch_key_value(const quantile_sketch_t* sketch, int32_t key) {
+  return exp((double)key * sketch->log_gamma) * 2.0 / (1.0 + sketch->gamma);
+}
+
+int nblex_quantile_sketch_add(quantile_sketch_t* sketch, double value) {
+  if (!sketch || isnan(value)) {
+    return -1;
+  }
+
+  if (sketch->exact) {
+    if (sketch->values_count == sketch->values_capacity) {
+      size_t capacity = sketch->values_capacity ? sketch->values_capacity * 2 :
+                                                  EXACT_INITIAL_CAPACITY;
+      double* values = nblex_realloc(sketch->values, capacity * sizeof(double));
+      if (!values) {
+        return -1;
+      }
+      sketch->values = values;
+      sketch->values_capacity = capacity;
+    }
+    sketch->values[sketch->values_count++] = value;
+  } else if (value > sketch->min_indexable) {
+    if (store_add(&sketch->positive, sketch->max_bins, sketch_key(sketch, value), 1) != 0) {
+      return -1;
+    }
+  } else if (value < -sketch->min_indexable) {
+    if (store_add(&sketch->negative, sketch->max_bins, sketch_key(sketch, -value), 1) != 0) {
+      return -1;
+    }
+  } else {
+    sketch->zero_count++;
+  }
+
+  sketch->count++;
+  if (value < sketch->min) {
+    sketch->min = value;
+  }
+  if (value > sketch->max) {
+    sketch->max = value;
+  }
+  return 0;
+}
+
+/* Helper: Merge every bin of one store into another */
+static int store_merge(sketch_store_t* dst, size_t max_bins, const sketch_store_t* src) {
+  if (src->total == 0) {
+    return 0;
+  }
+  for (int32_t key = src->min_key; key <= src->max_key; key++) {
+    uint64_t n = src->counts[key - src->offset];
+    if (n > 0 && store_add(dst, max_bins, key, n) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int nblex_quantile_sketch_merge(quantile_sketch_t* dst, const quantile_sketch_t* src) {
+  if (!dst || !src || dst->exact != src->exact ||
+      dst->relative_accuracy != src->relative_accuracy) {
+    return -1;
+  }
+
+  if (dst->exact) {
+    for (size_t i = 0; i < src->values_count; i++) {
+      if (nblex_quantile_sketch_add(dst, src->values[i]) != 0) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+
+  if (store_merge(&dst->positive, dst->max_bins, &src->positive) != 0 ||
+      store_merge(&dst->negative, dst->max_bins, &src->negative) != 0) {
+    return -1;
+  }
+  dst->zero_count += src->zero_count;
+  dst->count += src->count;
+  if (src->min < dst->min) {
+    dst->min = src->min;
+  }
+  if (src->max > dst->max) {
+    dst->max = src->max;
+  }
+  return 0;
+}
+
+/* Helper: Quickselect the k-th smallest of an array (reorders it) */
+static double select_kth(double* values, size_t count, size_t k) {
+  size_t lo = 0;
+  size_t hi = count - 1;
+
+  while (lo < hi) {
+    double pivot = values[lo + (hi - lo) / 2];
+    size_t i = lo;
+    size_t j = hi;
+    while (i <= j) {
+      while (values[i] < pivot) {
+        i++;
+      }
+      while (values[j] > pivot) {
+        j--;
+      }
+      if (i <= j) {
+        double tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+        i++;
+        if (j == 0) {
+          break;
+        }
+        j--;
+      }
+    }
+    if (k <= j) {
+      hi = j;
+    } else if (k >= i) {
+      lo = i;
+    } else {
+      break;
+    }
+  }
+  return values[k];
+}
+
+double nblex_quantile_sketch_quantile(quantile_sketch_t* sketch, double q) {
+  if (!sketch || sketch->count == 0 || isnan(q)) {
+    return NAN;
+  }
+  if (q < 0.0) {
+    q = 0.0;
+  } else if (q > 1.0) {
+    q = 1.0;
+  }
+
+  /* Zero-based rank, matching the nearest-rank rule of the exact mode */
+  uint64_t rank = (uint64_t)(q * (double)sketch->count);
+  if (rank >= sketch->count) {
+    rank = sketch->count - 1;
+  }
+
+  if (sketch->exact) {
+    return select_kth(sketch->values, sketch->values_count, (size_t)rank);
+  }
+
+  double value;
+  uint64_t seen = 0;
+  const sketch_store_t* neg = &sketch->negative;
+  const sketch_store_t* pos = &sketch->positive;
+
+  if (neg->total > rank) {
+    /* Largest magnitudes are the smallest negative values */
+    for (int32_t key = neg->max_key; key >= neg->min_key; key--) {
+      seen += neg->counts[key - neg->offset];
+      if (seen > rank) {
+        value = -sketch_key_value(sketch, key);
+        goto clamp;
+      }
+    }
+  }
+  seen = neg->total;
+
+  if (seen + sketch->zero_count > rank) {
+    value = 0.0;
+    goto clamp;
+  }
+  seen += sketch->zero_count;
+
+  value = sketch->max;
+  for (int32_t key = pos->min_key; pos->total > 0 && key <= pos->max_key; key++) {
+    seen += pos->counts[key - pos->offset];
+    if (seen > rank) {
+      value = sketch_key_value(sketch, key);
+      break;
+    }
+  }
+
+clamp:
+  /* The exact extremes are known, so never report beyond them */
+  if (value < sketch->min) {
+    value = sketch->min;
+  }
+  if (value > sketch->max) {
+    value = sketch->max;
+  }
+  return value;
+}
+
+uint64_t nblex_quantile_sketch_count(const quantile_sketch_t* sketch) {
+  return sketch ? sketch->count : 0;
+}
+
+double nblex_quantile_sketch_relative_accuracy(const quantile_sketch_t* sketch) {
+  return sketch ? sketch->relative_accuracy : 0.0;
+}
+
+size_t nblex_quantile_sketch_bin_count(const quantile_sketch_t* sketch) {
+  if (!sketch || sketch->exact) {
+    return 0;
+  }
+  return sketch->positive.capacity + sketch->negative.capacity;
+}
+
+size_t nblex_quantile_sketch_max_bins(const quantile_sketch_t* sketch) {
+  return (sketch && !sketch->exact) ? 2 * sketch->max_bins : 0;
+}
+
+/* Helper: Write a store's used bins */
+static void store_write(const sketch_store_t* store, nblex_ckpt_writer_t* writer) {
+  nblex_ckpt_put_u64(writer, store->total);
+  if (store->total == 0) {
+    return;
+  }
+  nblex_ckpt_put_u32(writer, (uint32_t)store->min_key);
+  nblex_ckpt_put_u32(writer, (uint32_t)store->max_key);
+  for (int32_t key = store->min_key; key <= store->max_key; key++) {
+    nblex_ckpt_put_u64(writer, store->counts[key - store->offset]);
+  }
+}
+
+/* Helper: Read bins written by store_write() into an empty store */
+static int store_read(sketch_store_t* store, size_t max_bins, nblex_ckpt_reader_t* reader) {
+  uint64_t total = nblex_ckpt_get_u64(reader);
+  if (total == 0) {
+    return reader->failed ? -1 : 0;
+  }
+  int32_t min_key = (int32_t)nblex_ckpt_get_u32(reader);
+  int32_t max_key = (int32_t)nblex_ckpt_get_u32(reader);
+  if (reader->failed || max_key < min_key ||
+      (uint64_t)((int64_t)max_key - min_key + 1) > max_bins ||
+      nblex_ckpt_remaining(reader) / sizeof(uint64_t) < (size_t)((int64_t)max_key - min_key + 1)) {
+    return -1;
+  }
+  for (int32_t key = min_key; key <= max_key; key++) {
+    uint64_t n = nblex_ckpt_get_u64(reader);
+    if (n > 0 && store_add(store, max_bins, key, n) != 0) {
+      return -1;
+    }
+  }
+  return store->total == total ? 0 : -1;
+}
+
+int nblex_quantile_sketch_write(const quantile_sketch_t* sketch, nblex_ckpt_writer_t* writer) {
+  if (!sketch || !writer) {
+    return -1;
+  }
+
+  nblex_ckpt_put_u8(writer, sketch->exact ? 1 : 0);
+  nblex_ckpt_put_double(writer, sketch->relative_accuracy);
+  if (sketch->exact) {
+    nblex_ckpt_put_u64(writer, sketch->values_count);
+    for (size_t i = 0; i < sketch->values_count; i++) {
+      nblex_ckpt_put_double(writer, sketch->values[i]);
+    }
+    return writer->failed ? -1 : 0;
+  }
+
+  nblex_ckpt_put_u64(writer, sketch->count);
+  nblex_ckpt_put_double(writer, sketch->min);
+  nblex_ckpt_put_double(writer, sketch->max);
+  nblex_ckpt_put_u64(writer, sketch->zero_count);
+  store_write(&sketch->positive, writer);
+  store_write(&sketch->negative, writer);
+  return writer->failed ? -1 : 0;
+}
+
+quantile_sketch_t* nblex_quantile_sketch_read(nblex_ckpt_reader_t* reader) {
+  if (!reader) {
+    return NULL;
+  }
+
+  bool exact = nblex_ckpt_get_u8(reader) != 0;
+  double accuracy = nblex_ckpt_get_double(reader);
+  if (reader->failed || exact != (accuracy == 0.0)) {
+    return NULL;
+  }
+  quantile_sketch_t* sketch = nblex_quantile_sketch_new(accuracy);
+  if (!sketch) {
+    return NULL;
+  }
+
+  if (exact) {
+    uint64_t count = nblex_ckpt_get_u64(reader);
+    if (count > nblex_ckpt_remaining(reader) / sizeof(double)) {
+      nblex_quantile_sketch_free(sketch);
+      return NULL;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      if (nblex_quantile_sketch_add(sketch, nblex_ckpt_get_double(reader)) != 0) {
+        nblex_quantile_sketch_free(sketch);
+        return NULL;
+      }
+    }
+    return sketch;
+  }
+
+  sketch->count = nblex_ckpt_get_u64(reader);
+  sketch->min = nblex_ckpt_get_double(reader);
+  sketch->max = nblex_ckpt_get_double(reader);
+  sketch->zero_count = nblex_ckpt_get_u64(reader);
+  if (store_read(&sketch->positive, sketch->max_bins, reader) != 0 ||
+      store_read(&sketch->negative, sketch->max_bins, reader) != 0 ||
+      sketch->positive.total + sketch->negative.total + sketch->zero_count != sketch->count) {
+    nblex_quantile_sketch_free(sketch);
+    return NULL;
+  }
+  return sketch;
+}
@@ -0,0 +1,170 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * worker_pool.c - Fixed pool of threads running one function together
+ *
+ * Copyright (C) 2025
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "../nblex_internal.h"
+#include <stdlib.h>
+
+/* The caller of nblex_worker_pool_run() is worker 0; the pool starts
+ * threads for the others. Each run bumps a generation that waiting
+ * threads watch for, and the caller waits until every thread has
+ * finished with it.
+ */
+
+typedef struct {
+  nblex_worker_pool_t* pool;
+  size_t index;
+  uv_thread_t thread;
+} nblex_worker_t;
+
+struct nblex_worker_pool_s {
+  size_t size;                  /* Including the calling thread */
+  nblex_worker_t* workers;      /* size - 1 started threads */
+  size_t started;
+
+  uv_mutex_t mutex;
+  uv_cond_t start;              /* A run or shutdown is ready */
+  uv_cond_t done;               /* The last thread finished a run */
+
+  uint64_t generation;
+  size_t pending;               /* Threads still in the current run */
+  bool stopping;
+
+  nblex_worker_fn fn;
+  void* arg;
+};
+
+/* Helper: Thread body, running each generation's function until stopped */
+static void worker_main(void* data) {
+  nblex_worker_t* worker = (nblex_worker_t*)data;
+  nblex_worker_pool_t* pool = worker->pool;
+  uint64_t seen = 0;
+
+  uv_mutex_lock(&pool->mutex);
+  for (;;) {
+    while (!pool->stopping && pool->generation == seen) {
+      uv_cond_wait(&pool->start, &pool->mutex);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->generation;
+    nblex_worker_fn fn = pool->fn;
+    void* arg = pool->arg;
+    uv_mutex_unlock(&pool->mutex);
+
+    fn(arg, worker->index);
+
+    uv_mutex_lock(&pool->mutex);
+    if (--pool->pending == 0) {
+      uv_cond_signal(&pool->done);
+    }
+  }
+  uv_mutex_unlock(&pool->mutex);
+}
+
+nblex_worker_pool_t* nblex_worker_pool_new(size_t threads) {
+  if (threads == 0) {
+    return NULL;
+  }
+
+  nblex_worker_pool_t* pool = calloc(1, sizeof(nblex_worker_pool_t));
+  if (!pool) {
+    return NULL;
+  }
+  pool->size = threads;
+  if (threads > 1) {
+    pool->workers = calloc(threads - 1, sizeof(nblex_worker_t));
+    if (!pool->workers) {
+      free(pool);
+      return NULL;
+    }
+  }
+
+  if (uv_mutex_init(&pool->mutex) != 0) {
+    free(pool->workers);
+    free(pool);
+    return NULL;
+  }
+  if (uv_cond_init(&pool->start) != 0) {
+    uv_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+    return NULL;
+  }
+  if (uv_cond_init(&pool->done) != 0) {
+    uv_cond_destroy(&pool->start);
+    uv_mutex_destroy(&pool->mutex);
+    free(pool->workers);
+    free(pool);
+    return NULL;
+  }
+
+  for (size_t i = 0; i + 1 < threads; i++) {
+    nblex_worker_t* worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->index = i + 1;
+    if (uv_thread_create(&worker->thread, worker_main, worker) != 0) {
+      nblex_worker_pool_free(pool);
+      return NULL;
+    }
+    pool->started++;
+  }
+
+  return pool;
+}
+
+void nblex_worker_pool_free(nblex_worker_pool_t* pool) {
+  if (!pool) {
+    return;
+  }
+
+  uv_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  uv_cond_broadcast(&pool->start);
+  uv_mutex_unlock(&pool->mutex);
+
+  for (size_t i = 0; i < pool->started; i++) {
+    uv_thread_join(&pool->workers[i].thread);
+  }
+
+  uv_cond_destroy(&pool->done);
+  uv_cond_destroy(&pool->start);
+  uv_mutex_destroy(&pool->mutex);
+  free(pool->workers);
+  free(pool);
+}
+
+size_t nblex_worker_pool_size(const nblex_worker_pool_t* pool) {
+  return pool ? pool->size : 0;
+}
+
+void nblex_worker_pool_run(nblex_worker_pool_t* pool, nblex_worker_fn fn, void* arg) {
+  if (!pool || !fn) {
+    return;
+  }
+
+  if (pool->size > 1) {
+    uv_mutex_lock(&pool->mutex);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->pending = pool->size - 1;
+    pool->generation++;
+    uv_cond_broadcast(&pool->start);
+    uv_mutex_unlock(&pool->mutex);
+  }
+
+  fn(arg, 0);
+
+  if (pool->size > 1) {
+    uv_mutex_lock(&pool->mutex);
+    while (pool->pending > 0) {
+      uv_cond_wait(&pool->done, &pool->mutex);
+    }
+    uv_mutex_unlock(&pool->mutex);
+  }
+}
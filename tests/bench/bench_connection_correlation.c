@@ -0,0 +1,115 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_connection_correlation.c - Connection vs time correlation of logs
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* A busy server: `count` clients each send a packet and get an access
+ * log line naming their address and port, 100us apart. The connection
+ * strategy joins each log to its own flow; the time strategy pairs it
+ * with every packet in its 100ms window.
+ */
+
+static void discard_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+}
+
+static nblex_event* build_packet(nblex_input* input, size_t index, uint64_t timestamp_ns) {
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  event->timestamp_ns = timestamp_ns;
+  event->data = json_pack("{s:s, s:i}", "protocol", "tcp", "length", 100);
+
+  struct in_addr client;
+  struct in_addr server;
+  client.s_addr = htonl(0x0a000000u + (uint32_t)(index / 50000) + 2);
+  server.s_addr = htonl(0x0a000001u);
+  nblex_flow_map_ipv4(event->flow.addr[0], &client);
+  nblex_flow_map_ipv4(event->flow.addr[1], &server);
+  event->flow.port[0] = (uint16_t)(10000 + index % 50000);
+  event->flow.port[1] = 443;
+  event->flow.protocol = IPPROTO_TCP;
+  nblex_flow_key_normalize(&event->flow);
+  return event;
+}
+
+static nblex_event* build_log(nblex_input* input, size_t index, uint64_t timestamp_ns) {
+  char address[INET_ADDRSTRLEN];
+  struct in_addr client;
+  client.s_addr = htonl(0x0a000000u + (uint32_t)(index / 50000) + 2);
+  inet_ntop(AF_INET, &client, address, sizeof(address));
+
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  event->timestamp_ns = timestamp_ns;
+  event->data = json_pack("{s:s, s:i, s:i}", "remote_addr", address,
+                          "remote_port", (int)(10000 + index % 50000), "status", 200);
+  return event;
+}
+
+static void run(const char* name, nblex_correlation_type type, size_t count,
+                nblex_event** packets, nblex_event** logs) {
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    exit(1);
+  }
+  nblex_set_event_handler(world, discard_handler, NULL);
+  nblex_correlation* corr = nblex_correlation_new(world);
+  nblex_correlation_add_strategy(corr, type, 100);
+
+  uint64_t start = nblex_timestamp_now();
+  for (size_t i = 0; i < count; i++) {
+    nblex_correlation_process_event(corr, packets[i]);
+    nblex_correlation_process_event(corr, logs[i]);
+  }
+  uint64_t elapsed = nblex_timestamp_now() - start;
+
+  char label[96];
+  snprintf(label, sizeof(label), "%s (%zu clients)", name, count);
+  bench_report(label, count * 2, elapsed);
+  printf("  correlations: %llu (%.1f per log)\n",
+         (unsigned long long)corr->correlations_found,
+         (double)corr->correlations_found / (double)count);
+
+  nblex_correlation_free(corr);
+  nblex_world_free(world);
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 100000);
+
+  nblex_world* world = nblex_world_new();
+  nblex_input* input = world ? nblex_input_new(world, NBLEX_INPUT_FILE) : NULL;
+  nblex_event** packets = calloc(count, sizeof(nblex_event*));
+  nblex_event** logs = calloc(count, sizeof(nblex_event*));
+  if (!input || !packets || !logs) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+
+  uint64_t base = 1000000000000ULL;
+  for (size_t i = 0; i < count; i++) {
+    packets[i] = build_packet(input, i, base + (uint64_t)i * 100000ULL);
+    logs[i] = build_log(input, i, base + (uint64_t)i * 100000ULL + 5000ULL);
+  }
+
+  run("connection", NBLEX_CORR_CONNECTION, count, packets, logs);
+  size_t time_count = count < 2000 ? count : 2000;
+  run("time", NBLEX_CORR_TIME_BASED, time_count, packets, logs);
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(packets[i]);
+    nblex_event_free(logs[i]);
+  }
+  free(packets);
+  free(logs);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
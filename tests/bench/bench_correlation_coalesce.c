@@ -0,0 +1,78 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_correlation_coalesce.c - Per-pair vs coalesced correlation output
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A packet burst inside one correlation window, then log lines that
+ * each match every packet of it */
+#define LOGS 100
+
+static size_t emitted;
+
+static void count_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+  emitted++;
+}
+
+static void run(const char* name, bool coalesce, size_t burst) {
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    exit(1);
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, count_handler, NULL);
+  nblex_correlation* corr = nblex_correlation_new(world);
+  nblex_correlation_add_strategy(corr, NBLEX_CORR_TIME_BASED, 1000);
+  nblex_correlation_set_coalesce(corr, coalesce, 10);
+
+  uint64_t base = 1000000000000ULL;
+  for (size_t i = 0; i < burst; i++) {
+    nblex_event* packet = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+    packet->timestamp_ns = base + (uint64_t)i * 100000ULL;
+    packet->data = json_pack("{s:s, s:i}", "protocol", "tcp", "length", 1500);
+    nblex_correlation_process_event(corr, packet);
+    nblex_event_free(packet);
+  }
+
+  nblex_event* logs[LOGS];
+  for (size_t i = 0; i < LOGS; i++) {
+    logs[i] = bench_build_log_event(input, i, 16);
+    logs[i]->timestamp_ns = base + (uint64_t)burst * 50000ULL;
+  }
+
+  emitted = 0;
+  uint64_t start = nblex_timestamp_now();
+  for (size_t i = 0; i < LOGS; i++) {
+    nblex_correlation_process_event(corr, logs[i]);
+  }
+  uint64_t elapsed = nblex_timestamp_now() - start;
+
+  char label[96];
+  snprintf(label, sizeof(label), "%s (burst %zu)", name, burst);
+  bench_report(label, LOGS, elapsed);
+  printf("  events per log: %.1f, pairs dropped: %llu\n",
+         (double)emitted / LOGS, (unsigned long long)corr->pairs_dropped);
+
+  for (size_t i = 0; i < LOGS; i++) {
+    nblex_event_free(logs[i]);
+  }
+  nblex_correlation_free(corr);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+
+int main(int argc, char** argv) {
+  size_t burst = bench_parse_count(argc, argv, 5000);
+
+  run("per pair", false, burst);
+  run("coalesced", true, burst);
+  return 0;
+}
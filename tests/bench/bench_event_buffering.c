@@ -0,0 +1,54 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_event_buffering.c - Cost of emitting events the correlator buffers
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Network events created and emitted as an input does, each buffered by
+ * the world's time correlator with nothing to match; the buffer is
+ * emptied every block so it stays small */
+#define BLOCK 1000
+
+static void discard_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 1000000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, discard_handler, NULL);
+  json_t* data = json_pack("{s:s, s:i}", "protocol", "tcp", "length", 1500);
+  if (!input || !data) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+
+  uint64_t start = nblex_timestamp_now();
+  for (size_t i = 0; i < count; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+    event->timestamp_ns = 1000000000ULL + i;  /* Long past: expiry drops it */
+    event->data = json_incref(data);
+    nblex_event_emit(world, event);
+    if (i % BLOCK == BLOCK - 1) {
+      nblex_correlation_expire(world->correlation);
+    }
+  }
+  bench_report("emit and buffer", count, nblex_timestamp_now() - start);
+
+  json_decref(data);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
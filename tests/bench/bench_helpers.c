@@ -0,0 +1,46 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_helpers.c - Shared utilities for nblex benchmarks
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+size_t bench_parse_count(int argc, char** argv, size_t default_count) {
+  if (argc > 1) {
+    char* end = NULL;
+    unsigned long long value = strtoull(argv[1], &end, 10);
+    if (end && *end == '\0' && value > 0) {
+      return (size_t)value;
+    }
+  }
+  return default_count;
+}
+
+nblex_event* bench_build_log_event(nblex_input* input, size_t index, size_t services) {
+  static const char* levels[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+  char service[32];
+
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  if (!event) {
+    return NULL;
+  }
+
+  snprintf(service, sizeof(service), "svc-%zu", services ? index % services : 0);
+
+  event->data = json_object();
+  json_object_set_new(event->data, "log.level", json_string(levels[index % 4]));
+  json_object_set_new(event->data, "log.service", json_string(service));
+  json_object_set_new(event->data, "network.latency_ms",
+                      json_real((double)(index % 1000) / 10.0));
+  event->timestamp_ns = 1000000000000ULL + index * 1000ULL;
+  return event;
+}
+
+void bench_report(const char* name, size_t ops, uint64_t elapsed_ns) {
+  double per_op = ops ? (double)elapsed_ns / (double)ops : 0.0;
+  printf("%-44s %10zu ops %12.1f ns/op\n", name, ops, per_op);
+}
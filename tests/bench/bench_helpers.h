@@ -0,0 +1,24 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_helpers.h - Shared utilities for nblex benchmarks
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#ifndef BENCH_HELPERS_H
+#define BENCH_HELPERS_H
+
+#include "../../src/nblex_internal.h"
+
+/* Parse an iteration count from argv[1], falling back to a default */
+size_t bench_parse_count(int argc, char** argv, size_t default_count);
+
+/* Build a log event with level, service and latency fields. Services
+ * cycle through `services` distinct values.
+ */
+nblex_event* bench_build_log_event(nblex_input* input, size_t index, size_t services);
+
+/* Print one result line: name, operations and per-operation cost */
+void bench_report(const char* name, size_t ops, uint64_t elapsed_ns);
+
+#endif /* BENCH_HELPERS_H */
@@ -0,0 +1,73 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_id_correlation.c - ID correlator cost as its index fills
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Each request ID appears on one log and one network event 1ms apart;
+ * with a 60s window nothing expires while the index fills towards its
+ * 10000-event cap */
+#define BLOCK 1000
+
+static void discard_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 20000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, discard_handler, NULL);
+  nblex_correlation* corr = nblex_correlation_new(world);
+  nblex_correlation_add_strategy(corr, NBLEX_CORR_ID_BASED, 60000);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  if (!input || !corr || !events) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    char request_id[32];
+    snprintf(request_id, sizeof(request_id), "req-%zu", i / 2);
+    events[i] = bench_build_log_event(input, i, 16);
+    json_object_set_new(events[i]->data, (i % 2) == 0 ? "request_id" : "trace_id",
+                        json_string(request_id));
+    events[i]->type = (i % 2) == 0 ? NBLEX_EVENT_LOG : NBLEX_EVENT_NETWORK;
+    events[i]->timestamp_ns = 1000000000000ULL + (uint64_t)i * 1000000ULL;
+  }
+
+  for (size_t block = 0; block * BLOCK < count; block++) {
+    size_t first = block * BLOCK;
+    size_t last = first + BLOCK < count ? first + BLOCK : count;
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = first; i < last; i++) {
+      nblex_correlation_process_event(corr, events[i]);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "buffered %zu-%zu", first, last);
+    bench_report(name, last - first, nblex_timestamp_now() - start);
+  }
+  printf("correlations: %llu, bloom rejects: %llu\n",
+         (unsigned long long)corr->correlations_found,
+         (unsigned long long)corr->id_bloom_rejects);
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_correlation_free(corr);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
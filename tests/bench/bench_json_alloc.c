@@ -0,0 +1,74 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_json_alloc.c - Cost of building, serializing and freeing event JSON
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Log events are parsed into JSON and freed once handled, `held` at a
+ * time as correlation buffers keep them; every allocation goes through
+ * jansson's allocator. Also reports where the memory was counted. */
+
+static json_t* build_data(size_t index) {
+  static const char* levels[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+  char service[32];
+  snprintf(service, sizeof(service), "svc-%zu", index % 50);
+  return json_pack("{s:s, s:s, s:f, s:i, s:s}",
+                   "log.level", levels[index % 4],
+                   "log.service", service,
+                   "network.latency_ms", (double)(index % 1000) / 10.0,
+                   "http.status", 200 + (int)(index % 5),
+                   "message", "GET /api/v1/orders returned in time");
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 1000000);
+  static const size_t helds[] = { 1, 1000, 100000 };
+  nblex_json_allocator_init();
+
+  for (size_t h = 0; h < sizeof(helds) / sizeof(helds[0]); h++) {
+    json_t** held = calloc(helds[h], sizeof(json_t*));
+    if (!held) {
+      fprintf(stderr, "Failed to allocate buffer\n");
+      return 1;
+    }
+    char name[64];
+
+    nblex_mem_tag previous = nblex_mem_tag_enter(NBLEX_MEM_TAG_PARSER);
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = 0; i < count; i++) {
+      json_t** slot = &held[i % helds[h]];
+      json_decref(*slot);
+      *slot = build_data(i);
+    }
+    snprintf(name, sizeof(name), "build and free, %zu held", helds[h]);
+    bench_report(name, count, nblex_timestamp_now() - start);
+    nblex_mem_tag_leave(previous);
+
+    nblex_mem_tag_stats_t stats;
+    nblex_memory_get_tag_stats(NBLEX_MEM_TAG_PARSER, &stats);
+    printf("  parser: %zu live bytes\n", stats.live_bytes);
+
+    for (size_t i = 0; i < helds[h]; i++) {
+      json_decref(held[i]);
+    }
+    free(held);
+  }
+
+  json_t* data = build_data(0);
+  uint64_t start = nblex_timestamp_now();
+  size_t bytes = 0;
+  for (size_t i = 0; i < count; i++) {
+    char* text = nblex_json_dumps(data, JSON_COMPACT);
+    bytes += text ? 1 : 0;
+    free(text);
+  }
+  bench_report("serialize", count, nblex_timestamp_now() - start);
+  json_decref(data);
+
+  return bytes == count ? 0 : 1;
+}
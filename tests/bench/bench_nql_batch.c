@@ -0,0 +1,78 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_batch.c - Per-event vs batch-at-a-time nQL pipeline execution
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The shapes of the integration pipeline tests' queries */
+static const char* queries[] = {
+  "log.level == \"ERROR\"",
+  "log.level != \"DEBUG\" | aggregate count() by log.service window tumbling(1m)",
+  "log.level == \"ERROR\" and network.latency_ms > 50 or log.service == \"svc-3\" "
+  "| show log.service, network.latency_ms where network.latency_ms > 10",
+};
+
+static void discard_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 100000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, discard_handler, NULL);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  uint32_t* matched = calloc(count, sizeof(uint32_t));
+  if (!input || !events || !matched) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = bench_build_log_event(input, i, 16);
+  }
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    size_t matched_each = 0;
+    printf("query: %s\n", queries[q]);
+
+    nql_prepared_t* prepared = nql_prepare(queries[q], world);
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = 0; i < count; i++) {
+      matched_each += (size_t)nql_execute_prepared(prepared, events[i]);
+    }
+    bench_report("  per event", count, nblex_timestamp_now() - start);
+    nql_prepared_free(prepared);
+
+    prepared = nql_prepare(queries[q], world);
+    start = nblex_timestamp_now();
+    size_t matched_batch = nql_execute_prepared_batch(prepared, events, count, matched);
+    bench_report("  batch", count, nblex_timestamp_now() - start);
+    nql_prepared_free(prepared);
+
+    if (matched_each != matched_batch) {
+      fprintf(stderr, "Result mismatch: %zu vs %zu\n", matched_each, matched_batch);
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(matched);
+  free(events);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
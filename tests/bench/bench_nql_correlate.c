@@ -0,0 +1,91 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_correlate.c - Time-only vs keyed (hash join) nQL correlation
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Events alternate sides 1ms apart, so a 100ms window holds about 50 of
+ * each side; request IDs cycle through KEYS values */
+#define KEYS 64
+
+static const char* queries[] = {
+  "correlate log.level == \"ERROR\" with network.dst_port == 3306 within 100ms",
+  "correlate log.level == \"ERROR\" with network.dst_port == 3306 on request_id within 100ms",
+};
+
+static size_t results;
+
+static void count_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+  results++;
+}
+
+/* Build a log or network event for one side, carrying a request ID */
+static nblex_event* build_side_event(nblex_input* input, size_t index) {
+  bool left = (index % 2) == 0;
+  nblex_event* event = nblex_event_new(left ? NBLEX_EVENT_LOG : NBLEX_EVENT_NETWORK, input);
+  json_t* data = json_object();
+  char request_id[32];
+  snprintf(request_id, sizeof(request_id), "req-%zu", (index / 2) % KEYS);
+  if (left) {
+    json_object_set_new(data, "log.level", json_string("ERROR"));
+  } else {
+    json_object_set_new(data, "network.dst_port", json_integer(3306));
+  }
+  json_object_set_new(data, "request_id", json_string(request_id));
+  event->data = data;
+  event->timestamp_ns = 1000000000000ULL + (uint64_t)index * 1000000ULL;
+  return event;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 20000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, count_handler, NULL);
+  nblex_scheduler_t* scheduler = nblex_world_window_scheduler(world);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  if (!input || !events) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = build_side_event(input, i);
+  }
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    printf("query: %s\n", queries[q]);
+    results = 0;
+
+    nql_prepared_t* prepared = nql_prepare(queries[q], world);
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = 0; i < count; i++) {
+      nql_execute_prepared(prepared, events[i]);
+      /* Expire buffered events as event time advances */
+      nblex_scheduler_run(scheduler, events[i]->timestamp_ns);
+    }
+    bench_report("  correlate", count, nblex_timestamp_now() - start);
+    printf("  results: %zu\n", results);
+    nql_prepared_free(prepared);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
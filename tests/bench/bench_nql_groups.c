@@ -0,0 +1,83 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_groups.c - Aggregation cost as the number of groups grows
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run `count` events spread over `groups` group keys through a windowed
+ * aggregate: the first pass creates buckets, the second only finds them.
+ */
+static int bench_groups(nblex_world* world, nblex_input* input, size_t groups) {
+  json_t** keys = calloc(groups, sizeof(json_t*));
+  if (!keys) {
+    return -1;
+  }
+  for (size_t i = 0; i < groups; i++) {
+    char ip[32];
+    snprintf(ip, sizeof(ip), "10.%zu.%zu.%zu", (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+    keys[i] = json_string(ip);
+  }
+
+  nblex_event* event = bench_build_log_event(input, 0, 1);
+  nql_prepared_t* prepared = nql_prepare(
+      "aggregate count(), sum(network.latency_ms) by client.ip window tumbling(1h)", world);
+  if (!event || !prepared) {
+    return -1;
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    char name[64];
+    nblex_memory_stats_t before;
+    nblex_memory_stats_t after;
+    nblex_memory_get_stats(&before);
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = 0; i < groups; i++) {
+      /* Scatter the visiting order so lookups do not follow insertion */
+      size_t g = (i * 2654435761u) % groups;
+      json_object_set(event->data, "client.ip", keys[g]);
+      nql_execute_prepared(prepared, event);
+    }
+    snprintf(name, sizeof(name), "%7zu groups, %s", groups,
+             pass == 0 ? "insert" : "update");
+    bench_report(name, groups, nblex_timestamp_now() - start);
+    nblex_memory_get_stats(&after);
+    printf("%-44s %10.3f allocs/op\n", "",
+           (double)(after.allocations - before.allocations) / (double)groups);
+  }
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  for (size_t i = 0; i < groups; i++) {
+    json_decref(keys[i]);
+  }
+  free(keys);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  size_t max_groups = bench_parse_count(argc, argv, 1000000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  /* World is not started, so no window is flushed during the run */
+  for (size_t groups = 1000; groups <= max_groups; groups *= 10) {
+    if (bench_groups(world, input, groups) != 0) {
+      fprintf(stderr, "Benchmark setup failed\n");
+      return 1;
+    }
+  }
+
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
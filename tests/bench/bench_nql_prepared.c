@@ -0,0 +1,78 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_prepared.c - Per-event cost of prepared vs re-parsed nQL
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* queries[] = {
+  "log.level == \"ERROR\"",
+  "log.level == \"ERROR\" and network.latency_ms > 50 or log.service == \"svc-3\"",
+  "log.level in [\"ERROR\", \"WARN\"] | show log.service, network.latency_ms "
+  "where network.latency_ms > 10",
+};
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 100000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  if (!input || !events) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = bench_build_log_event(input, i, 16);
+  }
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    char name[64];
+    size_t matched_reparse = 0;
+    size_t matched_prepared = 0;
+
+    printf("query: %s\n", queries[q]);
+
+    /* Parse, execute and free per event (the pre-prepared behaviour) */
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = 0; i < count; i++) {
+      nql_prepared_t* prepared = nql_prepare(queries[q], world);
+      matched_reparse += (size_t)nql_execute_prepared(prepared, events[i]);
+      nql_prepared_free(prepared);
+    }
+    snprintf(name, sizeof(name), "  re-parse per event");
+    bench_report(name, count, nblex_timestamp_now() - start);
+
+    /* Parse once, execute per event */
+    start = nblex_timestamp_now();
+    nql_prepared_t* prepared = nql_prepare(queries[q], world);
+    for (size_t i = 0; i < count; i++) {
+      matched_prepared += (size_t)nql_execute_prepared(prepared, events[i]);
+    }
+    nql_prepared_free(prepared);
+    snprintf(name, sizeof(name), "  prepared");
+    bench_report(name, count, nblex_timestamp_now() - start);
+
+    if (matched_reparse != matched_prepared) {
+      fprintf(stderr, "Result mismatch: %zu vs %zu\n", matched_reparse, matched_prepared);
+      return 1;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
@@ -0,0 +1,93 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_shared.c - Many standing queries, run one by one or sharing
+ * predicates through nql_execute_all()
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_EVENTS 1000
+#define BENCH_SERVICES 100
+
+/* Register `queries` filters that share level tests and differ by service */
+static int bench_queries(size_t queries, size_t count) {
+  static const char* levels[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    nblex_world_free(world);
+    return -1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  int* ids = calloc(queries, sizeof(int));
+  nblex_event** events = calloc(BENCH_EVENTS, sizeof(nblex_event*));
+  if (!ids || !events) {
+    return -1;
+  }
+  for (size_t i = 0; i < queries; i++) {
+    char expr[128];
+    snprintf(expr, sizeof(expr), "log.level == \"%s\" AND log.service == \"svc-%zu\"",
+             levels[i % 4], i % BENCH_SERVICES);
+    ids[i] = nql_register(world, expr, NULL);
+    if (ids[i] < 0) {
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < BENCH_EVENTS; i++) {
+    events[i] = bench_build_log_event(input, i, BENCH_SERVICES);
+    if (!events[i]) {
+      return -1;
+    }
+  }
+
+  char name[64];
+  size_t matched_each = 0;
+  uint64_t start = nblex_timestamp_now();
+  for (size_t i = 0; i < count; i++) {
+    nblex_event* event = events[i % BENCH_EVENTS];
+    for (size_t q = 0; q < queries; q++) {
+      matched_each += (size_t)nql_execute_id(world, ids[q], event);
+    }
+  }
+  snprintf(name, sizeof(name), "%zu queries, one by one", queries);
+  bench_report(name, count, nblex_timestamp_now() - start);
+
+  size_t matched_all = 0;
+  start = nblex_timestamp_now();
+  for (size_t i = 0; i < count; i++) {
+    matched_all += (size_t)nql_execute_all(world, events[i % BENCH_EVENTS], NULL, NULL);
+  }
+  snprintf(name, sizeof(name), "%zu queries, shared predicates", queries);
+  bench_report(name, count, nblex_timestamp_now() - start);
+
+  if (matched_each != matched_all) {
+    fprintf(stderr, "Match counts differ: %zu vs %zu\n", matched_each, matched_all);
+    return -1;
+  }
+
+  for (size_t i = 0; i < BENCH_EVENTS; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  free(ids);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 200000);
+
+  if (bench_queries(1, count) != 0 ||
+      bench_queries(10, count) != 0 ||
+      bench_queries(100, count) != 0) {
+    fprintf(stderr, "Benchmark setup failed\n");
+    return 1;
+  }
+  return 0;
+}
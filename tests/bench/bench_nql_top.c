@@ -0,0 +1,81 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_top.c - Window close and output cost with and without top(N)
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t results_emitted;
+static size_t bytes_serialized;
+
+/* Serialize every result, as an output would */
+static void serialize_handler(nblex_event* event, void* user_data) {
+  (void)user_data;
+  char* json = nblex_event_to_json(event);
+  if (json) {
+    results_emitted++;
+    bytes_serialized += strlen(json);
+    free(json);
+  }
+}
+
+/* Feed one event-time window of `groups` groups, then time its close */
+static int bench_close(const char* name, const char* query, size_t groups) {
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0 ||
+      nblex_world_set_event_time(world, NULL, 0) != 0) {
+    nblex_world_free(world);
+    return -1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, serialize_handler, NULL);
+
+  nql_prepared_t* prepared = nql_prepare(query, world);
+  if (!prepared) {
+    nblex_world_free(world);
+    return -1;
+  }
+
+  /* Every event falls in the minute starting at 1000s */
+  for (size_t i = 0; i < groups; i++) {
+    nblex_event* event = bench_build_log_event(input, i, groups);
+    if (!event) {
+      return -1;
+    }
+    event->timestamp_ns = 1020000000000ULL + i;
+    nql_execute_prepared(prepared, event);
+    nblex_event_free(event);
+  }
+
+  results_emitted = 0;
+  bytes_serialized = 0;
+  uint64_t start = nblex_timestamp_now();
+  nblex_world_advance_watermark(world, 1080000000000ULL);
+  bench_report(name, groups, nblex_timestamp_now() - start);
+  printf("%-44s %10zu results %10zu bytes\n", "", results_emitted, bytes_serialized);
+
+  nql_prepared_free(prepared);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  size_t groups = bench_parse_count(argc, argv, 100000);
+
+  if (bench_close("close, all groups",
+                  "aggregate count(), avg(network.latency_ms) by log.service "
+                  "window tumbling(1m)", groups) != 0 ||
+      bench_close("close, top(10) by avg",
+                  "aggregate count(), avg(network.latency_ms) by log.service "
+                  "window tumbling(1m) | top(10) by avg(network.latency_ms)", groups) != 0) {
+    fprintf(stderr, "Benchmark setup failed\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_windows.c - Per-event cost of window types
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Run `count` events, 1ms apart over 10 services, through one query */
+static int bench_window(nblex_world* world, nblex_input* input,
+                        const char* name, const char* query, size_t count) {
+  nql_prepared_t* prepared = nql_prepare(query, world);
+  if (!prepared) {
+    return -1;
+  }
+
+  nblex_event** events = calloc(10, sizeof(nblex_event*));
+  if (!events) {
+    nql_prepared_free(prepared);
+    return -1;
+  }
+  for (size_t i = 0; i < 10; i++) {
+    events[i] = bench_build_log_event(input, i, 10);
+    if (!events[i]) {
+      return -1;
+    }
+  }
+
+  uint64_t base_ts = events[0]->timestamp_ns;
+  uint64_t start = nblex_timestamp_now();
+  for (size_t i = 0; i < count; i++) {
+    nblex_event* event = events[i % 10];
+    event->timestamp_ns = base_ts + i * 1000000ULL;
+    nql_execute_prepared(prepared, event);
+  }
+  bench_report(name, count, nblex_timestamp_now() - start);
+
+  for (size_t i = 0; i < 10; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nql_prepared_free(prepared);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 1000000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  /* World is not started, so no window is flushed during the run; a
+   * sliding(5m, 1s) event used to update 300 overlapping buckets */
+  if (bench_window(world, input, "tumbling(5m)",
+                   "aggregate count(), avg(network.latency_ms) by log.service "
+                   "window tumbling(5m)", count) != 0 ||
+      bench_window(world, input, "sliding(5m, 1s)",
+                   "aggregate count(), avg(network.latency_ms) by log.service "
+                   "window sliding(5m, 1s)", count) != 0 ||
+      bench_window(world, input, "sliding(5m, 1s) percentile",
+                   "aggregate percentile(network.latency_ms, 99) by log.service "
+                   "window sliding(5m, 1s)", count) != 0) {
+    fprintf(stderr, "Benchmark setup failed\n");
+    return 1;
+  }
+
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
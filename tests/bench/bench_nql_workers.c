@@ -0,0 +1,85 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_nql_workers.c - Batch aggregation on 1 to 8 worker threads
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Several functions per event, so bucket updates dominate */
+static const char* queries[] = {
+  "aggregate count(), sum(network.latency_ms), min(network.latency_ms), "
+  "max(network.latency_ms) by log.service window tumbling(1s)",
+  "aggregate count(), percentile(network.latency_ms, 99), distinct(log.level) "
+  "by log.service window tumbling(1s)",
+  "aggregate count(), avg(network.latency_ms), percentile(network.latency_ms, 50) "
+  "by log.service window sliding(1s, 250ms)",
+};
+
+static size_t results;
+
+static void count_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+  results++;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 1000000);
+  static const size_t threads[] = {1, 2, 4, 8};
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, count_handler, NULL);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  if (!input || !events) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = bench_build_log_event(input, i, 64);
+  }
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    size_t expected_results = 0;
+    printf("query: %s\n", queries[q]);
+
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+      char name[64];
+      nblex_world_set_worker_threads(world, threads[t]);
+      nql_prepared_t* prepared = nql_prepare(queries[q], world);
+      results = 0;
+
+      uint64_t start = nblex_timestamp_now();
+      nql_execute_prepared_batch(prepared, events, count, NULL);
+      while (nblex_scheduler_run(nblex_world_window_scheduler(world), UINT64_MAX) > 0) {
+      }
+      snprintf(name, sizeof(name), "  %zu thread%s", threads[t], threads[t] > 1 ? "s" : "");
+      bench_report(name, count, nblex_timestamp_now() - start);
+      nql_prepared_free(prepared);
+
+      if (t == 0) {
+        expected_results = results;
+      } else if (results != expected_results) {
+        fprintf(stderr, "Result mismatch: %zu vs %zu\n", results, expected_results);
+        return 1;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
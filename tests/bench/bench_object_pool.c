@@ -0,0 +1,86 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_object_pool.c - Buffer entries from malloc vs a fixed-size pool
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A correlation buffer's allocation pattern: entries are added at the
+ * head and expired from the tail, `held` of them live at a time. Each
+ * entry is written once and read once, as buffers do. */
+
+typedef struct {
+  nblex_event_buffer_entry** ring;
+  size_t held;
+} fifo_t;
+
+static uint64_t run_malloc(fifo_t* fifo, size_t count) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_buffer_entry** slot = &fifo->ring[i % fifo->held];
+    if (*slot) {
+      sum += (*slot)->size;
+      nblex_free(*slot);
+    }
+    *slot = nblex_calloc(1, sizeof(nblex_event_buffer_entry));
+    (*slot)->size = i;
+  }
+  for (size_t i = 0; i < fifo->held; i++) {
+    nblex_free(fifo->ring[i]);
+    fifo->ring[i] = NULL;
+  }
+  return sum;
+}
+
+static uint64_t run_pool(fifo_t* fifo, nblex_pool_t* pool, size_t count) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_buffer_entry** slot = &fifo->ring[i % fifo->held];
+    if (*slot) {
+      sum += (*slot)->size;
+      nblex_pool_free(pool, *slot);
+    }
+    *slot = nblex_pool_calloc(pool);
+    (*slot)->size = i;
+  }
+  for (size_t i = 0; i < fifo->held; i++) {
+    nblex_pool_free(pool, fifo->ring[i]);
+    fifo->ring[i] = NULL;
+  }
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 10000000);
+  static const size_t helds[] = { 100, 10000, 1000000 };
+  uint64_t sum = 0;
+
+  for (size_t h = 0; h < sizeof(helds) / sizeof(helds[0]); h++) {
+    fifo_t fifo = { calloc(helds[h], sizeof(nblex_event_buffer_entry*)), helds[h] };
+    nblex_pool_t* pool = nblex_pool_new(sizeof(nblex_event_buffer_entry), true);
+    if (!fifo.ring || !pool) {
+      fprintf(stderr, "Failed to allocate buffer\n");
+      return 1;
+    }
+    char name[64];
+
+    uint64_t start = nblex_timestamp_now();
+    sum += run_malloc(&fifo, count);
+    snprintf(name, sizeof(name), "malloc, %zu held", helds[h]);
+    bench_report(name, count, nblex_timestamp_now() - start);
+
+    start = nblex_timestamp_now();
+    sum += run_pool(&fifo, pool, count);
+    snprintf(name, sizeof(name), "pool, %zu held", helds[h]);
+    bench_report(name, count, nblex_timestamp_now() - start);
+
+    nblex_pool_detach(pool);
+    free(fifo.ring);
+  }
+
+  return sum == 0 ? 1 : 0;
+}
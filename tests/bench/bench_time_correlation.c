@@ -0,0 +1,67 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * bench_time_correlation.c - Time correlator cost as its buffers fill
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+#include "bench_helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Log and network events alternate 1ms apart with a 1ms window, so each
+ * event matches one or two others while the buffers (never expired
+ * here) fill towards their 10000-event cap */
+#define BLOCK 1000
+
+static void discard_handler(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+}
+
+int main(int argc, char** argv) {
+  size_t count = bench_parse_count(argc, argv, 20000);
+
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0) {
+    fprintf(stderr, "Failed to create world\n");
+    return 1;
+  }
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, discard_handler, NULL);
+  nblex_correlation* corr = nblex_correlation_new(world);
+  nblex_correlation_add_strategy(corr, NBLEX_CORR_TIME_BASED, 1);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  if (!input || !corr || !events) {
+    fprintf(stderr, "Failed to allocate events\n");
+    return 1;
+  }
+  for (size_t i = 0; i < count; i++) {
+    events[i] = bench_build_log_event(input, i, 16);
+    events[i]->type = (i % 2) == 0 ? NBLEX_EVENT_LOG : NBLEX_EVENT_NETWORK;
+    events[i]->timestamp_ns = 1000000000000ULL + (uint64_t)i * 1000000ULL;
+  }
+
+  for (size_t block = 0; block * BLOCK < count; block++) {
+    size_t first = block * BLOCK;
+    size_t last = first + BLOCK < count ? first + BLOCK : count;
+    uint64_t start = nblex_timestamp_now();
+    for (size_t i = first; i < last; i++) {
+      nblex_correlation_process_event(corr, events[i]);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "buffered %zu-%zu", first, last);
+    bench_report(name, last - first, nblex_timestamp_now() - start);
+  }
+  printf("correlations: %llu\n", (unsigned long long)corr->correlations_found);
+
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_correlation_free(corr);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return 0;
+}
@@ -0,0 +1,383 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * test_checkpoint.c - Unit tests for checkpoint and restore of query state
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+/* Feature test macros must be defined before any system headers */
+#ifndef __APPLE__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
+#include <check.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/nblex_internal.h"
+#include "test_helpers.h"
+
+Suite* checkpoint_suite(void);
+
+/* Epoch milliseconds, aligned to an hour */
+#define BASE_MS 1699999200000ULL
+#define MINUTE_MS 60000ULL
+#define MS 1000000ULL
+
+static const char* window_queries[] = {
+  "aggregate count(), percentile(latency, 95), distinct(user) by service window tumbling(1h)",
+  "aggregate count(), sum(latency) by service window sliding(1h, 30m)",
+  "aggregate count(), max(latency) by service window session(10m)"
+};
+
+/* Source events read from inputs */
+static size_t source_events;
+
+/* Run every query on source events; capture what they emit */
+static void run_queries_handler(nblex_event* event, void* user_data) {
+  nblex_world* world = (nblex_world*)user_data;
+  if (event->input) {
+    source_events++;
+    nql_execute_all(world, event, NULL, NULL);
+  } else {
+    test_capture_event_handler(event, NULL);
+  }
+}
+
+/* Helper: A started world in event time mode tailing a JSON log, running
+ * the window queries and checkpointing on request only
+ */
+static nblex_world* start_world(const char* log_path, const char* checkpoint_path) {
+  nblex_world* world = nblex_world_new();
+  if (!world || nblex_world_open(world) != 0 ||
+      nblex_world_set_event_time(world, "ts", 0) != 0 ||
+      nblex_world_set_checkpoint(world, checkpoint_path, 0) != 0) {
+    return NULL;
+  }
+  nblex_input* input = nblex_input_file_new(world, log_path);
+  if (!input || nblex_input_set_format(input, NBLEX_FORMAT_JSON) != 0) {
+    return NULL;
+  }
+  for (size_t i = 0; i < sizeof(window_queries) / sizeof(window_queries[0]); i++) {
+    if (nql_register(world, window_queries[i], NULL) < 0) {
+      return NULL;
+    }
+  }
+  nblex_set_event_handler(world, run_queries_handler, world);
+  source_events = 0;
+  test_reset_captured_events();
+  return nblex_world_start(world) == 0 ? world : NULL;
+}
+
+/* Helper: Append a log line */
+static void append_log(const char* path, uint64_t minute, const char* service,
+                       int latency, const char* user) {
+  FILE* file = fopen(path, "a");
+  if (!file) {
+    return;
+  }
+  fprintf(file, "{\"ts\":%llu,\"service\":\"%s\",\"latency\":%d,\"user\":\"%s\"}\n",
+          (unsigned long long)(BASE_MS + minute * MINUTE_MS), service, latency, user);
+  fclose(file);
+}
+
+/* Helper: Run the loop until inputs have read `count` events */
+static bool pump_until(nblex_world* world, size_t count) {
+  for (int i = 0; i < 500 && source_events < count; i++) {
+    uv_run(world->loop, UV_RUN_NOWAIT);
+    usleep(10000);
+  }
+  return source_events == count;
+}
+
+/* Helper: The captured result for a service that has a given metric */
+static json_t* find_result(const char* service, const char* metric) {
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    json_t* data = test_captured_events[i]->data;
+    json_t* group = json_object_get(data, "group");
+    json_t* metrics = json_object_get(data, "metrics");
+    if (group && metrics && json_object_get(metrics, metric) &&
+        strcmp(json_string_value(json_object_get(group, "service")), service) == 0) {
+      return metrics;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(test_checkpoint_kill_and_restart_mid_window) {
+  char dir[] = "/tmp/nblex_checkpoint_XXXXXX";
+  ck_assert_ptr_ne(mkdtemp(dir), NULL);
+  char log_path[64];
+  char checkpoint_path[64];
+  snprintf(log_path, sizeof(log_path), "%s/app.jsonl", dir);
+  snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/state.ckpt", dir);
+  fclose(fopen(log_path, "w"));
+
+  /* First run: checkpoint after four events, read two more, get killed */
+  pid_t pid = fork();
+  ck_assert_int_ge(pid, 0);
+  if (pid == 0) {
+    nblex_world* world = start_world(log_path, checkpoint_path);
+    if (!world) {
+      _exit(1);
+    }
+    append_log(log_path, 1, "api", 10, "u1");
+    append_log(log_path, 2, "db", 20, "u2");
+    append_log(log_path, 3, "api", 30, "u2");
+    append_log(log_path, 5, "api", 40, "u3");
+    if (!pump_until(world, 4) || nblex_world_checkpoint(world) != 0) {
+      _exit(1);
+    }
+    append_log(log_path, 6, "db", 50, "u1");
+    append_log(log_path, 7, "api", 60, "u1");
+    if (!pump_until(world, 6) || test_captured_events_count != 0) {
+      _exit(1);
+    }
+    raise(SIGKILL);
+    _exit(1);
+  }
+  int status;
+  ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+  ck_assert(WIFSIGNALED(status));
+  ck_assert_int_eq(WTERMSIG(status), SIGKILL);
+
+  /* Restart: windows come back, and the two events read after the
+   * checkpoint are read again */
+  nblex_world* world = start_world(log_path, checkpoint_path);
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_uint_eq(world->event_time.watermark_ns, (BASE_MS + 5 * MINUTE_MS) * MS);
+  ck_assert(pump_until(world, 2));
+  ck_assert_uint_eq(test_captured_events_count, 0);
+
+  /* Two hours on, every window of the first hour closes */
+  append_log(log_path, 130, "api", 70, "u4");
+  ck_assert(pump_until(world, 3));
+
+  json_t* tumbling = find_result("api", "distinct_user");
+  ck_assert_ptr_ne(tumbling, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "count")), 4);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "distinct_user")), 3);
+  ck_assert_double_eq_tol(json_real_value(json_object_get(tumbling, "p95_latency")), 60.0, 1.0);
+  tumbling = find_result("db", "distinct_user");
+  ck_assert_ptr_ne(tumbling, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "count")), 2);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "distinct_user")), 2);
+
+  json_t* sliding = find_result("api", "latency");
+  ck_assert_ptr_ne(sliding, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(sliding, "count")), 4);
+  ck_assert_double_eq(json_real_value(json_object_get(sliding, "latency")), 140.0);
+
+  json_t* session = find_result("db", "max_latency");
+  ck_assert_ptr_ne(session, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(session, "count")), 2);
+  ck_assert_double_eq(json_real_value(json_object_get(session, "max_latency")), 50.0);
+  session = find_result("api", "max_latency");
+  ck_assert_ptr_ne(session, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(session, "count")), 4);
+
+  /* Stopping writes a final checkpoint over the old one */
+  ck_assert_int_eq(nblex_world_stop(world), 0);
+  nblex_world_free(world);
+  char tmp_path[80];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", checkpoint_path);
+  struct stat st;
+  ck_assert_int_eq(stat(checkpoint_path, &st), 0);
+  ck_assert_int_ne(stat(tmp_path, &st), 0);
+
+  unlink(checkpoint_path);
+  unlink(log_path);
+  rmdir(dir);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_checkpoint_stop_and_restart) {
+  char dir[] = "/tmp/nblex_checkpoint_XXXXXX";
+  ck_assert_ptr_ne(mkdtemp(dir), NULL);
+  char log_path[64];
+  char checkpoint_path[64];
+  snprintf(log_path, sizeof(log_path), "%s/app.jsonl", dir);
+  snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/state.ckpt", dir);
+  fclose(fopen(log_path, "w"));
+
+  /* First run: stopping closes the open windows and emits them */
+  nblex_world* world = start_world(log_path, checkpoint_path);
+  ck_assert_ptr_ne(world, NULL);
+  append_log(log_path, 1, "api", 10, "u1");
+  append_log(log_path, 2, "api", 20, "u2");
+  ck_assert(pump_until(world, 2));
+  ck_assert_uint_eq(test_captured_events_count, 0);
+  ck_assert_int_eq(nblex_world_stop(world), 0);
+  json_t* tumbling = find_result("api", "distinct_user");
+  ck_assert_ptr_ne(tumbling, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "count")), 2);
+  nblex_world_free(world);
+
+  /* Restart: the checkpoint holds the watermark the events reached and
+   * none of the windows already emitted */
+  world = start_world(log_path, checkpoint_path);
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_uint_eq(world->event_time.watermark_ns, (BASE_MS + 2 * MINUTE_MS) * MS);
+
+  /* Two hours on, nothing of the first hour is emitted again */
+  append_log(log_path, 130, "api", 30, "u3");
+  ck_assert(pump_until(world, 1));
+  ck_assert_uint_eq(test_captured_events_count, 0);
+  ck_assert_uint_eq(world->event_time.late_dropped, 0);
+
+  ck_assert_int_eq(nblex_world_stop(world), 0);
+  tumbling = find_result("api", "distinct_user");
+  ck_assert_ptr_ne(tumbling, NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(tumbling, "count")), 1);
+  nblex_world_free(world);
+
+  unlink(checkpoint_path);
+  unlink(log_path);
+  rmdir(dir);
+  test_reset_captured_events();
+}
+END_TEST
+
+/* Helper: A world with a correlation query, checkpointing to a path */
+static nblex_world* new_correlation_world(const char* checkpoint_path, nql_prepared_t** prepared_out) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_set_checkpoint(world, checkpoint_path, 0), 0);
+  *prepared_out = nql_prepare("correlate level == \"ERROR\" with dst_port == 5432 within 1s", world);
+  ck_assert_ptr_ne(*prepared_out, NULL);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+  return world;
+}
+
+/* Helper: Run a query on an event with one field */
+static void execute_event(nql_prepared_t* prepared, const char* field, json_t* value) {
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, NULL);
+  event->data = json_object();
+  json_object_set_new(event->data, field, value);
+  nql_execute_prepared(prepared, event);
+  nblex_event_free(event);
+}
+
+START_TEST(test_checkpoint_correlation_and_corruption) {
+  char path[] = "/tmp/nblex_checkpoint_XXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  unlink(path);
+
+  /* No checkpoint yet is a fresh start */
+  nql_prepared_t* prepared;
+  nblex_world* world = new_correlation_world(path, &prepared);
+  ck_assert_int_eq(nblex_world_restore(world), 0);
+  execute_event(prepared, "level", json_string("ERROR"));
+  ck_assert_int_eq(nblex_world_checkpoint(world), 0);
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+
+  /* The buffered left event survives into a new world */
+  world = new_correlation_world(path, &prepared);
+  ck_assert_int_eq(nblex_world_restore(world), 0);
+  execute_event(prepared, "dst_port", json_integer(5432));
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  json_t* left = json_object_get(test_captured_events[0]->data, "left_event");
+  ck_assert_str_eq(json_string_value(json_object_get(left, "level")), "ERROR");
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+
+  /* A damaged checkpoint is rejected whole */
+  FILE* file = fopen(path, "r+b");
+  ck_assert_ptr_ne(file, NULL);
+  fseek(file, -12, SEEK_END);
+  int byte = fgetc(file);
+  fseek(file, -12, SEEK_END);
+  fputc(byte ^ 0xff, file);
+  fclose(file);
+
+  world = new_correlation_world(path, &prepared);
+  ck_assert_int_ne(nblex_world_restore(world), 0);
+  execute_event(prepared, "dst_port", json_integer(5432));
+  ck_assert_uint_eq(test_captured_events_count, 0);
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+
+  /* As is a truncated one */
+  ck_assert_int_eq(truncate(path, 20), 0);
+  world = new_correlation_world(path, &prepared);
+  ck_assert_int_ne(nblex_world_restore(world), 0);
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+
+  unlink(path);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_checkpoint_periodic) {
+  char path[] = "/tmp/nblex_checkpoint_XXXXXX";
+  int fd = mkstemp(path);
+  ck_assert_int_ge(fd, 0);
+  close(fd);
+  unlink(path);
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_set_checkpoint(world, path, 20), 0);
+  ck_assert_int_eq(nql_register(world, "aggregate count() by service window tumbling(1h)", NULL), 0);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  /* Cannot be changed once started */
+  ck_assert_int_ne(nblex_world_set_checkpoint(world, NULL, 0), 0);
+
+  struct stat st;
+  for (int i = 0; i < 100 && stat(path, &st) != 0; i++) {
+    uv_run(world->loop, UV_RUN_NOWAIT);
+    usleep(10000);
+  }
+  ck_assert_int_eq(stat(path, &st), 0);
+  ck_assert_int_gt(st.st_size, 0);
+
+  nblex_world_free(world);
+  unlink(path);
+}
+END_TEST
+
+Suite* checkpoint_suite(void) {
+  Suite* s = suite_create("Checkpoint");
+
+  TCase* tc_core = tcase_create("Core");
+  tcase_set_timeout(tc_core, 30);
+  tcase_add_test(tc_core, test_checkpoint_kill_and_restart_mid_window);
+  tcase_add_test(tc_core, test_checkpoint_stop_and_restart);
+  tcase_add_test(tc_core, test_checkpoint_correlation_and_corruption);
+  tcase_add_test(tc_core, test_checkpoint_periodic);
+  suite_add_tcase(s, tc_core);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite* s = checkpoint_suite();
+  SRunner* sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -92,7 +92,8 @@ START_TEST(test_config_load_with_inputs) {
     "    - name: app_logs\n"
     "      type: file\n"
     "      path: /var/log/app.log\n"
-    "      format: json\n";
+    "      format: json\n"
+    "      priority: 2\n";
   
   char* path = create_temp_yaml(yaml);
   ck_assert_ptr_ne(path, NULL);
@@ -159,8 +160,11 @@ START_TEST(test_config_load_with_performance) {
     "version: \"1.0\"\n"
     "performance:\n"
     "  worker_threads: 8\n"
+    "  batch_size: 128\n"
     "  buffer_size: 128MB\n"
-    "  memory_limit: 2GB\n";
+    "  memory_limit: 2GB\n"
+    "  query_memory_limit: 64KB\n"
+    "  evict_policy: fold\n";
   
   char* path = create_temp_yaml(yaml);
   ck_assert_ptr_ne(path, NULL);
@@ -170,10 +174,21 @@ START_TEST(test_config_load_with_performance) {
   /* Test via getter functions */
   int threads = nblex_config_get_int(config, "performance.worker_threads", 4);
   ck_assert_int_eq(threads, 8);
+  ck_assert_int_eq(nblex_config_get_int(config, "performance.batch_size", 0), 128);
   size_t buffer = nblex_config_get_size(config, "performance.buffer_size", 0);
   ck_assert_int_eq(buffer, 128 * 1024 * 1024);
   size_t memory = nblex_config_get_size(config, "performance.memory_limit", 0);
   ck_assert_int_eq(memory, 2UL * 1024 * 1024 * 1024);
+  ck_assert_uint_eq(nblex_config_get_size(config, "performance.query_memory_limit", 0),
+                    64 * 1024);
+  ck_assert_str_eq(nblex_config_get_string(config, "performance.evict_policy"), "fold");
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_config_apply(config, world), 0);
+  ck_assert_uint_eq(world->query_memory_limit, 64 * 1024);
+  ck_assert_int_eq(world->query_evict_policy, NBLEX_EVICT_FOLD);
+  nblex_world_free(world);
   
   nblex_config_free(config);
   unlink(path);
@@ -181,6 +196,144 @@ START_TEST(test_config_load_with_performance) {
 }
 END_TEST
 
+START_TEST(test_config_load_with_event_time) {
+  const char* yaml =
+    "version: \"1.0\"\n"
+    "event_time:\n"
+    "  enabled: true\n"
+    "  field: ts\n"
+    "  max_delay_ms: 5000\n"
+    "  late_policy: update\n"
+    "  allowed_lateness_ms: 60000\n";
+
+  char* path = create_temp_yaml(yaml);
+  ck_assert_ptr_ne(path, NULL);
+
+  nblex_config_t* config = nblex_config_load_yaml(path);
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_int_eq(nblex_config_get_int(config, "event_time.enabled", 0), 1);
+  ck_assert_str_eq(nblex_config_get_string(config, "event_time.field"), "ts");
+  ck_assert_int_eq(nblex_config_get_int(config, "event_time.max_delay_ms", 0), 5000);
+  ck_assert_str_eq(nblex_config_get_string(config, "event_time.late_policy"), "update");
+  ck_assert_int_eq(nblex_config_get_int(config, "event_time.allowed_lateness_ms", 0), 60000);
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_config_apply(config, world), 0);
+  ck_assert(world->event_time.enabled);
+  ck_assert_str_eq(world->event_time.field, "ts");
+  ck_assert_uint_eq(world->event_time.max_delay_ns, 5000000000ULL);
+  ck_assert_int_eq(world->event_time.late_policy, NBLEX_LATE_UPDATE);
+  ck_assert_uint_eq(world->event_time.allowed_lateness_ns, 60000000000ULL);
+
+  nblex_world_free(world);
+  nblex_config_free(config);
+  unlink(path);
+  free(path);
+}
+END_TEST
+
+START_TEST(test_config_load_with_checkpoint) {
+  const char* yaml =
+    "version: \"1.0\"\n"
+    "checkpoint:\n"
+    "  path: /tmp/nblex_test_state.ckpt\n"
+    "  interval_ms: 5000\n";
+
+  char* path = create_temp_yaml(yaml);
+  ck_assert_ptr_ne(path, NULL);
+
+  nblex_config_t* config = nblex_config_load_yaml(path);
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_str_eq(nblex_config_get_string(config, "checkpoint.path"), "/tmp/nblex_test_state.ckpt");
+  ck_assert_int_eq(nblex_config_get_int(config, "checkpoint.interval_ms", 0), 5000);
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_config_apply(config, world), 0);
+  ck_assert_ptr_ne(world->checkpoint, NULL);
+
+  nblex_world_free(world);
+  nblex_config_free(config);
+  unlink(path);
+  free(path);
+}
+END_TEST
+
+START_TEST(test_config_load_with_id_correlation) {
+  const char* yaml =
+    "version: \"1.0\"\n"
+    "correlation:\n"
+    "  enabled: true\n"
+    "  strategy: id_based\n"
+    "  window_ms: 30000\n"
+    "  log_id_fields: request_id, trace_id\n"
+    "  network_id_fields: http.headers.x-request-id\n";
+
+  char* path = create_temp_yaml(yaml);
+  ck_assert_ptr_ne(path, NULL);
+
+  nblex_config_t* config = nblex_config_load_yaml(path);
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_str_eq(nblex_config_get_string(config, "correlation.strategy"), "id_based");
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_config_apply(config, world), 0);
+  ck_assert_int_eq(world->correlation->type, NBLEX_CORR_ID_BASED);
+  ck_assert_uint_eq(world->correlation->window_ns, 30000 * 1000000ULL);
+  ck_assert_uint_eq(world->correlation->log_id_fields_count, 2);
+  ck_assert_str_eq(world->correlation->log_id_fields[1], "trace_id");
+  ck_assert_uint_eq(world->correlation->network_id_fields_count, 1);
+  ck_assert_str_eq(world->correlation->network_id_fields[0], "http.headers.x-request-id");
+
+  nblex_world_free(world);
+  nblex_config_free(config);
+  unlink(path);
+  free(path);
+}
+END_TEST
+
+START_TEST(test_config_load_with_connection_correlation) {
+  const char* yaml =
+    "version: \"1.0\"\n"
+    "correlation:\n"
+    "  enabled: true\n"
+    "  strategy: connection\n"
+    "  peer_ip_field: client_ip\n"
+    "  peer_port_field: client_port\n"
+    "  flow_idle_timeout_ms: 120000\n"
+    "  max_flows: 1000\n"
+    "  coalesce: true\n"
+    "  max_matches: 5\n";
+
+  char* path = create_temp_yaml(yaml);
+  ck_assert_ptr_ne(path, NULL);
+
+  nblex_config_t* config = nblex_config_load_yaml(path);
+  ck_assert_ptr_ne(config, NULL);
+  ck_assert_int_eq(nblex_config_get_int(config, "correlation.max_flows", 0), 1000);
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_config_apply(config, world), 0);
+  ck_assert_int_eq(world->correlation->type, NBLEX_CORR_CONNECTION);
+  ck_assert_str_eq(world->correlation->peer_ip_field, "client_ip");
+  ck_assert_str_eq(world->correlation->peer_port_field, "client_port");
+  ck_assert_uint_eq(world->correlation->flow_idle_ns, 120000 * 1000000ULL);
+  ck_assert_uint_eq(world->correlation->max_flows, 1000);
+  ck_assert(world->correlation->coalesce);
+  ck_assert_uint_eq(world->correlation->max_matches, 5);
+
+  nblex_world_free(world);
+  nblex_config_free(config);
+  unlink(path);
+  free(path);
+}
+END_TEST
+
 START_TEST(test_config_load_defaults) {
   const char* yaml = "version: \"1.0\"\n";
   char* path = create_temp_yaml(yaml);
@@ -195,7 +348,7 @@ START_TEST(test_config_load_defaults) {
   int window = nblex_config_get_int(config, "correlation.window_ms", 0);
   ck_assert_int_eq(window, 100);
   int threads = nblex_config_get_int(config, "performance.worker_threads", 0);
-  ck_assert_int_eq(threads, 4);
+  ck_assert_int_eq(threads, 1);
   size_t buffer = nblex_config_get_size(config, "performance.buffer_size", 0);
   ck_assert_int_eq(buffer, 64 * 1024 * 1024);
   size_t memory = nblex_config_get_size(config, "performance.memory_limit", 0);
@@ -392,7 +545,11 @@ Suite* config_suite(void) {
   tcase_add_test(tc_load, test_config_load_with_inputs);
   tcase_add_test(tc_load, test_config_load_with_outputs);
   tcase_add_test(tc_load, test_config_load_with_correlation);
+  tcase_add_test(tc_load, test_config_load_with_id_correlation);
+  tcase_add_test(tc_load, test_config_load_with_connection_correlation);
   tcase_add_test(tc_load, test_config_load_with_performance);
+  tcase_add_test(tc_load, test_config_load_with_event_time);
+  tcase_add_test(tc_load, test_config_load_with_checkpoint);
   tcase_add_test(tc_load, test_config_load_defaults);
   
   TCase* tc_free = tcase_create("Free");
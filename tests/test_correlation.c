@@ -37,10 +37,8 @@ START_TEST(test_correlation_new) {
   ck_assert_ptr_eq(corr->world, world);
   ck_assert_int_eq(corr->type, NBLEX_CORR_TIME_BASED);
   ck_assert_int_eq(corr->window_ns, 100 * 1000000ULL);
-  ck_assert_ptr_eq(corr->log_events, NULL);
-  ck_assert_ptr_eq(corr->network_events, NULL);
-  ck_assert_int_eq(corr->log_events_count, 0);
-  ck_assert_int_eq(corr->network_events_count, 0);
+  ck_assert_int_eq(corr->log_events.count, 0);
+  ck_assert_int_eq(corr->network_events.count, 0);
   ck_assert_int_eq(corr->correlations_found, 0);
   ck_assert_int_eq(corr->timer_initialized, 0);
   
@@ -164,8 +162,7 @@ START_TEST(test_correlation_process_log_event) {
   nblex_correlation_process_event(corr, log_event);
   
   /* Event should be buffered */
-  ck_assert_int_eq(corr->log_events_count, 1);
-  ck_assert_ptr_ne(corr->log_events, NULL);
+  ck_assert_int_eq(corr->log_events.count, 1);
   
   nblex_event_free(log_event);
   nblex_input_free(input);
@@ -194,8 +191,7 @@ START_TEST(test_correlation_process_network_event) {
   nblex_correlation_process_event(corr, net_event);
   
   /* Event should be buffered */
-  ck_assert_int_eq(corr->network_events_count, 1);
-  ck_assert_ptr_ne(corr->network_events, NULL);
+  ck_assert_int_eq(corr->network_events.count, 1);
   
   nblex_event_free(net_event);
   nblex_input_free(input);
@@ -232,12 +228,12 @@ START_TEST(test_correlation_time_based_match) {
   
   /* Process log event first */
   nblex_correlation_process_event(corr, log_event);
-  ck_assert_int_eq(corr->log_events_count, 1);
+  ck_assert_int_eq(corr->log_events.count, 1);
   
   /* Process network event - should correlate */
   nblex_correlation_process_event(corr, net_event);
   ck_assert_int_eq(corr->correlations_found, 1);
-  ck_assert_int_eq(corr->network_events_count, 1);
+  ck_assert_int_eq(corr->network_events.count, 1);
   
   /* Check that correlation event was emitted */
   ck_assert_ptr_ne(test_captured_event, NULL);
@@ -349,6 +345,274 @@ START_TEST(test_correlation_bidirectional_matching) {
 }
 END_TEST
 
+START_TEST(test_correlation_out_of_order_and_expire) {
+  nblex_world* world = nblex_world_new();
+  nblex_world_open(world);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nblex_correlation* corr = nblex_correlation_new(world);
+  nblex_correlation_add_strategy(corr, NBLEX_CORR_TIME_BASED, 100);
+
+  /* Long past, so the wall clock expires everything below */
+  uint64_t base_time = 1000000000ULL;
+  uint64_t log_offsets_ms[] = { 30, 10, 20, 10 };
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  for (size_t i = 0; i < sizeof(log_offsets_ms) / sizeof(log_offsets_ms[0]); i++) {
+    nblex_event* log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    log_event->timestamp_ns = base_time + log_offsets_ms[i] * 1000000ULL;
+    log_event->data = json_object();
+    json_object_set_new(log_event->data, "seq", json_integer((json_int_t)i));
+    nblex_correlation_process_event(corr, log_event);
+    nblex_event_free(log_event);
+  }
+
+  /* Late events are kept in time order, equal times in arrival order */
+  ck_assert_int_eq(corr->log_events.count, 4);
+  json_int_t expected_seq[] = { 1, 3, 2, 0 };
+  for (size_t i = 0; i < 4; i++) {
+    nblex_event_buffer_entry* entry =
+        &corr->log_events.entries[(corr->log_events.head + i) & (corr->log_events.capacity - 1)];
+    ck_assert_int_eq(json_integer_value(json_object_get(entry->event->data, "seq")),
+                     expected_seq[i]);
+  }
+
+  /* Only the log event at 30ms is within 100ms of one at 130ms */
+  nblex_event* net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time + 130 * 1000000ULL;
+  net_event->data = json_object();
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+  ck_assert_int_eq(corr->correlations_found, 1);
+
+  nblex_correlation_expire(corr);
+  ck_assert_int_eq(corr->log_events.count, 0);
+  ck_assert_int_eq(corr->network_events.count, 0);
+  ck_assert_uint_eq(corr->buffered_bytes, 0);
+
+  nblex_input_free(input);
+  nblex_correlation_free(corr);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_correlation_id_based_match) {
+  nblex_world* world = nblex_world_new();
+  nblex_world_open(world);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nblex_correlation* corr = nblex_correlation_new(world);
+  ck_assert_int_eq(nblex_correlation_add_strategy(corr, NBLEX_CORR_ID_BASED, 1000), 0);
+  ck_assert_int_eq(nblex_correlation_add_id_field(corr, NBLEX_EVENT_LOG, "req"), 0);
+  ck_assert_int_eq(nblex_correlation_add_id_field(corr, NBLEX_EVENT_NETWORK,
+                                                  "http.headers.x-request-id"), 0);
+  ck_assert_int_ne(nblex_correlation_add_id_field(corr, NBLEX_EVENT_CORRELATION, "req"), 0);
+
+  /* Long past, so the wall clock expires everything below */
+  uint64_t base_time = 1000000000ULL;
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_event* log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  log_event->timestamp_ns = base_time;
+  log_event->data = json_pack("{s:s, s:s}", "req", "abc", "level", "ERROR");
+  nblex_correlation_process_event(corr, log_event);
+  nblex_event_free(log_event);
+
+  /* Far apart in time, but the same ID within the window */
+  nblex_event* net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time + 800 * 1000000ULL;
+  net_event->data = json_pack("{s:{s:{s:s}}}", "http", "headers", "x-request-id", "abc");
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+
+  ck_assert_int_eq(corr->correlations_found, 1);
+  ck_assert_ptr_ne(test_captured_event, NULL);
+  ck_assert_str_eq(json_string_value(json_object_get(test_captured_event->data,
+                                                     "correlation_type")), "id_based");
+  ck_assert_str_eq(json_string_value(json_object_get(test_captured_event->data, "id")), "abc");
+
+  /* Another ID does not match, and the Bloom filter answers for it */
+  net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time + 10 * 1000000ULL;
+  net_event->data = json_pack("{s:s}", "http.headers.x-request-id", "xyz");
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+  ck_assert_int_eq(corr->correlations_found, 1);
+  ck_assert_uint_ge(corr->id_bloom_rejects, 1);
+
+  /* Events without an ID are not buffered */
+  size_t buffered = corr->buffered_bytes;
+  net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time;
+  net_event->data = json_pack("{s:i}", "dst_port", 443);
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+  ck_assert_uint_eq(corr->buffered_bytes, buffered);
+  ck_assert_uint_gt(buffered, 0);
+
+  nblex_correlation_expire(corr);
+  ck_assert_uint_eq(corr->buffered_bytes, 0);
+
+  nblex_input_free(input);
+  nblex_correlation_free(corr);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_correlation_connection_match) {
+  nblex_world* world = nblex_world_new();
+  nblex_world_open(world);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nblex_correlation* corr = nblex_correlation_new(world);
+  ck_assert_int_eq(nblex_correlation_add_strategy(corr, NBLEX_CORR_CONNECTION, 100), 0);
+  ck_assert_int_eq(nblex_correlation_set_peer_fields(corr, "client.ip", "client.port"), 0);
+  ck_assert_int_eq(nblex_correlation_set_flow_limits(corr, 0, 2), 0);
+
+  /* Long past, so the wall clock expires everything below */
+  uint64_t base_time = 1000000000ULL;
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  /* Both directions of one connection, from packet fields */
+  nblex_event* net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time;
+  net_event->data = json_pack("{s:s, s:s, s:s, s:i, s:i, s:i}",
+                              "protocol", "tcp", "ip_src", "10.0.0.5", "ip_dst", "10.0.0.1",
+                              "tcp_src_port", 51000, "tcp_dst_port", 443, "length", 60);
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+
+  net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  net_event->timestamp_ns = base_time + 5 * 1000000ULL;
+  net_event->data = json_pack("{s:i}", "length", 1500);
+  net_event->flow.protocol = IPPROTO_TCP;
+  inet_pton(AF_INET, "10.0.0.1", &net_event->flow.addr[0][12]);
+  memset(&net_event->flow.addr[0][10], 0xff, 2);
+  inet_pton(AF_INET, "10.0.0.5", &net_event->flow.addr[1][12]);
+  memset(&net_event->flow.addr[1][10], 0xff, 2);
+  net_event->flow.port[0] = 443;
+  net_event->flow.port[1] = 51000;
+  nblex_flow_key_normalize(&net_event->flow);
+  nblex_correlation_process_event(corr, net_event);
+  nblex_event_free(net_event);
+
+  /* Long after the time window, but the connection is still live */
+  nblex_event* log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  log_event->timestamp_ns = base_time + 2000 * 1000000ULL;
+  log_event->data = json_pack("{s:{s:s, s:s}}", "client", "ip", "10.0.0.5", "port", "51000");
+  nblex_correlation_process_event(corr, log_event);
+  nblex_event_free(log_event);
+
+  ck_assert_int_eq(corr->correlations_found, 1);
+  ck_assert_ptr_ne(test_captured_event, NULL);
+  json_t* data = test_captured_event->data;
+  ck_assert_str_eq(json_string_value(json_object_get(data, "correlation_type")), "connection");
+  json_t* flow = json_object_get(data, "flow");
+  ck_assert_str_eq(json_string_value(json_object_get(flow, "peer_ip")), "10.0.0.5");
+  ck_assert_int_eq(json_integer_value(json_object_get(flow, "peer_port")), 51000);
+  ck_assert_str_eq(json_string_value(json_object_get(flow, "local_ip")), "10.0.0.1");
+  ck_assert_int_eq(json_integer_value(json_object_get(flow, "local_port")), 443);
+  ck_assert_int_eq(json_integer_value(json_object_get(flow, "packets")), 2);
+  ck_assert_int_eq(json_integer_value(json_object_get(flow, "bytes")), 1560);
+
+  /* Another client port on the same host has no flow */
+  log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  log_event->timestamp_ns = base_time;
+  log_event->data = json_pack("{s:{s:s, s:i}}", "client", "ip", "10.0.0.5", "port", 51001);
+  nblex_correlation_process_event(corr, log_event);
+  nblex_event_free(log_event);
+  ck_assert_int_eq(corr->correlations_found, 1);
+
+  /* Two more flows at a cap of two evict the first */
+  for (int i = 0; i < 2; i++) {
+    net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+    net_event->timestamp_ns = base_time + (uint64_t)(10 + i) * 1000000ULL;
+    net_event->data = json_pack("{s:s, s:s, s:s, s:i, s:i}",
+                                "protocol", "udp", "ip_src", "fd00::2", "ip_dst", "fd00::1",
+                                "udp_src_port", 40000 + i, "udp_dst_port", 53);
+    nblex_correlation_process_event(corr, net_event);
+    nblex_event_free(net_event);
+  }
+  ck_assert_uint_eq(corr->flows_evicted, 1);
+
+  log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  log_event->timestamp_ns = base_time + 20 * 1000000ULL;
+  log_event->data = json_pack("{s:{s:s, s:i}}", "client", "ip", "10.0.0.5", "port", 51000);
+  nblex_correlation_process_event(corr, log_event);
+  nblex_event_free(log_event);
+  ck_assert_int_eq(corr->correlations_found, 1);
+
+  /* Idle flows expire */
+  nblex_correlation_expire(corr);
+  ck_assert_uint_eq(corr->flows_expired, 2);
+
+  nblex_input_free(input);
+  nblex_correlation_free(corr);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_correlation_coalesced_output) {
+  nblex_world* world = nblex_world_new();
+  nblex_world_open(world);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nblex_correlation* corr = nblex_correlation_new(world);
+  ck_assert_int_eq(nblex_correlation_add_strategy(corr, NBLEX_CORR_TIME_BASED, 100), 0);
+  ck_assert_int_eq(nblex_correlation_set_coalesce(corr, true, 3), 0);
+
+  /* A burst of ten packets, 10ms apart */
+  uint64_t base_time = 1000000000ULL;
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  for (int i = 0; i < 10; i++) {
+    nblex_event* net_event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+    net_event->timestamp_ns = base_time + (uint64_t)i * 10 * 1000000ULL;
+    net_event->data = json_pack("{s:i, s:i}", "seq", i, "length", 100);
+    nblex_correlation_process_event(corr, net_event);
+    nblex_event_free(net_event);
+  }
+
+  /* One log in the middle matches all ten, in one correlation */
+  nblex_event* log_event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  log_event->timestamp_ns = base_time + 45 * 1000000ULL;
+  log_event->data = json_pack("{s:s}", "level", "ERROR");
+  nblex_correlation_process_event(corr, log_event);
+  nblex_event_free(log_event);
+
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  ck_assert_int_eq(corr->correlations_found, 10);
+  ck_assert_uint_eq(corr->pairs_dropped, 7);
+
+  json_t* data = test_captured_event->data;
+  ck_assert_str_eq(json_string_value(json_object_get(data, "correlation_type")), "time_based");
+  ck_assert_ptr_ne(json_object_get(data, "log"), NULL);
+  ck_assert_int_eq(json_integer_value(json_object_get(data, "match_count")), 10);
+  ck_assert_int_eq(json_integer_value(json_object_get(data, "matches_dropped")), 7);
+  ck_assert_int_eq(json_integer_value(json_object_get(data, "bytes")), 1000);
+  ck_assert_double_eq_tol(json_real_value(json_object_get(data, "min_time_diff_ms")), -45.0, 0.001);
+  ck_assert_double_eq_tol(json_real_value(json_object_get(data, "max_time_diff_ms")), 45.0, 0.001);
+
+  /* Closest first; ties go to the older */
+  json_t* matches = json_object_get(data, "matches");
+  ck_assert_uint_eq(json_array_size(matches), 3);
+  int expected_seq[3] = { 4, 5, 3 };
+  for (size_t i = 0; i < 3; i++) {
+    json_t* network = json_object_get(json_array_get(matches, i), "network");
+    ck_assert_int_eq(json_integer_value(json_object_get(network, "seq")), expected_seq[i]);
+  }
+
+  nblex_input_free(input);
+  nblex_correlation_free(corr);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
 START_TEST(test_correlation_process_null_corr) {
   nblex_world* world = nblex_world_new();
   nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
@@ -401,6 +665,10 @@ Suite* correlation_suite(void) {
   tcase_add_test(tc_matching, test_correlation_time_based_match);
   tcase_add_test(tc_matching, test_correlation_time_based_no_match_outside_window);
   tcase_add_test(tc_matching, test_correlation_bidirectional_matching);
+  tcase_add_test(tc_matching, test_correlation_out_of_order_and_expire);
+  tcase_add_test(tc_matching, test_correlation_id_based_match);
+  tcase_add_test(tc_matching, test_correlation_connection_match);
+  tcase_add_test(tc_matching, test_correlation_coalesced_output);
   
   suite_add_tcase(s, tc_core);
   suite_add_tcase(s, tc_lifecycle);
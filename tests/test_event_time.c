@@ -0,0 +1,547 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * test_event_time.c - Unit tests for event-time windows and watermarks
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+/* Feature test macros must be defined before any system headers */
+#ifndef __APPLE__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/nblex_internal.h"
+#include "test_helpers.h"
+
+Suite* event_time_suite(void);
+
+/* Epoch milliseconds, aligned to 10 s */
+#define BASE_MS 1700000000000ULL
+#define MS 1000000ULL
+
+/* Run the query on source events; capture what it emits */
+static void run_query_handler(nblex_event* event, void* user_data) {
+  if (event->input) {
+    nql_execute_prepared((nql_prepared_t*)user_data, event);
+  } else {
+    test_capture_event_handler(event, NULL);
+  }
+}
+
+/* Run the query on batches of source events */
+static void run_query_batch_handler(nblex_event** events, size_t count, void* user_data) {
+  nql_execute_prepared_batch((nql_prepared_t*)user_data, events, count, NULL);
+}
+
+/* Helper: A world in event time mode on field "ts" running one query */
+static nblex_world* new_event_time_world(const char* query, uint32_t max_delay_ms,
+                                         nblex_late_policy policy, uint32_t lateness_ms,
+                                         nql_prepared_t** prepared_out) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_set_event_time(world, "ts", max_delay_ms), 0);
+  ck_assert_int_eq(nblex_world_set_late_policy(world, policy, lateness_ms), 0);
+
+  nql_prepared_t* prepared = nql_prepare(query, world);
+  ck_assert_ptr_ne(prepared, NULL);
+  nblex_set_event_handler(world, run_query_handler, prepared);
+  *prepared_out = prepared;
+  test_reset_captured_events();
+  return world;
+}
+
+/* Helper: A file input registered with the world */
+static nblex_input* add_input(nblex_world* world) {
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(input, NULL);
+  ck_assert_int_eq(nblex_world_add_input(world, input), 0);
+  return input;
+}
+
+/* Helper: Emit a log event whose "ts" field is in epoch milliseconds */
+static void emit_log(nblex_world* world, nblex_input* input, uint64_t offset_ms,
+                     const char* service, int value) {
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  ck_assert_ptr_ne(event, NULL);
+  event->data = json_object();
+  json_object_set_new(event->data, "ts", json_integer((json_int_t)(BASE_MS + offset_ms)));
+  json_object_set_new(event->data, "service", json_string(service));
+  json_object_set_new(event->data, "value", json_integer(value));
+  nblex_event_emit(world, event);
+}
+
+/* Helper: Captured results of a given type */
+static size_t count_results(const char* type) {
+  size_t count = 0;
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    json_t* result_type = json_object_get(test_captured_events[i]->data, "nql_result_type");
+    if (result_type && strcmp(json_string_value(result_type), type) == 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+/* Helper: Metric of the i-th captured result */
+static json_int_t result_count(size_t i) {
+  json_t* metrics = json_object_get(test_captured_events[i]->data, "metrics");
+  return json_integer_value(json_object_get(metrics, "count"));
+}
+
+START_TEST(test_event_time_parse) {
+  uint64_t ns = 0;
+  json_t* value;
+
+  /* Epoch numbers by magnitude */
+  value = json_integer(1736937000);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000000000000ULL);
+  json_decref(value);
+
+  value = json_integer(1736937000123LL);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000123000000ULL);
+  json_decref(value);
+
+  value = json_integer(1736937000123456LL);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000123456000ULL);
+  json_decref(value);
+
+  value = json_integer(1736937000123456789LL);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000123456789ULL);
+  json_decref(value);
+
+  value = json_real(1736937000.5);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000500000000ULL);
+  json_decref(value);
+
+  /* ISO 8601, with and without fraction and zone */
+  value = json_string("2025-01-15T10:30:00Z");
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000000000000ULL);
+  json_decref(value);
+
+  value = json_string("2025-01-15 11:30:00.25+01:00");
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000250000000ULL);
+  json_decref(value);
+
+  value = json_string("2025-01-15T10:30:00");
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000000000000ULL);
+  json_decref(value);
+
+  /* nginx time_local */
+  value = json_string("15/Jan/2025:05:30:00 -0500");
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), 0);
+  ck_assert_uint_eq(ns, 1736937000000000000ULL);
+  json_decref(value);
+
+  /* Not times */
+  const char* invalid[] = { "", "yesterday", "2025-13-01T00:00:00Z",
+                            "2025-01-15T10:30:00Zjunk", "15/Foo/2025:05:30:00 +0000" };
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    value = json_string(invalid[i]);
+    ck_assert_int_eq(nblex_event_time_parse(value, &ns), -1);
+    json_decref(value);
+  }
+  value = json_integer(-5);
+  ck_assert_int_eq(nblex_event_time_parse(value, &ns), -1);
+  json_decref(value);
+  ck_assert_int_eq(nblex_event_time_parse(NULL, &ns), -1);
+  ck_assert_int_eq(nblex_event_time_parse(json_null(), &ns), -1);
+}
+END_TEST
+
+START_TEST(test_event_time_watermark_closes_window) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() by service window tumbling(1s)",
+                                            500, NBLEX_LATE_DROP, 0, &prepared);
+  nblex_input* input = add_input(world);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), 0);
+
+  emit_log(world, input, 100, "api", 1);
+  emit_log(world, input, 900, "api", 1);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 400) * MS);
+
+  /* Watermark 900 ms: the first window is still open */
+  emit_log(world, input, 1400, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 0);
+
+  /* Watermark 1100 ms: it closes, with no wall-clock timer involved */
+  emit_log(world, input, 1600, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  ck_assert_int_eq(result_count(0), 2);
+  json_t* window = json_object_get(test_captured_events[0]->data, "window");
+  ck_assert_uint_eq((uint64_t)json_integer_value(json_object_get(window, "start_ns")), BASE_MS * MS);
+  ck_assert_ptr_eq(world->scheduler, NULL);
+
+  /* Events without the field are stamped from their input, never late */
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  event->data = json_object();
+  json_object_set_new(event->data, "service", json_string("api"));
+  nblex_event_emit(world, event);
+  ck_assert_uint_eq(world->event_time.missing_timestamps, 1);
+  ck_assert_uint_eq(world->event_time.late_dropped, 0);
+
+  /* Network events keep their capture time */
+  nblex_event* packet = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  packet->data = json_object();
+  packet->timestamp_ns = (BASE_MS + 2600) * MS;
+  nblex_event_emit(world, packet);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 2100) * MS);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  ck_assert_int_eq(result_count(1), 3);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_event_time_lowest_input_watermark) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() window tumbling(1s)",
+                                            100, NBLEX_LATE_DROP, 0, &prepared);
+  nblex_input* fast = add_input(world);
+  nblex_input* slow = add_input(world);
+
+  emit_log(world, slow, 200, "api", 1);
+  emit_log(world, fast, 300, "api", 1);
+  emit_log(world, fast, 5000, "api", 1);
+
+  /* The slow input holds the window open */
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 100) * MS);
+  ck_assert_uint_eq(test_captured_events_count, 0);
+
+  /* Its late-looking event is on time: the watermark has not passed it */
+  emit_log(world, slow, 800, "api", 1);
+  emit_log(world, slow, 1200, "api", 1);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 1100) * MS);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  ck_assert_int_eq(result_count(0), 3);
+  ck_assert_uint_eq(world->event_time.late_dropped, 0);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_event_time_untimed_and_ended_inputs) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() window tumbling(1s)",
+                                            100, NBLEX_LATE_DROP, 0, &prepared);
+  nblex_input* first = add_input(world);
+  nblex_input* second = add_input(world);
+
+  /* A header line before any time is known is skipped, not stamped now */
+  nblex_event* header = nblex_event_new(NBLEX_EVENT_LOG, first);
+  header->data = json_pack("{s:s}", "message", "# replay of yesterday");
+  nblex_event_emit(world, header);
+  ck_assert_uint_eq(world->event_time.untimed_skipped, 1);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), 0);
+
+  emit_log(world, first, 200, "api", 1);
+  emit_log(world, second, 300, "api", 1);
+  emit_log(world, second, 5000, "api", 1);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 100) * MS);
+
+  /* Later untimed events take their input's newest time, and do not
+   * move the watermark */
+  nblex_event* untimed = nblex_event_new(NBLEX_EVENT_LOG, second);
+  untimed->data = json_pack("{s:s}", "message", "malformed");
+  nblex_event_emit(world, untimed);
+  ck_assert_uint_eq(world->event_time.missing_timestamps, 2);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 100) * MS);
+
+  /* An input that ended no longer holds the watermark back */
+  nblex_event_time_input_done(world, first);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), (BASE_MS + 4900) * MS);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  ck_assert_int_eq(result_count(0), 2);
+
+  /* Once none is left, the last window closes too */
+  nblex_world_stop(world);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  ck_assert_int_eq(result_count(1), 2);
+  ck_assert_uint_eq(world->event_time.late_dropped, 0);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+static int compare_lines(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Helper: Feed events to a fresh world, batch_size at a time on that
+ * many threads if above 1, and return its results as sorted "service
+ * start count sum" lines, flushing every window at the end
+ */
+static char* replay(const uint64_t* offsets, const int* services, size_t count,
+                    size_t batch_size, size_t threads) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world(
+      "aggregate count(), sum(value) by service window tumbling(1s)",
+      2000, NBLEX_LATE_DROP, 0, &prepared);
+  nblex_input* input = add_input(world);
+  if (batch_size > 1) {
+    ck_assert_int_eq(nblex_set_batch_handler(world, run_query_batch_handler, prepared), 0);
+    ck_assert_int_eq(nblex_world_set_batch_size(world, batch_size), 0);
+  }
+  ck_assert_int_eq(nblex_world_set_worker_threads(world, threads), 0);
+
+  static const char* names[] = { "api", "db", "web" };
+  for (size_t i = 0; i < count; i++) {
+    emit_log(world, input, offsets[i], names[services[i]], (int)(offsets[i] % 97));
+  }
+  /* Stopping ends the input, closing the last windows */
+  nblex_world_stop(world);
+  ck_assert_uint_eq(world->event_time.late_dropped, 0);
+
+  char** lines = calloc(test_captured_events_count, sizeof(char*));
+  size_t total = 0;
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    json_t* data = test_captured_events[i]->data;
+    json_t* metrics = json_object_get(data, "metrics");
+    json_int_t events = json_integer_value(json_object_get(metrics, "count"));
+    char line[256];
+    snprintf(line, sizeof(line), "%s %lld %lld %.1f\n",
+             json_string_value(json_object_get(json_object_get(data, "group"), "service")),
+             (long long)json_integer_value(json_object_get(json_object_get(data, "window"), "start_ns")),
+             (long long)events, json_real_value(json_object_get(metrics, "value")));
+    lines[i] = strdup(line);
+    total += (size_t)events;
+  }
+  ck_assert_uint_eq(total, count);
+  qsort(lines, test_captured_events_count, sizeof(char*), compare_lines);
+
+  size_t length = 1;
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    length += strlen(lines[i]);
+  }
+  char* text = calloc(1, length);
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    strcat(text, lines[i]);
+    free(lines[i]);
+  }
+  free(lines);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+  return text;
+}
+
+START_TEST(test_event_time_replay_matches_in_order) {
+  /* 3000 events over 30 s, then the same events disordered by up to the
+   * allowed 2 s delay (moved up to 90 places), as a lagging tail or a replay would deliver them */
+  enum { COUNT = 3000 };
+  static uint64_t offsets[COUNT];
+  static int services[COUNT];
+  uint64_t x = 88172645463325252ULL;
+  for (size_t i = 0; i < COUNT; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    offsets[i] = i * 10 + x % 10;
+    services[i] = (int)(x % 3);
+  }
+  char* in_order = replay(offsets, services, COUNT, 0, 1);
+
+  static bool moved[COUNT];
+  for (size_t i = 0; i + 1 < COUNT; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    size_t j = i + x % 90;
+    if (j < COUNT && !moved[i] && !moved[j]) {
+      moved[i] = moved[j] = true;
+      uint64_t t = offsets[i];
+      offsets[i] = offsets[j];
+      offsets[j] = t;
+      int s = services[i];
+      services[i] = services[j];
+      services[j] = s;
+    }
+  }
+  char* disordered = replay(offsets, services, COUNT, 0, 1);
+
+  ck_assert(strlen(in_order) > 0);
+  ck_assert_str_eq(in_order, disordered);
+
+  /* Batches are handed over before the watermark passes their events,
+   * so none is late or misses its window for having waited */
+  char* batched = replay(offsets, services, COUNT, 200, 1);
+  ck_assert_str_eq(in_order, batched);
+
+  /* And their buckets are updated on worker threads */
+  char* parallel = replay(offsets, services, COUNT, 200, 4);
+  ck_assert_str_eq(in_order, parallel);
+  free(in_order);
+  free(disordered);
+  free(batched);
+  free(parallel);
+}
+END_TEST
+
+START_TEST(test_event_time_late_drop) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() window tumbling(1s)",
+                                            0, NBLEX_LATE_DROP, 0, &prepared);
+  nblex_input* input = add_input(world);
+
+  emit_log(world, input, 100, "api", 1);
+  emit_log(world, input, 1100, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+
+  emit_log(world, input, 200, "api", 1);
+  ck_assert_uint_eq(world->event_time.late_dropped, 1);
+  nblex_world_advance_watermark(world, UINT64_MAX);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  ck_assert_int_eq(result_count(0), 1);
+  ck_assert_int_eq(result_count(1), 1);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_event_time_late_side_output) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() by service window sliding(2s, 1s)",
+                                            0, NBLEX_LATE_SIDE_OUTPUT, 0, &prepared);
+  nblex_input* input = add_input(world);
+
+  emit_log(world, input, 100, "api", 1);
+  emit_log(world, input, 2500, "api", 1);
+  ck_assert_uint_eq(count_results("aggregation"), 2);
+
+  /* Both windows holding 500 ms have closed; [1s, 3s) is still open */
+  emit_log(world, input, 500, "api", 7);
+  emit_log(world, input, 1500, "api", 1);
+  ck_assert_uint_eq(count_results("late_event"), 1);
+  ck_assert_uint_eq(world->event_time.late_side_output, 1);
+
+  nblex_event* late = test_captured_events[test_captured_events_count - 1];
+  ck_assert_str_eq(json_string_value(json_object_get(late->data, "nql_result_type")), "late_event");
+  ck_assert_uint_eq(late->timestamp_ns, (BASE_MS + 500) * MS);
+  json_t* original = json_object_get(late->data, "event");
+  ck_assert_int_eq(json_integer_value(json_object_get(original, "value")), 7);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_event_time_late_update) {
+  nql_prepared_t* prepared;
+  nblex_world* world = new_event_time_world("aggregate count() window tumbling(1s)",
+                                            0, NBLEX_LATE_UPDATE, 2000, &prepared);
+  nblex_input* input = add_input(world);
+
+  emit_log(world, input, 100, "api", 1);
+  emit_log(world, input, 200, "api", 1);
+  emit_log(world, input, 1100, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+  ck_assert_int_eq(result_count(0), 2);
+
+  /* Within the allowed lateness: a revised result for the closed window */
+  emit_log(world, input, 300, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  ck_assert_int_eq(result_count(1), 3);
+  ck_assert(json_is_true(json_object_get(test_captured_events[1]->data, "late_update")));
+  ck_assert_uint_eq(world->event_time.late_updates, 1);
+
+  /* A window that closed with no events takes late updates too */
+  emit_log(world, input, 3100, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 3);
+  ck_assert_int_eq(result_count(2), 1);
+  emit_log(world, input, 2500, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 4);
+  ck_assert_int_eq(result_count(3), 1);
+
+  /* Past window end + lateness the window is gone: dropped */
+  emit_log(world, input, 400, "api", 1);
+  ck_assert_uint_eq(test_captured_events_count, 4);
+  ck_assert_uint_eq(world->event_time.late_dropped, 1);
+  ck_assert_uint_eq(world->event_time.late_updates, 2);
+
+  nql_prepared_free(prepared);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_event_time_set_after_prepare) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_set_late_policy(world, (nblex_late_policy)7, 0), -1);
+  ck_assert_int_eq(nblex_world_set_event_time(NULL, NULL, 0), -1);
+
+  nql_prepared_t* prepared = nql_prepare("aggregate count() window tumbling(1s)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  ck_assert_int_eq(nblex_world_set_event_time(world, NULL, 0), -1);
+  ck_assert_uint_eq(nblex_world_get_watermark(world), 0);
+
+  nql_prepared_free(prepared);
+  ck_assert_int_eq(nblex_world_set_event_time(world, NULL, 0), 0);
+  nblex_world_free(world);
+}
+END_TEST
+
+Suite* event_time_suite(void) {
+  Suite* s = suite_create("EventTime");
+
+  TCase* tc_parse = tcase_create("Parse");
+  tcase_add_test(tc_parse, test_event_time_parse);
+  suite_add_tcase(s, tc_parse);
+
+  TCase* tc_watermark = tcase_create("Watermark");
+  tcase_add_test(tc_watermark, test_event_time_watermark_closes_window);
+  tcase_add_test(tc_watermark, test_event_time_lowest_input_watermark);
+  tcase_add_test(tc_watermark, test_event_time_untimed_and_ended_inputs);
+  tcase_add_test(tc_watermark, test_event_time_replay_matches_in_order);
+  tcase_add_test(tc_watermark, test_event_time_set_after_prepare);
+  suite_add_tcase(s, tc_watermark);
+
+  TCase* tc_late = tcase_create("Late");
+  tcase_add_test(tc_late, test_event_time_late_drop);
+  tcase_add_test(tc_late, test_event_time_late_side_output);
+  tcase_add_test(tc_late, test_event_time_late_update);
+  suite_add_tcase(s, tc_late);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite* s = event_time_suite();
+  SRunner* sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -166,6 +166,62 @@ START_TEST(test_filter_logical_or) {
 }
 END_TEST
 
+START_TEST(test_filter_select_batch) {
+  static const char* levels[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+  static const char* services[] = {"api", "db", "cache"};
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(input, NULL);
+
+  filter_t* filter = nblex_filter_new(
+      "NOT level == \"DEBUG\" AND (status >= 500 OR service == \"db\")");
+  ck_assert_ptr_ne(filter, NULL);
+
+  nblex_event* events[NBLEX_BATCH_SIZE];
+  for (int i = 0; i < NBLEX_BATCH_SIZE; i++) {
+    events[i] = nblex_event_new(NBLEX_EVENT_LOG, input);
+    ck_assert_ptr_ne(events[i], NULL);
+    /* One event without data, which never matches */
+    if (i == 7) {
+      continue;
+    }
+    events[i]->data = json_object();
+    json_object_set_new(events[i]->data, "level", json_string(levels[i % 4]));
+    json_object_set_new(events[i]->data, "service", json_string(services[i % 3]));
+    json_object_set_new(events[i]->data, "status", json_integer(i % 5 == 0 ? 503 : 200));
+  }
+
+  /* Every other event selected; survivors match event by event */
+  uint16_t sel[NBLEX_BATCH_SIZE];
+  size_t count = 0;
+  for (int i = 0; i < NBLEX_BATCH_SIZE; i += 2) {
+    sel[count++] = (uint16_t)i;
+  }
+  size_t kept = nblex_filter_select(filter, events, sel, count);
+
+  size_t expected = 0;
+  for (int i = 0; i < NBLEX_BATCH_SIZE; i += 2) {
+    if (nblex_filter_matches(filter, events[i])) {
+      ck_assert_uint_lt(expected, kept);
+      ck_assert_uint_eq(sel[expected], (unsigned)i);
+      expected++;
+    }
+  }
+  ck_assert_uint_eq(kept, expected);
+  ck_assert_uint_gt(kept, 0);
+
+  for (int i = 0; i < NBLEX_BATCH_SIZE; i++) {
+    nblex_event_free(events[i]);
+  }
+  nblex_filter_free(filter);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
 Suite* filters_suite(void) {
   Suite* s = suite_create("Filters");
 
@@ -180,6 +236,7 @@ Suite* filters_suite(void) {
   TCase* tc_logical = tcase_create("Logical");
   tcase_add_test(tc_logical, test_filter_logical_and);
   tcase_add_test(tc_logical, test_filter_logical_or);
+  tcase_add_test(tc_logical, test_filter_select_batch);
   suite_add_tcase(s, tc_logical);
 
   return s;
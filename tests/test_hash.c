@@ -0,0 +1,130 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * test_hash.c - Unit tests for hashing and the hash index
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+/* Feature test macros must be defined before any system headers */
+#ifndef __APPLE__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/nblex_internal.h"
+
+Suite* hash_suite(void);
+
+/* Helper: Hash shared by every fourth value, all with the same low bits */
+static uint64_t colliding_hash(uintptr_t value) {
+  return ((uint64_t)(value % 4) << 32) | 5;
+}
+
+START_TEST(test_hash64_stable) {
+  ck_assert_uint_eq(nblex_hash64_string("abc"), nblex_hash64("abc", 3, 0));
+  ck_assert_uint_ne(nblex_hash64("abc", 3, 0), nblex_hash64("abc", 3, 1));
+  ck_assert_uint_ne(nblex_hash64("abc", 3, 0), nblex_hash64("abd", 3, 0));
+  ck_assert_uint_eq(nblex_hash64_string(NULL), 0);
+  ck_assert_uint_ne(nblex_hash64_combine(1, 2), nblex_hash64_combine(2, 1));
+}
+END_TEST
+
+START_TEST(test_index_empty) {
+  nblex_index_t index;
+  memset(&index, 0, sizeof(index));
+  size_t pos = 7;
+  ck_assert_ptr_eq(nblex_index_next(&index, 7, &pos), NULL);
+  ck_assert(!nblex_index_remove(&index, 7, 1));
+  nblex_index_free(&index);
+}
+END_TEST
+
+START_TEST(test_index_collisions) {
+  nblex_index_t index;
+  memset(&index, 0, sizeof(index));
+
+  for (uintptr_t v = 1; v <= 200; v++) {
+    ck_assert_int_eq(nblex_index_insert(&index, colliding_hash(v), v), 0);
+  }
+  ck_assert_uint_eq(index.count, 200);
+
+  /* Remove every third value from the middle of the probe chains */
+  for (uintptr_t v = 3; v <= 200; v += 3) {
+    ck_assert(nblex_index_remove(&index, colliding_hash(v), v));
+  }
+  ck_assert(!nblex_index_remove(&index, colliding_hash(3), 3));
+  ck_assert_uint_eq(index.count, 134);
+
+  size_t found = 0;
+  for (uint64_t h = 0; h < 4; h++) {
+    uint64_t hash = colliding_hash(h);
+    size_t pos = (size_t)hash;
+    nblex_index_bucket_t* bucket;
+    while ((bucket = nblex_index_next(&index, hash, &pos)) != NULL) {
+      ck_assert_uint_eq(bucket->value % 4, h);
+      ck_assert_uint_ne(bucket->value % 3, 0);
+      found++;
+    }
+  }
+  ck_assert_uint_eq(found, 134);
+
+  nblex_index_free(&index);
+  ck_assert_uint_eq(index.count, 0);
+}
+END_TEST
+
+START_TEST(test_index_replace_value) {
+  nblex_index_t index;
+  memset(&index, 0, sizeof(index));
+  uint64_t hash = nblex_hash64_string("key");
+  ck_assert_int_eq(nblex_index_insert(&index, hash, 1), 0);
+
+  size_t pos = (size_t)hash;
+  nblex_index_bucket_t* bucket = nblex_index_next(&index, hash, &pos);
+  ck_assert_ptr_ne(bucket, NULL);
+  bucket->value = 2;
+
+  ck_assert(!nblex_index_remove(&index, hash, 1));
+  ck_assert(nblex_index_remove(&index, hash, 2));
+  ck_assert_uint_eq(index.count, 0);
+  nblex_index_free(&index);
+}
+END_TEST
+
+Suite* hash_suite(void) {
+  Suite* s = suite_create("Hash");
+
+  TCase* tc_hash = tcase_create("Hash");
+  tcase_add_test(tc_hash, test_hash64_stable);
+  suite_add_tcase(s, tc_hash);
+
+  TCase* tc_index = tcase_create("Index");
+  tcase_add_test(tc_index, test_index_empty);
+  tcase_add_test(tc_index, test_index_collisions);
+  tcase_add_test(tc_index, test_index_replace_value);
+  suite_add_tcase(s, tc_index);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite* s = hash_suite();
+  SRunner* sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -141,7 +141,9 @@ START_TEST(test_buffer_size_limits) {
   size_t final_buffer = nblex_world_get_buffer_usage(world);
   ck_assert_int_le(final_buffer, 1 * 1024 * 1024);
 
-  /* Events are processed synchronously by nblex_event_emit */
+  /* Expire as the loop would once the buffered events have aged out of
+   * the correlation window (100ms by default, kept for twice that) */
+  nblex_correlation_expire_at(world->correlation, nblex_timestamp_now() + 300 * 1000000ULL);
 
   /* Buffer should be reduced after processing */
   size_t after_process = nblex_world_get_buffer_usage(world);
@@ -233,6 +235,184 @@ START_TEST(test_resource_cleanup_after_limit) {
 }
 END_TEST
 
+/* Helper: Emit a log event from an input, if it is admitted */
+static bool emit_log(nblex_input* input, int index) {
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  if (!event) {
+    return false;
+  }
+  event->data = json_object();
+  json_object_set_new(event->data, "index", json_integer(index));
+  nblex_event_emit(input->world, event);
+  return true;
+}
+
+/* Helper: Count the network events of an input not admitted */
+static int network_refused(nblex_input* input, int count) {
+  int refused = 0;
+  for (int i = 0; i < count; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+    if (event) {
+      nblex_event_free(event);
+    } else {
+      refused++;
+    }
+  }
+  return refused;
+}
+
+START_TEST(test_memory_limit_degradation) {
+  /* Over the memory limit nblex shrinks correlation buffers, then samples
+   * network events, then sheds low priority inputs, each step only after
+   * the one before had an interval to help; every drop is counted */
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  nblex_world_open(world);
+
+  nblex_input* high = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_input* low = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(high, NULL);
+  ck_assert_ptr_ne(low, NULL);
+  ck_assert_int_eq(nblex_input_set_priority(high, 1), 0);
+  /* Shedding weighs the world's inputs against each other */
+  ck_assert_int_eq(nblex_world_add_input(world, high), 0);
+  ck_assert_int_eq(nblex_world_add_input(world, low), 0);
+
+  /* A limit the buffers reach with 16 events */
+  for (int i = 0; i < 16; i++) {
+    ck_assert(emit_log(low, i));
+  }
+  size_t limit = nblex_world_get_buffer_usage(world);
+  ck_assert_uint_gt(limit, 0);
+  ck_assert_int_eq(nblex_world_set_memory_limit(world, limit), 0);
+
+  /* First step: the oldest buffered events are released */
+  ck_assert(emit_log(low, 16));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHRINK);
+  ck_assert_uint_gt(nblex_world_get_drops(world, NBLEX_DROP_BUFFER_SHRUNK), 0);
+  ck_assert_uint_lt(nblex_world_get_buffer_usage(world), limit);
+
+  /* Reaching the limit again within the interval does not step up */
+  for (int i = 0; i < 16; i++) {
+    ck_assert(emit_log(low, i));
+  }
+  ck_assert_int_eq(network_refused(high, NBLEX_NETWORK_SAMPLE), 0);
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHRINK);
+
+  /* After an interval that did not help, network events are sampled */
+  world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+  ck_assert_int_eq(network_refused(high, NBLEX_NETWORK_SAMPLE), NBLEX_NETWORK_SAMPLE - 1);
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SAMPLE);
+  ck_assert_uint_eq(nblex_world_get_drops(world, NBLEX_DROP_NETWORK_SAMPLED),
+                    NBLEX_NETWORK_SAMPLE - 1);
+
+  /* After another, the low priority input is shed, the high one kept */
+  for (int i = 0; i < 16; i++) {
+    ck_assert(emit_log(low, i));
+  }
+  world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+  ck_assert(!emit_log(low, 0));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHED);
+  ck_assert_uint_eq(nblex_world_get_drops(world, NBLEX_DROP_INPUT_SHED), 1);
+  ck_assert(emit_log(high, 0));
+
+  /* Each interval under the limit steps back once */
+  for (int step = NBLEX_DEGRADE_SHED; step > NBLEX_DEGRADE_NONE; step--) {
+    world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, high);
+    ck_assert_ptr_ne(event, NULL);
+    nblex_event_free(event);
+    ck_assert_int_eq(world->degrade_level, step - 1);
+  }
+  ck_assert(emit_log(low, 0));
+
+  /* With query state filling the limit, fewer events would not help */
+  nblex_mem_account_t* previous = nblex_mem_account_enter(&world->memory);
+  void* block = nblex_malloc(limit);
+  nblex_mem_account_leave(previous);
+  ck_assert_ptr_ne(block, NULL);
+  for (int i = 0; i < 4; i++) {
+    ck_assert(emit_log(low, i));
+  }
+  world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+  ck_assert(emit_log(low, 0));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHRINK);
+  previous = nblex_mem_account_enter(&world->memory);
+  nblex_free(block);
+  nblex_mem_account_leave(previous);
+
+  nblex_world_stop(world);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_memory_limit_payload_growth) {
+  /* Events in flight count by their JSON and structs, so events that
+   * grow their payloads degrade the world without any being buffered */
+
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  nblex_world_open(world);
+
+  nblex_input* high = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_input* low = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(high, NULL);
+  ck_assert_ptr_ne(low, NULL);
+  ck_assert_int_eq(nblex_input_set_priority(high, 1), 0);
+  ck_assert_int_eq(nblex_world_add_input(world, high), 0);
+  ck_assert_int_eq(nblex_world_add_input(world, low), 0);
+  ck_assert_int_eq(nblex_world_set_memory_limit(world, 64 * 1024), 0);
+
+  /* Small payloads fit */
+  nblex_event* held[32];
+  for (int i = 0; i < 32; i++) {
+    held[i] = nblex_event_new(NBLEX_EVENT_LOG, low);
+    ck_assert_ptr_ne(held[i], NULL);
+    held[i]->data = json_object();
+    json_object_set_new(held[i]->data, "index", json_integer(i));
+  }
+  size_t small = nblex_world_get_memory_usage(world);
+  ck_assert_uint_ge(small, 32 * sizeof(nblex_event));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_NONE);
+
+  /* The same events with 4KB payloads do not */
+  char payload[4096];
+  memset(payload, 'x', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  for (int i = 0; i < 32; i++) {
+    json_object_set_new(held[i]->data, "payload", json_string(payload));
+  }
+  ck_assert_uint_gt(nblex_world_get_memory_usage(world), 64 * 1024);
+  ck_assert_uint_eq(nblex_world_get_buffer_usage(world), 0);
+  ck_assert(emit_log(low, 32));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHRINK);
+
+  /* Still grown an interval later, the world keeps stepping up */
+  world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+  ck_assert(emit_log(low, 33));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SAMPLE);
+  world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+  ck_assert(!emit_log(low, 34));
+  ck_assert_int_eq(world->degrade_level, NBLEX_DEGRADE_SHED);
+
+  /* Once the events are released, each interval steps back once */
+  for (int i = 0; i < 32; i++) {
+    nblex_event_free(held[i]);
+  }
+  ck_assert_uint_lt(nblex_world_get_memory_usage(world), 64 * 1024);
+  ck_assert(emit_log(high, 34));
+  for (int step = NBLEX_DEGRADE_SHED; step > NBLEX_DEGRADE_NONE; step--) {
+    world->degrade_since_ns -= NBLEX_DEGRADE_INTERVAL_NS;
+    ck_assert(emit_log(high, 0));
+    ck_assert_int_eq(world->degrade_level, step - 1);
+  }
+
+  nblex_world_stop(world);
+  nblex_world_free(world);
+}
+END_TEST
+
 Suite* integration_resource_limits_suite(void) {
   Suite* s = suite_create("Integration Resource Limits");
 
@@ -241,6 +421,8 @@ Suite* integration_resource_limits_suite(void) {
   tcase_add_test(tc_limits, test_buffer_size_limits);
   tcase_add_test(tc_limits, test_event_rate_limiting);
   tcase_add_test(tc_limits, test_resource_cleanup_after_limit);
+  tcase_add_test(tc_limits, test_memory_limit_degradation);
+  tcase_add_test(tc_limits, test_memory_limit_payload_growth);
   suite_add_tcase(s, tc_limits);
 
   return s;
@@ -19,6 +19,7 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 #include "../src/nblex_internal.h"
@@ -347,6 +348,90 @@ START_TEST(test_nql_execute_correlate_bidirectional) {
 }
 END_TEST
 
+/* Helper: Event with a field and an optional join key */
+static nblex_event* make_keyed_event(nblex_input* input, nblex_event_type type,
+                                     const char* field, json_t* value,
+                                     const char* key, json_t* key_value,
+                                     uint64_t timestamp_ns) {
+  nblex_event* event = nblex_event_new(type, input);
+  json_t* data = json_object();
+  json_object_set_new(data, field, value);
+  if (key_value) {
+    json_object_set_new(data, key, key_value);
+  }
+  event->data = data;
+  event->timestamp_ns = timestamp_ns;
+  return event;
+}
+
+START_TEST(test_nql_execute_correlate_on_key) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(input, NULL);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nql_prepared_t* prepared = nql_prepare(
+      "correlate log.level == \"ERROR\" with network.dst_port == 3306 "
+      "on request_id within 100ms", world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  uint64_t base_ts = 1000000000000ULL;
+  nblex_event* events[] = {
+    make_keyed_event(input, NBLEX_EVENT_LOG, "log.level", json_string("ERROR"),
+                     "request_id", json_string("a"), base_ts),
+    make_keyed_event(input, NBLEX_EVENT_LOG, "log.level", json_string("ERROR"),
+                     "request_id", json_string("b"), base_ts + 10000000),
+    make_keyed_event(input, NBLEX_EVENT_LOG, "log.level", json_string("ERROR"),
+                     "request_id", json_integer(7), base_ts + 20000000),
+    /* Joins only the first log event */
+    make_keyed_event(input, NBLEX_EVENT_NETWORK, "network.dst_port", json_integer(3306),
+                     "request_id", json_string("a"), base_ts + 90000000),
+    /* No join key: joins nothing */
+    make_keyed_event(input, NBLEX_EVENT_NETWORK, "network.dst_port", json_integer(3306),
+                     NULL, NULL, base_ts + 30000000),
+    /* Key matches but outside the window */
+    make_keyed_event(input, NBLEX_EVENT_NETWORK, "network.dst_port", json_integer(3306),
+                     "request_id", json_string("b"), base_ts + 150000000),
+    /* Integer keys join like group keys */
+    make_keyed_event(input, NBLEX_EVENT_NETWORK, "network.dst_port", json_integer(3306),
+                     "request_id", json_integer(7), base_ts + 40000000),
+  };
+  size_t count = sizeof(events) / sizeof(events[0]);
+
+  for (size_t i = 0; i < count; i++) {
+    ck_assert_int_eq(nql_execute_prepared(prepared, events[i]), 1);
+  }
+
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  json_t* left = json_object_get(test_captured_events[0]->data, "left_event");
+  ck_assert_str_eq(json_string_value(json_object_get(left, "request_id")), "a");
+  left = json_object_get(test_captured_events[1]->data, "left_event");
+  ck_assert_int_eq(json_integer_value(json_object_get(left, "request_id")), 7);
+
+  /* Once the buffers expire, a late event finds nothing to join */
+  nblex_scheduler_t* scheduler = nblex_world_window_scheduler(world);
+  while (nblex_scheduler_run(scheduler, base_ts + 10000000000ULL) > 0) {
+  }
+  nblex_event* late = make_keyed_event(input, NBLEX_EVENT_NETWORK, "network.dst_port",
+                                       json_integer(3306), "request_id", json_string("a"),
+                                       base_ts + 50000000);
+  ck_assert_int_eq(nql_execute_prepared(prepared, late), 1);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+
+  nblex_event_free(late);
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  nql_prepared_free(prepared);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
 START_TEST(test_nql_execute_lazy_timer_initialization) {
   /* Test that timers are NOT initialized until world starts */
   nblex_world* world = NULL;
@@ -398,6 +483,972 @@ START_TEST(test_nql_execute_lazy_timer_initialization) {
 }
 END_TEST
 
+START_TEST(test_nql_prepare_invalid_query) {
+  char* error = NULL;
+  nql_prepared_t* prepared = nql_prepare_ex("correlate log.level == ERROR", NULL, &error);
+  ck_assert_ptr_eq(prepared, NULL);
+  ck_assert_ptr_ne(error, NULL);
+  nblex_free(error);
+
+  ck_assert_ptr_eq(nql_prepare(NULL, NULL), NULL);
+}
+END_TEST
+
+START_TEST(test_nql_execute_prepared_filter) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.level", json_string("ERROR"));
+
+  nql_prepared_t* prepared =
+      nql_prepare("log.level == \"ERROR\" | show log.level", world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+
+  json_object_set_new(event->data, "log.level", json_string("INFO"));
+  ck_assert_int_eq(nql_execute_prepared(prepared, event), 0);
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_prepared_owns_state) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.level", json_string("ERROR"));
+
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  const char* expr = "aggregate count() where log.level == \"ERROR\"";
+  nql_prepared_t* first = nql_prepare(expr, world);
+  nql_prepared_t* second = nql_prepare(expr, world);
+  ck_assert_ptr_ne(first, NULL);
+  ck_assert_ptr_ne(second, NULL);
+
+  /* State accumulates across executions of the same handle */
+  for (int i = 0; i < 3; i++) {
+    ck_assert_int_eq(nql_execute_prepared(first, event), 1);
+  }
+  ck_assert_ptr_ne(test_captured_event, NULL);
+  json_t* metrics = json_object_get(test_captured_event->data, "metrics");
+  ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), 3);
+
+  /* A second handle for the same string has independent state */
+  ck_assert_int_eq(nql_execute_prepared(second, event), 1);
+  metrics = json_object_get(test_captured_event->data, "metrics");
+  ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), 1);
+
+  nql_prepared_free(first);
+  nql_prepared_free(second);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_nql_prepared_free_after_world) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_ptr_ne(input, NULL);
+
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  event->data = json_object();
+  json_object_set_new(event->data, "log.service", json_string("api"));
+
+  /* Windowed aggregate creates a timer on the world's loop */
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate count() by log.service window tumbling(1s)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+
+  /* Handle is detached from the freed world and can still be released */
+  nql_prepared_free(prepared);
+}
+END_TEST
+
+START_TEST(test_nql_register_query_ids) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.level", json_string("ERROR"));
+
+  int error_id = nql_register(world, "log.level == \"ERROR\"", NULL);
+  int warn_id = nql_register(world, "log.level == \"WARN\"", NULL);
+  int show_id = nql_register(world, "show log.level where log.level == \"ERROR\"", NULL);
+  ck_assert_int_ge(error_id, 0);
+  ck_assert_int_ne(error_id, warn_id);
+  ck_assert_int_ne(warn_id, show_id);
+
+  ck_assert_int_eq(nql_execute_id(world, error_id, event), 1);
+  ck_assert_int_eq(nql_execute_id(world, warn_id, event), 0);
+  ck_assert_int_eq(nql_execute_id(world, show_id, event), 1);
+
+  /* Removed IDs no longer execute and are reused by later queries */
+  ck_assert_int_eq(nql_unregister(world, warn_id), 0);
+  ck_assert_int_eq(nql_execute_id(world, warn_id, event), 0);
+  ck_assert_int_eq(nql_unregister(world, warn_id), -1);
+  ck_assert_int_eq(nql_register(world, "log.level == \"INFO\"", NULL), warn_id);
+
+  /* Caller-owned handles get an ID but cannot be unregistered */
+  nql_prepared_t* prepared = nql_prepare("log.level == \"ERROR\"", world);
+  ck_assert_int_ge(nql_prepared_id(prepared), 0);
+  ck_assert_int_eq(nql_execute_id(world, nql_prepared_id(prepared), event), 1);
+  ck_assert_int_eq(nql_unregister(world, nql_prepared_id(prepared)), -1);
+  nql_prepared_free(prepared);
+
+  char* error = NULL;
+  ck_assert_int_eq(nql_register(world, "correlate log.level == ERROR", &error), -1);
+  ck_assert_ptr_ne(error, NULL);
+  nblex_free(error);
+
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+/* Helper: Record the IDs of queries matched by nql_execute_all() */
+static void record_match(int query_id, nblex_event* event, void* user_data) {
+  (void)event;
+  unsigned* matched = (unsigned*)user_data;
+  *matched |= 1u << query_id;
+}
+
+START_TEST(test_nql_execute_all_shared_predicates) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.level", json_string("ERROR"));
+  json_object_set_new(event->data, "log.service", json_string("api"));
+  json_object_set_new(event->data, "log.latency", json_integer(50));
+  json_object_set_new(event->data, "log.message", json_string("upstream timeout"));
+
+  const char* exprs[] = {
+    "log.level == \"ERROR\"",
+    "log.level == \"ERROR\" AND log.service == \"api\"",
+    "log.level == \"ERROR\" AND log.service == \"db\"",
+    "log.level == \"WARN\"",
+    "show log.service where log.level == \"ERROR\" AND log.service == \"api\"",
+    "log.latency > 100 OR log.level == \"ERROR\"",
+    "log.message =~ time.*out",
+    "log.message =~ time.*out AND log.level == \"WARN\"",
+  };
+  int ids[8];
+  for (int i = 0; i < 8; i++) {
+    ids[i] = nql_register(world, exprs[i], NULL);
+    ck_assert_int_eq(ids[i], i);
+  }
+
+  /* Six distinct predicates and four distinct conjunctions/disjunctions */
+  ck_assert_uint_eq(nblex_filter_dag_size(world->filter_dag), 10);
+
+  /* Level and service are one lookup each; latency and the regex one
+   * test each, however many queries use them */
+  unsigned matched = 0;
+  uint64_t before = nblex_filter_dag_evaluations(world->filter_dag);
+  ck_assert_int_eq(nql_execute_all(world, event, record_match, &matched), 5);
+  ck_assert_uint_eq(nblex_filter_dag_evaluations(world->filter_dag) - before, 4);
+  for (int i = 0; i < 8; i++) {
+    ck_assert_int_eq((matched >> i) & 1, nql_execute_id(world, ids[i], event));
+  }
+
+  /* Outside nql_execute_all() filters are evaluated on their own */
+  before = nblex_filter_dag_evaluations(world->filter_dag);
+  ck_assert_int_eq(nql_execute_id(world, ids[1], event), 1);
+  ck_assert_uint_eq(nblex_filter_dag_evaluations(world->filter_dag), before);
+
+  /* Unshared nodes go with the last query that uses them */
+  ck_assert_int_eq(nql_unregister(world, ids[1]), 0);
+  ck_assert_uint_eq(nblex_filter_dag_size(world->filter_dag), 10);
+  ck_assert_int_eq(nql_unregister(world, ids[4]), 0);
+  ck_assert_uint_eq(nblex_filter_dag_size(world->filter_dag), 8);
+  matched = 0;
+  ck_assert_int_eq(nql_execute_all(world, event, record_match, &matched), 3);
+  ck_assert_uint_eq(matched, (1u << 0) | (1u << 5) | (1u << 6));
+
+  ck_assert_int_ge(nql_register(world, exprs[1], NULL), 0);
+  ck_assert_uint_eq(nblex_filter_dag_size(world->filter_dag), 10);
+  ck_assert_int_eq(nql_execute_all(world, event, NULL, NULL), 4);
+
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_all_equality_group) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.service", json_string("svc-37"));
+
+  /* Equality tests against 100 constants on one field */
+  int ids[100];
+  for (int i = 0; i < 100; i++) {
+    char expr[64];
+    snprintf(expr, sizeof(expr), "log.service == \"svc-%d\"", i);
+    ids[i] = nql_register(world, expr, NULL);
+    ck_assert_int_ge(ids[i], 0);
+  }
+  for (int i = 0; i < 100; i += 2) {
+    ck_assert_int_eq(nql_unregister(world, ids[i]), 0);
+  }
+
+  unsigned matched = 0;
+  uint64_t before = nblex_filter_dag_evaluations(world->filter_dag);
+  ck_assert_int_eq(nql_execute_all(world, event, NULL, NULL), 1);
+  ck_assert_uint_eq(nblex_filter_dag_evaluations(world->filter_dag) - before, 1);
+
+  json_object_set_new(event->data, "log.service", json_string("svc-36"));
+  ck_assert_int_eq(nql_execute_all(world, event, record_match, &matched), 0);
+  ck_assert_uint_eq(matched, 0);
+
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+static size_t batch_results_emitted;
+
+static void count_results(nblex_event* event, void* user_data) {
+  (void)event;
+  (void)user_data;
+  batch_results_emitted++;
+}
+
+/* Helper: Events mixing log levels, services and database traffic */
+static nblex_event** build_batch_events(nblex_input* input, size_t count) {
+  static const char* levels[] = {"DEBUG", "INFO", "ERROR"};
+  static const char* services[] = {"api", "db", "cache", "auth"};
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  ck_assert_ptr_ne(events, NULL);
+  for (size_t i = 0; i < count; i++) {
+    events[i] = nblex_event_new(i % 7 == 3 ? NBLEX_EVENT_NETWORK : NBLEX_EVENT_LOG, input);
+    events[i]->data = json_object();
+    events[i]->timestamp_ns = 1000000000000ULL + i * 10000000ULL;
+    if (i % 7 == 3) {
+      json_object_set_new(events[i]->data, "network.dst_port", json_integer(3306));
+    } else {
+      json_object_set_new(events[i]->data, "log.level", json_string(levels[i % 3]));
+      json_object_set_new(events[i]->data, "log.service", json_string(services[i % 4]));
+    }
+  }
+  return events;
+}
+
+START_TEST(test_nql_execute_batch_matches_per_event) {
+  static const char* queries[] = {
+    "log.level == \"ERROR\" or log.service == \"db\"",
+    "not log.level == \"DEBUG\" | aggregate count() by log.service",
+    "correlate log.level == \"ERROR\" with network.dst_port == 3306 within 100ms",
+  };
+  /* Crosses a batch boundary */
+  const size_t count = NBLEX_BATCH_SIZE + 44;
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    uint32_t expected[NBLEX_BATCH_SIZE + 44];
+    uint32_t matched[NBLEX_BATCH_SIZE + 44];
+    size_t expected_count = 0;
+    size_t expected_results;
+
+    /* One event at a time */
+    nblex_world* world = nblex_world_new();
+    ck_assert_int_eq(nblex_world_open(world), 0);
+    nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+    nblex_set_event_handler(world, count_results, NULL);
+    nblex_event** events = build_batch_events(input, count);
+    nql_prepared_t* prepared = nql_prepare(queries[q], world);
+    ck_assert_ptr_ne(prepared, NULL);
+    batch_results_emitted = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (nql_execute_prepared(prepared, events[i])) {
+        expected[expected_count++] = (uint32_t)i;
+      }
+    }
+    expected_results = batch_results_emitted;
+    nql_prepared_free(prepared);
+
+    /* Batch at a time, on fresh state */
+    prepared = nql_prepare(queries[q], world);
+    ck_assert_ptr_ne(prepared, NULL);
+    batch_results_emitted = 0;
+    size_t matched_count = nql_execute_prepared_batch(prepared, events, count, matched);
+    ck_assert_uint_eq(matched_count, expected_count);
+    ck_assert_int_eq(memcmp(matched, expected, expected_count * sizeof(uint32_t)), 0);
+    ck_assert_uint_eq(batch_results_emitted, expected_results);
+    ck_assert_uint_gt(expected_count, 0);
+    if (q > 0) {
+      ck_assert_uint_gt(expected_results, 0);
+    }
+    nql_prepared_free(prepared);
+
+    for (size_t i = 0; i < count; i++) {
+      nblex_event_free(events[i]);
+    }
+    free(events);
+    nblex_input_free(input);
+    nblex_world_free(world);
+  }
+}
+END_TEST
+
+/* Aggregation results in order, as compact JSON */
+static char* worker_results[512];
+static size_t worker_results_count;
+
+static void collect_results(nblex_event* event, void* user_data) {
+  (void)user_data;
+  if (worker_results_count < sizeof(worker_results) / sizeof(worker_results[0])) {
+    worker_results[worker_results_count++] = nblex_json_dumps(event->data, JSON_COMPACT | JSON_SORT_KEYS);
+  }
+}
+
+/* Helper: Run a query over events a batch at a time with some number of
+ * worker threads, close every window and collect the results */
+static void run_with_workers(const char* query, size_t threads, size_t count) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_set_worker_threads(world, threads), 0);
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, collect_results, NULL);
+
+  nblex_event** events = calloc(count, sizeof(nblex_event*));
+  ck_assert_ptr_ne(events, NULL);
+  for (size_t i = 0; i < count; i++) {
+    char user[16];
+    snprintf(user, sizeof(user), "u%zu", (i * 7) % 97);
+    events[i] = nblex_event_new(NBLEX_EVENT_LOG, input);
+    events[i]->data = json_object();
+    events[i]->timestamp_ns = 1000000000000ULL + i * 1000000ULL;
+    json_object_set_new(events[i]->data, "service", json_integer((json_int_t)(i % 6)));
+    json_object_set_new(events[i]->data, "latency", json_real(0.1 + (double)((i * 37) % 101) / 3.0));
+    json_object_set_new(events[i]->data, "user", json_string(user));
+  }
+
+  nql_prepared_t* prepared = nql_prepare(query, world);
+  ck_assert_ptr_ne(prepared, NULL);
+  ck_assert_uint_eq(nql_execute_prepared_batch(prepared, events, count, NULL), count);
+  ck_assert_uint_eq(threads > 1, world->workers != NULL);
+  /* A sliding group reschedules itself for its next window */
+  while (nblex_scheduler_run(nblex_world_window_scheduler(world), UINT64_MAX) > 0) {
+  }
+
+  nql_prepared_free(prepared);
+  for (size_t i = 0; i < count; i++) {
+    nblex_event_free(events[i]);
+  }
+  free(events);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+
+START_TEST(test_nql_execute_batch_worker_threads) {
+  static const char* queries[] = {
+    "aggregate count(), sum(latency), min(latency), max(latency), avg(latency), "
+    "percentile(latency, 95), distinct(user) by service window tumbling(250ms)",
+    "aggregate count(), sum(latency), percentile(latency, 50) by service "
+    "window sliding(500ms, 100ms)",
+  };
+  const size_t count = 4 * NBLEX_BATCH_SIZE + 17;
+
+  for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+    char* expected[512];
+    worker_results_count = 0;
+    run_with_workers(queries[q], 1, count);
+    size_t expected_count = worker_results_count;
+    memcpy(expected, worker_results, expected_count * sizeof(char*));
+    ck_assert_uint_gt(expected_count, 6);
+
+    /* Every bucket is updated in event order by one thread, so even
+     * floating point sums and sketches come out the same */
+    worker_results_count = 0;
+    run_with_workers(queries[q], 4, count);
+    ck_assert_uint_eq(worker_results_count, expected_count);
+    for (size_t i = 0; i < expected_count; i++) {
+      ck_assert_str_eq(worker_results[i], expected[i]);
+      free(worker_results[i]);
+      free(expected[i]);
+    }
+  }
+}
+END_TEST
+
+START_TEST(test_nql_explain_analyze) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "log.level", json_string("ERROR"));
+  json_object_set_new(event->data, "log.service", json_string("api"));
+
+  /* explain alone describes the plan without running the query */
+  nql_prepared_t* plan = nql_prepare(
+      "explain log.level == \"ERROR\" | aggregate count() by log.service window tumbling(1m)",
+      world);
+  ck_assert_ptr_ne(plan, NULL);
+  ck_assert_int_eq(nql_execute_prepared(plan, event), 0);
+  char* text = nql_explain(plan);
+  ck_assert_ptr_ne(text, NULL);
+  ck_assert_ptr_ne(strstr(text, "stage 1: filter"), NULL);
+  ck_assert_ptr_ne(strstr(text, "where: log.level == \"ERROR\""), NULL);
+  ck_assert_ptr_ne(strstr(text, "stage 2: aggregate"), NULL);
+  ck_assert_ptr_ne(strstr(text, "group by: log.service"), NULL);
+  ck_assert_ptr_ne(strstr(text, "window: tumbling 60000 ms"), NULL);
+  ck_assert_ptr_eq(strstr(text, "events:"), NULL);
+  nblex_free(text);
+  nql_prepared_free(plan);
+
+  /* explain analyze runs it, counting per stage */
+  nql_prepared_t* prepared = nql_prepare(
+      "explain analyze log.level == \"ERROR\" | aggregate count() by log.service "
+      "window tumbling(1m)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  for (int i = 0; i < 10; i++) {
+    json_object_set_new(event->data, "log.level", json_string(i < 4 ? "ERROR" : "INFO"));
+    nql_execute_prepared(prepared, event);
+  }
+  nblex_event* batch[6];
+  for (int i = 0; i < 6; i++) {
+    batch[i] = event;
+  }
+  json_object_set_new(event->data, "log.level", json_string("ERROR"));
+  ck_assert_uint_eq(nql_execute_prepared_batch(prepared, batch, 6, NULL), 6);
+  
+  nql_stage_stats_t filter_stats;
+  nql_stage_stats_t agg_stats;
+  ck_assert_int_eq(nql_prepared_get_stage_stats(prepared, 0, &filter_stats), 0);
+  ck_assert_int_eq(nql_prepared_get_stage_stats(prepared, 1, &agg_stats), 0);
+  ck_assert_int_eq(nql_prepared_get_stage_stats(prepared, 2, &agg_stats), -1);
+  ck_assert_uint_eq(filter_stats.events_in, 16);
+  ck_assert_uint_eq(filter_stats.events_out, 10);
+  ck_assert_uint_eq(agg_stats.events_in, 10);
+  ck_assert_uint_eq(agg_stats.events_out, 10);
+  ck_assert_uint_gt(agg_stats.time_ns, 0);
+  ck_assert_uint_gt(agg_stats.allocations, 0);
+
+  text = nql_explain(prepared);
+  ck_assert_ptr_ne(text, NULL);
+  ck_assert_ptr_ne(strstr(text, "events: 16 in, 10 out (62.5%)"), NULL);
+  ck_assert_ptr_ne(strstr(text, "buckets: 1 open"), NULL);
+  ck_assert_ptr_ne(strstr(text, "memory: "), NULL);
+  nblex_free(text);
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_registry_string_index) {
+  nql_registry_t* registry = nql_registry_new();
+  ck_assert_ptr_ne(registry, NULL);
+
+  char keys[200][32];
+  int ids[200];
+  for (int i = 0; i < 200; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "log.code == %d", i);
+    ids[i] = nql_registry_add(registry, (nql_prepared_t*)(uintptr_t)(i + 1), keys[i]);
+    ck_assert_int_eq(ids[i], i);
+  }
+  ck_assert_uint_eq(nql_registry_count(registry), 200);
+
+  /* Remove every third entry; the rest must stay reachable */
+  for (int i = 0; i < 200; i += 3) {
+    nql_registry_remove(registry, ids[i]);
+  }
+  for (int i = 0; i < 200; i++) {
+    nql_prepared_t* found = nql_registry_find(registry, keys[i]);
+    if (i % 3 == 0) {
+      ck_assert_ptr_eq(found, NULL);
+      ck_assert_ptr_eq(nql_registry_get(registry, ids[i]), NULL);
+    } else {
+      ck_assert_ptr_eq(found, (nql_prepared_t*)(uintptr_t)(i + 1));
+      ck_assert_ptr_eq(nql_registry_get(registry, ids[i]), found);
+    }
+  }
+  ck_assert_ptr_eq(nql_registry_find(registry, "log.code == 1000"), NULL);
+  ck_assert_ptr_eq(nql_registry_get(registry, 1000), NULL);
+
+  nql_registry_free(registry);
+}
+END_TEST
+
+/* Helper: Run a standing aggregate on a private world; returns final count */
+static void* run_world_thread(void* arg) {
+  long* result = (long*)arg;
+  nblex_world* world = nblex_world_new();
+  nblex_world_open(world);
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+
+  const char* expr = "aggregate count() by log.service window tumbling(1m)";
+  int id = nql_register(world, expr, NULL);
+  for (int i = 0; i < 2000; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_object();
+    json_object_set_new(event->data, "log.service", json_string(i % 2 ? "api" : "db"));
+    event->timestamp_ns = 1000000000000ULL;
+    *result += nql_execute_id(world, id, event);
+    *result += nql_execute(expr, event, world);
+    nblex_event_free(event);
+  }
+
+  nblex_input_free(input);
+  nblex_world_free(world);
+  return NULL;
+}
+
+START_TEST(test_nql_registry_worlds_on_threads) {
+  pthread_t threads[4];
+  long results[4] = {0, 0, 0, 0};
+
+  for (int i = 0; i < 4; i++) {
+    ck_assert_int_eq(pthread_create(&threads[i], NULL, run_world_thread, &results[i]), 0);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+    ck_assert_int_eq(results[i], 4000);
+  }
+}
+END_TEST
+
+START_TEST(test_nql_execute_aggregate_many_groups) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nql_prepared_t* prepared = nql_prepare("aggregate count() by client.ip", world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  /* Every group seen twice: the second pass must find the first bucket */
+  for (int pass = 1; pass <= 2; pass++) {
+    for (int i = 0; i < 5000; i++) {
+      char ip[32];
+      snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 256, i % 256);
+      json_object_set_new(event->data, "client.ip", json_string(ip));
+      ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+      json_t* metrics = json_object_get(test_captured_event->data, "metrics");
+      ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), pass);
+      /* Keep only the latest result */
+      test_reset_captured_events();
+    }
+  }
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_aggregate_percentile) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "network.latency_ms", json_real(0.0));
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nql_prepared_t* prepared = nql_prepare(
+      "aggregate percentile(network.latency_ms, 90), "
+      "percentile(network.latency_ms, 50, exact)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  /* Values 1000..1 arrive in descending order */
+  for (int i = 1000; i >= 1; i--) {
+    json_object_set_new(event->data, "network.latency_ms", json_real(i));
+    test_reset_captured_events();
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  }
+
+  ck_assert_ptr_ne(test_captured_event, NULL);
+  json_t* metrics = json_object_get(test_captured_event->data, "metrics");
+  double p90 = json_real_value(json_object_get(metrics, "p90_network.latency_ms"));
+  double p50 = json_real_value(json_object_get(metrics, "p50_network.latency_ms"));
+  ck_assert(fabs(p90 - 901.0) <= 901.0 * NQL_PERCENTILE_DEFAULT_ACCURACY);
+  ck_assert_double_eq(p50, 501.0);
+
+  test_reset_captured_events();
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_aggregate_distinct_strings) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "user.id", json_string(""));
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate count(), distinct(user.id), distinct(status)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  /* 50 distinct string IDs, and numeric statuses stored as int or real */
+  for (int i = 0; i < 500; i++) {
+    char id[32];
+    snprintf(id, sizeof(id), "user-%d", i % 50);
+    json_object_set_new(event->data, "user.id", json_string(id));
+    json_object_set_new(event->data, "status",
+                        (i % 2) ? json_integer(200 + i % 3) : json_real(200 + i % 3));
+    test_reset_captured_events();
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  }
+
+  ck_assert_ptr_ne(test_captured_event, NULL);
+  json_t* metrics = json_object_get(test_captured_event->data, "metrics");
+  ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), 500);
+  ck_assert_int_eq(json_integer_value(json_object_get(metrics, "distinct_user.id")), 50);
+  ck_assert_int_eq(json_integer_value(json_object_get(metrics, "distinct_status")), 3);
+
+  test_reset_captured_events();
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_aggregate_steady_state_no_alloc) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  json_object_set_new(event->data, "network.latency_ms", json_real(12.5));
+  json_object_set_new(event->data, "status", json_integer(200));
+  event->timestamp_ns = 3600ULL * 1000000000ULL * 10;
+
+  nql_prepared_t* prepared = nql_prepare(
+      "aggregate count(), sum(network.latency_ms) by client.ip, status window tumbling(1h)",
+      world);
+  ck_assert_ptr_ne(prepared, NULL);
+
+  json_t* ips[64];
+  for (int i = 0; i < 64; i++) {
+    char ip[32];
+    snprintf(ip, sizeof(ip), "10.0.0.%d", i);
+    ips[i] = json_string(ip);
+  }
+
+  /* First pass creates every bucket */
+  for (int i = 0; i < 64; i++) {
+    json_object_set(event->data, "client.ip", ips[i]);
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  }
+
+  /* Known groups are found without touching the heap */
+  nblex_memory_stats_t before;
+  nblex_memory_stats_t after;
+  nblex_memory_get_stats(&before);
+  for (int i = 0; i < 10000; i++) {
+    json_object_set(event->data, "client.ip", ips[(i * 7) % 64]);
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  }
+  nblex_memory_get_stats(&after);
+  ck_assert_uint_eq(after.allocations, before.allocations);
+  ck_assert_uint_eq(after.frees, before.frees);
+
+  for (int i = 0; i < 64; i++) {
+    json_decref(ips[i]);
+  }
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+static size_t evicted_results;
+static size_t other_count;
+static size_t results_count_sum;
+
+/* Tally aggregation results: evicted ones, and counts per group */
+static void tally_results(nblex_event* event, void* user_data) {
+  (void)user_data;
+  if (json_is_true(json_object_get(event->data, "evicted"))) {
+    evicted_results++;
+  }
+  json_t* metrics = json_object_get(event->data, "metrics");
+  json_int_t count = json_integer_value(json_object_get(metrics, "count"));
+  results_count_sum += (size_t)count;
+  json_t* group = json_object_get(event->data, "group");
+  if (strcmp(json_string_value(json_object_get(group, "client.ip")), "__other__") == 0) {
+    other_count += (size_t)count;
+  }
+}
+
+/* Feed `groups` distinct client IPs, all in one hour window */
+static void feed_groups(nql_prepared_t* prepared, nblex_event* event, int groups) {
+  for (int i = 0; i < groups; i++) {
+    char ip[32];
+    snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 256, i % 256);
+    json_object_set_new(event->data, "client.ip", json_string(ip));
+    event->timestamp_ns = 3600ULL * 1000000000ULL * 10 + (uint64_t)i;
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+  }
+}
+
+START_TEST(test_nql_execute_memory_limit_evicts) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  nblex_set_event_handler(world, tally_results, NULL);
+  evicted_results = 0;
+  results_count_sum = 0;
+  other_count = 0;
+
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate count() by client.ip window tumbling(1h)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  ck_assert_int_eq(nql_prepared_set_memory_limit(prepared, 64 * 1024, NQL_EVICT_EMIT), 0);
+
+  feed_groups(prepared, event, 5000);
+
+  /* Least recently updated groups were emitted early to stay in budget */
+  nql_memory_stats_t stats;
+  ck_assert_int_eq(nql_prepared_get_memory_stats(prepared, &stats), 0);
+  ck_assert_uint_eq(stats.limit, 64 * 1024);
+  ck_assert_uint_le(stats.used, stats.limit);
+  ck_assert_uint_gt(stats.peak, 0);
+  ck_assert_uint_gt(stats.evicted, 0);
+  ck_assert_uint_eq(stats.evicted, evicted_results);
+  ck_assert_uint_eq(stats.folded, 0);
+  ck_assert_uint_eq(stats.dropped, 0);
+  ck_assert_uint_eq(results_count_sum, evicted_results);
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_memory_limit_folds_other) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  ck_assert_int_eq(nblex_world_set_event_time(world, NULL, 0), 0);
+  nblex_set_event_handler(world, tally_results, NULL);
+  evicted_results = 0;
+  results_count_sum = 0;
+  other_count = 0;
+
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate count() by client.ip window tumbling(1h)", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  ck_assert_int_eq(nql_prepared_set_memory_limit(prepared, 64 * 1024, NQL_EVICT_FOLD), 0);
+
+  feed_groups(prepared, event, 5000);
+  nql_memory_stats_t stats;
+  ck_assert_int_eq(nql_prepared_get_memory_stats(prepared, &stats), 0);
+  ck_assert_uint_gt(stats.folded, 0);
+  ck_assert_uint_eq(stats.evicted, 0);
+  ck_assert_uint_eq(results_count_sum, 0);
+
+  /* Closing the window accounts for every event, folded or not */
+  nblex_world_advance_watermark(world, 3600ULL * 1000000000ULL * 11);
+  ck_assert_uint_eq(evicted_results, 0);
+  ck_assert_uint_eq(results_count_sum, 5000);
+  ck_assert_uint_eq(other_count, stats.folded);
+
+  nql_prepared_free(prepared);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_world_query_memory_limit) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  nblex_set_event_handler(world, tally_results, NULL);
+  evicted_results = 0;
+  results_count_sum = 0;
+  other_count = 0;
+
+  /* The world's budget and policy reach queries prepared before and after */
+  nql_prepared_t* before =
+      nql_prepare("aggregate count() by client.ip window tumbling(1h)", world);
+  ck_assert_ptr_ne(before, NULL);
+  ck_assert_int_eq(nblex_world_set_query_memory_limit(world, 64 * 1024, NBLEX_EVICT_FOLD), 0);
+  nql_prepared_t* after =
+      nql_prepare("aggregate count() by client.ip window tumbling(1h)", world);
+  ck_assert_ptr_ne(after, NULL);
+  ck_assert_int_eq(nblex_world_set_query_memory_limit(world, 0, (nblex_evict_policy)2), -1);
+
+  feed_groups(before, event, 5000);
+  feed_groups(after, event, 5000);
+  nql_memory_stats_t stats;
+  ck_assert_int_eq(nql_prepared_get_memory_stats(before, &stats), 0);
+  ck_assert_uint_eq(stats.limit, 64 * 1024);
+  ck_assert_uint_gt(stats.folded, 0);
+  ck_assert_int_eq(nql_prepared_get_memory_stats(after, &stats), 0);
+  ck_assert_uint_eq(stats.limit, 64 * 1024);
+  ck_assert_uint_gt(stats.folded, 0);
+  ck_assert_uint_eq(stats.evicted, 0);
+  ck_assert_uint_eq(evicted_results, 0);
+
+  ck_assert_int_eq(nblex_world_set_query_memory_limit(world, 0, NBLEX_EVICT_EMIT), 0);
+  ck_assert_int_eq(nql_prepared_get_memory_stats(before, &stats), 0);
+  ck_assert_uint_eq(stats.limit, 0);
+
+  nql_prepared_free(before);
+  nql_prepared_free(after);
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_execute_world_memory_limit) {
+  nblex_world* world = NULL;
+  nblex_input* input = NULL;
+  nblex_event* event =
+      test_build_event_with_field(&world, &input, "client.ip", json_string(""));
+  nblex_set_event_handler(world, tally_results, NULL);
+  evicted_results = 0;
+  results_count_sum = 0;
+  other_count = 0;
+  ck_assert_int_eq(nblex_world_set_memory_limit(world, 128 * 1024), 0);
+
+  nql_prepared_t* first =
+      nql_prepare("aggregate count() by client.ip window tumbling(1h)", world);
+  nql_prepared_t* second =
+      nql_prepare("aggregate count() by client.ip window tumbling(2h)", world);
+  ck_assert_ptr_ne(first, NULL);
+  ck_assert_ptr_ne(second, NULL);
+
+  for (int i = 0; i < 5000; i++) {
+    char ip[32];
+    snprintf(ip, sizeof(ip), "10.0.%d.%d", i / 256, i % 256);
+    json_object_set_new(event->data, "client.ip", json_string(ip));
+    nql_execute_prepared(first, event);
+    nql_execute_prepared(second, event);
+  }
+
+  /* Both queries are charged to the world's budget */
+  nql_memory_stats_t first_stats;
+  nql_memory_stats_t second_stats;
+  nql_prepared_get_memory_stats(first, &first_stats);
+  nql_prepared_get_memory_stats(second, &second_stats);
+  size_t usage = atomic_load(&world->memory.used);
+  ck_assert_uint_gt(usage, 0);
+  ck_assert_uint_le(usage, 128 * 1024);
+  ck_assert_uint_eq(usage, first_stats.used + second_stats.used);
+  ck_assert_uint_gt(first_stats.evicted + second_stats.evicted, 0);
+
+  /* The limit installed nblex's JSON allocator; live JSON counts too */
+  ck_assert_uint_gt(nblex_json_live_bytes(), 0);
+  ck_assert_uint_ge(nblex_world_get_memory_usage(world), usage + nblex_json_live_bytes());
+
+  /* Freeing the queries returns everything they were charged */
+  nql_prepared_free(first);
+  nql_prepared_free(second);
+  ck_assert_uint_eq(atomic_load(&world->memory.used), 0);
+
+  nblex_event_free(event);
+  nblex_input_free(input);
+  nblex_world_free(world);
+}
+END_TEST
+
+START_TEST(test_nql_interner_ids) {
+  nql_interner_t* interner = nql_interner_new(2);
+  ck_assert_ptr_ne(interner, NULL);
+
+  nql_key_part_t a[2] = { { "api", 3 }, { "200", 3 } };
+  nql_key_part_t b[2] = { { "api", 3 }, { "500", 3 } };
+  /* Parts are compared by length and bytes, not NUL-terminated */
+  nql_key_part_t a_copy[2] = { { "apix", 3 }, { "2001", 3 } };
+
+  int id_a = nql_interner_intern(interner, a);
+  int id_b = nql_interner_intern(interner, b);
+  ck_assert_int_ge(id_a, 0);
+  ck_assert_int_ne(id_a, id_b);
+  ck_assert_int_eq(nql_interner_intern(interner, a_copy), id_a);
+  ck_assert_uint_eq(nql_interner_hash(interner, id_a), nql_interner_hash_parts(a, 2));
+  ck_assert_str_eq(nql_interner_part(interner, id_a, 0), "api");
+  ck_assert_str_eq(nql_interner_part(interner, id_b, 1), "500");
+  ck_assert_uint_eq(nql_interner_count(interner), 2);
+
+  /* id_a holds two references */
+  nql_interner_release(interner, id_a);
+  ck_assert_uint_eq(nql_interner_count(interner), 2);
+  nql_interner_release(interner, id_a);
+  ck_assert_uint_eq(nql_interner_count(interner), 1);
+  ck_assert_ptr_eq(nql_interner_part(interner, id_a, 0), NULL);
+
+  /* A released ID is reused */
+  nql_key_part_t c[2] = { { "web", 3 }, { "404", 3 } };
+  ck_assert_int_eq(nql_interner_intern(interner, c), id_a);
+
+  nql_interner_free(interner);
+}
+END_TEST
+
+START_TEST(test_nql_interner_compaction) {
+  nql_interner_t* interner = nql_interner_new(1);
+  int ids[20000];
+  char buf[64];
+
+  for (int round = 0; round < 5; round++) {
+    /* Intern a batch, then release all but every tenth key */
+    for (int i = 0; i < 20000; i++) {
+      snprintf(buf, sizeof(buf), "round-%d-key-%d", round, i);
+      nql_key_part_t part = { buf, strlen(buf) };
+      ids[i] = nql_interner_intern(interner, &part);
+      ck_assert_int_ge(ids[i], 0);
+    }
+    for (int i = 0; i < 20000; i++) {
+      if (i % 10 != 0 || round < 4) {
+        nql_interner_release(interner, ids[i]);
+      }
+    }
+  }
+
+  /* Survivors keep their IDs and contents across compactions */
+  ck_assert_uint_eq(nql_interner_count(interner), 2000);
+  for (int i = 0; i < 20000; i += 10) {
+    snprintf(buf, sizeof(buf), "round-4-key-%d", i);
+    ck_assert_str_eq(nql_interner_part(interner, ids[i], 0), buf);
+    nql_key_part_t part = { buf, strlen(buf) };
+    ck_assert_int_eq(nql_interner_intern(interner, &part), ids[i]);
+  }
+  /* Dead tuples were reclaimed rather than accumulated */
+  ck_assert_uint_le(nql_interner_arena_size(interner), 2 * 1024 * 1024);
+
+  nql_interner_free(interner);
+}
+END_TEST
+
 Suite* nql_execute_suite(void) {
   Suite* s = suite_create("nQL Execute");
 
@@ -414,17 +1465,49 @@ Suite* nql_execute_suite(void) {
   tcase_add_test(tc_aggregate, test_nql_execute_aggregate_where);
   tcase_add_test(tc_aggregate, test_nql_execute_aggregate_emits_event);
   tcase_add_test(tc_aggregate, test_nql_execute_aggregate_group_by);
+  tcase_add_test(tc_aggregate, test_nql_execute_aggregate_many_groups);
+  tcase_add_test(tc_aggregate, test_nql_execute_aggregate_percentile);
+  tcase_add_test(tc_aggregate, test_nql_execute_aggregate_distinct_strings);
+  tcase_add_test(tc_aggregate, test_nql_execute_aggregate_steady_state_no_alloc);
+  tcase_add_test(tc_aggregate, test_nql_execute_memory_limit_evicts);
+  tcase_add_test(tc_aggregate, test_nql_execute_memory_limit_folds_other);
+  tcase_add_test(tc_aggregate, test_nql_execute_world_memory_limit);
+  tcase_add_test(tc_aggregate, test_nql_execute_world_query_memory_limit);
   suite_add_tcase(s, tc_aggregate);
 
   TCase* tc_correlate = tcase_create("Correlate");
   tcase_add_test(tc_correlate, test_nql_execute_correlate_emits_event);
   tcase_add_test(tc_correlate, test_nql_execute_correlate_bidirectional);
+  tcase_add_test(tc_correlate, test_nql_execute_correlate_on_key);
   suite_add_tcase(s, tc_correlate);
 
   TCase* tc_timers = tcase_create("Timers");
   tcase_add_test(tc_timers, test_nql_execute_lazy_timer_initialization);
   suite_add_tcase(s, tc_timers);
 
+  TCase* tc_prepared = tcase_create("Prepared");
+  tcase_add_test(tc_prepared, test_nql_prepare_invalid_query);
+  tcase_add_test(tc_prepared, test_nql_execute_prepared_filter);
+  tcase_add_test(tc_prepared, test_nql_execute_prepared_owns_state);
+  tcase_add_test(tc_prepared, test_nql_prepared_free_after_world);
+  tcase_add_test(tc_prepared, test_nql_execute_batch_matches_per_event);
+  tcase_add_test(tc_prepared, test_nql_execute_batch_worker_threads);
+  tcase_add_test(tc_prepared, test_nql_explain_analyze);
+  suite_add_tcase(s, tc_prepared);
+
+  TCase* tc_registry = tcase_create("Registry");
+  tcase_add_test(tc_registry, test_nql_register_query_ids);
+  tcase_add_test(tc_registry, test_nql_registry_string_index);
+  tcase_add_test(tc_registry, test_nql_execute_all_shared_predicates);
+  tcase_add_test(tc_registry, test_nql_execute_all_equality_group);
+  tcase_add_test(tc_registry, test_nql_registry_worlds_on_threads);
+  suite_add_tcase(s, tc_registry);
+
+  TCase* tc_interner = tcase_create("Interner");
+  tcase_add_test(tc_interner, test_nql_interner_ids);
+  tcase_add_test(tc_interner, test_nql_interner_compaction);
+  suite_add_tcase(s, tc_interner);
+
   return s;
 }
 
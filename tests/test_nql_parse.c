@@ -19,6 +19,7 @@
 #endif
 
 #include <check.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "../src/nblex_internal.h"
@@ -48,11 +49,35 @@ START_TEST(test_nql_parse_correlate) {
   ck_assert_ptr_ne(corr->left_filter, NULL);
   ck_assert_ptr_ne(corr->right_filter, NULL);
   ck_assert_uint_eq(corr->within_ms, 1000);
+  ck_assert_ptr_eq(corr->on_field, NULL);
 
   nql_free(query);
 }
 END_TEST
 
+START_TEST(test_nql_parse_correlate_on_key) {
+  const char* expr =
+      "correlate log.level == ERROR with network.dst_port == 3306 "
+      "on request_id within 1s";
+  nql_query_t* query = nql_parse(expr);
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->type, NQL_QUERY_CORRELATE);
+
+  nql_correlate_t* corr = query->data.correlate;
+  ck_assert_ptr_ne(corr->right_filter, NULL);
+  ck_assert_str_eq(corr->on_field, "request_id");
+  ck_assert_uint_eq(corr->within_ms, 1000);
+  nql_free(query);
+
+  char* error = NULL;
+  query = nql_parse_ex("correlate log.level == ERROR with network.dst_port == 3306 on",
+                       &error);
+  ck_assert_ptr_eq(query, NULL);
+  ck_assert_ptr_ne(error, NULL);
+  nblex_free(error);
+}
+END_TEST
+
 START_TEST(test_nql_parse_aggregate) {
   const char* expr =
       "aggregate count(), avg(network.latency_ms) by log.service, log.endpoint "
@@ -109,6 +134,32 @@ START_TEST(test_nql_parse_pipeline) {
 }
 END_TEST
 
+START_TEST(test_nql_parse_explain) {
+  nql_query_t* query = nql_parse("log.level == \"ERROR\"");
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->explain, NQL_EXPLAIN_NONE);
+  nql_free(query);
+
+  query = nql_parse("explain aggregate count() by log.service");
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->type, NQL_QUERY_AGGREGATE);
+  ck_assert_int_eq(query->explain, NQL_EXPLAIN_PLAN);
+  nql_free(query);
+
+  query = nql_parse("EXPLAIN ANALYZE log.level == \"ERROR\" | show log.service");
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->type, NQL_QUERY_PIPELINE);
+  ck_assert_int_eq(query->explain, NQL_EXPLAIN_ANALYZE);
+  ck_assert_int_eq(query->data.pipeline.stages[0]->explain, NQL_EXPLAIN_NONE);
+  nql_free(query);
+
+  char* error = NULL;
+  ck_assert_ptr_eq(nql_parse_ex("explain analyze", &error), NULL);
+  ck_assert_ptr_ne(error, NULL);
+  nblex_free(error);
+}
+END_TEST
+
 START_TEST(test_nql_parse_correlate_default_window) {
   const char* expr =
       "correlate log.status >= 500 with network.tcp.retransmits > 0";
@@ -168,18 +219,128 @@ START_TEST(test_nql_parse_session_window) {
 }
 END_TEST
 
+START_TEST(test_nql_parse_percentile_accuracy) {
+  const char* expr =
+      "aggregate percentile(network.latency_ms, 95), "
+      "percentile(network.latency_ms, 99, 0.001), "
+      "percentile(network.latency_ms, 50, exact) by log.service";
+  nql_query_t* query = nql_parse(expr);
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->type, NQL_QUERY_AGGREGATE);
+
+  nql_aggregate_t* agg = query->data.aggregate;
+  ck_assert_uint_eq(agg->funcs_count, 3);
+  ck_assert_int_eq(agg->funcs[0].type, NQL_AGG_PERCENTILE);
+  ck_assert_double_eq(agg->funcs[0].percentile, 95.0);
+  ck_assert_double_eq(agg->funcs[0].accuracy, NQL_PERCENTILE_DEFAULT_ACCURACY);
+  ck_assert_double_eq(agg->funcs[1].percentile, 99.0);
+  ck_assert_double_eq(agg->funcs[1].accuracy, 0.001);
+  ck_assert_double_eq(agg->funcs[2].percentile, 50.0);
+  ck_assert_double_eq(agg->funcs[2].accuracy, 0.0);
+
+  nql_free(query);
+}
+END_TEST
+
+START_TEST(test_nql_parse_percentile_invalid) {
+  const char* exprs[] = {
+    "aggregate percentile(network.latency_ms, 150)",
+    "aggregate percentile(network.latency_ms, 95, 1.5)",
+    "aggregate percentile(network.latency_ms, 95, 0)",
+    "aggregate percentile(network.latency_ms, 95, fast)",
+  };
+
+  for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++) {
+    char* error = NULL;
+    nql_query_t* query = nql_parse_ex(exprs[i], &error);
+    ck_assert_ptr_eq(query, NULL);
+    ck_assert_ptr_ne(error, NULL);
+    free(error);
+  }
+}
+END_TEST
+
+START_TEST(test_nql_parse_top) {
+  struct {
+    const char* stage;
+    bool ordered;
+    bool descending;
+    uint64_t limit;
+    int func_index;
+  } cases[] = {
+    {"top(10) by percentile(network.latency_ms, 95)", true, true, 10, 1},
+    {"order by count() limit 5", true, false, 5, 0},
+    {"order by avg(network.latency_ms) desc", true, true, 0, 2},
+    {"limit 3", false, false, 3, -1},
+  };
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    char expr[256];
+    snprintf(expr, sizeof(expr),
+             "aggregate count(), percentile(network.latency_ms, 95), "
+             "avg(network.latency_ms) by log.endpoint window 1m | %s", cases[i].stage);
+    nql_query_t* query = nql_parse(expr);
+    ck_assert_ptr_ne(query, NULL);
+    ck_assert_int_eq(query->type, NQL_QUERY_PIPELINE);
+    ck_assert_uint_eq(query->data.pipeline.count, 2);
+
+    nql_query_t* stage = query->data.pipeline.stages[1];
+    ck_assert_int_eq(stage->type, NQL_QUERY_TOP);
+    ck_assert(stage->data.top->ordered == cases[i].ordered);
+    ck_assert(stage->data.top->descending == cases[i].descending);
+    ck_assert_uint_eq(stage->data.top->limit, cases[i].limit);
+    ck_assert_int_eq(stage->data.top->func_index, cases[i].func_index);
+    nql_free(query);
+  }
+
+  /* Fields named like the keywords are still filters */
+  nql_query_t* query = nql_parse("top == 1 | limit == 2");
+  ck_assert_ptr_ne(query, NULL);
+  ck_assert_int_eq(query->data.pipeline.stages[0]->type, NQL_QUERY_FILTER);
+  ck_assert_int_eq(query->data.pipeline.stages[1]->type, NQL_QUERY_FILTER);
+  nql_free(query);
+}
+END_TEST
+
+START_TEST(test_nql_parse_top_invalid) {
+  const char* exprs[] = {
+    "top(10) by count()",
+    "log.level == ERROR | limit 10",
+    "aggregate count() by log.service | top(10) by count()",
+    "aggregate count() by log.service window session(5s) | top(10) by count()",
+    "aggregate count() by log.service window 1m | top(10) by avg(latency)",
+    "aggregate count() by log.service window 1m | top(0) by count()",
+    "aggregate count() by log.service window 1m | top(10) count()",
+  };
+
+  for (size_t i = 0; i < sizeof(exprs) / sizeof(exprs[0]); i++) {
+    char* error = NULL;
+    nql_query_t* query = nql_parse_ex(exprs[i], &error);
+    ck_assert_ptr_eq(query, NULL);
+    ck_assert_ptr_ne(error, NULL);
+    free(error);
+  }
+}
+END_TEST
+
 Suite* nql_parse_suite(void) {
   Suite* s = suite_create("nQL Parse");
 
   TCase* tc_core = tcase_create("Core");
   tcase_add_test(tc_core, test_nql_parse_filter);
   tcase_add_test(tc_core, test_nql_parse_correlate);
+  tcase_add_test(tc_core, test_nql_parse_correlate_on_key);
   tcase_add_test(tc_core, test_nql_parse_aggregate);
   tcase_add_test(tc_core, test_nql_parse_show_all);
   tcase_add_test(tc_core, test_nql_parse_pipeline);
+  tcase_add_test(tc_core, test_nql_parse_explain);
   tcase_add_test(tc_core, test_nql_parse_correlate_default_window);
   tcase_add_test(tc_core, test_nql_parse_show_fields);
   tcase_add_test(tc_core, test_nql_parse_ex_error);
+  tcase_add_test(tc_core, test_nql_parse_percentile_accuracy);
+  tcase_add_test(tc_core, test_nql_parse_percentile_invalid);
+  tcase_add_test(tc_core, test_nql_parse_top);
+  tcase_add_test(tc_core, test_nql_parse_top_invalid);
   suite_add_tcase(s, tc_core);
 
   TCase* tc_windows = tcase_create("Windows");
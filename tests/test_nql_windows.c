@@ -19,6 +19,8 @@
 #endif
 
 #include <check.h>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "../src/nblex_internal.h"
@@ -389,20 +391,398 @@ START_TEST(test_nql_windowed_aggregate_schema) {
 }
 END_TEST
 
+/* Helper: Run the world's loop until `count` events are captured or
+ * `timeout_ms` elapses */
+static void run_loop_until_captured(nblex_world* world, size_t count, uint64_t timeout_ms) {
+  uint64_t deadline = nblex_timestamp_now() + timeout_ms * 1000000ULL;
+  while (test_captured_events_count < count && nblex_timestamp_now() < deadline) {
+    uv_run(world->loop, UV_RUN_ONCE);
+  }
+}
+
+/* Helper: Find a captured aggregation result by group and window start */
+static json_t* find_captured_result(const char* service, uint64_t window_start_ns) {
+  for (size_t i = 0; i < test_captured_events_count; i++) {
+    json_t* data = test_captured_events[i]->data;
+    json_t* group = json_object_get(data, "group");
+    json_t* window = json_object_get(data, "window");
+    if (group && window &&
+        strcmp(json_string_value(json_object_get(group, "log.service")), service) == 0 &&
+        (uint64_t)json_integer_value(json_object_get(window, "start_ns")) == window_start_ns) {
+      return data;
+    }
+  }
+  return NULL;
+}
+
+START_TEST(test_nql_tumbling_window_flush_groups) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  const char* services[] = {"api", "db", "web"};
+  uint64_t window_ns = 100000000ULL;
+  /* Two already-closed windows, aligned to the window size */
+  uint64_t base_ts = ((nblex_timestamp_now() / window_ns) - 10) * window_ns;
+
+  const char* expr = "aggregate count() by log.service window tumbling(100ms)";
+  for (int w = 0; w < 2; w++) {
+    for (int svc = 0; svc < 3; svc++) {
+      /* Service i gets (i + 1) events per window, plus w more */
+      for (int n = 0; n < svc + 1 + w; n++) {
+        nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+        event->data = json_object();
+        json_object_set_new(event->data, "log.service", json_string(services[svc]));
+        event->timestamp_ns = base_ts + (uint64_t)w * window_ns + (uint64_t)n * 1000;
+        ck_assert_int_eq(nql_execute(expr, event, world), 1);
+        nblex_event_free(event);
+      }
+    }
+  }
+
+  run_loop_until_captured(world, 6, 2000);
+  ck_assert_uint_eq(test_captured_events_count, 6);
+
+  for (int w = 0; w < 2; w++) {
+    for (int svc = 0; svc < 3; svc++) {
+      json_t* result = find_captured_result(services[svc], base_ts + (uint64_t)w * window_ns);
+      ck_assert_ptr_ne(result, NULL);
+      json_t* metrics = json_object_get(result, "metrics");
+      ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), svc + 1 + w);
+    }
+  }
+
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_nql_tumbling_window_flushes_only_due) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  /* Half the groups fall in a closed window, half in one that closes in
+   * an hour; only the closed ones may be touched. */
+  const size_t groups = 2000;
+  uint64_t window_ns = 100000000ULL;
+  uint64_t now = nblex_timestamp_now();
+  uint64_t closed_start = ((now / window_ns) - 10) * window_ns;
+  uint64_t open_start = ((now + 3600000000000ULL) / window_ns) * window_ns;
+
+  const char* expr = "aggregate count() by log.service window tumbling(100ms)";
+  nql_prepared_t* prepared = nql_prepare(expr, world);
+  ck_assert_ptr_ne(prepared, NULL);
+  for (size_t i = 0; i < groups; i++) {
+    char service[32];
+    snprintf(service, sizeof(service), "svc-%zu", i);
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_object();
+    json_object_set_new(event->data, "log.service", json_string(service));
+    event->timestamp_ns = (i % 2 ? open_start : closed_start) + i;
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+    nblex_event_free(event);
+  }
+  ck_assert_uint_eq(nblex_scheduler_pending(world->scheduler), groups);
+
+  run_loop_until_captured(world, groups / 2, 2000);
+  ck_assert_uint_eq(test_captured_events_count, groups / 2);
+  ck_assert_uint_eq(nblex_scheduler_pending(world->scheduler), groups / 2);
+  ck_assert_ptr_ne(find_captured_result("svc-0", closed_start), NULL);
+  ck_assert_ptr_eq(find_captured_result("svc-1", open_start), NULL);
+
+  /* Freeing the query takes its remaining deadlines out of the scheduler */
+  nql_prepared_free(prepared);
+  ck_assert_uint_eq(nblex_scheduler_pending(world->scheduler), 0);
+
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+/* Helper: Feed events at the given offsets (ms) through a sliding window
+ * query and check each emitted window against a direct count over the
+ * events, including merged max and percentile values.
+ */
+static void check_sliding_windows(const char* expr, uint64_t size_ms, uint64_t slide_ms,
+                                  const uint64_t* offsets_ms, size_t count) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  /* Offsets are taken from 20s after a base a minute and a half ago, so
+   * every window has closed; the base is aligned to the slide */
+  uint64_t ms = 1000000ULL;
+  uint64_t base_ts = ((nblex_timestamp_now() / (10000 * ms)) - 9) * 10000 * ms + 20000 * ms;
+
+  nql_prepared_t* prepared = nql_prepare(expr, world);
+  ck_assert_ptr_ne(prepared, NULL);
+  for (size_t i = 0; i < count; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_object();
+    json_object_set_new(event->data, "log.service", json_string("api"));
+    json_object_set_new(event->data, "latency", json_integer((json_int_t)i + 1));
+    event->timestamp_ns = base_ts + offsets_ms[i] * ms;
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+    nblex_event_free(event);
+  }
+
+  uint64_t lo = offsets_ms[0];
+  uint64_t hi = offsets_ms[0];
+  for (size_t i = 1; i < count; i++) {
+    lo = offsets_ms[i] < lo ? offsets_ms[i] : lo;
+    hi = offsets_ms[i] > hi ? offsets_ms[i] : hi;
+  }
+
+  /* Every window start (a multiple of the slide) holding an event */
+  size_t expected = 0;
+  int64_t first = ((int64_t)lo - (int64_t)size_ms) / (int64_t)slide_ms;
+  while (first * (int64_t)slide_ms + (int64_t)size_ms <= (int64_t)lo) {
+    first++;
+  }
+  for (int64_t start = first * (int64_t)slide_ms; start <= (int64_t)hi; start += (int64_t)slide_ms) {
+    json_int_t n = 0;
+    json_int_t max = 0;
+    for (size_t i = 0; i < count; i++) {
+      if ((int64_t)offsets_ms[i] >= start && (int64_t)offsets_ms[i] < start + (int64_t)size_ms) {
+        n++;
+        max = (json_int_t)i + 1;
+      }
+    }
+    if (n == 0) {
+      continue;
+    }
+    expected++;
+    run_loop_until_captured(world, expected, 2000);
+    json_t* result = find_captured_result("api", base_ts + (uint64_t)(start * (int64_t)ms));
+    ck_assert_ptr_ne(result, NULL);
+    json_t* window = json_object_get(result, "window");
+    ck_assert_uint_eq(json_integer_value(json_object_get(window, "end_ns")),
+                      base_ts + (uint64_t)((start + (int64_t)size_ms) * (int64_t)ms));
+    json_t* metrics = json_object_get(result, "metrics");
+    ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), n);
+    ck_assert_int_eq((json_int_t)json_real_value(json_object_get(metrics, "max_latency")), max);
+    double p100 = json_real_value(json_object_get(metrics, "p100_latency"));
+    ck_assert(fabs(p100 - (double)max) <= 0.01 * (double)max);
+  }
+  ck_assert_uint_eq(test_captured_events_count, expected);
+
+  nql_prepared_free(prepared);
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+
+START_TEST(test_nql_sliding_window_pane_results) {
+  /* Windows [-0.5, 0.5), [0, 1), [0.5, 1.5) and [1, 2) seconds; the
+   * events arrive out of order */
+  const uint64_t offsets_ms[] = {1200, 200, 700};
+  check_sliding_windows("aggregate count(), max(latency), percentile(latency, 100) "
+                        "by log.service window sliding(1s, 500ms)",
+                        1000, 500, offsets_ms, 3);
+}
+END_TEST
+
+START_TEST(test_nql_sliding_window_many_panes) {
+  /* 100 windows per event, and a slide that does not divide the size */
+  uint64_t offsets_ms[50];
+  for (size_t i = 0; i < 50; i++) {
+    offsets_ms[i] = 1000 + i * 40;
+  }
+  check_sliding_windows("aggregate count(), max(latency), percentile(latency, 100) "
+                        "by log.service window sliding(10s, 100ms)",
+                        10000, 100, offsets_ms, 50);
+  check_sliding_windows("aggregate count(), max(latency), percentile(latency, 100) "
+                        "by log.service window sliding(5s, 2s)",
+                        5000, 2000, offsets_ms, 50);
+}
+END_TEST
+
+START_TEST(test_nql_session_window_gap_starts_new_session) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  uint64_t base_ts = nblex_timestamp_now() - 60000000000ULL; /* 60s ago */
+  uint64_t offsets_ms[] = {0, 50, 100, 5000, 5050};
+
+  const char* expr = "aggregate count() by log.service window session(1s)";
+  for (size_t i = 0; i < 5; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_object();
+    json_object_set_new(event->data, "log.service", json_string("api"));
+    event->timestamp_ns = base_ts + offsets_ms[i] * 1000000ULL;
+    ck_assert_int_eq(nql_execute(expr, event, world), 1);
+    nblex_event_free(event);
+  }
+
+  /* The 4.9s gap splits the events into sessions of 3 and 2 */
+  run_loop_until_captured(world, 2, 2000);
+  ck_assert_uint_eq(test_captured_events_count, 2);
+  json_int_t counts[2];
+  for (size_t i = 0; i < 2; i++) {
+    json_t* metrics = json_object_get(test_captured_events[i]->data, "metrics");
+    counts[i] = json_integer_value(json_object_get(metrics, "count"));
+  }
+  ck_assert(counts[0] + counts[1] == 5 && (counts[0] == 3 || counts[1] == 3));
+
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_nql_top_tumbling_window) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  /* 50 groups in each of two closed windows: svc-i has i + 1 events in
+   * the first and 50 - i in the second */
+  const int groups = 50;
+  uint64_t window_ns = 100000000ULL;
+  uint64_t base_ts = ((nblex_timestamp_now() / window_ns) - 10) * window_ns;
+
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate count() by log.service window tumbling(100ms) | "
+                  "top(3) by count()", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  for (int w = 0; w < 2; w++) {
+    for (int svc = 0; svc < groups; svc++) {
+      int n = w == 0 ? svc + 1 : groups - svc;
+      for (int i = 0; i < n; i++) {
+        char service[32];
+        snprintf(service, sizeof(service), "svc-%d", svc);
+        nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+        event->data = json_object();
+        json_object_set_new(event->data, "log.service", json_string(service));
+        event->timestamp_ns = base_ts + (uint64_t)w * window_ns + (uint64_t)i * 1000;
+        ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+        nblex_event_free(event);
+      }
+    }
+  }
+
+  /* Only the three winners of each window are emitted, ranked */
+  run_loop_until_captured(world, 7, 500);
+  ck_assert_uint_eq(test_captured_events_count, 6);
+  const char* winners[2][3] = {{"svc-49", "svc-48", "svc-47"}, {"svc-0", "svc-1", "svc-2"}};
+  for (int w = 0; w < 2; w++) {
+    for (int rank = 0; rank < 3; rank++) {
+      json_t* result = find_captured_result(winners[w][rank], base_ts + (uint64_t)w * window_ns);
+      ck_assert_ptr_ne(result, NULL);
+      ck_assert_int_eq(json_integer_value(json_object_get(result, "rank")), rank + 1);
+      json_t* metrics = json_object_get(result, "metrics");
+      ck_assert_int_eq(json_integer_value(json_object_get(metrics, "count")), groups - rank);
+    }
+  }
+  ck_assert_uint_eq(nblex_scheduler_pending(world->scheduler), 0);
+
+  nql_prepared_free(prepared);
+  nblex_input_free(input);
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_nql_order_by_sliding_window) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_eq(nblex_world_set_event_time(world, NULL, 0), 0);
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  test_reset_captured_events();
+
+  /* Every event falls in the windows ending at 1s and 2s */
+  const char* services[] = {"a", "b", "c", "d", "e"};
+  const double latencies[] = {10.0, 50.0, 30.0, 20.0, 40.0};
+  uint64_t base_ts = 1000000000000ULL;
+
+  nql_prepared_t* prepared =
+      nql_prepare("aggregate avg(latency) by log.service window sliding(2s, 1s) | "
+                  "order by avg(latency) asc limit 2", world);
+  ck_assert_ptr_ne(prepared, NULL);
+  for (size_t i = 0; i < 5; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_object();
+    json_object_set_new(event->data, "log.service", json_string(services[i]));
+    json_object_set_new(event->data, "latency", json_real(latencies[i]));
+    event->timestamp_ns = base_ts + 500000000ULL + i;
+    ck_assert_int_eq(nql_execute_prepared(prepared, event), 1);
+    nblex_event_free(event);
+  }
+
+  nblex_world_advance_watermark(world, base_ts + 3000000000ULL);
+  ck_assert_uint_eq(test_captured_events_count, 4);
+  for (uint64_t start = base_ts - 1000000000ULL; start <= base_ts; start += 1000000000ULL) {
+    json_t* first = find_captured_result("a", start);
+    json_t* second = find_captured_result("d", start);
+    ck_assert_ptr_ne(first, NULL);
+    ck_assert_ptr_ne(second, NULL);
+    ck_assert_int_eq(json_integer_value(json_object_get(first, "rank")), 1);
+    ck_assert_int_eq(json_integer_value(json_object_get(second, "rank")), 2);
+  }
+
+  nql_prepared_free(prepared);
+  nblex_input_free(input);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
 Suite* nql_windows_suite(void) {
   Suite* s = suite_create("nQL Windows");
 
   TCase* tc_tumbling = tcase_create("Tumbling");
   tcase_add_test(tc_tumbling, test_nql_execute_tumbling_window);
   tcase_add_test(tc_tumbling, test_nql_execute_tumbling_window_different_windows);
+  tcase_add_test(tc_tumbling, test_nql_tumbling_window_flush_groups);
+  tcase_add_test(tc_tumbling, test_nql_tumbling_window_flushes_only_due);
   suite_add_tcase(s, tc_tumbling);
 
   TCase* tc_sliding = tcase_create("Sliding");
   tcase_add_test(tc_sliding, test_nql_execute_sliding_window_multiple_windows);
+  tcase_add_test(tc_sliding, test_nql_sliding_window_pane_results);
+  tcase_add_test(tc_sliding, test_nql_sliding_window_many_panes);
   suite_add_tcase(s, tc_sliding);
 
   TCase* tc_session = tcase_create("Session");
   tcase_add_test(tc_session, test_nql_execute_session_window);
+  tcase_add_test(tc_session, test_nql_session_window_gap_starts_new_session);
   suite_add_tcase(s, tc_session);
 
   TCase* tc_group_by = tcase_create("Group By");
@@ -410,6 +790,11 @@ Suite* nql_windows_suite(void) {
   tcase_add_test(tc_group_by, test_nql_execute_window_aggregation_functions);
   suite_add_tcase(s, tc_group_by);
 
+  TCase* tc_top = tcase_create("Top");
+  tcase_add_test(tc_top, test_nql_top_tumbling_window);
+  tcase_add_test(tc_top, test_nql_order_by_sliding_window);
+  suite_add_tcase(s, tc_top);
+
   TCase* tc_schema = tcase_create("Schema");
   tcase_add_test(tc_schema, test_nql_windowed_aggregate_schema);
   suite_add_tcase(s, tc_schema);
@@ -0,0 +1,239 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * test_scheduler.c - Unit tests for the deadline scheduler
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+/* Feature test macros must be defined before any system headers */
+#ifndef __APPLE__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/nblex_internal.h"
+
+Suite* scheduler_suite(void);
+
+#define DEADLINE_COUNT 1000
+
+/* Firing order, recorded by the callbacks below */
+static int fired_ids[DEADLINE_COUNT];
+static size_t fired_count;
+
+static void record_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+  (void)now_ns;
+  if (fired_count < DEADLINE_COUNT) {
+    fired_ids[fired_count] = (int)(intptr_t)deadline->data;
+  }
+  fired_count++;
+}
+
+/* Reschedule itself at the time it fired */
+static nblex_scheduler_t* repeat_scheduler;
+
+static void repeat_here_cb(nblex_deadline_t* deadline, uint64_t now_ns) {
+  record_cb(deadline, now_ns);
+  nblex_deadline_schedule(repeat_scheduler, deadline, now_ns);
+}
+
+/* Helper: Free a scheduler and run the loop so its timer is closed */
+static void free_scheduler(uv_loop_t* loop, nblex_scheduler_t* scheduler) {
+  nblex_scheduler_free(scheduler);
+  uv_run(loop, UV_RUN_NOWAIT);
+}
+
+START_TEST(test_scheduler_order) {
+  uv_loop_t loop;
+  ck_assert_int_eq(uv_loop_init(&loop), 0);
+  nblex_scheduler_t* scheduler = nblex_scheduler_new(&loop);
+  ck_assert_ptr_ne(scheduler, NULL);
+
+  /* Pseudo-random deadlines in [0, 100), many of them equal */
+  static nblex_deadline_t deadlines[DEADLINE_COUNT];
+  uint64_t x = 88172645463325252ULL;
+  for (int i = 0; i < DEADLINE_COUNT; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    nblex_deadline_init(&deadlines[i], record_cb, (void*)(intptr_t)i);
+    ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[i], x % 100), 0);
+  }
+  ck_assert_uint_eq(nblex_scheduler_pending(scheduler), DEADLINE_COUNT);
+
+  /* Only the due half fires */
+  fired_count = 0;
+  size_t due = 0;
+  for (int i = 0; i < DEADLINE_COUNT; i++) {
+    due += deadlines[i].when_ns < 50;
+  }
+  ck_assert_uint_eq(nblex_scheduler_run(scheduler, 49), due);
+  ck_assert_uint_eq(nblex_scheduler_pending(scheduler), DEADLINE_COUNT - due);
+  ck_assert_uint_eq(nblex_scheduler_run(scheduler, 99), DEADLINE_COUNT - due);
+  ck_assert_uint_eq(fired_count, DEADLINE_COUNT);
+
+  /* Earliest first; equal deadlines in scheduling order */
+  for (size_t i = 1; i < DEADLINE_COUNT; i++) {
+    nblex_deadline_t* prev = &deadlines[fired_ids[i - 1]];
+    nblex_deadline_t* cur = &deadlines[fired_ids[i]];
+    ck_assert(prev->when_ns < cur->when_ns ||
+              (prev->when_ns == cur->when_ns && fired_ids[i - 1] < fired_ids[i]));
+    ck_assert(!nblex_deadline_pending(cur));
+  }
+
+  free_scheduler(&loop, scheduler);
+  ck_assert_int_eq(uv_loop_close(&loop), 0);
+}
+END_TEST
+
+START_TEST(test_scheduler_cancel_and_move) {
+  uv_loop_t loop;
+  ck_assert_int_eq(uv_loop_init(&loop), 0);
+  nblex_scheduler_t* scheduler = nblex_scheduler_new(&loop);
+  ck_assert_ptr_ne(scheduler, NULL);
+
+  nblex_deadline_t deadlines[5];
+  for (int i = 0; i < 5; i++) {
+    nblex_deadline_init(&deadlines[i], record_cb, (void*)(intptr_t)i);
+    ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[i], 10 * (uint64_t)(i + 1)), 0);
+  }
+
+  nblex_deadline_cancel(&deadlines[1]);
+  nblex_deadline_cancel(&deadlines[1]); /* No-op when not scheduled */
+  ck_assert(!nblex_deadline_pending(&deadlines[1]));
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[4], 5), 0);   /* Earlier */
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[0], 100), 0); /* Later */
+  ck_assert_uint_eq(nblex_scheduler_pending(scheduler), 4);
+
+  fired_count = 0;
+  ck_assert_uint_eq(nblex_scheduler_run(scheduler, 1000), 4);
+  ck_assert_int_eq(fired_ids[0], 4);
+  ck_assert_int_eq(fired_ids[1], 2);
+  ck_assert_int_eq(fired_ids[2], 3);
+  ck_assert_int_eq(fired_ids[3], 0);
+
+  /* Freeing the scheduler unschedules what is left */
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[1], 1), 0);
+  free_scheduler(&loop, scheduler);
+  ck_assert(!nblex_deadline_pending(&deadlines[1]));
+  ck_assert_int_eq(uv_loop_close(&loop), 0);
+}
+END_TEST
+
+START_TEST(test_scheduler_callback_reschedules) {
+  uv_loop_t loop;
+  ck_assert_int_eq(uv_loop_init(&loop), 0);
+  repeat_scheduler = nblex_scheduler_new(&loop);
+  ck_assert_ptr_ne(repeat_scheduler, NULL);
+
+  /* A deadline rescheduled as already due waits for the next run */
+  nblex_deadline_t deadline;
+  nblex_deadline_init(&deadline, repeat_here_cb, (void*)(intptr_t)7);
+  ck_assert_int_eq(nblex_deadline_schedule(repeat_scheduler, &deadline, 1), 0);
+
+  fired_count = 0;
+  ck_assert_uint_eq(nblex_scheduler_run(repeat_scheduler, 10), 1);
+  ck_assert(nblex_deadline_pending(&deadline));
+  ck_assert_uint_eq(nblex_scheduler_run(repeat_scheduler, 10), 1);
+  ck_assert_uint_eq(fired_count, 2);
+
+  free_scheduler(&loop, repeat_scheduler);
+  repeat_scheduler = NULL;
+  ck_assert_int_eq(uv_loop_close(&loop), 0);
+}
+END_TEST
+
+START_TEST(test_scheduler_without_timer) {
+  nblex_scheduler_t* scheduler = nblex_scheduler_new(NULL);
+  ck_assert_ptr_ne(scheduler, NULL);
+
+  /* Only explicit runs fire deadlines, at whatever clock they pass */
+  nblex_deadline_t deadlines[3];
+  for (int i = 0; i < 3; i++) {
+    nblex_deadline_init(&deadlines[i], record_cb, (void*)(intptr_t)i);
+    ck_assert_int_eq(nblex_deadline_schedule(scheduler, &deadlines[i], 1000 * (uint64_t)(3 - i)), 0);
+  }
+  fired_count = 0;
+  ck_assert_uint_eq(nblex_scheduler_run(scheduler, 2500), 2);
+  ck_assert_int_eq(fired_ids[0], 2);
+  ck_assert_int_eq(fired_ids[1], 1);
+
+  /* Freed at once: there is no timer handle to close */
+  nblex_scheduler_free(scheduler);
+  ck_assert(!nblex_deadline_pending(&deadlines[0]));
+}
+END_TEST
+
+START_TEST(test_scheduler_timer_drives_world) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_ptr_eq(world->scheduler, NULL);
+
+  nblex_scheduler_t* scheduler = nblex_world_scheduler(world);
+  ck_assert_ptr_ne(scheduler, NULL);
+  ck_assert_ptr_eq(nblex_world_scheduler(world), scheduler);
+
+  /* Two deadlines, one timer: the loop wakes for each in turn */
+  nblex_deadline_t first;
+  nblex_deadline_t second;
+  nblex_deadline_init(&first, record_cb, (void*)(intptr_t)1);
+  nblex_deadline_init(&second, record_cb, (void*)(intptr_t)2);
+  uint64_t now = nblex_timestamp_now();
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &second, now + 40000000ULL), 0);
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &first, now + 20000000ULL), 0);
+
+  fired_count = 0;
+  uint64_t limit = now + 2000000000ULL;
+  while (fired_count < 2 && nblex_timestamp_now() < limit) {
+    uv_run(world->loop, UV_RUN_ONCE);
+  }
+  ck_assert_uint_eq(fired_count, 2);
+  ck_assert_int_eq(fired_ids[0], 1);
+  ck_assert_int_eq(fired_ids[1], 2);
+  ck_assert_uint_ge(nblex_timestamp_now(), now + 40000000ULL);
+
+  /* A pending deadline does not outlive the world's scheduler */
+  ck_assert_int_eq(nblex_deadline_schedule(scheduler, &first, now + 3600000000000ULL), 0);
+  nblex_world_free(world);
+  ck_assert(!nblex_deadline_pending(&first));
+}
+END_TEST
+
+Suite* scheduler_suite(void) {
+  Suite* s = suite_create("Scheduler");
+
+  TCase* tc_heap = tcase_create("Heap");
+  tcase_add_test(tc_heap, test_scheduler_order);
+  tcase_add_test(tc_heap, test_scheduler_cancel_and_move);
+  tcase_add_test(tc_heap, test_scheduler_callback_reschedules);
+  tcase_add_test(tc_heap, test_scheduler_without_timer);
+  suite_add_tcase(s, tc_heap);
+
+  TCase* tc_loop = tcase_create("Loop");
+  tcase_add_test(tc_loop, test_scheduler_timer_drives_world);
+  suite_add_tcase(s, tc_loop);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite* s = scheduler_suite();
+  SRunner* sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,414 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * test_sketches.c - Unit tests for streaming sketches
+ *
+ * Licensed under the Apache License, Version 2.0
+ */
+
+/* Feature test macros must be defined before any system headers */
+#ifndef __APPLE__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/nblex_internal.h"
+
+Suite* sketches_suite(void);
+
+#define SAMPLE_COUNT 100000
+
+/* Deterministic pseudo-random source (xorshift64) */
+static uint64_t rng_state;
+
+static double next_uniform(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+/* Heavy-tailed latency-like values spanning several orders of magnitude,
+ * with some zeros and negatives mixed in.
+ */
+static double next_value(void) {
+  double u = next_uniform();
+  if (u < 0.02) {
+    return 0.0;
+  }
+  if (u < 0.10) {
+    return -exp(next_uniform() * 10.0);
+  }
+  return exp(next_uniform() * 16.0 - 4.0);
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/* Helper: Exact value at the sketch's nearest-rank position */
+static double exact_quantile(const double* sorted, size_t count, double q) {
+  size_t rank = (size_t)(q * (double)count);
+  if (rank >= count) {
+    rank = count - 1;
+  }
+  return sorted[rank];
+}
+
+/* Helper: Check every percentile of a sketch against sorted values */
+static void assert_within_accuracy(quantile_sketch_t* sketch, const double* sorted,
+                                   size_t count, double accuracy) {
+  for (int p = 0; p <= 1000; p++) {
+    double q = p / 1000.0;
+    double expected = exact_quantile(sorted, count, q);
+    double actual = nblex_quantile_sketch_quantile(sketch, q);
+    double bound = accuracy * fabs(expected) * (1.0 + 1e-9);
+    ck_assert_msg(fabs(actual - expected) <= bound,
+                  "q=%.3f expected %.9g got %.9g (accuracy %g)",
+                  q, expected, actual, accuracy);
+  }
+}
+
+START_TEST(test_quantile_sketch_accuracy) {
+  const double accuracies[] = { 0.05, 0.01, 0.001 };
+  double* values = malloc(SAMPLE_COUNT * sizeof(double));
+  ck_assert_ptr_ne(values, NULL);
+
+  for (size_t a = 0; a < sizeof(accuracies) / sizeof(accuracies[0]); a++) {
+    quantile_sketch_t* sketch = nblex_quantile_sketch_new(accuracies[a]);
+    ck_assert_ptr_ne(sketch, NULL);
+
+    rng_state = 0x9E3779B97F4A7C15ULL + a;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+      values[i] = next_value();
+      ck_assert_int_eq(nblex_quantile_sketch_add(sketch, values[i]), 0);
+    }
+    ck_assert_uint_eq(nblex_quantile_sketch_count(sketch), SAMPLE_COUNT);
+
+    qsort(values, SAMPLE_COUNT, sizeof(double), compare_doubles);
+    assert_within_accuracy(sketch, values, SAMPLE_COUNT, accuracies[a]);
+
+    /* Memory stays bounded regardless of how many values were added */
+    ck_assert_uint_le(nblex_quantile_sketch_bin_count(sketch),
+                      nblex_quantile_sketch_max_bins(sketch));
+    nblex_quantile_sketch_free(sketch);
+  }
+
+  free(values);
+}
+END_TEST
+
+START_TEST(test_quantile_sketch_merge) {
+  quantile_sketch_t* left = nblex_quantile_sketch_new(0.01);
+  quantile_sketch_t* right = nblex_quantile_sketch_new(0.01);
+  quantile_sketch_t* whole = nblex_quantile_sketch_new(0.01);
+  double* values = malloc(SAMPLE_COUNT * sizeof(double));
+  ck_assert_ptr_ne(values, NULL);
+
+  rng_state = 42;
+  for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+    values[i] = next_value();
+    nblex_quantile_sketch_add(i % 3 == 0 ? left : right, values[i]);
+    nblex_quantile_sketch_add(whole, values[i]);
+  }
+
+  ck_assert_int_eq(nblex_quantile_sketch_merge(left, right), 0);
+  ck_assert_uint_eq(nblex_quantile_sketch_count(left), SAMPLE_COUNT);
+
+  /* A merged sketch is the same as one built from all the values */
+  for (int p = 0; p <= 100; p++) {
+    ck_assert_double_eq(nblex_quantile_sketch_quantile(left, p / 100.0),
+                        nblex_quantile_sketch_quantile(whole, p / 100.0));
+  }
+
+  qsort(values, SAMPLE_COUNT, sizeof(double), compare_doubles);
+  assert_within_accuracy(left, values, SAMPLE_COUNT, 0.01);
+
+  /* Sketches with different accuracy cannot be merged */
+  quantile_sketch_t* other = nblex_quantile_sketch_new(0.02);
+  ck_assert_int_eq(nblex_quantile_sketch_merge(left, other), -1);
+
+  nblex_quantile_sketch_free(other);
+  nblex_quantile_sketch_free(left);
+  nblex_quantile_sketch_free(right);
+  nblex_quantile_sketch_free(whole);
+  free(values);
+}
+END_TEST
+
+START_TEST(test_quantile_sketch_exact_mode) {
+  quantile_sketch_t* sketch = nblex_quantile_sketch_new(0.0);
+  quantile_sketch_t* extra = nblex_quantile_sketch_new(0.0);
+  ck_assert_ptr_ne(sketch, NULL);
+  ck_assert_double_eq(nblex_quantile_sketch_relative_accuracy(sketch), 0.0);
+
+  double values[1000];
+  rng_state = 7;
+  for (size_t i = 0; i < 1000; i++) {
+    values[i] = next_value();
+    nblex_quantile_sketch_add(i < 600 ? sketch : extra, values[i]);
+  }
+  ck_assert_int_eq(nblex_quantile_sketch_merge(sketch, extra), 0);
+
+  qsort(values, 1000, sizeof(double), compare_doubles);
+  for (int p = 0; p <= 100; p++) {
+    ck_assert_double_eq(nblex_quantile_sketch_quantile(sketch, p / 100.0),
+                        exact_quantile(values, 1000, p / 100.0));
+  }
+
+  nblex_quantile_sketch_free(extra);
+  nblex_quantile_sketch_free(sketch);
+}
+END_TEST
+
+START_TEST(test_quantile_sketch_bounded_range) {
+  quantile_sketch_t* sketch = nblex_quantile_sketch_new(0.01);
+  ck_assert_ptr_ne(sketch, NULL);
+
+  /* Values spanning far more than the bin limit can cover: the lowest
+   * bins are collapsed, upper quantiles keep their accuracy.
+   */
+  for (int e = -300; e <= 300; e++) {
+    for (int i = 0; i < 10; i++) {
+      nblex_quantile_sketch_add(sketch, pow(10.0, e) * (1.0 + i / 10.0));
+    }
+  }
+  ck_assert_uint_le(nblex_quantile_sketch_bin_count(sketch),
+                    nblex_quantile_sketch_max_bins(sketch) / 2);
+
+  double p99 = nblex_quantile_sketch_quantile(sketch, 0.99);
+  double expected = 1.9e294;
+  ck_assert(fabs(p99 - expected) <= 0.01 * expected * (1.0 + 1e-9));
+  double max = nblex_quantile_sketch_quantile(sketch, 1.0);
+  ck_assert(fabs(max - 1.9e300) <= 0.01 * 1.9e300 * (1.0 + 1e-9));
+
+  nblex_quantile_sketch_free(sketch);
+}
+END_TEST
+
+START_TEST(test_quantile_sketch_edge_cases) {
+  ck_assert_ptr_eq(nblex_quantile_sketch_new(-0.1), NULL);
+  ck_assert_ptr_eq(nblex_quantile_sketch_new(1.0), NULL);
+
+  quantile_sketch_t* sketch = nblex_quantile_sketch_new(0.01);
+  ck_assert(isnan(nblex_quantile_sketch_quantile(sketch, 0.5)));
+  ck_assert_int_eq(nblex_quantile_sketch_add(sketch, NAN), -1);
+
+  ck_assert_int_eq(nblex_quantile_sketch_add(sketch, 12.5), 0);
+  ck_assert_double_eq(nblex_quantile_sketch_quantile(sketch, 0.0), 12.5);
+  ck_assert_double_eq(nblex_quantile_sketch_quantile(sketch, 1.0), 12.5);
+
+  nblex_quantile_sketch_free(sketch);
+}
+END_TEST
+
+/* Helper: Hash of the i-th synthetic distinct item */
+static uint64_t item_hash(uint64_t i) {
+  return nblex_hash64(&i, sizeof(i), 0);
+}
+
+START_TEST(test_hll_exact_below_threshold) {
+  hll_t* hll = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+  ck_assert_ptr_ne(hll, NULL);
+  ck_assert_uint_eq(nblex_hll_estimate(hll), 0);
+
+  for (int pass = 0; pass < 3; pass++) {
+    for (uint64_t i = 0; i < NBLEX_HLL_EXACT_THRESHOLD; i++) {
+      ck_assert_int_eq(nblex_hll_add_hash(hll, item_hash(i)), 0);
+    }
+  }
+  ck_assert(nblex_hll_is_exact(hll));
+  ck_assert_uint_eq(nblex_hll_estimate(hll), NBLEX_HLL_EXACT_THRESHOLD);
+
+  /* One more switches to registers, which stay close at this size */
+  nblex_hll_add_hash(hll, item_hash(NBLEX_HLL_EXACT_THRESHOLD));
+  ck_assert(!nblex_hll_is_exact(hll));
+  ck_assert_uint_ge(nblex_hll_estimate(hll), NBLEX_HLL_EXACT_THRESHOLD - 2);
+  ck_assert_uint_le(nblex_hll_estimate(hll), NBLEX_HLL_EXACT_THRESHOLD + 4);
+
+  nblex_hll_free(hll);
+}
+END_TEST
+
+START_TEST(test_hll_accuracy) {
+  const uint64_t sizes[] = { 1000, 5000, 20000, 100000, 1000000 };
+  /* Three standard errors at the default precision */
+  const double tolerance = 3.0 * 1.04 / sqrt((double)(1 << NBLEX_HLL_DEFAULT_PRECISION));
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    hll_t* hll = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+    for (uint64_t i = 0; i < sizes[s]; i++) {
+      nblex_hll_add_hash(hll, item_hash(i + s * 10000000ULL));
+      /* Duplicates must not move the estimate */
+      nblex_hll_add_hash(hll, item_hash(i / 2 + s * 10000000ULL));
+    }
+    double estimate = (double)nblex_hll_estimate(hll);
+    double error = fabs(estimate - (double)sizes[s]) / (double)sizes[s];
+    ck_assert_msg(error <= tolerance, "n=%llu estimate %.0f error %.4f",
+                  (unsigned long long)sizes[s], estimate, error);
+
+    /* Fixed memory: one byte per register once dense */
+    ck_assert_uint_le(nblex_hll_memory_usage(hll),
+                      (1 << NBLEX_HLL_DEFAULT_PRECISION) + 256);
+    nblex_hll_free(hll);
+  }
+}
+END_TEST
+
+START_TEST(test_hll_merge) {
+  hll_t* left = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+  hll_t* right = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+  hll_t* whole = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+  hll_t* small = nblex_hll_new(NBLEX_HLL_DEFAULT_PRECISION);
+
+  /* Overlapping ranges: [0, 60000) and [40000, 100000) */
+  for (uint64_t i = 0; i < 100000; i++) {
+    if (i < 60000) {
+      nblex_hll_add_hash(left, item_hash(i));
+    }
+    if (i >= 40000) {
+      nblex_hll_add_hash(right, item_hash(i));
+    }
+    nblex_hll_add_hash(whole, item_hash(i));
+  }
+  for (uint64_t i = 0; i < 10; i++) {
+    nblex_hll_add_hash(small, item_hash(i + 200000));
+    nblex_hll_add_hash(whole, item_hash(i + 200000));
+  }
+
+  ck_assert_int_eq(nblex_hll_merge(left, right), 0);
+  ck_assert_int_eq(nblex_hll_merge(left, small), 0);
+  ck_assert_uint_eq(nblex_hll_estimate(left), nblex_hll_estimate(whole));
+
+  /* Merging registers into an exact set upgrades it */
+  ck_assert_int_eq(nblex_hll_merge(small, right), 0);
+  ck_assert(!nblex_hll_is_exact(small));
+  double estimate = (double)nblex_hll_estimate(small);
+  ck_assert(fabs(estimate - 60010.0) / 60010.0 <= 0.03);
+
+  hll_t* other = nblex_hll_new(10);
+  ck_assert_int_eq(nblex_hll_merge(left, other), -1);
+
+  nblex_hll_free(other);
+  nblex_hll_free(left);
+  nblex_hll_free(right);
+  nblex_hll_free(whole);
+  nblex_hll_free(small);
+}
+END_TEST
+
+START_TEST(test_hll_low_precision) {
+  /* 16 registers: goes straight from exact to dense */
+  hll_t* hll = nblex_hll_new(NBLEX_HLL_MIN_PRECISION);
+  ck_assert_ptr_ne(hll, NULL);
+  for (uint64_t i = 0; i < 10000; i++) {
+    nblex_hll_add_hash(hll, item_hash(i));
+  }
+  double estimate = (double)nblex_hll_estimate(hll);
+  ck_assert(estimate > 5000.0 && estimate < 20000.0);
+  nblex_hll_free(hll);
+
+  ck_assert_ptr_eq(nblex_hll_new(NBLEX_HLL_MIN_PRECISION - 1), NULL);
+  ck_assert_ptr_eq(nblex_hll_new(NBLEX_HLL_MAX_PRECISION + 1), NULL);
+}
+END_TEST
+
+START_TEST(test_hash64_json_values) {
+  json_t* int_one = json_integer(1);
+  json_t* real_one = json_real(1.0);
+  json_t* real_half = json_real(1.5);
+  json_t* str_one = json_string("1");
+  json_t* str_a = json_string("user-a");
+  json_t* str_a2 = json_string("user-a");
+  json_t* str_b = json_string("user-b");
+
+  ck_assert_uint_eq(nblex_hash64_json(int_one), nblex_hash64_json(real_one));
+  ck_assert_uint_ne(nblex_hash64_json(int_one), nblex_hash64_json(real_half));
+  ck_assert_uint_ne(nblex_hash64_json(int_one), nblex_hash64_json(str_one));
+  ck_assert_uint_eq(nblex_hash64_json(str_a), nblex_hash64_json(str_a2));
+  ck_assert_uint_ne(nblex_hash64_json(str_a), nblex_hash64_json(str_b));
+
+  json_decref(int_one);
+  json_decref(real_one);
+  json_decref(real_half);
+  json_decref(str_one);
+  json_decref(str_a);
+  json_decref(str_a2);
+  json_decref(str_b);
+}
+END_TEST
+
+START_TEST(test_bloom_filter_membership) {
+  /* 2^14 bits, 4 hashes, 1000 items: about 0.2% false positives */
+  bloom_filter_t* bloom = nblex_bloom_filter_new(14, 4);
+  ck_assert_ptr_ne(bloom, NULL);
+  for (uint64_t i = 0; i < 1000; i++) {
+    nblex_bloom_filter_add_hash(bloom, item_hash(i));
+  }
+  for (uint64_t i = 0; i < 1000; i++) {
+    ck_assert(nblex_bloom_filter_may_contain(bloom, item_hash(i)));
+  }
+  size_t false_positives = 0;
+  for (uint64_t i = 1000; i < 11000; i++) {
+    false_positives += nblex_bloom_filter_may_contain(bloom, item_hash(i)) ? 1 : 0;
+  }
+  ck_assert_uint_lt(false_positives, 100);
+
+  nblex_bloom_filter_clear(bloom);
+  ck_assert(!nblex_bloom_filter_may_contain(bloom, item_hash(0)));
+  nblex_bloom_filter_free(bloom);
+
+  ck_assert_ptr_eq(nblex_bloom_filter_new(NBLEX_BLOOM_MIN_BITS_LOG2 - 1, 4), NULL);
+  ck_assert_ptr_eq(nblex_bloom_filter_new(16, 0), NULL);
+}
+END_TEST
+
+Suite* sketches_suite(void) {
+  Suite* s = suite_create("Sketches");
+
+  TCase* tc_quantile = tcase_create("Quantile");
+  tcase_add_test(tc_quantile, test_quantile_sketch_accuracy);
+  tcase_add_test(tc_quantile, test_quantile_sketch_merge);
+  tcase_add_test(tc_quantile, test_quantile_sketch_exact_mode);
+  tcase_add_test(tc_quantile, test_quantile_sketch_bounded_range);
+  tcase_add_test(tc_quantile, test_quantile_sketch_edge_cases);
+  suite_add_tcase(s, tc_quantile);
+
+  TCase* tc_distinct = tcase_create("Distinct");
+  tcase_add_test(tc_distinct, test_hll_exact_below_threshold);
+  tcase_add_test(tc_distinct, test_hll_accuracy);
+  tcase_add_test(tc_distinct, test_hll_merge);
+  tcase_add_test(tc_distinct, test_hll_low_precision);
+  tcase_add_test(tc_distinct, test_hash64_json_values);
+  suite_add_tcase(s, tc_distinct);
+
+  TCase* tc_membership = tcase_create("Membership");
+  tcase_add_test(tc_membership, test_bloom_filter_membership);
+  suite_add_tcase(s, tc_membership);
+
+  return s;
+}
+
+int main(void) {
+  int number_failed;
+  Suite* s = sketches_suite();
+  SRunner* sr = srunner_create(s);
+
+  srunner_run_all(sr, CK_NORMAL);
+  number_failed = srunner_ntests_failed(sr);
+  srunner_free(sr);
+
+  return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -306,6 +306,200 @@ START_TEST(test_world_event_emission) {
 }
 END_TEST
 
+static nblex_event* retained_event;
+
+static void retain_event_handler(nblex_event* event, void* user_data) {
+  (void)user_data;
+  retained_event = nblex_event_retain(event);
+}
+
+START_TEST(test_world_event_retain_release) {
+  /* Not opened: without a correlation engine, nothing else holds events */
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  nblex_set_event_handler(world, retain_event_handler, NULL);
+
+  /* A retained event outlives its emission */
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  event->data = json_pack("{s:s}", "level", "INFO");
+  nblex_event_emit(world, event);
+  ck_assert_ptr_eq(retained_event, event);
+  ck_assert_str_eq(json_string_value(json_object_get(retained_event->data, "level")), "INFO");
+
+  /* A released event's struct is reused by the next one */
+  nblex_event_release(retained_event);
+  nblex_event* next = nblex_event_new(NBLEX_EVENT_NETWORK, input);
+  ck_assert_ptr_eq(next, event);
+  ck_assert_ptr_eq(next->data, NULL);
+  nblex_event_emit(world, next);
+
+  /* And may be released after its world is freed */
+  nblex_input_free(input);
+  nblex_world_free(world);
+  ck_assert_int_eq(nblex_event_get_type(retained_event), NBLEX_EVENT_NETWORK);
+  nblex_event_release(retained_event);
+  retained_event = NULL;
+}
+END_TEST
+
+static size_t batch_sizes[8];
+static size_t batch_calls;
+static size_t batch_matched;
+
+static void record_batch_handler(nblex_event** events, size_t count, void* user_data) {
+  nblex_world* world = (nblex_world*)user_data;
+  for (size_t i = 0; i < count; i++) {
+    ck_assert_ptr_ne(events[i]->input, NULL);
+  }
+  if (batch_calls < 8) {
+    batch_sizes[batch_calls] = count;
+  }
+  batch_calls++;
+  batch_matched += nql_execute_all_batch(world, events, count, NULL, NULL);
+}
+
+START_TEST(test_world_batch_handler) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  ck_assert_int_eq(nblex_world_open(world), 0);
+  ck_assert_int_ge(nql_register(world, "level == \"ERROR\"", NULL), 0);
+  nblex_set_event_handler(world, test_capture_event_handler, NULL);
+  ck_assert_int_eq(nblex_set_batch_handler(world, record_batch_handler, world), 0);
+  ck_assert_int_eq(nblex_world_set_batch_size(world, 4), 0);
+  test_reset_captured_events();
+  batch_calls = 0;
+  batch_matched = 0;
+
+  nblex_input* input = nblex_input_new(world, NBLEX_INPUT_FILE);
+  ck_assert_int_eq(nblex_world_add_input(world, input), 0);
+  ck_assert_int_eq(nblex_world_start(world), 0);
+  for (int i = 0; i < 10; i++) {
+    nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+    event->data = json_pack("{s:s}", "level", i % 2 ? "ERROR" : "INFO");
+    nblex_event_emit(world, event);
+  }
+  ck_assert_uint_eq(batch_calls, 2);
+  ck_assert_uint_eq(batch_sizes[0], 4);
+  ck_assert_uint_eq(batch_sizes[1], 4);
+  ck_assert_uint_eq(batch_matched, 4);
+
+  /* Events with no input go straight to the event handler */
+  nblex_event* result = nblex_event_new(NBLEX_EVENT_LOG, NULL);
+  result->data = json_object();
+  nblex_event_emit(world, result);
+  ck_assert_uint_eq(test_captured_events_count, 1);
+
+  /* The rest are handed over after the loop's iteration */
+  uv_run(world->loop, UV_RUN_NOWAIT);
+  ck_assert_uint_eq(batch_calls, 3);
+  ck_assert_uint_eq(batch_sizes[2], 2);
+  ck_assert_uint_eq(batch_matched, 5);
+
+  /* Without a batch size each event is a batch of its own */
+  ck_assert_int_eq(nblex_world_set_batch_size(world, 0), 0);
+  nblex_event* event = nblex_event_new(NBLEX_EVENT_LOG, input);
+  event->data = json_pack("{s:s}", "level", "ERROR");
+  nblex_event_emit(world, event);
+  ck_assert_uint_eq(batch_calls, 4);
+  ck_assert_uint_eq(batch_sizes[3], 1);
+  ck_assert_uint_eq(batch_matched, 6);
+
+  nblex_world_stop(world);
+  nblex_world_free(world);
+  test_reset_captured_events();
+}
+END_TEST
+
+START_TEST(test_world_entry_pool) {
+  nblex_world* world = nblex_world_new();
+  ck_assert_ptr_ne(world, NULL);
+  nblex_pool_t* pool = nblex_world_entry_pool(world);
+  ck_assert_ptr_ne(pool, NULL);
+  ck_assert_ptr_eq(nblex_world_entry_pool(world), pool);
+
+  /* Objects are charged to the current account and reused once freed */
+  nblex_mem_account_t account;
+  nblex_mem_account_init(&account, NULL);
+  nblex_mem_account_t* previous = nblex_mem_account_enter(&account);
+  nblex_event_buffer_entry* first = nblex_pool_calloc(pool);
+  nblex_event_buffer_entry* second = nblex_pool_calloc(pool);
+  ck_assert_ptr_ne(first, NULL);
+  ck_assert_ptr_ne(second, NULL);
+  ck_assert_ptr_eq(first->next, NULL);
+
+  nblex_pool_stats_t stats;
+  nblex_pool_get_stats(pool, &stats);
+  ck_assert_uint_ge(stats.object_size, sizeof(nblex_event_buffer_entry));
+  ck_assert_uint_eq(stats.live, 2);
+  ck_assert_uint_ge(stats.capacity, 2);
+  ck_assert_uint_eq(atomic_load(&account.used), 2 * stats.object_size);
+
+  nblex_pool_free(pool, first);
+  ck_assert_uint_eq(atomic_load(&account.used), stats.object_size);
+  ck_assert_ptr_eq(nblex_pool_alloc(pool), first);
+  nblex_pool_free(pool, first);
+  nblex_mem_account_leave(previous);
+
+  /* The pool outlives its world until the last object is freed */
+  nblex_world_free(world);
+  second->size = 1;
+  nblex_pool_free(pool, second);
+}
+END_TEST
+
+START_TEST(test_json_memory_tags) {
+  nblex_mem_tag_stats_t before, during, after;
+  nblex_memory_get_tag_stats(NBLEX_MEM_TAG_PARSER, &before);
+
+  /* JSON is charged to the tag it was allocated under... */
+  nblex_mem_tag previous = nblex_mem_tag_enter(NBLEX_MEM_TAG_PARSER);
+  json_t* data = json_pack("{s:s, s:i}", "message", "connection reset by peer", "status", 502);
+  nblex_mem_tag_leave(previous);
+  ck_assert_ptr_ne(data, NULL);
+  nblex_memory_get_tag_stats(NBLEX_MEM_TAG_PARSER, &during);
+  ck_assert_uint_gt(during.live_bytes, before.live_bytes);
+  ck_assert_uint_gt(during.allocations, before.allocations);
+
+  /* ...and credited to it when freed under another */
+  char* text = nblex_json_dumps(data, JSON_COMPACT | JSON_SORT_KEYS);
+  ck_assert_str_eq(text, "{\"message\":\"connection reset by peer\",\"status\":502}");
+  free(text);
+  previous = nblex_mem_tag_enter(NBLEX_MEM_TAG_OUTPUT);
+  json_decref(data);
+  nblex_mem_tag_leave(previous);
+  nblex_memory_get_tag_stats(NBLEX_MEM_TAG_PARSER, &after);
+  ck_assert_uint_eq(after.live_bytes, before.live_bytes);
+  ck_assert_uint_eq(after.frees - before.frees, during.allocations - before.allocations);
+}
+END_TEST
+
+START_TEST(test_json_foreign_blocks) {
+  json_malloc_t json_malloc_fn;
+  json_free_t json_free_fn;
+  json_get_alloc_funcs(&json_malloc_fn, &json_free_fn);
+  ck_assert(json_free_fn != free);
+
+  /* Blocks jansson made before the allocator was installed are freed
+   * uncounted, whatever their size */
+  size_t before = nblex_json_live_bytes();
+  for (size_t size = 1; size <= 1024; size *= 2) {
+    void* foreign = malloc(size);
+    ck_assert_ptr_ne(foreign, NULL);
+    memset(foreign, 0xa5, size);
+    json_free_fn(foreign);
+  }
+  ck_assert_uint_eq(nblex_json_live_bytes(), before);
+
+  /* Its own blocks are malloc() blocks; free() leaves them counted */
+  json_t* data = json_pack("{s:s}", "message", "connection reset by peer");
+  char* text = json_dumps(data, JSON_COMPACT);
+  ck_assert_ptr_ne(text, NULL);
+  free(text);
+  json_decref(data);
+}
+END_TEST
+
 Suite* world_suite(void) {
   Suite* s = suite_create("World");
   TCase* tc_core = tcase_create("Core");
@@ -338,6 +532,11 @@ Suite* world_suite(void) {
   tcase_add_test(tc_events, test_world_set_event_handler);
   tcase_add_test(tc_events, test_world_set_event_handler_null_world);
   tcase_add_test(tc_events, test_world_event_emission);
+  tcase_add_test(tc_events, test_world_event_retain_release);
+  tcase_add_test(tc_events, test_world_batch_handler);
+  tcase_add_test(tc_events, test_world_entry_pool);
+  tcase_add_test(tc_events, test_json_memory_tags);
+  tcase_add_test(tc_events, test_json_foreign_blocks);
   
   suite_add_tcase(s, tc_core);
   suite_add_tcase(s, tc_lifecycle);
@@ -349,6 +548,10 @@ Suite* world_suite(void) {
 
 int main(void) {
   int number_failed;
+  /* Before any JSON is created, as an application would */
+  if (nblex_json_allocator_init() != 0) {
+    return EXIT_FAILURE;
+  }
   Suite* s = world_suite();
   SRunner* sr = srunner_create(s);
   